@@ -15,6 +15,7 @@
 
 #include <algorithm>
 #include <condition_variable>
+#include <fstream>
 #include <memory>
 #include <string>
 
@@ -45,6 +46,9 @@
 #    include <libcpu/CPUMiner.h>
 #endif
 #include <libpool/PoolManager.h>
+#include <libpool/getwork/NewHeadsSubscriber.h>
+#include <libpool/stratum/StratumCapture.h>
+#include <libpool/stratum/StratumParser.h>
 
 #if API_CORE
 #    include <libapi/ApiServer.h>
@@ -144,7 +148,7 @@ static void on_help_module(const string& m) {
 #ifdef _WIN32
                 "env",
 #endif
-                "con", "test", "misc", "test", "conf", "reboot"
+                "con", "test", "misc", "test", "conf", "reboot", "events"
     });
     if (find(modules.begin(), modules.end(), m) != modules.end()) return;
 
@@ -163,11 +167,63 @@ static void on_nonce(const string& n) {
     }
 }
 
+static void on_getwork_push(const string& u) {
+    if (u.empty() || NewHeadsSubscriber::validUrl(u)) return;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    throw boost::program_options::error("The --getwork-push value must be a ws:// or ipc:// url");
+#else
+    throw boost::program_options::error("The --getwork-push value must be a ws:// url");
+#endif
+}
+
+// Splits --proxy value "[address:]port"
+static void ParseProxyBind(const string& inbind, string& outaddr, unsigned short& outport) {
+    size_t colon = inbind.rfind(':');
+    string addr = (colon == string::npos ? "0.0.0.0" : inbind.substr(0, colon));
+    string port = (colon == string::npos ? inbind : inbind.substr(colon + 1));
+    if (addr.size() > 1 && addr.front() == '[' && addr.back() == ']') addr = addr.substr(1, addr.size() - 2);
+
+    boost::system::error_code ec;
+    outaddr = boost::asio::ip::address::from_string(addr, ec).to_string();
+    if (ec) throw boost::program_options::error("The --proxy address is invalid");
+    if (port.empty() || port.find_first_not_of("0123456789") != string::npos || port.size() > 5 || stoul(port) < 1 || stoul(port) > 65535)
+        throw boost::program_options::error("The --proxy port must be in range [1 .. 65535]");
+    outport = (unsigned short) stoul(port);
+}
+
+static void on_proxy(const string& b) {
+    string addr;
+    unsigned short port;
+    ParseProxyBind(b, addr, port);
+}
+
+static void on_sim_difficulty(double d) {
+    if (d > 0) return;
+    throw boost::program_options::error("The --sim-difficulty value must be greater than 0");
+}
+
+static void on_replay(const string& f) {
+    ifstream in(f);
+    string magic;
+    if (getline(in, magic) && magic == StratumCapture::s_magic) return;
+    throw boost::program_options::error("The --replay file " + f + " is not a stratum capture");
+}
+
+static void on_replay_speed(double s) {
+    if (s > 0) return;
+    throw boost::program_options::error("The --replay-speed value must be greater than 0");
+}
+
 static void on_verbosity(unsigned u) {
     if (u < LOG_NEXT) return;
     throw boost::program_options::error("The --verbosity value must be less than " + to_string(LOG_NEXT));
 }
 
+static void on_log_events_format(const string& f) {
+    if (f == "json" || f == "binary") return;
+    throw boost::program_options::error("The --log-events-format value must be json or binary");
+}
+
 static void on_hwmon(unsigned u) {
     if (u < 3) return;
     throw boost::program_options::error("The --HWMON value must be 0, 1 or 2");
@@ -226,15 +282,17 @@ public:
         if (!ec && g_running) {
             if (g_logOptions & LOG_MULTI) {
                 list<string> vs;
-                Farm::f().Telemetry().strvec(vs);
+                TelemetryType telemetry = Farm::f().Telemetry();
+                telemetry.strvec(vs);
                 string s(vs.front());
                 vs.pop_front();
-                while (!vs.empty()) {
-                    cnote << s << vs.front();
+                for (unsigned i = 0; !vs.empty(); i++) {
+                    cnote << s << vs.front() << LogField("hashrate", double(telemetry.farm.hashrate)) << LogField("miner", i)
+                          << LogField("miner_hashrate", double(i < telemetry.miners.size() ? telemetry.miners[i].hashrate : 0));
                     vs.pop_front();
                 }
             } else
-                cnote << Farm::f().Telemetry().str();
+                cnote << Farm::f().Telemetry().str() << LogField("hashrate", double(Farm::f().HashRate()));
             // Restart timer
             m_cliDisplayTimer.expires_from_now(boost::posix_time::seconds(m_cliDisplayInterval));
             m_cliDisplayTimer.async_wait(m_io_strand.wrap(boost::bind(&MinerCLI::cliDisplayInterval_elapsed, this, boost::asio::placeholders::error)));
@@ -364,7 +422,7 @@ public:
 #ifdef _WIN32
                 "env, "
 #endif
-                "con, test, conf or reboot")
+                "con, test, conf, reboot or events")
 
             ("version,V", "The version number")
 
@@ -413,6 +471,12 @@ public:
                 "Value expressed in milliseconds. "
                 "It has no meaning in stratum mode")
 
+            ("getwork-push", value<string>()->default_value("")->notifier(on_getwork_push),
+                "In getWork mode subscribe to new blocks announced by the node "
+                "(ws://host:port or ipc:///path/to/node.ipc) and ask for "
+                "new work as soon as one comes in. Polling goes on as a "
+                "fallback (every 5 seconds at least while subscribed)")
+
             ("retry-delay", value<unsigned>()->default_value(0),
                 "Delay in seconds before reconnection retry")
 
@@ -429,6 +493,27 @@ public:
                 "If no response from pool to a stratum message "
                 "after this amount of time the connection is dropped")
 
+            ("dns-ttl", value<unsigned>()->default_value(300),
+                "Reuse resolved pool addresses for this amount of "
+                "time before querying DNS again. "
+                "Value expressed in seconds. Set to 0 to disable caching")
+
+            ("pool-state", value<string>(),
+                "File where the stratum flavour autodetected for each pool "
+                "is saved so later runs skip the detection probes. "
+                "Nothing is saved unless set")
+
+            ("stratum-capture", value<string>(),
+                "Record every stratum message sent and received, with "
+                "its timing, to this file. Use --replay to feed it back.")
+
+            ("proxy", value<string>()->notifier(on_proxy),
+                "Serve the pool jobs to other miners which connect to "
+                "[address:]port using EthereumStratum/1.0.0 (stratum2+tcp) "
+                "or Eth-Proxy (stratum1+tcp). Only one pool connection is "
+                "kept and each downstream miner mines its own slice of the "
+                "nonce space")
+
             ("report-hashrate,R",
                 "Report miner hash rate to the pool")
 
@@ -449,6 +534,31 @@ public:
                 "connected to a fail-over pool before trying to "
                 "reconnect to the primary (the first) connection.")
 
+            ("share-rate", value<double>()->default_value(0),
+                "Ask the pool for a share difficulty yielding this "
+                "number of shares per minute at current hashrate. "
+                "Only Stratum and EthereumStratum/1.0.0 pools take "
+                "suggestions. Set to 0 to disable")
+
+            ("stale-age", value<unsigned>()->default_value(0),
+                "Drop solutions found on a job which at least this "
+                "number of newer jobs have superseded instead of "
+                "submitting them. Set to 0 to submit stale solutions. "
+                "Solutions already submitted are always dropped.")
+
+            ("pool-probe", value<unsigned>()->default_value(0),
+                "Measure the TCP round trip to every pool in the "
+                "connections list this often, as reported by "
+                "miner_getconnections. Value expressed in seconds. "
+                "Set to 0 to disable")
+
+            ("latency-margin", value<unsigned>()->default_value(0),
+                "Switch to another pool of the connections list when "
+                "its round trip stays shorter than the active one's by "
+                "this margin for 3 probes in a row. Value expressed in "
+                "milliseconds. Probes every 30 seconds unless "
+                "--pool-probe is set. Set to 0 to disable")
+
             ("nocolor",
                 "Monochrome display log lines")
 
@@ -456,6 +566,16 @@ public:
                 "Use syslog appropriate output (drop timestamp "
                 "and channel prefix)")
 
+            ("log-events", value<string>(),
+                "Also write log lines as structured events with "
+                "typed fields (miner, job, epoch, latencies, hash "
+                "rates ...) to this file, or to the Unix stream "
+                "socket at this path prefixed with unix:")
+
+            ("log-events-format", value<string>()->default_value("json")->notifier(on_log_events_format),
+                "Format of --log-events: json (one object per line) "
+                "or binary (length prefixed records)")
+
 #if ETH_ETHASHCL || ETH_ETHASHCUDA || ETH_ETHASH_CPU || ETH_ETHASHSYCL
             ("list-devices,L",
                 "Lists the detected OpenCL/CUDA devices and "
@@ -519,7 +639,20 @@ public:
 
             ("cl-split",
 
-                "Force split-DAG mode. May improve performance on older GPU models.");
+                "Force split-DAG mode. May improve performance on older GPU models.")
+
+            ("cl-profile",
+
+                "Profile kernels and result transfers on device. Reports "
+                "device utilization and idle gap between kernels.");
+#endif
+#if ETH_ETHASHSYCL
+        sycl.add_options()
+
+            ("sycl-profile",
+
+                "Profile kernels and result transfers on device. Reports "
+                "device utilization and idle gap between kernels.");
 #endif
         test.add_options()
             ("benchmark,M", value<unsigned>(),
@@ -528,7 +661,42 @@ public:
 
             ("simulate,Z", value<unsigned>(),
                 "Mining test. Used to test hashing speed. "
-                "Specify the block number to test on.");
+                "Specify the block number to test on.")
+
+            ("sim-interval", value<unsigned>()->default_value(0),
+                "Simulation sends a new job every this number "
+                "of milliseconds. 0 sends a single job.")
+
+            ("sim-jitter", value<unsigned>()->default_value(0),
+                "Random milliseconds added to or subtracted from "
+                "each --sim-interval.")
+
+            ("sim-boundary-every", value<unsigned>()->default_value(0),
+                "Every n-th simulated update only changes the "
+                "share boundary. 0 disables.")
+
+            ("sim-epoch-every", value<unsigned>()->default_value(0),
+                "Every n-th simulated job advances to next epoch. "
+                "0 disables.")
+
+            ("sim-difficulty", value<double>()->default_value(1.0)->notifier(on_sim_difficulty),
+                "Share difficulty of simulated jobs.")
+
+            ("sim-latency", value<unsigned>()->default_value(0),
+                "Milliseconds before a simulated submission is "
+                "answered.")
+
+            ("replay", value<string>()->notifier(on_replay),
+                "Mining test. Feed back a session recorded with "
+                "--stratum-capture instead of connecting to a pool. "
+                "Submissions get the recorded answers.")
+
+            ("replay-speed", value<double>()->default_value(1.0)->notifier(on_replay_speed),
+                "Speed factor applied to recorded timings on --replay.")
+
+            ("bench-stratum", value<unsigned>()->implicit_value(300000),
+                "Measure throughput of stratum messages parsing "
+                "and exit. Specify the number of messages to parse.");
 
         // clang-format on
 
@@ -540,6 +708,9 @@ public:
 #if ETH_ETHASHCUDA
                 .add(cu)
 #endif
+#if ETH_ETHASHSYCL
+                .add(sycl)
+#endif
 #if ETH_ETHASHCPU
                 .add(cp)
 #endif
@@ -601,6 +772,11 @@ public:
             return false;
         }
 
+        if (vm.count("bench-stratum")) {
+            benchmarkStratumParser(vm["bench-stratum"].as<unsigned>());
+            return false;
+        }
+
         if (vm.count("help-module")) {
             const auto& s = vm["help-module"].as<string>();
             if (s == "con")
@@ -727,6 +903,29 @@ public:
                      << "    the search path.\n\n"
                      << "    For Linux:   reboot.sh\n\n"
                      << "    For Windows: reboot.bat\n\n";
+            } else if (s == "events") {
+                cout << "\nStructured log events:\n\n"
+                     << "    With --log-events every log line is also written as an event\n"
+                     << "    carrying typed fields, for log pipelines to ingest without\n"
+                     << "    parsing display lines. Events are written by the log thread\n"
+                     << "    and share its queue: they never block mining, and are lost\n"
+                     << "    while a socket target isn't listening (retried every 5s).\n\n"
+                     << "    Every event has\n"
+                     << "      ts      Microseconds since the Unix epoch\n"
+                     << "      sev     Severity: note, warn, crit or extra\n"
+                     << "      thread  Thread name (miner, cpu-0, cl-1 ...)\n"
+                     << "      src     Source file and line of the log statement\n"
+                     << "      msg     Text of the line, without colors\n"
+                     << "    followed by the fields of the line, such as miner, job,\n"
+                     << "    nonce, epoch, block, pool, difficulty, latency_ms, stale,\n"
+                     << "    dag_ms, dag_bytes, hashrate and miner_hashrate.\n\n"
+                     << "    json    One JSON object per line.\n\n"
+                     << "    binary  Records of a little endian u32 size of the rest,\n"
+                     << "            u64 ts and u8 sev (0 note, 1 warn, 2 crit, 3 extra),\n"
+                     << "            then fields up to the end of the record: u8 type,\n"
+                     << "            u8 name size, name and value, an i64 (type 1), f64\n"
+                     << "            (type 2) or u32 size and bytes (type 3, strings).\n"
+                     << "            thread, src and msg come first as strings.\n\n";
             }
             return false;
         }
@@ -734,24 +933,46 @@ public:
         g_logOptions = vm["verbosity"].as<unsigned>();
         g_logNoColor = vm.count("nocolor");
         g_logSyslog = vm.count("syslog");
+        if (vm.count("log-events")) setLogEvents(vm["log-events"].as<string>(), vm["log-events-format"].as<string>() == "binary");
         g_exitOnError = vm.count("exit");
         g_seqDAG = vm.count("seq");
 
         m_PoolSettings.getWorkPollInterval = vm["getwork-recheck"].as<unsigned>();
+        m_PoolSettings.getWorkPushUrl = vm["getwork-push"].as<string>();
         m_PoolSettings.connectionMaxRetries = vm["retry-max"].as<unsigned>();
         m_PoolSettings.delayBeforeRetry = vm["retry-delay"].as<unsigned>();
         m_PoolSettings.noWorkTimeout = vm["work-timeout"].as<unsigned>();
         m_PoolSettings.noResponseTimeout = vm["response-timeout"].as<unsigned>();
+        m_PoolSettings.dnsCacheTtl = vm["dns-ttl"].as<unsigned>();
+        if (vm.count("pool-state")) m_PoolSettings.stateFile = vm["pool-state"].as<string>();
+        if (vm.count("proxy")) ParseProxyBind(vm["proxy"].as<string>(), m_PoolSettings.proxyAddress, m_PoolSettings.proxyPort);
         m_PoolSettings.reportHashrate = vm.count("report-hashrate");
         m_PoolSettings.poolFailoverTimeout = vm["failover-timeout"].as<unsigned>();
+        m_PoolSettings.shareRate = max(vm["share-rate"].as<double>(), 0.0);
+        m_PoolSettings.staleAge = vm["stale-age"].as<unsigned>();
+        m_PoolSettings.probeInterval = vm["pool-probe"].as<unsigned>();
+        m_PoolSettings.poolSwitchMargin = vm["latency-margin"].as<unsigned>();
+        if (m_PoolSettings.poolSwitchMargin && !m_PoolSettings.probeInterval) m_PoolSettings.probeInterval = 30;
         if (vm.count("simulate") != 0) {
             m_bench = true;
-            m_PoolSettings.benchmarkBlock = vm["simulate"].as<unsigned>();
+            m_PoolSettings.simulation.block = vm["simulate"].as<unsigned>();
         }
         if (vm.count("benchmark") != 0) {
             m_bench = true;
-            m_PoolSettings.benchmarkBlock = vm["benchmark"].as<unsigned>();
+            m_PoolSettings.simulation.block = vm["benchmark"].as<unsigned>();
+        }
+        m_PoolSettings.simulation.jobInterval = vm["sim-interval"].as<unsigned>();
+        m_PoolSettings.simulation.jobJitter = vm["sim-jitter"].as<unsigned>();
+        m_PoolSettings.simulation.boundaryEvery = vm["sim-boundary-every"].as<unsigned>();
+        m_PoolSettings.simulation.epochEvery = vm["sim-epoch-every"].as<unsigned>();
+        m_PoolSettings.simulation.difficulty = vm["sim-difficulty"].as<double>();
+        m_PoolSettings.simulation.submitLatency = vm["sim-latency"].as<unsigned>();
+        if (vm.count("replay")) {
+            m_bench = true;
+            m_PoolSettings.replayFile = vm["replay"].as<string>();
         }
+        m_PoolSettings.replaySpeed = vm["replay-speed"].as<double>();
+        if (vm.count("stratum-capture")) m_PoolSettings.captureFile = vm["stratum-capture"].as<string>();
 
         m_cliDisplayInterval = vm["display-interval"].as<unsigned>();
         should_list = m_shouldListDevices = vm.count("list-devices");
@@ -771,6 +992,10 @@ public:
 #if ETH_ETHASHCL
         m_FarmSettings.clGroupSize = vm["cl-work"].as<unsigned>();
         m_FarmSettings.clSplit = vm.count("cl-split");
+        m_FarmSettings.clProfile = vm.count("cl-profile");
+#endif
+#if ETH_ETHASHSYCL
+        m_FarmSettings.syclProfile = vm.count("sycl-profile");
 #endif
 
         m_FarmSettings.tempStop = vm["tstop"].as<unsigned>();
@@ -1132,15 +1357,18 @@ int main(int argc, char** argv) {
 
             cli.execute();
 
+            flushLog();
             cout << endl << endl;
             return 0;
         } catch (boost::program_options::error& e) {
             cout << "\nError: " << e.what() << "\n\n";
             return 1;
         } catch (runtime_error& e) {
+            flushLog();
             cout << "\nError: " << e.what() << "\n\n";
             return 2;
         } catch (exception& e) {
+            flushLog();
             cout << "\nError: " << e.what() << "\n\n";
             return 3;
         } catch (...) {
@@ -15,6 +15,13 @@
 
 #include <utility>
 
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#ifdef API_ZLIB
+#    include <zlib.h>
+#endif
+
 #ifndef HOST_NAME_MAX
 #    define HOST_NAME_MAX 255
 #endif
@@ -117,6 +124,58 @@ static bool getRequestValue(const char* membername, string& refValue, Json::Valu
     return true;
 }
 
+// Value of header _name in the lower cased request head _head (empty if missing)
+static string httpHeader(string const& _head, string const& _name) {
+    size_t pos = _head.find("\r\n" + _name + ":");
+    if (pos == string::npos) return "";
+    pos += _name.size() + 3;
+    return boost::trim_copy(_head.substr(pos, _head.find("\r\n", pos) - pos));
+}
+
+// Whether Accept-Encoding value _accepted allows _coding (not given with q=0)
+static bool httpAccepts(string const& _accepted, string const& _coding) {
+    vector<string> codings;
+    boost::split(codings, _accepted, boost::is_any_of(","));
+    for (auto coding: codings) {
+        boost::erase_all(coding, " ");
+        if (coding == _coding) return true;
+        if (boost::starts_with(coding, _coding + ";q=")) return atof(coding.c_str() + _coding.size() + 3) > 0;
+    }
+    return false;
+}
+
+// Count and percentiles (microseconds) of a latency histogram
+static Json::Value latencyPercentiles(LatencyHistogram const& _histogram) {
+    Json::Value jRes;
+    jRes["count"] = _histogram.count();
+    jRes["p50"] = _histogram.percentile(50);
+    jRes["p90"] = _histogram.percentile(90);
+    jRes["p99"] = _histogram.percentile(99);
+    jRes["max"] = _histogram.max();
+    return jRes;
+}
+
+// Effective hash rate estimates (hashes per second) by window
+static Json::Value effectiveHashRate(array<EffectiveHashRateType, EffectiveHashRate::s_windows> const& _estimates) {
+    Json::Value jRes;
+    Json::Value jWindows = Json::Value(Json::arrayValue);
+    for (auto const& e: _estimates) {
+        Json::Value jWindow;
+        jWindow["minutes"] = e.minutes;
+        jWindow["seconds"] = uint64_t(e.seconds);
+        jWindow["shares"] = e.shares;
+        jWindow["rate"] = e.rate;
+        jWindow["low"] = e.low;
+        jWindow["high"] = e.high;
+        jWindow["reported"] = e.reported;
+        jWindow["alert"] = e.alert;
+        jWindows.append(jWindow);
+    }
+    jRes["alert"] = _estimates[EffectiveHashRate::s_alertWindow].alert;
+    jRes["windows"] = jWindows;
+    return jRes;
+}
+
 static bool checkApiWriteAccess(bool is_read_only, Json::Value& jResponse) {
     if (is_read_only) {
         jResponse["error"]["code"] = -32601;
@@ -188,6 +247,10 @@ void ApiServer::start() {
         return;
     }
 
+    // Render readers' views once per telemetry collection
+    Farm::f().onTelemetryCollected([]() { ApiConnection::updateSnapshot(true); });
+    MinerEvents::listen([this](MinerEvent const& _event) { onMinerEvent(_event); });
+
     cnote << "Api server listening on port " + to_string(m_acceptor.local_endpoint().port()) << (m_password.empty() ? "." : ". Authentication needed.");
     m_running.store(true, memory_order_relaxed);
     m_workThread = thread{[this] { begin_accept(); }};
@@ -197,6 +260,8 @@ void ApiServer::stop() {
     // Exit if not started
     if (!m_running.load(memory_order_relaxed)) return;
 
+    MinerEvents::listen(nullptr);
+    Farm::f().onTelemetryCollected(nullptr);
     m_acceptor.cancel();
     m_acceptor.close();
     m_workThread.join();
@@ -236,11 +301,64 @@ void ApiServer::handle_accept(shared_ptr<ApiConnection> session, boost::system::
     begin_accept();
 }
 
+// miner_event notification for _event
+static string renderEvent(MinerEvent const& _event) {
+    static const char* names[] = {"job", "epoch", "solution", "accepted", "rejected", "paused", "resumed"};
+
+    Json::Value params;
+    params["event"] = names[unsigned(_event.type)];
+    params["time"] = Json::UInt64(chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count());
+    if (_event.miner >= 0) params["miner"] = _event.miner;
+    switch (_event.type) {
+        case MinerEvent::Type::Job:
+            params["header"] = _event.text;
+            if (_event.value >= 0) params["block"] = Json::Int64(_event.value);
+            break;
+        case MinerEvent::Type::Epoch: params["epoch"] = Json::Int64(_event.value); break;
+        case MinerEvent::Type::Solution:
+            params["nonce"] = toHex(uint64_t(_event.value), HexPrefix::Add);
+            params["header"] = _event.text;
+            break;
+        case MinerEvent::Type::Accepted: params["stale"] = !_event.text.empty(); [[fallthrough]];
+        case MinerEvent::Type::Rejected: params["delay"] = Json::Int64(_event.value); break;
+        case MinerEvent::Type::Paused: params["reason"] = _event.text; break;
+        default: break;
+    }
+
+    Json::Value jEvent;
+    jEvent["jsonrpc"] = "2.0";
+    jEvent["method"] = "miner_event";
+    jEvent["params"] = params;
+    Json::StreamWriterBuilder builder;
+    builder.settings_["indentation"] = "";
+    return Json::writeString(builder, jEvent) + "\n";
+}
+
+void ApiServer::onMinerEvent(MinerEvent const& _event) {
+    // Runs on the publisher's thread : render once, fan out in our strand
+    if (!ApiConnection::subscribers()) return;
+    if (_event.type == MinerEvent::Type::Telemetry) {
+        m_io_strand.post([this]() {
+            auto snap = ApiConnection::snapshot();
+            auto sessions = m_sessions;
+            for (auto const& session: sessions) session->pushTelemetry(snap);
+        });
+        return;
+    }
+    auto line = make_shared<const string>(renderEvent(_event));
+    m_io_strand.post([this, line]() {
+        auto sessions = m_sessions;
+        for (auto const& session: sessions) session->pushEvent(*line);
+    });
+}
+
 void ApiConnection::disconnect() {
     // cnote << "ApiConnection::disconnect";
+    subscribe(false, false);
 
     // Cancel pending operations
     m_socket.cancel();
+    m_idleTimer.cancel();
 
     if (m_socket.is_open()) {
         boost::system::error_code ec;
@@ -252,7 +370,7 @@ void ApiConnection::disconnect() {
 }
 
 ApiConnection::ApiConnection(boost::asio::io_service::strand& _strand, int id, bool readonly, string password)
-    : m_sessionId(id), m_socket(g_io_service), m_io_strand(_strand), m_readonly(readonly), m_password(move(password)) {
+    : m_sessionId(id), m_socket(g_io_service), m_io_strand(_strand), m_readonly(readonly), m_password(move(password)), m_idleTimer(g_io_service) {
     m_jSwBuilder.settings_["indentation"] = "";
     if (!m_password.empty()) m_is_authenticated = false;
 }
@@ -324,11 +442,28 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
 
     cnote << "API : Method " << _method << " requested";
     if (_method == "miner_getstat1") {
-        jResponse["result"] = getMinerStat1();
+        auto snap = snapshot();
+        m_result = shared_ptr<const string>(snap, &snap->stat1);
     }
 
     else if (_method == "miner_getstatdetail") {
-        jResponse["result"] = getMinerStatDetail();
+        auto snap = snapshot();
+        m_result = shared_ptr<const string>(snap, &snap->statDetail);
+    }
+
+    else if (_method == "miner_subscribe") {
+        Json::Value jRequestParams;
+        bool telemetry = true, events = true;
+        if (!jRequest["params"].empty() && !getRequestValue("params", jRequestParams, jRequest, false, jResponse)) return;
+        if (!getRequestValue("telemetry", telemetry, jRequestParams, true, jResponse)) return;
+        if (!getRequestValue("events", events, jRequestParams, true, jResponse)) return;
+        subscribe(telemetry, events);
+        jResponse["result"] = true;
+    }
+
+    else if (_method == "miner_unsubscribe") {
+        subscribe(false, false);
+        jResponse["result"] = true;
     }
 
     else if (_method == "miner_ping") {
@@ -356,6 +491,11 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
         jResponse["result"] = PoolManager::p().getConnectionsJson();
     }
 
+    else if (_method == "miner_getproxy") {
+        // Returns downstream miners served in proxy mode
+        jResponse["result"] = PoolManager::p().getProxyJson();
+    }
+
     else if (_method == "miner_addconnection") {
         if (!checkApiWriteAccess(m_readonly, jResponse)) return;
 
@@ -481,6 +621,28 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
         jResponse["result"] = true;
     }
 
+    else if (_method == "miner_settrace") {
+        if (!checkApiWriteAccess(m_readonly, jResponse)) return;
+
+        Json::Value jRequestParams;
+        if (!getRequestValue("params", jRequestParams, jRequest, false, jResponse)) return;
+
+        bool enabled, clear = false;
+        if (!getRequestValue("enabled", enabled, jRequestParams, false, jResponse)) return;
+        if (!getRequestValue("clear", clear, jRequestParams, true, jResponse)) return;
+
+        if (clear) Trace::clear();
+        Trace::enable(enabled);
+        cnote << "Tracing " << (enabled ? "enabled" : "disabled");
+        jResponse["result"]["enabled"] = Trace::enabled();
+        jResponse["result"]["events"] = uint64_t(Trace::size());
+    }
+
+    else if (_method == "miner_gettrace") {
+        // Chrome trace JSON can get big: it is spliced in the response as is
+        m_result = make_shared<const string>(Trace::chromeJson());
+    }
+
     else if (_method == "miner_setnonce") {
         if (!checkApiWriteAccess(m_readonly, jResponse)) return;
 
@@ -518,10 +680,11 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
 }
 
 void ApiConnection::recvSocketData() {
-    boost::asio::async_read(
-            m_socket, m_recvBuffer, boost::asio::transfer_at_least(1),
-            m_io_strand.wrap(   //
-                    boost::bind(&ApiConnection::onRecvSocketDataCompleted, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+    m_reading = true;
+    boost::asio::async_read(m_socket, m_recvBuffer, boost::asio::transfer_at_least(1),
+                            m_io_strand.wrap(   //
+                                    boost::bind(&ApiConnection::onRecvSocketDataCompleted, shared_from_this(), boost::asio::placeholders::error,
+                                                boost::asio::placeholders::bytes_transferred)));
 }
 
 void ApiConnection::onRecvSocketDataCompleted(const boost::system::error_code& ec, size_t bytes_transferred) {
@@ -534,154 +697,312 @@ void ApiConnection::onRecvSocketDataCompleted(const boost::system::error_code& e
     static regex http_pattern(R"(^([A-Z]{1,6}) (\/[\S]*) (HTTP\/1\.[0-9]{1}))");
     smatch http_matches;
 
-    if (!ec && bytes_transferred > 0) {
-        // Extract received message and free the buffer
-        string rx_message(boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
-        m_recvBuffer.consume(bytes_transferred);
-        m_message.append(rx_message);
-
-        string line;
-        string linedelimiter;
-        size_t linedelimiteroffset;
-
-        if (m_message.size() < 4) return;   // Wait for other data to come in
-
-        if (regex_search(m_message, http_matches, http_pattern, regex_constants::match_default)) {
-            // We got an HTTP request
-            string http_method = http_matches[1].str();
-            string http_path = http_matches[2].str();
-            string http_ver = http_matches[3].str();
-
-            // Do we support method ?
-            if (http_method != "GET") {
-                string what = "Method " + http_method + " not allowed";
-                stringstream ss;
-                ss << http_ver << " "
-                   << "405 Method not allowed\r\n"
-                   << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
-                   << "Content-Type: text/plain\r\n"
-                   << "Content-Length: " << what.size() << "\r\n\r\n"
-                   << what;
-                sendSocketData(ss.str(), true);
-                m_message.clear();
-                cnote << "HTTP Request " << http_method << " " << http_path << " not supported (405).";
-                return;
-            }
+    m_reading = false;
+    if (ec || bytes_transferred == 0) {
+        disconnect();
+        return;
+    }
 
-            // Do we support path ?
-            if (http_path != "/" && http_path != "/getstat1" && http_path != "/metrics") {
-                string what = "The requested resource " + http_path + " not found on this server";
-                stringstream ss;
-                ss << http_ver << " "
-                   << "404 Not Found\r\n"
-                   << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
-                   << "Content-Type: text/plain\r\n"
-                   << "Content-Length: " << what.size() << "\r\n\r\n"
-                   << what;
-                sendSocketData(ss.str(), true);
-                m_message.clear();
-                cnote << "HTTP Request " << http_method << " " << http_path << " not found (404).";
-                return;
+    // Extract received message and free the buffer
+    string rx_message(boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
+    m_recvBuffer.consume(bytes_transferred);
+    m_message.append(rx_message);
+
+    if (m_websocket) processFrames();
+    else if (m_message.size() < 4) {
+        // Wait for other data to come in
+    } else if (regex_search(m_message, http_matches, http_pattern, regex_constants::match_default)) {
+        // We got HTTP requests. Serve those whose headers are complete
+        do {
+            size_t headEnd = m_message.find("\r\n\r\n");
+            if (headEnd == string::npos) {
+                if (m_message.size() > s_maxFrame)
+                    sendSocketData(http_matches[3].str() + " 431 Request Header Fields Too Large\r\nContent-Length: 0\r\n\r\n", true);
+                break;
             }
+            processHttpRequest(http_matches[1].str(), http_matches[2].str(), http_matches[3].str(), headEnd + 4);
+        } while (!m_closeAfterSend && !m_websocket && regex_search(m_message, http_matches, http_pattern, regex_constants::match_default));
+    } else {
+        // We got a Json request
+        // Process each line in the transmission
+        size_t linedelimiteroffset = m_message.find('\n');
+        while (linedelimiteroffset != string::npos) {
+            if (linedelimiteroffset > 0) processLine(m_message.substr(0, linedelimiteroffset));
+
+            // Next line (if any)
+            m_message.erase(0, linedelimiteroffset + 1);
+            linedelimiteroffset = m_message.find('\n');
+        }
+    }
 
-            //// Get all the lines - we actually don't care much
-            //// until we support other http methods or paths
-            //// Keep this for future use (if any)
-            //// Remember to #include <boost/algorithm/string.hpp>
-            // vector<string> lines;
-            // boost::split(lines, m_message, [](char _c) { return _c == '\n'; });
-
-            stringstream ss;   // Builder of the response
+    // Eventually keep reading from socket
+    if (m_socket.is_open() && !m_closeAfterSend && !m_reading) recvSocketData();
+}
 
-            if (http_method == "GET" && (http_path == "/" || http_path == "/getstat1" || http_path == "/metrics")) {
-                try {
-                    string body, content_type;
-                    if (http_path == "/metrics") {
-                        body = getHttpMinerMetrics();
-                        content_type = "text/plain";
-                    } else {
-                        body = getHttpMinerStatDetail();
-                        content_type = "text/html";
-                    }
-                    ss.clear();
-                    ss << http_ver << " "
-                       << "200 OK\r\n"
-                       << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
-                       << "Content-Type: " << content_type << "; charset=utf-8\r\n"
-                       << "Content-Length: " << body.size() << "\r\n\r\n"
-                       << body;
-                    cnote << "HTTP Request " << http_method << " " << http_path << " 200 OK (" << ss.str().size() << " bytes).";
-                } catch (const exception& _ex) {
-                    string what = "Internal error : " + string(_ex.what());
-                    ss.clear();
-                    ss << http_ver << " "
-                       << "500 Internal Server Error\r\n"
-                       << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
-                       << "Content-Type: text/plain\r\n"
-                       << "Content-Length: " << what.size() << "\r\n\r\n"
-                       << what;
-                    cnote << "HTTP Request " << http_method << " " << http_path << " 500 Error (" << _ex.what() << ").";
-                }
-            }
+void ApiConnection::processLine(string const& _line) {
+    string line = boost::trim_copy(_line);
+    if (line.empty()) return;
+    auto start = chrono::steady_clock::now();
 
-            sendSocketData(ss.str(), true);
-            m_message.clear();
-        } else {
-            // We got a Json request
-            // Process each line in the transmission
-            linedelimiter = "\n";
-
-            linedelimiteroffset = m_message.find(linedelimiter);
-            while (linedelimiteroffset != string::npos) {
-                if (linedelimiteroffset > 0) {
-                    line = m_message.substr(0, linedelimiteroffset);
-                    boost::trim(line);
-
-                    if (!line.empty()) {
-                        // Test validity of chunk and process
-                        Json::Value jMsg;
-                        Json::Value jRes;
-
-                        JSONCPP_STRING err;
-                        Json::CharReaderBuilder builder;
-                        const std::unique_ptr<Json::CharReader> jRdr(builder.newCharReader());
-
-                        if (jRdr->parse(line.c_str(), line.c_str() + line.length(), &jMsg, &err)) {
-                            try {
-                                // Run in sync so no 2 different async reads may overlap
-                                processRequest(jMsg, jRes);
-                            } catch (const exception& _ex) {
-                                jRes = Json::Value();
-                                jRes["jsonrpc"] = "2.0";
-                                jRes["id"] = Json::Value::null;
-                                jRes["error"]["errorcode"] = "500";
-                                jRes["error"]["message"] = _ex.what();
-                            }
-                        } else {
-                            jRes = Json::Value();
-                            jRes["jsonrpc"] = "2.0";
-                            jRes["id"] = Json::Value::null;
-                            jRes["error"]["errorcode"] = "-32700";
-                            boost::replace_all(err, "\n", " ");
-                            cwarn << "API : Got invalid Json message " << err;
-                            jRes["error"]["message"] = "Json parse error : " + err;
-                        }
-
-                        // Send response to client
-                        sendSocketData(jRes);
-                    }
-                }
+    // Test validity of chunk and process
+    Json::Value jMsg;
+    Json::Value jRes;
 
-                // Next line (if any)
-                m_message.erase(0, linedelimiteroffset + 1);
-                linedelimiteroffset = m_message.find(linedelimiter);
-            }
+    JSONCPP_STRING err;
+    Json::CharReaderBuilder builder;
+    const std::unique_ptr<Json::CharReader> jRdr(builder.newCharReader());
 
-            // Eventually keep reading from socket
-            if (m_socket.is_open()) recvSocketData();
+    if (jRdr->parse(line.c_str(), line.c_str() + line.length(), &jMsg, &err)) {
+        try {
+            // Run in sync so no 2 different async reads may overlap
+            processRequest(jMsg, jRes);
+        } catch (const exception& _ex) {
+            jRes = Json::Value();
+            jRes["jsonrpc"] = "2.0";
+            jRes["id"] = Json::Value::null;
+            jRes["error"]["errorcode"] = "500";
+            jRes["error"]["message"] = _ex.what();
+            m_result.reset();
         }
     } else {
-        disconnect();
+        jRes = Json::Value();
+        jRes["jsonrpc"] = "2.0";
+        jRes["id"] = Json::Value::null;
+        jRes["error"]["errorcode"] = "-32700";
+        boost::replace_all(err, "\n", " ");
+        cwarn << "API : Got invalid Json message " << err;
+        jRes["error"]["message"] = "Json parse error : " + err;
+    }
+
+    // Send response to client
+    if (m_result) sendSocketData(jRes, *m_result);
+    else
+        sendSocketData(jRes);
+    account(EndpointJsonRpc, m_result ? m_result->size() : 0, start);
+    m_result.reset();
+}
+
+void ApiConnection::processHttpRequest(string const& http_method, string const& http_path, string const& http_ver, size_t _length) {
+    auto start = chrono::steady_clock::now();
+    string head = boost::to_lower_copy(m_message.substr(0, _length));
+
+    // Do we support method ?
+    if (http_method != "GET") {
+        string what = "Method " + http_method + " not allowed";
+        stringstream ss;
+        ss << http_ver << " "
+           << "405 Method not allowed\r\n"
+           << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
+           << "Content-Type: text/plain\r\n"
+           << "Content-Length: " << what.size() << "\r\n\r\n"
+           << what;
+        sendSocketData(ss.str(), true);
+        m_message.clear();
+        cnote << "HTTP Request " << http_method << " " << http_path << " not supported (405).";
+        return;
+    }
+
+    // Subscriptions need the connection to stay open
+    if (http_path == "/subscribe") {
+        if (httpHeader(head, "upgrade") == "websocket") {
+            upgradeWebSocket(http_ver);
+            account(EndpointSubscribe, 0, start);
+            return;
+        }
+        string what = "The requested resource " + http_path + " is only available over WebSocket";
+        stringstream ss;
+        ss << http_ver << " "
+           << "426 Upgrade Required\r\n"
+           << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
+           << "Upgrade: websocket\r\n"
+           << "Content-Type: text/plain\r\n"
+           << "Content-Length: " << what.size() << "\r\n\r\n"
+           << what;
+        sendSocketData(ss.str(), true);
+        m_message.clear();
+        cnote << "HTTP Request " << http_method << " " << http_path << " without upgrade (426).";
+        return;
+    }
+
+    // Do we support path ?
+    if (http_path != "/" && http_path != "/getstat1" && http_path != "/metrics") {
+        string what = "The requested resource " + http_path + " not found on this server";
+        stringstream ss;
+        ss << http_ver << " "
+           << "404 Not Found\r\n"
+           << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
+           << "Content-Type: text/plain\r\n"
+           << "Content-Length: " << what.size() << "\r\n\r\n"
+           << what;
+        sendSocketData(ss.str(), true);
+        m_message.clear();
+        cnote << "HTTP Request " << http_method << " " << http_path << " not found (404).";
+        return;
+    }
+
+    // Http/1.1 connections persist unless told otherwise, Http/1.0 ones the other way round
+    string connection = httpHeader(head, "connection");
+    bool keepAlive = (http_ver == "HTTP/1.0" ? connection == "keep-alive" : connection != "close");
+    unsigned endpoint = (http_path == "/metrics" ? EndpointMetrics : (http_path == "/" ? EndpointRoot : EndpointGetstat1));
+
+    stringstream ss;   // Builder of the response
+
+    try {
+        auto snap = snapshot();
+
+        // Nothing changed since the client's copy
+        if (httpHeader(head, "if-none-match") == boost::to_lower_copy(snap->etag)) {
+            ss << http_ver << " "
+               << "304 Not Modified\r\n"
+               << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
+               << "ETag: " << snap->etag << "\r\n"
+               << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+            sendSocketData(ss.str(), !keepAlive);
+            account(endpoint, ss.str().size(), start, true);
+            m_message.erase(0, _length);
+            if (keepAlive) armIdleTimer();
+            return;
+        }
+
+        string const& body = (http_path == "/metrics" ? snap->metrics : snap->html);
+        string content_type = (http_path == "/metrics" ? "text/plain" : "text/html");
+
+        // Compress when client accepts it (gzip preferred)
+        HttpEncoding encoding = HttpEncoding::Identity;
+        string accepted = httpHeader(head, "accept-encoding");
+        if (httpAccepts(accepted, "gzip")) encoding = HttpEncoding::Gzip;
+        else if (httpAccepts(accepted, "deflate"))
+            encoding = HttpEncoding::Deflate;
+        string const& content = snap->encoded(body, encoding);
+        if (&content == &body) encoding = HttpEncoding::Identity;
+
+        ss.clear();
+        ss << http_ver << " "
+           << "200 OK\r\n"
+           << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
+           << "Content-Type: " << content_type << "; charset=utf-8\r\n"
+           << "Content-Length: " << content.size() << "\r\n"
+           << "ETag: " << snap->etag << "\r\n"
+           << "Vary: Accept-Encoding\r\n";
+        if (encoding != HttpEncoding::Identity) ss << "Content-Encoding: " << (encoding == HttpEncoding::Gzip ? "gzip" : "deflate") << "\r\n";
+        ss << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n" << content;
+        cnote << "HTTP Request " << http_method << " " << http_path << " 200 OK (" << ss.str().size() << " bytes).";
+    } catch (const exception& _ex) {
+        string what = "Internal error : " + string(_ex.what());
+        ss.clear();
+        ss << http_ver << " "
+           << "500 Internal Server Error\r\n"
+           << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
+           << "Content-Type: text/plain\r\n"
+           << "Content-Length: " << what.size() << "\r\n\r\n"
+           << what;
+        cnote << "HTTP Request " << http_method << " " << http_path << " 500 Error (" << _ex.what() << ").";
+        keepAlive = false;
+    }
+
+    sendSocketData(ss.str(), !keepAlive);
+    account(endpoint, ss.str().size(), start);
+    m_message.erase(0, _length);
+    if (keepAlive) armIdleTimer();
+}
+
+void ApiConnection::armIdleTimer() {
+    m_idleTimer.expires_from_now(boost::posix_time::seconds(s_keepAliveTimeout));
+    m_idleTimer.async_wait(m_io_strand.wrap(boost::bind(&ApiConnection::onIdleTimeout, shared_from_this(), boost::asio::placeholders::error)));
+}
+
+void ApiConnection::onIdleTimeout(const boost::system::error_code& ec) {
+    // Aborted when rearmed by next request
+    if (ec || m_websocket || !m_socket.is_open()) return;
+    disconnect();
+}
+
+void ApiConnection::upgradeWebSocket(string const& http_ver) {
+    static regex key_pattern(R"(\r\nSec-WebSocket-Key:[ \t]*([A-Za-z0-9+/=]+)[ \t]*\r\n)", regex_constants::icase);
+    smatch key_matches;
+    if (!regex_search(m_message, key_matches, key_pattern)) {
+        sendSocketData(http_ver + " 400 Bad Request\r\nContent-Length: 0\r\n\r\n", true);
+        m_message.clear();
+        return;
+    }
+
+    // RFC 6455 handshake
+    string key = key_matches[1].str() + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(key.data()), key.size(), digest);
+    char accept[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+    EVP_EncodeBlock(reinterpret_cast<unsigned char*>(accept), digest, SHA_DIGEST_LENGTH);
+
+    stringstream ss;
+    ss << http_ver << " "
+       << "101 Switching Protocols\r\n"
+       << "Server: " << eaminer_get_buildinfo()->project_name_with_version << "\r\n"
+       << "Upgrade: websocket\r\n"
+       << "Connection: Upgrade\r\n"
+       << "Sec-WebSocket-Accept: " << accept << "\r\n\r\n";
+    sendSocketData(ss.str());
+    cnote << "API : WebSocket subscription from " << m_socket.remote_endpoint();
+
+    m_websocket = true;
+    m_message.erase(0, m_message.find("\r\n\r\n") + 4);
+    if (m_is_authenticated) subscribe(true, true);
+    processFrames();
+}
+
+void ApiConnection::processFrames() {
+    while (m_message.size() >= 2 && !m_closeAfterSend) {
+        auto bytes = reinterpret_cast<const uint8_t*>(m_message.data());
+        bool fin = bytes[0] & 0x80;
+        uint8_t opcode = bytes[0] & 0x0f;
+        uint64_t length = bytes[1] & 0x7f;
+        size_t offset = 2;
+        if (length == 126) {
+            if (m_message.size() < 4) return;
+            length = (uint64_t(bytes[2]) << 8) | bytes[3];
+            offset = 4;
+        } else if (length == 127) {
+            if (m_message.size() < 10) return;
+            length = 0;
+            for (size_t i = 2; i < 10; i++) length = (length << 8) | bytes[i];
+            offset = 10;
+        }
+
+        // Clients must mask their frames and we won't buffer huge ones
+        // (compared without adding : a 64 bit length could wrap the sum)
+        if (!(bytes[1] & 0x80) || length > s_maxFrame || m_wsMessage.size() > s_maxFrame - length) {
+            queue(string{char(0x03), char(!(bytes[1] & 0x80) ? 0xea : 0xf1)}, true, 0x8);   // 1002 protocol error or 1009 too big
+            m_closeAfterSend = true;
+            flush();
+            return;
+        }
+        if (m_message.size() < offset + 4 + length) return;   // Wait for other data to come in
+
+        string payload = m_message.substr(offset + 4, length);
+        for (size_t i = 0; i < payload.size(); i++) payload[i] ^= m_message[offset + (i & 3)];
+        m_message.erase(0, offset + 4 + length);
+
+        switch (opcode) {
+            case 0x0:   // Continuation
+            case 0x1:   // Text
+            case 0x2:   // Binary
+                m_wsMessage.append(payload);
+                if (fin) {
+                    processLine(m_wsMessage);
+                    m_wsMessage.clear();
+                }
+                break;
+            case 0x8:   // Close
+                queue(payload.substr(0, 2), true, 0x8);
+                m_closeAfterSend = true;
+                flush();
+                return;
+            case 0x9:   // Ping
+                queue(payload, true, 0xA);
+                flush();
+                break;
+            default:   // Pong
+                break;
+        }
     }
 }
 
@@ -692,16 +1013,112 @@ void ApiConnection::sendSocketData(Json::Value const& jReq, bool _disconnect) {
     sendSocketData(line.str(), _disconnect);
 }
 
+void ApiConnection::sendSocketData(Json::Value const& jReq, string const& _result) {
+    if (!m_socket.is_open()) return;
+    // Splice the pre-rendered result into the envelope instead of parsing it back
+    string line = Json::writeString(m_jSwBuilder, jReq);
+    line.pop_back();
+    line.append(",\"result\":").append(_result).append("}\n");
+    sendSocketData(line);
+}
+
 void ApiConnection::sendSocketData(string const& _s, bool _disconnect) {
     if (!m_socket.is_open()) return;
-    ostream os(&m_sendBuffer);
-    os << _s;
+    if (_disconnect) m_closeAfterSend = true;
+
+    // Replies only pile up when the client doesn't read them
+    if (!queue(_s, true)) {
+        cwarn << "API : Session " << m_sessionId << " does not read its replies. Disconnecting";
+        disconnect();
+        return;
+    }
+    flush();
+}
 
-    async_write(m_socket, m_sendBuffer, m_io_strand.wrap(boost::bind(&ApiConnection::onSendSocketDataCompleted, this, boost::asio::placeholders::error, _disconnect)));
+bool ApiConnection::queue(string const& _payload, bool _priority, uint8_t _opcode) {
+    string msg = m_txQueue.acquire();
+    if (m_websocket) {
+        // Unmasked server frame, without the line feed the Json-RPC stream needs
+        size_t length = _payload.size() - (_opcode == 0x1 && !_payload.empty() && _payload.back() == '\n' ? 1 : 0);
+        msg.push_back(char(0x80 | _opcode));
+        if (length < 126) msg.push_back(char(length));
+        else if (length < 65536) {
+            msg.push_back(char(126));
+            msg.push_back(char(length >> 8));
+            msg.push_back(char(length & 0xff));
+        } else {
+            msg.push_back(char(127));
+            for (int i = 7; i >= 0; i--) msg.push_back(char((uint64_t(length) >> (8 * i)) & 0xff));
+        }
+        msg.append(_payload, 0, length);
+    } else
+        msg.append(_payload);
+    return m_txQueue.push(std::move(msg), _priority);
+}
+
+void ApiConnection::flush() {
+    if (m_txPending || !m_socket.is_open()) return;
+    if (m_txQueue.empty()) {
+        if (m_closeAfterSend) disconnect();
+        return;
+    }
+    m_txPending = true;
+    boost::asio::async_write(m_socket, m_txQueue.flight(),
+                             m_io_strand.wrap(boost::bind(&ApiConnection::onSendSocketDataCompleted, shared_from_this(), boost::asio::placeholders::error)));
 }
 
-void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& ec, bool _disconnect) {
-    if (ec || _disconnect) disconnect();
+void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& ec) {
+    m_txQueue.landed();
+    m_txPending = false;
+    if (ec) disconnect();
+    else
+        flush();
+}
+
+void ApiConnection::subscribe(bool _telemetry, bool _events) {
+    bool was = m_subTelemetry || m_subEvents;
+    m_subTelemetry = _telemetry;
+    m_subEvents = _events;
+    bool is = m_subTelemetry || m_subEvents;
+    if (is && !was) s_subscribers.fetch_add(1, memory_order_relaxed);
+    else if (was && !is)
+        s_subscribers.fetch_sub(1, memory_order_relaxed);
+
+    // Start with a whole snapshot, after the reply
+    m_pushedVersion = 0;
+    if (m_subTelemetry) m_io_strand.post([self = shared_from_this()]() { self->pushTelemetry(snapshot()); });
+}
+
+void ApiConnection::pushTelemetry(shared_ptr<const ApiSnapshot> const& _snap) {
+    if (!m_subTelemetry || !m_socket.is_open() || _snap->version == m_pushedVersion) return;
+    bool delta = m_pushedVersion && !_snap->update.empty() && _snap->base == m_pushedVersion;
+    if (push(delta ? _snap->update : _snap->full)) m_pushedVersion = _snap->version;
+}
+
+void ApiConnection::pushEvent(string const& _event) {
+    if (m_subEvents && m_socket.is_open()) push(_event);
+}
+
+bool ApiConnection::push(string const& _msg) {
+    // Tell how many pushes were missed before resuming them
+    if (m_dropped) {
+        Json::Value jNotice;
+        jNotice["jsonrpc"] = "2.0";
+        jNotice["method"] = "miner_event";
+        jNotice["params"]["event"] = "dropped";
+        jNotice["params"]["count"] = m_dropped;
+        if (!queue(Json::writeString(m_jSwBuilder, jNotice) + "\n", false)) {
+            m_dropped++;
+            return false;
+        }
+        m_dropped = 0;
+    }
+    if (!queue(_msg, false)) {
+        m_dropped++;
+        return false;
+    }
+    flush();
+    return true;
 }
 
 Json::Value ApiConnection::getMinerStat1() {
@@ -803,7 +1220,33 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(const TelemetryType& _t, c
     mininginfo["pause_reason"] = _miner->paused() ? _miner->pausedString() : Json::Value::null;
 
     /* Hash & Share infos */
-    mininginfo["hashrate"] = toHex((uint32_t) _t.miners.at(_index).hashrate, HexPrefix::Add);
+    mininginfo["hashrate"] = toHex(uint64_t(_t.miners.at(_index).hashrate), HexPrefix::Add);
+    mininginfo["hashes"] = _t.miners.at(_index).hashes;
+    mininginfo["effective"] = effectiveHashRate(_t.miners.at(_index).effective);
+
+    /* Latencies */
+    Json::Value latencyinfo;
+    latencyinfo["switch"] = latencyPercentiles(_miner->switchLatency());
+    latencyinfo["dag"] = latencyPercentiles(_miner->dagBuildTime());
+    latencyinfo["light"] = latencyPercentiles(_miner->lightBuildTime());
+    mininginfo["latency"] = latencyinfo;
+
+    /* Kernel profile (device clock) */
+    KernelProfileType const& profile = _t.miners.at(_index).profile;
+    if (profile.enabled) {
+        Json::Value profileinfo;
+        profileinfo["kernels"] = profile.kernels;
+        profileinfo["dag_kernels"] = profile.dagKernels;
+        profileinfo["transfers"] = profile.transfers;
+        profileinfo["dag_ms"] = profile.dagMs;
+        profileinfo["utilization"] = profile.utilization;
+        profileinfo["kernel_us"] = profile.kernelUs;
+        profileinfo["gap_us"] = profile.gapUs;
+        profileinfo["queue_us"] = profile.queueUs;
+        profileinfo["transfer_us"] = profile.transferUs;
+        mininginfo["profile"] = profileinfo;
+    } else
+        mininginfo["profile"] = Json::Value::null;
 
     jRes["hardware"] = hwinfo;
     jRes["mining"] = mininginfo;
@@ -811,10 +1254,7 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(const TelemetryType& _t, c
     return jRes;
 }
 
-string ApiConnection::getHttpMinerMetrics() {
-    Json::Value jStat = getMinerStatDetail();
-    Json::StreamWriterBuilder builder;
-
+string ApiConnection::getHttpMinerMetrics(Json::Value const& jStat) {
     ostringstream ss;
     ss << "host=" << jStat["host"]["name"] << ",version=" << jStat["host"]["version"];
     string labels = ss.str();
@@ -832,6 +1272,7 @@ string ApiConnection::getHttpMinerMetrics() {
     // Per device help/type info.
 
     double total_power = 0;
+    map<unsigned, string> devices_labels;
     for (Json::Value::ArrayIndex i = 0; i != jStat["devices"].size(); i++) {
         Json::Value device = jStat["devices"][i];
         ostringstream os;
@@ -839,6 +1280,7 @@ string ApiConnection::getHttpMinerMetrics() {
            << ",name=" << device["hardware"]["name"] << ",pci=" << device["hardware"]["pci"] << ",device_type=" << device["hardware"]["type"]
            << ",mode=" << device["_mode"];
         string device_labels = os.str();
+        devices_labels[device["_index"].asUInt()] = device_labels;
 
         double hashrate = stoul(device["mining"]["hashrate"].asString(), nullptr, 16);
         double power = device["hardware"]["sensors"][2].asDouble();
@@ -846,6 +1288,9 @@ string ApiConnection::getHttpMinerMetrics() {
         _ret << "# HELP miner_device_hashrate Device hash rate in hashes/sec.\n"
              << "# TYPE miner_device_hashrate gauge\n"
              << "miner_device_hashrate{" << device_labels << "} " << hashrate << "\n"
+             << "# HELP miner_device_hashes_total Hashes computed by device.\n"
+             << "# TYPE miner_device_hashes_total counter\n"
+             << "miner_device_hashes_total{" << device_labels << "} " << device["mining"]["hashes"].asUInt64() << "\n"
              << "# HELP miner_device_power_watts Device power draw in watts.\n"
              << "# TYPE miner_device_power_watts gauge\n"
              << "miner_device_power_watts{" << device_labels << "} " << power << "\n"
@@ -870,12 +1315,39 @@ string ApiConnection::getHttpMinerMetrics() {
              << "# TYPE miner_device_paused gauge\n"
              << "miner_device_paused{" << device_labels << "} " << (device["mining"]["paused"].asBool() ? 1 : 0) << "\n";
 
+        _ret << getHttpEffectiveMetrics("miner_device_", device_labels, device["mining"]["effective"]);
+
+        Json::Value const& profile = device["mining"]["profile"];
+        if (profile.isObject())
+            _ret << "# HELP miner_device_utilization_percent Device time spent running search kernels (percentage 0-100).\n"
+                 << "# TYPE miner_device_utilization_percent gauge\n"
+                 << "miner_device_utilization_percent{" << device_labels << "} " << profile["utilization"].asDouble() << "\n"
+                 << "# HELP miner_device_kernel_seconds Average search kernel execution (seconds).\n"
+                 << "# TYPE miner_device_kernel_seconds gauge\n"
+                 << "miner_device_kernel_seconds{" << device_labels << "} " << profile["kernel_us"].asDouble() / 1e6 << "\n"
+                 << "# HELP miner_device_kernel_gap_seconds Average device idle time between search kernels (seconds).\n"
+                 << "# TYPE miner_device_kernel_gap_seconds gauge\n"
+                 << "miner_device_kernel_gap_seconds{" << device_labels << "} " << profile["gap_us"].asDouble() / 1e6 << "\n"
+                 << "# HELP miner_device_kernel_queue_seconds Average time from search kernel queued to started (seconds).\n"
+                 << "# TYPE miner_device_kernel_queue_seconds gauge\n"
+                 << "miner_device_kernel_queue_seconds{" << device_labels << "} " << profile["queue_us"].asDouble() / 1e6 << "\n"
+                 << "# HELP miner_device_transfer_seconds Average result buffer transfer (seconds).\n"
+                 << "# TYPE miner_device_transfer_seconds gauge\n"
+                 << "miner_device_transfer_seconds{" << device_labels << "} " << profile["transfer_us"].asDouble() / 1e6 << "\n"
+                 << "# HELP miner_device_kernels_total Search kernels profiled on device.\n"
+                 << "# TYPE miner_device_kernels_total counter\n"
+                 << "miner_device_kernels_total{" << device_labels << "} " << profile["kernels"].asUInt64() << "\n";
+
         total_power += power;
     }
     double total_hashrate = stoul(jStat["mining"]["hashrate"].asString(), nullptr, 16);
     _ret << "# HELP miner_total_hashrate Total miner process hashrate across all devices (hashes/sec).\n"
          << "# TYPE miner_total_hashrate gauge\n"
          << "miner_total_hashrate{" << labels << "} " << total_hashrate << "\n"
+         << "# HELP miner_hashes_total Hashes computed across all devices.\n"
+         << "# TYPE miner_hashes_total counter\n"
+         << "miner_hashes_total{" << labels << "} " << jStat["mining"]["hashes"].asUInt64() << "\n"
+         << getHttpEffectiveMetrics("miner_", labels, jStat["mining"]["effective"])
          << "# HELP miner_total_power_watts Total power consumption across all devices (watts).\n"
          << "# TYPE miner_total_power_watts gauge\n"
          << "miner_total_power_watts{" << labels << "} " << total_power << "\n"
@@ -891,15 +1363,11 @@ string ApiConnection::getHttpMinerMetrics() {
          << "# TYPE miner_shares_last_found_seconds gauge\n"
          << "miner_shares_last_found_secs{" << labels << "} " << jStat["mining"]["shares"][3].asUInt() << "\n";
 
-    // For debugging
-    //_ret << Json::writeString(builder, jStat);
-
-    _ret << "# EOF\n";
+    _ret << getHttpLatencyMetrics(labels, devices_labels) << getHttpApiMetrics(labels) << "# EOF\n";
     return _ret.str();
 }
 
-string ApiConnection::getHttpMinerStatDetail() {
-    Json::Value jStat = getMinerStatDetail();
+string ApiConnection::getHttpMinerStatDetail(Json::Value const& jStat) {
     uint64_t durationSeconds = jStat["host"]["runtime"].asUInt64();
     int hours = (int) (durationSeconds / 3600);
     durationSeconds -= (hours * 3600);
@@ -1028,14 +1496,25 @@ Json::Value ApiConnection::getMinerStatDetail() {
     connectioninfo["connected"] = PoolManager::p().isConnected();
     connectioninfo["switches"] = PoolManager::p().getConnectionSwitches();
 
+    Json::Value latencyinfo(Json::objectValue);
+    for (auto const& pool: PoolProber::histograms()) {
+        latencyinfo[pool.first]["submit"] = latencyPercentiles(pool.second->submit);
+        latencyinfo[pool.first]["ack"] = latencyPercentiles(pool.second->ack);
+    }
+    connectioninfo["latency"] = latencyinfo;
+
     /* Mining Info */
     Json::Value mininginfo;
     Json::Value sharesinfo = Json::Value(Json::arrayValue);
 
-    mininginfo["hashrate"] = toHex(uint32_t(t.farm.hashrate), HexPrefix::Add);
+    mininginfo["hashrate"] = toHex(uint64_t(t.farm.hashrate), HexPrefix::Add);
+    mininginfo["hashes"] = t.farm.hashes;
+    mininginfo["effective"] = effectiveHashRate(t.farm.effective);
     mininginfo["epoch"] = PoolManager::p().getCurrentEpoch();
     mininginfo["epoch_changes"] = PoolManager::p().getEpochChanges();
     mininginfo["difficulty"] = PoolManager::p().getPoolDifficulty();
+    mininginfo["requested_difficulty"] = PoolManager::p().getRequestedDifficulty();
+    mininginfo["filtered"] = PoolManager::p().getShareFilterJson();
 
     sharesinfo.append(t.farm.solutions.accepted);
     sharesinfo.append(t.farm.solutions.rejected);
@@ -1067,3 +1546,176 @@ Json::Value ApiConnection::getMinerStatDetail() {
 
     return jRes;
 }
+
+shared_ptr<const ApiSnapshot> ApiConnection::s_snapshot;
+atomic<uint64_t> ApiConnection::s_snapshotVersion = {0};
+atomic<unsigned> ApiConnection::s_subscribers = {0};
+const size_t ApiConnection::s_maxFrame;
+const unsigned ApiConnection::s_keepAliveTimeout;
+const unsigned ApiConnection::s_snapshotMaxAge;
+const char* const ApiConnection::s_endpointNames[Endpoint_MAX] = {"/", "/getstat1", "/metrics", "/subscribe", "jsonrpc"};
+ApiEndpointStats ApiConnection::s_endpointStats[Endpoint_MAX];
+
+void ApiConnection::account(unsigned _endpoint, size_t _bytes, chrono::steady_clock::time_point _start, bool _notModified) {
+    auto& stats = s_endpointStats[_endpoint];
+    stats.requests.fetch_add(1, memory_order_relaxed);
+    if (_notModified) stats.notModified.fetch_add(1, memory_order_relaxed);
+    stats.bytes.fetch_add(_bytes, memory_order_relaxed);
+    stats.micros.fetch_add(uint64_t(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - _start).count()), memory_order_relaxed);
+}
+
+string ApiConnection::getHttpLatencyMetrics(string const& labels, map<unsigned, string> const& devices_labels) {
+    stringstream ss[5];
+    ss[0] << "# HELP miner_device_job_switch_seconds Time from job received to device searching it (seconds).\n"
+          << "# TYPE miner_device_job_switch_seconds histogram\n";
+    ss[1] << "# HELP miner_device_dag_build_seconds Time spent generating DAG on device (seconds).\n"
+          << "# TYPE miner_device_dag_build_seconds histogram\n";
+    ss[2] << "# HELP miner_device_light_cache_build_seconds Time spent getting the light cache for device (seconds).\n"
+          << "# TYPE miner_device_light_cache_build_seconds histogram\n";
+    ss[3] << "# HELP miner_pool_submit_write_seconds Time from solution found to submit written to pool (seconds).\n"
+          << "# TYPE miner_pool_submit_write_seconds histogram\n";
+    ss[4] << "# HELP miner_pool_submit_ack_seconds Time from submit to pool answer (seconds).\n"
+          << "# TYPE miner_pool_submit_ack_seconds histogram\n";
+    for (const shared_ptr<Miner>& miner: Farm::f().getMiners()) {
+        auto it = devices_labels.find(miner->Index());
+        if (it == devices_labels.end()) continue;
+        miner->switchLatency().prometheus(ss[0], "miner_device_job_switch_seconds", it->second);
+        miner->dagBuildTime().prometheus(ss[1], "miner_device_dag_build_seconds", it->second);
+        miner->lightBuildTime().prometheus(ss[2], "miner_device_light_cache_build_seconds", it->second);
+    }
+    for (auto const& pool: PoolProber::histograms()) {
+        string pool_labels = labels + ",pool=\"" + pool.first + "\"";
+        pool.second->submit.prometheus(ss[3], "miner_pool_submit_write_seconds", pool_labels);
+        pool.second->ack.prometheus(ss[4], "miner_pool_submit_ack_seconds", pool_labels);
+    }
+    return ss[0].str() + ss[1].str() + ss[2].str() + ss[3].str() + ss[4].str();
+}
+
+string ApiConnection::getHttpEffectiveMetrics(string const& prefix, string const& labels, Json::Value const& jEffective) {
+    stringstream ss[4];
+    ss[0] << "# HELP " << prefix << "effective_hashrate Hash rate from accepted shares difficulty in hashes/sec.\n"
+          << "# TYPE " << prefix << "effective_hashrate gauge\n";
+    ss[1] << "# HELP " << prefix << "effective_hashrate_low Lower bound of effective hash rate 95% confidence interval in hashes/sec.\n"
+          << "# TYPE " << prefix << "effective_hashrate_low gauge\n";
+    ss[2] << "# HELP " << prefix << "effective_hashrate_high Upper bound of effective hash rate 95% confidence interval in hashes/sec.\n"
+          << "# TYPE " << prefix << "effective_hashrate_high gauge\n";
+    ss[3] << "# HELP " << prefix << "effective_hashrate_alert True if reported hash rate is significantly above effective one.\n"
+          << "# TYPE " << prefix << "effective_hashrate_alert gauge\n"
+          << prefix << "effective_hashrate_alert{" << labels << "} " << (jEffective["alert"].asBool() ? 1 : 0) << "\n";
+    for (auto const& window: jEffective["windows"]) {
+        string window_labels = labels + ",window=\"" + to_string(window["minutes"].asUInt()) + "m\"";
+        ss[0] << prefix << "effective_hashrate{" << window_labels << "} " << window["rate"].asDouble() << "\n";
+        ss[1] << prefix << "effective_hashrate_low{" << window_labels << "} " << window["low"].asDouble() << "\n";
+        ss[2] << prefix << "effective_hashrate_high{" << window_labels << "} " << window["high"].asDouble() << "\n";
+    }
+    return ss[0].str() + ss[1].str() + ss[2].str() + ss[3].str();
+}
+
+string ApiConnection::getHttpApiMetrics(string const& labels) {
+    stringstream ss[4];
+    ss[0] << "# HELP miner_api_requests_total Requests served by the API.\n"
+          << "# TYPE miner_api_requests_total counter\n";
+    ss[1] << "# HELP miner_api_not_modified_total Http requests answered 304 Not Modified.\n"
+          << "# TYPE miner_api_not_modified_total counter\n";
+    ss[2] << "# HELP miner_api_response_bytes_total Bytes of API responses (after compression).\n"
+          << "# TYPE miner_api_response_bytes_total counter\n";
+    ss[3] << "# HELP miner_api_request_seconds_total Time spent handling API requests (seconds).\n"
+          << "# TYPE miner_api_request_seconds_total counter\n";
+    for (unsigned i = 0; i < Endpoint_MAX; i++) {
+        string endpoint_labels = labels + ",endpoint=\"" + s_endpointNames[i] + "\"";
+        auto const& stats = s_endpointStats[i];
+        ss[0] << "miner_api_requests_total{" << endpoint_labels << "} " << stats.requests.load(memory_order_relaxed) << "\n";
+        ss[1] << "miner_api_not_modified_total{" << endpoint_labels << "} " << stats.notModified.load(memory_order_relaxed) << "\n";
+        ss[2] << "miner_api_response_bytes_total{" << endpoint_labels << "} " << stats.bytes.load(memory_order_relaxed) << "\n";
+        ss[3] << "miner_api_request_seconds_total{" << endpoint_labels << "} " << stats.micros.load(memory_order_relaxed) / 1e6 << "\n";
+    }
+    return ss[0].str() + ss[1].str() + ss[2].str() + ss[3].str();
+}
+
+string const& ApiSnapshot::encoded(string const& _body, HttpEncoding _encoding) const {
+#ifdef API_ZLIB
+    if (_encoding == HttpEncoding::Identity || _body.size() < 512) return _body;
+
+    lock_guard<mutex> l(encodedMutex);
+    auto it = encodedBodies.find({&_body, _encoding});
+    if (it != encodedBodies.end()) return it->second.empty() ? _body : it->second;
+
+    // Gzip wraps deflate data in a gzip header (window bits + 16), deflate in a zlib one
+    string& out = encodedBodies[{&_body, _encoding}];
+    z_stream zs = {};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, _encoding == HttpEncoding::Gzip ? 31 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return _body;
+    out.resize(deflateBound(&zs, uLong(_body.size())) + 18);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(_body.data()));
+    zs.avail_in = uInt(_body.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = uInt(out.size());
+    bool done = (deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    out.resize(done && zs.total_out < _body.size() ? zs.total_out : 0);
+    deflateEnd(&zs);
+    return out.empty() ? _body : out;
+#else
+    (void) _encoding;
+    return _body;
+#endif
+}
+
+shared_ptr<const ApiSnapshot> ApiConnection::snapshot() {
+    auto snap = atomic_load(&s_snapshot);
+    if (!snap || chrono::steady_clock::now() - snap->built > chrono::seconds(s_snapshotMaxAge)) {
+        updateSnapshot();
+        snap = atomic_load(&s_snapshot);
+    }
+    return snap;
+}
+
+// Members of _to which differ from _from, removed ones as null. Arrays are
+// replaced as a whole
+static Json::Value jsonDelta(Json::Value const& _from, Json::Value const& _to) {
+    Json::Value delta(Json::objectValue);
+    for (auto const& name: _to.getMemberNames()) {
+        Json::Value const& value = _to[name];
+        if (!_from.isMember(name)) delta[name] = value;
+        else if (value.isObject() && _from[name].isObject()) {
+            Json::Value inner = jsonDelta(_from[name], value);
+            if (!inner.empty()) delta[name] = inner;
+        } else if (value != _from[name])
+            delta[name] = value;
+    }
+    for (auto const& name: _from.getMemberNames())
+        if (!_to.isMember(name)) delta[name] = Json::nullValue;
+    return delta;
+}
+
+// miner_telemetry notification around pre-rendered _data (whole statdetail when _base is 0)
+static string telemetryNotification(uint64_t _version, uint64_t _base, string const& _data) {
+    return R"({"jsonrpc":"2.0","method":"miner_telemetry","params":{"base":)" + (_base ? to_string(_base) : string("null")) + R"(,"data":)" + _data +
+           R"(,"version":)" + to_string(_version) + "}}\n";
+}
+
+void ApiConnection::updateSnapshot(bool _tick) {
+    static shared_ptr<const ApiSnapshot> s_ticked;   // Last one built by collectData (only touched in Farm's strand)
+
+    auto snap = make_shared<ApiSnapshot>();
+    snap->built = chrono::steady_clock::now();
+
+    Json::StreamWriterBuilder builder;
+    builder.settings_["indentation"] = "";
+    snap->detail = getMinerStatDetail();
+    snap->stat1 = Json::writeString(builder, getMinerStat1());
+    snap->statDetail = Json::writeString(builder, snap->detail);
+    snap->metrics = getHttpMinerMetrics(snap->detail);
+    snap->html = getHttpMinerStatDetail(snap->detail);
+
+    snap->version = ++s_snapshotVersion;
+    snap->full = telemetryNotification(snap->version, 0, snap->statDetail);
+    snap->etag = "W/\"" + to_string(snap->version) + "\"";
+    if (_tick) {
+        if (s_ticked) {
+            snap->base = s_ticked->version;
+            snap->update = telemetryNotification(snap->version, snap->base, Json::writeString(builder, jsonDelta(s_ticked->detail, snap->detail)));
+        } else
+            snap->update = snap->full;
+        s_ticked = snap;
+    }
+    atomic_store(&s_snapshot, shared_ptr<const ApiSnapshot>(move(snap)));
+}
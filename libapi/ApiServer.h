@@ -9,6 +9,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
 
 #include <boost/asio.hpp>
@@ -19,7 +24,9 @@
 
 #include <libeth/Farm.h>
 #include <libeth/Miner.h>
+#include <libeth/MinerEvents.h>
 #include <libpool/PoolManager.h>
+#include <libpool/stratum/StratumSender.h>
 
 using namespace dev;
 using namespace dev::eth;
@@ -28,15 +35,59 @@ using namespace dev::eth;
 using boost::asio::ip::tcp;
 using namespace boost::placeholders;
 
-class ApiConnection {
+enum class HttpEncoding { Identity, Gzip, Deflate };
+
+// Immutable view of the miner state built once per telemetry collection and
+// pre-rendered for every kind of reader. Connections hold it by shared
+// pointer so a new one can be published while older ones are still sent.
+struct ApiSnapshot {
+    uint64_t version = 0;
+    uint64_t base = 0;   // Version update is relative to (0 if none)
+    std::chrono::steady_clock::time_point built;
+    Json::Value detail;       // miner_getstatdetail result
+    std::string stat1;        // miner_getstat1 result (Json)
+    std::string statDetail;   // miner_getstatdetail result (Json)
+    std::string metrics;      // /metrics (Prometheus text)
+    std::string html;         // / and /getstat1 (Html)
+    std::string full;         // miner_telemetry notification with statDetail
+    std::string update;       // miner_telemetry notification with changes since base (only on collectData ticks)
+    std::string etag;         // Http entity tag of metrics and html
+
+    // _body (one of the above) in the given content coding. Compressed once
+    // on first request and then shared. Returns _body if it can't be smaller
+    std::string const& encoded(std::string const& _body, HttpEncoding _encoding) const;
+
+    mutable std::mutex encodedMutex;
+    mutable std::map<std::pair<std::string const*, HttpEncoding>, std::string> encodedBodies;
+};
+
+// What the API serves, by endpoint, exposed on /metrics
+struct ApiEndpointStats {
+    std::atomic<uint64_t> requests = {0};
+    std::atomic<uint64_t> notModified = {0};   // Answered 304 thanks to If-None-Match
+    std::atomic<uint64_t> bytes = {0};         // Sent, after compression
+    std::atomic<uint64_t> micros = {0};        // Spent handling requests
+};
+
+class ApiConnection : public std::enable_shared_from_this<ApiConnection> {
 public:
     ApiConnection(boost::asio::io_service::strand& _strand, int id, bool readonly, string password);
 
-    ~ApiConnection() = default;
+    ~ApiConnection() { subscribe(false, false); }
 
     void start();
 
     static Json::Value getMinerStat1();
+    static unsigned subscribers() { return s_subscribers.load(std::memory_order_relaxed); }
+
+    // Latest snapshot (rebuilt on the spot when telemetry collection stalled)
+    static std::shared_ptr<const ApiSnapshot> snapshot();
+    static void updateSnapshot(bool _tick = false);
+
+    // Subscription pushes. Neither blocks : what does not fit in the send
+    // queue is dropped, and telemetry is then resent whole
+    void pushTelemetry(std::shared_ptr<const ApiSnapshot> const& _snap);
+    void pushEvent(std::string const& _event);
 
     using Disconnected = std::function<void(int const&)>;
     void onDisconnected(Disconnected const& _handler) { m_onDisconnected = _handler; }
@@ -48,17 +99,32 @@ public:
 private:
     void disconnect();
     void processRequest(Json::Value& jRequest, Json::Value& jResponse);
+    void processLine(std::string const& _line);
+    void processHttpRequest(std::string const& http_method, std::string const& http_path, std::string const& http_ver, size_t _length);
+    void armIdleTimer();
+    void onIdleTimeout(const boost::system::error_code& ec);
+    void upgradeWebSocket(std::string const& http_ver);
+    void processFrames();
     void recvSocketData();
     void onRecvSocketDataCompleted(const boost::system::error_code& ec, std::size_t bytes_transferred);
     void sendSocketData(Json::Value const& jReq, bool _disconnect = false);
+    void sendSocketData(Json::Value const& jReq, std::string const& _result);
     void sendSocketData(std::string const& _s, bool _disconnect = false);
-    void onSendSocketDataCompleted(const boost::system::error_code& ec, bool _disconnect = false);
+    bool queue(std::string const& _payload, bool _priority, uint8_t _opcode = 0x1);
+    void flush();
+    void onSendSocketDataCompleted(const boost::system::error_code& ec);
+    void subscribe(bool _telemetry, bool _events);
+    bool push(std::string const& _msg);
 
     static Json::Value getMinerStatDetail();
     static Json::Value getMinerStatDetailPerMiner(const TelemetryType& _t, const std::shared_ptr<Miner>& _miner);
 
-    static std::string getHttpMinerMetrics();
-    static std::string getHttpMinerStatDetail();
+    static std::string getHttpMinerMetrics(Json::Value const& jStat);
+    static std::string getHttpLatencyMetrics(std::string const& labels, std::map<unsigned, std::string> const& devices_labels);
+    static std::string getHttpEffectiveMetrics(std::string const& prefix, std::string const& labels, Json::Value const& jEffective);
+    static std::string getHttpApiMetrics(std::string const& labels);
+    static void account(unsigned _endpoint, size_t _bytes, std::chrono::steady_clock::time_point _start, bool _notModified = false);
+    static std::string getHttpMinerStatDetail(Json::Value const& jStat);
 
     Disconnected m_onDisconnected;
 
@@ -66,16 +132,45 @@ private:
 
     tcp::socket m_socket;
     boost::asio::io_service::strand& m_io_strand;
-    boost::asio::streambuf m_sendBuffer;
     boost::asio::streambuf m_recvBuffer;
     Json::StreamWriterBuilder m_jSwBuilder;
 
-    std::string m_message;   // The internal message string buffer
+    std::string m_message;                        // The internal message string buffer
+    std::shared_ptr<const std::string> m_result;   // Pre-rendered result of last request (keeps its snapshot alive)
+
+    static std::shared_ptr<const ApiSnapshot> s_snapshot;
+    static std::atomic<uint64_t> s_snapshotVersion;
+    static const unsigned s_snapshotMaxAge = 10;   // Seconds before readers stop trusting collectData
 
     bool m_readonly = false;
     std::string m_password;
 
     bool m_is_authenticated = true;
+
+    // Outgoing messages. Replies take the priority lane, subscription pushes
+    // the normal one where they are dropped once s_maxPending are waiting
+    StratumSendQueue m_txQueue;
+    bool m_txPending = false;
+    bool m_closeAfterSend = false;
+    bool m_reading = false;
+
+    // Http/1.1 persistent connections are closed after that many idle seconds
+    boost::asio::deadline_timer m_idleTimer;
+    static const unsigned s_keepAliveTimeout = 30;
+
+    enum Endpoint { EndpointRoot, EndpointGetstat1, EndpointMetrics, EndpointSubscribe, EndpointJsonRpc, Endpoint_MAX };
+    static const char* const s_endpointNames[Endpoint_MAX];
+    static ApiEndpointStats s_endpointStats[Endpoint_MAX];
+
+    bool m_websocket = false;
+    std::string m_wsMessage;   // Fragments of incoming WebSocket message
+    static const size_t s_maxFrame = 65536;
+
+    bool m_subTelemetry = false;
+    bool m_subEvents = false;
+    uint64_t m_pushedVersion = 0;   // Last snapshot version delivered to subscriber
+    unsigned m_dropped = 0;         // Pushes dropped since last delivered one
+    static std::atomic<unsigned> s_subscribers;
 };
 
 class ApiServer {
@@ -88,6 +183,7 @@ public:
 private:
     void begin_accept();
     void handle_accept(std::shared_ptr<ApiConnection> session, boost::system::error_code ec);
+    void onMinerEvent(MinerEvent const& _event);
 
     int lastSessionId = 0;
 
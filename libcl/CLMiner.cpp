@@ -162,10 +162,29 @@ std::vector<cl::Device> getDevices(std::vector<cl::Platform> const& _platforms,
 CLMiner::CLMiner(unsigned _index, DeviceDescriptor& _device) : Miner("cl-", _index) {
     m_deviceDescriptor = _device;
     m_block_multiple = 200000;
+    m_profiling = _device.clProfile;
 
     if (_device.clPlatformType == ClPlatformTypeEnum::Apple) { m_block_multiple = 1024; }
 }
 
+cl::Event* CLMiner::profiledEvent(ProfiledCommand _command) {
+    if (!m_profiling) return nullptr;
+    m_profiled.emplace_back(_command, cl::Event());
+    return &m_profiled.back().second;
+}
+
+void CLMiner::reportProfiled() {
+    for (auto& p: m_profiled) {
+        try {
+            ReportProfiled(p.first, p.second.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(), p.second.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>(),
+                           p.second.getProfilingInfo<CL_PROFILING_COMMAND_START>(), p.second.getProfilingInfo<CL_PROFILING_COMMAND_END>());
+        } catch (cl::Error const&) {
+            // Timestamps not available (e.g. command failed): skip it
+        }
+    }
+    m_profiled.clear();
+}
+
 CLMiner::~CLMiner() {
     stopWorking();
     kick_miner();
@@ -190,6 +209,7 @@ void CLMiner::workLoop() {
     // The work package currently processed by GPU.
     WorkPackage current;
     current.header = h256();
+    bool inFlight = false;   // Whether a kernel was launched on current
 
     if (!initDevice()) return;
 
@@ -200,9 +220,13 @@ void CLMiner::workLoop() {
 
             if (m_queue) {
                 // synchronize and read the results.
-                m_queue->enqueueReadBuffer(*m_searchBuffer, CL_TRUE, 0, sizeof(results), (void*) &results);
+                m_queue->enqueueReadBuffer(*m_searchBuffer, CL_TRUE, 0, sizeof(results), (void*) &results, nullptr, profiledEvent(ProfiledCommand::Transfer));
+                if (inFlight) Trace::complete("kernel", Trace::job(current.header), 0);
+                inFlight = false;
+                // In order queue: all commands up to the read are complete
+                reportProfiled();
                 // clear the solution count, hash count, and abort flag
-                m_queue->enqueueWriteBuffer(*m_searchBuffer, CL_FALSE, 0, sizeof(zerox3), zerox3);
+                m_queue->enqueueWriteBuffer(*m_searchBuffer, CL_FALSE, 0, sizeof(zerox3), zerox3, nullptr, profiledEvent(ProfiledCommand::Transfer));
             } else
                 results.count = 0;
 
@@ -216,6 +240,7 @@ void CLMiner::workLoop() {
             }
 
             if (current.header != w.header) {
+                Trace::instant("job picked up", Trace::job(w.header), m_index);
                 if (current.epoch != w.epoch) {
                     setEpoch(w);
                     if (g_seqDAG) g_seqDAGMutex.lock();
@@ -232,14 +257,11 @@ void CLMiner::workLoop() {
                 m_queue->enqueueWriteBuffer(*m_header, CL_FALSE, 0, w.header.size, w.header.data());
 
                 // zero the result count
-                m_queue->enqueueWriteBuffer(*m_searchBuffer, CL_FALSE, offsetof(SearchResults, count), sizeof(zerox3), zerox3);
+                m_queue->enqueueWriteBuffer(*m_searchBuffer, CL_FALSE, offsetof(SearchResults, count), sizeof(zerox3), zerox3, nullptr,
+                                            profiledEvent(ProfiledCommand::Transfer));
 
                 m_searchKernel.setArg(6, (uint64_t) (u64) ((u256) w.boundary >> 192));
-#ifdef DEV_BUILD
-                if (g_logOptions & LOG_SWITCH)
-                    cnote << "Switch time: " << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_workSwitchStart).count()
-                          << " us.";
-#endif
+                ReportWorkSwitched();
             }
 
             float hr = RetrieveHashRate();
@@ -250,7 +272,10 @@ void CLMiner::workLoop() {
             // Run the kernel.
             m_searchKernel.setArg(5, startNonce);
             m_hung_miner.store(false);
-            m_queue->enqueueNDRangeKernel(m_searchKernel, cl::NullRange, batch_blocks, m_deviceDescriptor.clGroupSize);
+            m_queue->enqueueNDRangeKernel(m_searchKernel, cl::NullRange, batch_blocks, m_deviceDescriptor.clGroupSize, nullptr,
+                                          profiledEvent(ProfiledCommand::Search));
+            Trace::launch("kernel", Trace::job(w.header), 0);
+            inFlight = true;
 
             // Report results while the kernel is running.
             if (results.count > c_maxSearchResults) results.count = c_maxSearchResults;
@@ -265,7 +290,7 @@ void CLMiner::workLoop() {
             // Increase start nonce for following kernel execution.
             startNonce += batch_blocks;
             // Report hash count
-            updateHashRate(m_deviceDescriptor.clGroupSize, results.hashCount);
+            countHashes(m_deviceDescriptor.clGroupSize, results.hashCount);
         }
 
         if (m_queue) m_queue->finish();
@@ -506,7 +531,7 @@ bool CLMiner::initEpoch() {
         // create context
         m_context = new cl::Context(std::vector<cl::Device>(&m_device, &m_device + 1));
         // create new queue with default in order execution property
-        m_queue = new cl::CommandQueue(*m_context, m_device);
+        m_queue = new cl::CommandQueue(*m_context, m_device, m_profiling ? CL_QUEUE_PROFILING_ENABLE : 0);
         m_abortqueue = new cl::CommandQueue(*m_context, m_device);
 
         m_dagItems = m_epochContext.dagNumItems;
@@ -608,15 +633,18 @@ bool CLMiner::initEpoch() {
 
         for (start = 0; start <= workItems - chunk; start += chunk) {
             m_dagKernel.setArg(0, start);
-            m_queue->enqueueNDRangeKernel(m_dagKernel, cl::NullRange, chunk, m_deviceDescriptor.clGroupSize);
+            m_queue->enqueueNDRangeKernel(m_dagKernel, cl::NullRange, chunk, m_deviceDescriptor.clGroupSize, nullptr, profiledEvent(ProfiledCommand::DAG));
             m_queue->finish();
+            reportProfiled();
         }
         if (start < workItems) {
             uint32_t groupsLeft = workItems - start;
             groupsLeft = (groupsLeft + m_deviceDescriptor.clGroupSize - 1) / m_deviceDescriptor.clGroupSize;
             m_dagKernel.setArg(0, start);
-            m_queue->enqueueNDRangeKernel(m_dagKernel, cl::NullRange, groupsLeft * m_deviceDescriptor.clGroupSize, m_deviceDescriptor.clGroupSize);
+            m_queue->enqueueNDRangeKernel(m_dagKernel, cl::NullRange, groupsLeft * m_deviceDescriptor.clGroupSize, m_deviceDescriptor.clGroupSize, nullptr,
+                                          profiledEvent(ProfiledCommand::DAG));
             m_queue->finish();
+            reportProfiled();
         }
 
         auto dagTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startInit);
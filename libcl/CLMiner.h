@@ -10,6 +10,7 @@
 #pragma once
 
 #include <fstream>
+#include <list>
 #include <mutex>
 
 #include <libdev/Worker.h>
@@ -95,6 +96,7 @@ private:
             delete m_searchBuffer;
             m_searchBuffer = nullptr;
         }
+        m_profiled.clear();
         if (m_queue) {
             delete m_queue;
             m_queue = nullptr;
@@ -109,8 +111,14 @@ private:
         }
     }
 
+    // Event to attach to an enqueued command when profiling (nullptr otherwise)
+    cl::Event* profiledEvent(ProfiledCommand _command);
+    // Accounts profiled commands, which must all be complete
+    void reportProfiled();
+
     unsigned m_dagItems = 0;
     std::mutex m_abortMutex;
+    std::list<std::pair<ProfiledCommand, cl::Event>> m_profiled;
 };
 
 }}   // namespace dev::eth
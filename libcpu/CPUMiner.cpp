@@ -174,7 +174,9 @@ void CPUMiner::search(const dev::eth::WorkPackage& w) {
     const auto header = ethash::hash256_from_bytes(w.header.data());
     const auto boundary = ethash::hash256_from_bytes(w.boundary.data());
     auto nonce = w.startNonce;
+    uint32_t job = Trace::job(w.header);
 
+    ReportWorkSwitched();
     while (true) {
         if (m_new_work.load(std::memory_order_relaxed))   // new work arrived ?
         {
@@ -184,18 +186,21 @@ void CPUMiner::search(const dev::eth::WorkPackage& w) {
 
         if (shouldStop()) break;
 
+        m_hung_miner.store(false);
+        Trace::begin("search", job);
         auto r = ethash::search(context, header, boundary, nonce, blocksize);
+        Trace::end("search", job);
         if (r.solution_found) {
             h256 mix{reinterpret_cast<byte*>(r.mix_hash.bytes), h256::ConstructFromPointer};
             auto sol = Solution{r.nonce, mix, w, std::chrono::steady_clock::now(), m_index};
 
-            cnote << EthWhite << "Job: " << w.header.abridged() << " Solution: " << toHex(sol.nonce, HexPrefix::Add);
+            ReportSolution(w.header, sol.nonce);
             Farm::f().submitProof(sol);
         }
         nonce += blocksize;
 
         // Update the hash rate
-        updateHashRate(blocksize, 1);
+        countHashes(blocksize, 1);
     }
 }
 
@@ -232,6 +237,7 @@ void CPUMiner::workLoop() {
         // Persist most recent job.
         // Job's differences should be handled at higher level
         current = w;
+        Trace::instant("job picked up", Trace::job(w.header), m_index);
 
         // Start searching
         search(w);
@@ -159,6 +159,7 @@ void CUDAMiner::workLoop() {
             // Persist most recent job.
             // Job's differences should be handled at higher level
             last = current;
+            Trace::instant("job picked up", Trace::job(current.header), m_index);
 
             uint64_t upper64OfBoundary((uint64_t) (u64) ((u256) current.boundary >> 192));
 
@@ -254,6 +255,7 @@ void CUDAMiner::enumDevices(minerMap& DevicesCollection) {
 static const uint32_t zero3[3] = {0, 0, 0};   // zero the result count
 
 void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_nonce, const dev::eth::WorkPackage& w) {
+    uint32_t job = Trace::job(w.header);
     set_header(header);
     if (m_current_target != target) {
         set_target(target);
@@ -268,9 +270,11 @@ void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
         HostToDevice(m_search_buf[streamIdx], zero3, sizeof(zero3));
         m_hung_miner.store(false);
         run_ethash_search(m_block_multiple, m_deviceDescriptor.cuBlockSize, m_streams[streamIdx], m_search_buf[streamIdx], start_nonce);
+        Trace::launch("kernel", job, streamIdx);
     }
     m_done = false;
     m_doneMutex.unlock();
+    ReportWorkSwitched();
 
     uint32_t streams_bsy((1 << m_deviceDescriptor.cuStreamSize) - 1);
 
@@ -293,6 +297,7 @@ void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
 
             // Wait for the stream complete
             CUDA_CALL(cudaStreamSynchronize(stream));
+            Trace::complete("kernel", job, streamIdx);
 
             Search_results r;
 
@@ -306,6 +311,7 @@ void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
             } else {
                 m_hung_miner.store(false);
                 run_ethash_search(m_block_multiple, m_deviceDescriptor.cuBlockSize, stream, (Search_results*) buffer, start_nonce);
+                Trace::launch("kernel", job, streamIdx);
             }
 
             if (r.solCount > MAX_SEARCH_RESULTS) r.solCount = MAX_SEARCH_RESULTS;
@@ -322,13 +328,6 @@ void CUDAMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
                 m_done = true;
             }
         }
-        updateHashRate(m_deviceDescriptor.cuBlockSize, batchCount);
+        countHashes(m_deviceDescriptor.cuBlockSize, batchCount);
     }
-
-#ifdef DEV_BUILD
-    // Optionally log job switch time
-    if (!shouldStop() && (g_logOptions & LOG_SWITCH)) {
-        cnote << "Switch time: " << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_workSwitchStart).count() << " us.";
-    }
-#endif
 }
@@ -0,0 +1,35 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace dev {
+
+// Assumed size of a cache line. Data written by different threads is kept
+// this far apart so writers don't invalidate each other's lines
+constexpr size_t c_cacheLineSize = 64;
+
+// Monotonic 64 bit counter written by a single thread and read by any.
+// Adding is a relaxed load and store (no locked read-modify-write), which
+// is exact as long as only the owning thread adds. Readers derive rates
+// from differences between the values they sample.
+class SingleWriterCounter {
+public:
+    void add(uint64_t _n) noexcept { m_value.store(m_value.load(std::memory_order_relaxed) + _n, std::memory_order_relaxed); }
+    uint64_t value() const noexcept { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_value = {0};
+};
+
+}   // namespace dev
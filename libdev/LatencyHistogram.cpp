@@ -0,0 +1,84 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "LatencyHistogram.h"
+
+using namespace std;
+using namespace dev;
+
+namespace {
+// Position of the most significant bit set (_v must not be 0)
+unsigned msb(uint64_t _v) {
+    unsigned n = 0;
+    for (unsigned shift = 32; shift; shift >>= 1)
+        if (_v >> shift) {
+            _v >>= shift;
+            n += shift;
+        }
+    return n;
+}
+}   // namespace
+
+unsigned LatencyHistogram::index(uint64_t _us) {
+    if (_us < s_subBuckets) return unsigned(_us);
+    unsigned m = msb(_us);
+    unsigned group = m - s_subBits + 1;
+    if (group >= s_groups) return s_buckets - 1;
+    return group * s_subBuckets + unsigned((_us >> (m - s_subBits)) & (s_subBuckets - 1));
+}
+
+uint64_t LatencyHistogram::lower(unsigned _index) {
+    unsigned group = _index / s_subBuckets;
+    uint64_t sub = _index % s_subBuckets;
+    if (!group) return sub;
+    return (s_subBuckets + sub) << (group - 1);
+}
+
+void LatencyHistogram::record(uint64_t _us) {
+    m_buckets[index(_us)].fetch_add(1, memory_order_relaxed);
+    m_count.fetch_add(1, memory_order_relaxed);
+    m_sum.fetch_add(_us, memory_order_relaxed);
+    uint64_t max = m_max.load(memory_order_relaxed);
+    while (_us > max && !m_max.compare_exchange_weak(max, _us, memory_order_relaxed))
+        ;
+}
+
+uint64_t LatencyHistogram::percentile(double _p) const {
+    uint64_t total = count();
+    if (!total) return 0;
+    uint64_t rank = uint64_t(ceil(total * _p / 100.0));
+    if (!rank) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < s_buckets - 1; i++) {
+        seen += m_buckets[i].load(memory_order_relaxed);
+        if (seen >= rank) return std::min(lower(i + 1) - 1, max());
+    }
+    return max();
+}
+
+void LatencyHistogram::prometheus(ostream& _out, string const& _name, string const& _labels) const {
+    // Bucket bounds are the powers of 4 from 16 us to about 268 seconds.
+    // Being bucket edges of the histogram, cumulative counts are exact
+    uint64_t cumulative = 0;
+    unsigned i = 0;
+    for (unsigned bit = 4; bit <= 28; bit += 2) {
+        uint64_t bound = uint64_t(1) << bit;
+        for (; lower(i + 1) <= bound; i++) cumulative += m_buckets[i].load(memory_order_relaxed);
+        ostringstream le;
+        le << setprecision(9) << bound / 1e6;
+        _out << _name << "_bucket{" << _labels << ",le=\"" << le.str() << "\"} " << cumulative << "\n";
+    }
+    _out << _name << "_bucket{" << _labels << ",le=\"+Inf\"} " << count() << "\n"
+         << _name << "_sum{" << _labels << "} " << sum() / 1e6 << "\n"
+         << _name << "_count{" << _labels << "} " << count() << "\n";
+}
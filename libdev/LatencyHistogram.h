@@ -0,0 +1,60 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace dev {
+
+// Lock free log-linear (HDR style) histogram of durations in microseconds.
+// Every power of two range is split in 8 linear sub buckets so a recorded
+// value is known within 12.5% from 1 us up to about 19 hours, above which
+// values saturate in the last bucket. Recording costs a few relaxed atomic
+// increments and may run on any thread; readers get a consistent enough
+// view without stopping writers.
+class LatencyHistogram {
+public:
+    static const unsigned s_subBits = 3;
+    static const unsigned s_subBuckets = 1 << s_subBits;
+    static const unsigned s_groups = 34;   // Up to 2^36 us
+    static const unsigned s_buckets = s_groups * s_subBuckets;
+
+    void record(uint64_t _us);
+    void record(std::chrono::steady_clock::duration _elapsed) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(_elapsed).count();
+        record(uint64_t(us > 0 ? us : 0));
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    // Value (us) at or below which _p percent of recorded values lie
+    uint64_t percentile(double _p) const;
+
+    // Writes _name_bucket, _name_sum and _name_count samples of a Prometheus
+    // histogram in seconds (the # HELP and # TYPE lines are left to caller)
+    void prometheus(std::ostream& _out, std::string const& _name, std::string const& _labels) const;
+
+private:
+    static unsigned index(uint64_t _us);
+    static uint64_t lower(unsigned _index);
+
+    std::atomic<uint64_t> m_buckets[s_buckets] = {};
+    std::atomic<uint64_t> m_count = {0};
+    std::atomic<uint64_t> m_sum = {0};
+    std::atomic<uint64_t> m_max = {0};
+};
+
+}   // namespace dev
@@ -1,4 +1,3 @@
-
 /* Copyright (C) 1883 Thomas Edison - All Rights Reserved
  * You may use, distribute and modify this code under the
  * terms of the GPLv3 license, which unfortunately won't be
@@ -10,9 +9,26 @@
 
 #include "Log.h"
 
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <thread>
+#include <utility>
+
+#if !defined(_WIN32)
+#    include <fcntl.h>
+#    include <sys/socket.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#endif
 
 using namespace std;
 using namespace dev;
@@ -21,65 +37,604 @@ using namespace dev;
 unsigned g_logOptions = 0;
 bool g_logNoColor = false;
 bool g_logSyslog = false;
+bool g_logEvents = false;
 
-LogOutputStreamBase::LogOutputStreamBase(int severity) {
-    static const char* color[4] = {EthWhite, EthYellow, EthRed, EthGreen};
-    if (g_logSyslog) m_sstr << left << setw(5) << getThreadName() << " " EthReset;
-    else {
-        auto t = chrono::system_clock::to_time_t(chrono::system_clock::now());
-        m_sstr << EthGray << put_time(localtime(&t), "%X") << ' ' << color[severity] << left << setw(5) << getThreadName() << " " EthReset;
+namespace {
+
+struct LogEntry {
+    chrono::system_clock::time_point when;
+    int severity = 0;
+    char const* file = nullptr;
+    int line = 0;
+    string thread;
+    string text;
+    vector<LogField> fields;
+};
+
+// Bounded lock free multi producer queue (after Dmitry Vyukov's): each slot
+// carries a sequence number telling producers and the consumer whose turn
+// it is, so a push or pop is a single CAS on the shared position. Lines
+// which aren't critical only get s_size - s_reserve slots, the reserve
+// leaves room for critical lines in a flood.
+class LogRing {
+public:
+    static const size_t s_size = 4096;   // Power of 2
+    static const size_t s_reserve = s_size / 8;
+
+    LogRing() {
+        for (size_t i = 0; i < s_size; i++) m_slots[i].seq.store(i, memory_order_relaxed);
     }
-}
 
-/// Associate a name with each thread for nice logging.
-struct ThreadLocalLogName {
-    ThreadLocalLogName(char const* _name) { name = _name; }
-    thread_local static char const* name;
+    bool push(LogEntry&& _entry, bool _critical) {
+        size_t pos = m_tail.load(memory_order_relaxed);
+        for (;;) {
+            Slot& slot = m_slots[pos & (s_size - 1)];
+            intptr_t dif = intptr_t(slot.seq.load(memory_order_acquire)) - intptr_t(pos);
+            if (dif == 0) {
+                if (!_critical && pos - m_head.load(memory_order_relaxed) >= s_size - s_reserve) return false;
+                if (m_tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    slot.entry = std::move(_entry);
+                    slot.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0)
+                return false;   // Full
+            else
+                pos = m_tail.load(memory_order_relaxed);
+        }
+    }
+
+    // Single consumer
+    bool pop(LogEntry& _entry) {
+        size_t pos = m_head.load(memory_order_relaxed);
+        Slot& slot = m_slots[pos & (s_size - 1)];
+        if (intptr_t(slot.seq.load(memory_order_acquire)) - intptr_t(pos + 1) < 0) return false;
+        _entry = std::move(slot.entry);
+        slot.seq.store(pos + s_size, memory_order_release);
+        m_head.store(pos + 1, memory_order_relaxed);
+        return true;
+    }
+
+    bool empty() const { return m_head.load(memory_order_relaxed) == m_tail.load(memory_order_relaxed); }
+
+private:
+    struct Slot {
+        atomic<size_t> seq;
+        LogEntry entry;
+    };
+
+    alignas(64) atomic<size_t> m_tail = {0};
+    alignas(64) atomic<size_t> m_head = {0};
+    unique_ptr<Slot[]> m_slots{new Slot[s_size]};
+};
+
+// Formats log lines, caching the time of day of the current second
+class LogFormatter {
+public:
+    void format(LogEntry const& _entry, string& _out) {
+        static const char* color[4] = {EthWhite, EthYellow, EthRed, EthGreen};
+        string line;
+        if (!g_logSyslog) {
+            time_t t = chrono::system_clock::to_time_t(_entry.when);
+            if (t != m_second) {
+                tm local;
+#if defined(_WIN32)
+                localtime_s(&local, &t);
+#else
+                localtime_r(&t, &local);
+#endif
+                char buf[32];
+                m_time.assign(buf, strftime(buf, sizeof(buf), "%X", &local));
+                m_second = t;
+            }
+            line = EthGray + m_time + ' ' + color[_entry.severity];
+        }
+        line += _entry.thread;
+        if (_entry.thread.size() < 5) line.append(5 - _entry.thread.size(), ' ');
+        line += " " EthReset;
+        line += _entry.text;
+        append(line, _out);
+    }
+
+    // Appends _line (stripped of colors if so set) and a new line to _out
+    static void append(string const& _line, string& _out) {
+        if (!g_logNoColor) _out += _line;
+        else strip(_line, _out);
+        _out += '\n';
+    }
+
+    // Appends _line stripped of colors to _out
+    static void strip(string const& _line, string& _out) {
+        for (size_t pos = 0; pos < _line.size();) {
+            size_t esc = _line.find('\x1b', pos);
+            _out.append(_line, pos, esc == string::npos ? string::npos : esc - pos);
+            if (esc == string::npos) break;
+            size_t m = _line.find('m', esc);
+            pos = (m == string::npos ? _line.size() : m + 1);
+        }
+    }
+
+private:
+    time_t m_second = -1;
+    string m_time;
+};
+
+// Structured events of log entries: the entry's time (microseconds since
+// the Unix epoch), severity, thread, call site and text without colors,
+// followed by its fields
+class LogEventEncoder {
+public:
+    static void json(LogEntry const& _entry, string& _out) {
+        static const char* severity[4] = {"note", "warn", "crit", "extra"};
+        _out += "{\"ts\":" + to_string(micros(_entry)) + ",\"sev\":\"" + severity[_entry.severity] + "\",\"thread\":";
+        jsonString(_entry.thread, _out);
+        if (_entry.file) {
+            _out += ",\"src\":";
+            jsonString(site(_entry), _out);
+        }
+        _out += ",\"msg\":";
+        jsonString(text(_entry), _out);
+        for (LogField const& f: _entry.fields) {
+            _out += ",\"";
+            _out += f.name;
+            _out += "\":";
+            switch (f.type) {
+                case LogField::Type::Int: _out += to_string(f.i); break;
+                case LogField::Type::Float: _out += number(f.d); break;
+                case LogField::Type::String: jsonString(f.s, _out); break;
+            }
+        }
+        _out += "}\n";
+    }
+
+    // Record: u32 size of the rest, u64 time, u8 severity, then fields (u8
+    // type, u8 name size, name, value) up to the end. Values are i64, f64
+    // or u32 size and bytes (LogField::Type). Integers are little endian.
+    static void binary(LogEntry const& _entry, string& _out) {
+        size_t start = _out.size();
+        _out.append(4, '\0');
+        put(uint64_t(micros(_entry)), 8, _out);
+        put(uint64_t(_entry.severity), 1, _out);
+        string stripped = text(_entry);
+        binaryString("thread", _entry.thread, _out);
+        if (_entry.file) binaryString("src", site(_entry), _out);
+        binaryString("msg", stripped, _out);
+        for (LogField const& f: _entry.fields) {
+            switch (f.type) {
+                case LogField::Type::Int:
+                    name(f.type, f.name, _out);
+                    put(uint64_t(f.i), 8, _out);
+                    break;
+                case LogField::Type::Float: {
+                    uint64_t bits;
+                    memcpy(&bits, &f.d, sizeof(bits));
+                    name(f.type, f.name, _out);
+                    put(bits, 8, _out);
+                    break;
+                }
+                case LogField::Type::String: binaryString(f.name, f.s, _out); break;
+            }
+        }
+        uint64_t size = _out.size() - start - 4;
+        for (unsigned i = 0; i < 4; i++) _out[start + i] = char(size >> (8 * i));
+    }
+
+private:
+    static int64_t micros(LogEntry const& _entry) { return chrono::duration_cast<chrono::microseconds>(_entry.when.time_since_epoch()).count(); }
+
+    static string site(LogEntry const& _entry) {
+        char const* file = strrchr(_entry.file, '/');
+        return string(file ? file + 1 : _entry.file) + ":" + to_string(_entry.line);
+    }
+
+    static string text(LogEntry const& _entry) {
+        string ret;
+        LogFormatter::strip(_entry.text, ret);
+        return ret;
+    }
+
+    static string number(double _d) {
+        if (!isfinite(_d)) return "null";
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.10g", _d);
+        return buf;
+    }
+
+    static void jsonString(string const& _s, string& _out) {
+        _out += '"';
+        for (char c: _s) switch (c) {
+                case '"': _out += "\\\""; break;
+                case '\\': _out += "\\\\"; break;
+                case '\n': _out += "\\n"; break;
+                case '\r': _out += "\\r"; break;
+                case '\t': _out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+                        _out += buf;
+                    } else
+                        _out += c;
+            }
+        _out += '"';
+    }
+
+    static void put(uint64_t _v, unsigned _bytes, string& _out) {
+        for (unsigned i = 0; i < _bytes; i++) _out += char(_v >> (8 * i));
+    }
+
+    static void name(LogField::Type _type, char const* _name, string& _out) {
+        size_t size = min(strlen(_name), size_t(255));
+        put(uint64_t(_type), 1, _out);
+        put(size, 1, _out);
+        _out.append(_name, size);
+    }
+
+    static void binaryString(char const* _name, string const& _s, string& _out) {
+        name(LogField::Type::String, _name, _out);
+        put(_s.size(), 4, _out);
+        _out += _s;
+    }
+};
+
+// Destination of structured events, written by the writer thread only. A
+// socket is (re)connected to at most every s_retry, events written while
+// it is down are lost. The socket never blocks the writer : events it
+// can't take right away are dropped and counted, only the rest of a batch
+// already partly sent is kept so the reader never sees a truncated event.
+class LogEventSink {
+public:
+    static constexpr chrono::seconds s_retry = chrono::seconds(5);
+
+    LogEventSink(string const& _target, bool _binary) : m_binary(_binary) {
+        if (_target.compare(0, 5, "unix:") == 0) {
+#if defined(_WIN32)
+            throw runtime_error("Unix sockets are not supported on this platform: " + _target);
+#else
+            m_path = _target.substr(5);
+            if (m_path.empty() || m_path.size() >= sizeof(sockaddr_un::sun_path)) throw runtime_error("Invalid log events socket: " + _target);
+            m_socket = true;
+#endif
+        } else {
+            m_file.open(_target, ios::out | ios::app | ios::binary);
+            if (!m_file) throw runtime_error("Can't open log events file: " + _target);
+        }
+    }
+
+    ~LogEventSink() { disconnect(); }
+
+    bool binary() const { return m_binary; }
+
+    // Events dropped because the socket was full since last call
+    uint64_t dropped() { return exchange(m_dropped, 0); }
+
+    void write(string const& _events, unsigned _count) {
+        if (!m_socket) {
+            m_file.write(_events.data(), streamsize(_events.size()));
+            m_file.flush();
+            if (!m_file) m_file.clear();
+            return;
+        }
+#if !defined(_WIN32)
+        if (m_fd < 0 && !connect()) return;
+
+        // Rest of an interrupted batch goes first
+        if (!m_rest.empty()) {
+            size_t sent = 0;
+            Sent result = send(m_rest, sent);
+            if (result == Sent::Failed) {
+                disconnect();
+                return;
+            }
+            m_rest.erase(0, sent);
+            if (result == Sent::Blocked) {
+                m_dropped += _count;
+                return;
+            }
+        }
+
+        size_t sent = 0;
+        Sent result = send(_events, sent);
+        if (result == Sent::Failed) disconnect();
+        else if (result == Sent::Blocked) {
+            if (sent) m_rest.assign(_events, sent, string::npos);
+            else
+                m_dropped += _count;
+        }
+#endif
+    }
+
+private:
+#if !defined(_WIN32)
+    enum class Sent { All, Blocked, Failed };
+
+    Sent send(string const& _data, size_t& _sent) {
+        while (_sent < _data.size()) {
+#    if defined(MSG_NOSIGNAL)
+            ssize_t n = ::send(m_fd, _data.data() + _sent, _data.size() - _sent, MSG_NOSIGNAL);
+#    else
+            ssize_t n = ::send(m_fd, _data.data() + _sent, _data.size() - _sent, 0);
+#    endif
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return Sent::Blocked;
+            if (n <= 0) return Sent::Failed;
+            _sent += size_t(n);
+        }
+        return Sent::All;
+    }
+
+    bool connect() {
+        auto now = chrono::steady_clock::now();
+        if (now < m_retry) return false;
+        m_retry = now + s_retry;
+        m_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m_fd < 0) return false;
+#    if defined(SO_NOSIGPIPE)
+        int on = 1;
+        setsockopt(m_fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#    endif
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, m_path.c_str(), m_path.size());
+        if (::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            disconnect();
+            return false;
+        }
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+#endif
+
+    void disconnect() {
+#if !defined(_WIN32)
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+#endif
+        m_rest.clear();
+    }
+
+    bool m_binary;
+    bool m_socket = false;
+    ofstream m_file;
+    string m_path;
+    int m_fd = -1;
+    string m_rest;   // Unsent end of a partly sent batch
+    uint64_t m_dropped = 0;
+    chrono::steady_clock::time_point m_retry;
 };
 
-thread_local char const* ThreadLocalLogName::name;
+// Background writer draining the ring to stdout (and structured events to
+// their sink). Repetitive lines are rate limited by call site (token bucket)
+// and what gets suppressed or dropped is summed up in a line of its own.
+class LogWriter {
+public:
+    static constexpr double s_siteRate = 10.0;    // Lines per second a call site may sustain
+    static constexpr double s_siteBurst = 50.0;   // Lines a call site may burst
 
-ThreadLocalLogName g_logThreadName("main");
+    LogWriter() : m_thread([this] { run(); }) {}
+
+    ~LogWriter() {
+        m_stop.store(true, memory_order_release);
+        m_wake.notify_one();
+        m_thread.join();
+    }
+
+    void post(LogEntry&& _entry) {
+        bool critical = (_entry.severity == CritChannel::severity);
+        if (!m_ring.push(std::move(_entry), critical)) {
+            m_dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        // Only sleeping writers need a call, a missed one costs a timeout
+        if (m_sleeping.load(memory_order_relaxed)) m_wake.notify_one();
+    }
+
+    void events(shared_ptr<LogEventSink> _sink) {
+        lock_guard<mutex> l(x_sink);
+        m_sink = std::move(_sink);
+    }
+
+    void flush() {
+        for (int i = 0; i < 200 && (!m_ring.empty() || m_writing.load(memory_order_acquire)); i++) {
+            m_wake.notify_one();
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+    }
+
+private:
+    struct Site {
+        double tokens = s_siteBurst;
+        chrono::system_clock::time_point last;
+        uint64_t suppressed = 0;
+    };
+
+    bool allow(LogEntry const& _entry) {
+        if (_entry.severity == CritChannel::severity || !_entry.file) return true;
+        auto it = m_sites.find({_entry.file, _entry.line});
+        if (it == m_sites.end()) it = m_sites.emplace(make_pair(_entry.file, _entry.line), Site{s_siteBurst, _entry.when, 0}).first;
+        Site& site = it->second;
+        double elapsed = chrono::duration<double>(_entry.when - site.last).count();
+        if (elapsed > 0) {
+            site.tokens = min(s_siteBurst, site.tokens + elapsed * s_siteRate);
+            site.last = _entry.when;
+        }
+        if (site.tokens >= 1.0) {
+            site.tokens -= 1.0;
+            return true;
+        }
+        site.suppressed++;
+        return false;
+    }
+
+    void write(LogEntry const& _entry, LogEventSink const* _sink, string& _out, string& _events) {
+        m_formatter.format(_entry, _out);
+        if (!_sink) return;
+        if (_sink->binary()) LogEventEncoder::binary(_entry, _events);
+        else LogEventEncoder::json(_entry, _events);
+        m_batched++;
+    }
+
+    void notice(string const& _text, LogEventSink const* _sink, string& _out, string& _events) {
+        LogEntry entry;
+        entry.when = chrono::system_clock::now();
+        entry.severity = WarnChannel::severity;
+        entry.thread = "log";
+        entry.text = _text;
+        write(entry, _sink, _out, _events);
+    }
+
+    void run() {
+        setThreadName("log");
+        LogEntry entry;
+        string out, events;
+        auto lastSweep = chrono::steady_clock::now();
+        for (;;) {
+            bool stop = m_stop.load(memory_order_acquire);
+            m_writing.store(true, memory_order_relaxed);
+            out.clear();
+            events.clear();
+            m_batched = 0;
+            shared_ptr<LogEventSink> sink;
+            {
+                lock_guard<mutex> l(x_sink);
+                sink = m_sink;
+            }
+            for (unsigned n = 0; n < 256 && m_ring.pop(entry); n++)
+                if (allow(entry)) write(entry, sink.get(), out, events);
+
+            if (uint64_t dropped = m_dropped.exchange(0, memory_order_relaxed))
+                notice(to_string(dropped) + " log lines dropped (queue full)", sink.get(), out, events);
+            auto now = chrono::steady_clock::now();
+            if (now - lastSweep >= chrono::seconds(1)) {
+                lastSweep = now;
+                for (auto& site: m_sites)
+                    if (site.second.suppressed) {
+                        char const* file = strrchr(site.first.first, '/');
+                        notice(to_string(site.second.suppressed) + " similar log lines from " + (file ? file + 1 : site.first.first) + ":" +
+                                   to_string(site.first.second) + " suppressed",
+                               sink.get(), out, events);
+                        site.second.suppressed = 0;
+                    }
+                // Once a second at most : the notice itself may not get through
+                if (uint64_t dropped = sink ? sink->dropped() : 0)
+                    notice(to_string(dropped) + " log events dropped (events socket full)", sink.get(), out, events);
+            }
+
+            if (!out.empty()) {
+                try {
+                    cout.write(out.data(), streamsize(out.size()));
+                    cout.flush();
+                } catch (...) {
+                }
+                if (sink && !events.empty()) sink->write(events, m_batched);
+                continue;
+            }
+            m_writing.store(false, memory_order_release);
+            if (stop) break;
+
+            m_sleeping.store(true, memory_order_relaxed);
+            {
+                unique_lock<mutex> l(x_wake);
+                if (m_ring.empty() && !m_stop.load(memory_order_acquire)) m_wake.wait_for(l, chrono::milliseconds(100));
+            }
+            m_sleeping.store(false, memory_order_relaxed);
+        }
+    }
+
+    LogRing m_ring;
+    LogFormatter m_formatter;                    // Writer thread only
+    map<pair<char const*, int>, Site> m_sites;   // Writer thread only
+    unsigned m_batched = 0;                      // Events in the batch being built (writer thread only)
+    mutex x_sink;
+    shared_ptr<LogEventSink> m_sink;
+    atomic<uint64_t> m_dropped = {0};
+    atomic<bool> m_stop = {false};
+    atomic<bool> m_sleeping = {false};
+    atomic<bool> m_writing = {false};
+    mutex x_wake;
+    condition_variable m_wake;
+    thread m_thread;   // Last, started once all the above is built
+};
+
+// Writer state: lines posted while constructing or after destroying the
+// static writer (at exit) are written synchronously
+enum class WriterState { None, Alive, Gone };
+atomic<WriterState> s_writerState = {WriterState::None};
+
+struct LogWriterHolder {
+    LogWriterHolder() { s_writerState.store(WriterState::Alive, memory_order_release); }
+    ~LogWriterHolder() {
+        writer.reset();
+        s_writerState.store(WriterState::Gone, memory_order_release);
+    }
+    unique_ptr<LogWriter> writer{new LogWriter};
+};
+
+LogWriter* logWriter() {
+    if (s_writerState.load(memory_order_acquire) == WriterState::Gone) return nullptr;
+    static LogWriterHolder holder;
+    return holder.writer.get();
+}
+
+thread_local string t_threadName;
+
+}   // namespace
+
+void dev::logPost(int _severity, char const* _file, int _line, string&& _text, vector<LogField>&& _fields) {
+    LogEntry entry;
+    entry.when = chrono::system_clock::now();
+    entry.severity = _severity;
+    entry.file = _file;
+    entry.line = _line;
+    entry.thread = getThreadName();
+    entry.text = std::move(_text);
+    entry.fields = std::move(_fields);
+    if (LogWriter* writer = logWriter()) writer->post(std::move(entry));
+    else {
+        LogFormatter formatter;
+        string out;
+        formatter.format(entry, out);
+        out.pop_back();
+        simpleDebugOut(out);
+    }
+}
+
+void dev::flushLog() {
+    if (LogWriter* writer = logWriter()) writer->flush();
+}
+
+void dev::setLogEvents(string const& _target, bool _binary) {
+    auto sink = make_shared<LogEventSink>(_target, _binary);
+    if (LogWriter* writer = logWriter()) writer->events(std::move(sink));
+    g_logEvents = true;
+}
 
 string dev::getThreadName() {
+    if (t_threadName.empty()) {
 #if defined(__linux__)
-    char buffer[128];
-    pthread_getname_np(pthread_self(), buffer, 127);
-    buffer[127] = 0;
-    return buffer;
+        char buffer[128];
+        pthread_getname_np(pthread_self(), buffer, 127);
+        buffer[127] = 0;
+        t_threadName = buffer;
 #else
-    if (ThreadLocalLogName::name) return ThreadLocalLogName::name;
-    setThreadName("miner");
-    return "miner";
+        t_threadName = "miner";
 #endif
+    }
+    return t_threadName;
 }
 
 void dev::setThreadName(char const* _n) {
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), _n);
-#else
-    ThreadLocalLogName::name = _n;
 #endif
+    t_threadName = _n;
 }
 
 void dev::simpleDebugOut(string const& _s) {
     try {
-        if (!g_logNoColor) {
-            cout << _s + '\n';
-            cout.flush();
-            return;
-        }
-        bool skip = false;
-        stringstream ss;
-        for (auto it: _s) {
-            if (!skip && it == '\x1b') skip = true;
-            else if (skip && it == 'm')
-                skip = false;
-            else if (!skip)
-                ss << it;
-        }
-        ss << '\n';
-        cout << ss.str();
+        string out;
+        LogFormatter::append(_s, out);
+        cout << out;
         cout.flush();
     } catch (...) { return; }
 }
@@ -11,6 +11,7 @@
 
 #include <chrono>
 #include <ctime>
+#include <type_traits>
 
 #include "Common.h"
 #include "CommonData.h"
@@ -34,11 +35,44 @@
 extern unsigned g_logOptions;
 extern bool g_logNoColor;
 extern bool g_logSyslog;
+extern bool g_logEvents;
 
 namespace dev {
+/// Typed field of a structured log event. Shifted into a log line it adds
+/// nothing to the text, only to the event (see setLogEvents). Names must be
+/// string literals (only the pointer is kept).
+struct LogField {
+    enum class Type : uint8_t { Int = 1, Float = 2, String = 3 };
+
+    template<class T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    LogField(char const* _name, T _value) : name(_name), type(Type::Int), i(int64_t(_value)) {}
+    LogField(char const* _name, double _value) : name(_name), type(Type::Float), d(_value) {}
+    LogField(char const* _name, std::string _value) : name(_name), type(Type::String), s(std::move(_value)) {}
+
+    char const* name;
+    Type type;
+    int64_t i = 0;
+    double d = 0;
+    std::string s;
+};
+
 /// A simple log-output function that prints log messages to stdout.
 void simpleDebugOut(std::string const&);
 
+/// Queues a log line for the writer thread. Never blocks: when the queue is
+/// full the line is dropped (and the drop reported later on)
+void logPost(int _severity, char const* _file, int _line, std::string&& _text, std::vector<LogField>&& _fields = {});
+
+/// Waits (a bounded time) for queued log lines to be written out.
+void flushLog();
+
+/// Also writes every log line, with its fields, as a structured event to
+/// _target: a file (appended to) or, prefixed with "unix:", a Unix stream
+/// socket the writer thread (re)connects to. Events are JSON lines or,
+/// if _binary, length prefixed binary records. Throws if the file can't
+/// be opened.
+void setLogEvents(std::string const& _target, bool _binary);
+
 /// Set the current thread's log name.
 void setThreadName(char const* _n);
 
@@ -67,12 +101,16 @@ struct ExtraChannel : public LogChannel {
 
 class LogOutputStreamBase {
 public:
-    LogOutputStreamBase(int error);
+    LogOutputStreamBase(int _severity, char const* _file, int _line) : m_severity(_severity), m_file(_file), m_line(_line) {}
 
     template<class T> void append(T const& _t) { m_sstr << _t; }
 
 protected:
-    std::stringstream m_sstr;   ///< The accrued log entry.
+    std::stringstream m_sstr;         ///< The accrued log entry.
+    std::vector<LogField> m_fields;   ///< The accrued event fields (when events are written).
+    int m_severity;
+    char const* m_file;   ///< Call site (lines are rate limited by site)
+    int m_line;
 };
 
 /// Logging class, iostream-like, that can be shifted to.
@@ -81,10 +119,16 @@ public:
     /// Construct a new object.
     /// If _term is true the the prefix info is terminated with a ']' character; if not it ends only
     /// with a '|' character.
-    LogOutputStream() : LogOutputStreamBase(I::severity) {}
+    LogOutputStream(char const* _file = nullptr, int _line = 0) : LogOutputStreamBase(I::severity, _file, _line) {}
+
+    /// Destructor. Posts the accrued log entry to the writer thread.
+    ~LogOutputStream() { logPost(m_severity, m_file, m_line, m_sstr.str(), std::move(m_fields)); }
 
-    /// Destructor. Posts the accrued log entry to the g_logPost function.
-    ~LogOutputStream() { simpleDebugOut(m_sstr.str()); }
+    /// Shift a field to the structured event of the line.
+    LogOutputStream& operator<<(LogField&& _f) {
+        if (g_logEvents) m_fields.push_back(std::move(_f));
+        return *this;
+    }
 
     /// Shift arbitrary data to the log. Spaces will be added between items as required.
     template<class T> LogOutputStream& operator<<(T const& _t) {
@@ -93,7 +137,7 @@ public:
     }
 };
 
-#define clog_(X) dev::LogOutputStream<X>()
+#define clog_(X) dev::LogOutputStream<X>(__FILE__, __LINE__)
 
 // Simple cout-like stream objects for accessing common log channels.
 // Dirties the global namespace, but oh so convenient...
@@ -0,0 +1,118 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+
+#include "Log.h"
+#include "Trace.h"
+
+using namespace std;
+using namespace dev;
+
+atomic<bool> Trace::s_enabled = {false};
+mutex Trace::s_mutex;
+vector<shared_ptr<Trace::Ring>> Trace::s_rings;
+
+void Trace::enable(bool _enable) { s_enabled.store(_enable, memory_order_relaxed); }
+
+Trace::Ring& Trace::ring() {
+    thread_local shared_ptr<Ring> t_ring;
+    if (!t_ring) {
+        auto r = make_shared<Ring>();
+        r->thread = getThreadName();
+        lock_guard<mutex> l(s_mutex);
+        r->tid = unsigned(s_rings.size() + 1);
+        s_rings.push_back(r);
+        t_ring = r;
+    }
+    return *t_ring;
+}
+
+void Trace::record(char const* _name, char _phase, uint32_t _job, int64_t _value) {
+    Ring& r = ring();
+    uint64_t head = r.head.load(memory_order_relaxed);
+    TraceEvent& e = r.events[head % s_ringSize];
+    e.ts = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    e.name = _name;
+    e.phase = _phase;
+    e.job = _job;
+    e.value = _value;
+    r.head.store(head + 1, memory_order_release);
+}
+
+size_t Trace::size() {
+    lock_guard<mutex> l(s_mutex);
+    size_t n = 0;
+    for (auto const& r: s_rings) {
+        uint64_t head = r->head.load(memory_order_acquire);
+        n += size_t(head - max(r->tail.load(memory_order_relaxed), head > s_ringSize ? head - s_ringSize : 0));
+    }
+    return n;
+}
+
+void Trace::clear() {
+    lock_guard<mutex> l(s_mutex);
+    for (auto const& r: s_rings) r->tail.store(r->head.load(memory_order_acquire), memory_order_relaxed);
+}
+
+string Trace::chromeJson() {
+    // Rings are read while their threads keep writing: events are copied
+    // first, then the ones the writer may have overwritten meanwhile dropped
+    vector<pair<shared_ptr<Ring>, vector<TraceEvent>>> copies;
+    {
+        lock_guard<mutex> l(s_mutex);
+        for (auto const& r: s_rings) {
+            uint64_t head = r->head.load(memory_order_acquire);
+            uint64_t from = max(r->tail.load(memory_order_relaxed), head > s_ringSize ? head - s_ringSize : 0);
+            vector<TraceEvent> events;
+            events.reserve(size_t(head - from));
+            for (uint64_t i = from; i < head; i++) events.push_back(r->events[i % s_ringSize]);
+            // A write in progress (not yet counted in head) also spoils a slot
+            uint64_t overwritten = r->head.load(memory_order_acquire) + 1;
+            overwritten = overwritten > s_ringSize ? overwritten - s_ringSize : 0;
+            if (overwritten > from) events.erase(events.begin(), events.begin() + ptrdiff_t(min(overwritten - from, uint64_t(events.size()))));
+            copies.emplace_back(r, std::move(events));
+        }
+    }
+
+    int64_t origin = numeric_limits<int64_t>::max();
+    for (auto const& c: copies)
+        if (!c.second.empty()) origin = min(origin, c.second.front().ts);
+
+    ostringstream out;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    char buf[64];
+    for (auto const& c: copies) {
+        string thread;
+        for (char ch: c.first->thread)
+            if (ch != '"' && ch != '\\' && ch >= ' ') thread += ch;
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << c.first->tid << ",\"args\":{\"name\":\"" << thread << "\"}}";
+        first = false;
+        for (auto const& e: c.second) {
+            snprintf(buf, sizeof(buf), "%.3f", double(e.ts - origin) / 1000.0);
+            out << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase << "\"," << (e.phase == 'i' ? "\"s\":\"t\"," : "") << "\"pid\":1,\"tid\":" << c.first->tid
+                << ",\"ts\":" << buf << ",";
+            if (e.phase == 'b' || e.phase == 'e') out << "\"cat\":\"" << e.name << "\",\"id\":\"" << c.first->tid << "." << e.value << "\",";
+            out << "\"args\":{";
+            if (e.job) {
+                snprintf(buf, sizeof(buf), "%08x", e.job);
+                out << "\"job\":\"" << buf << "\"" << (e.value ? "," : "");
+            }
+            if (e.value) out << "\"value\":" << e.value;
+            out << "}}";
+        }
+    }
+    out << "\n]}\n";
+    return out.str();
+}
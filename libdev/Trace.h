@@ -0,0 +1,95 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "FixedHash.h"
+
+namespace dev {
+
+// Timestamped trace point. Names must be string literals (only the
+// pointer is kept)
+struct TraceEvent {
+    int64_t ts;         // steady_clock nanoseconds
+    char const* name;
+    char phase;         // 'B'egin, 'E'nd, 'i'nstant, async 'b'egin or 'e'nd (Chrome trace phases)
+    uint32_t job;       // First 4 bytes of the job header (0 if none)
+    int64_t value;      // Miner index, nonce, milliseconds ... (event dependent)
+};
+
+// Job timeline tracing.
+// Compiled in but disabled by default: a disabled trace point costs a
+// relaxed atomic load. Once enabled each thread records into its own ring
+// of the latest s_ringSize events, without locking nor allocating (but for
+// the ring itself on the first event of a thread). Rings outlive their
+// threads and are dumped on request as Chrome trace JSON, which Perfetto
+// (ui.perfetto.dev) and chrome://tracing open.
+class Trace {
+public:
+    static const size_t s_ringSize = 8192;   // Events kept per thread
+
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void enable(bool _enable);
+
+    static void instant(char const* _name, uint32_t _job = 0, int64_t _value = 0) {
+        if (enabled()) record(_name, 'i', _job, _value);
+    }
+    static void begin(char const* _name, uint32_t _job = 0, int64_t _value = 0) {
+        if (enabled()) record(_name, 'B', _job, _value);
+    }
+    static void end(char const* _name, uint32_t _job = 0, int64_t _value = 0) {
+        if (enabled()) record(_name, 'E', _job, _value);
+    }
+
+    // Spans which may overlap (e.g. kernels queued on several streams),
+    // paired by _id among the ones of the calling thread
+    static void launch(char const* _name, uint32_t _job, int64_t _id) {
+        if (enabled()) record(_name, 'b', _job, _id);
+    }
+    static void complete(char const* _name, uint32_t _job, int64_t _id) {
+        if (enabled()) record(_name, 'e', _job, _id);
+    }
+
+    // Id of a job in trace events
+    static uint32_t job(h256 const& _header) { return uint32_t(_header[0]) << 24 | uint32_t(_header[1]) << 16 | uint32_t(_header[2]) << 8 | _header[3]; }
+
+    // Events currently buffered (all threads)
+    static size_t size();
+
+    // Buffered events as Chrome trace JSON ({"traceEvents": [...]})
+    static std::string chromeJson();
+
+    // Forgets all buffered events
+    static void clear();
+
+private:
+    struct Ring {
+        std::string thread;
+        unsigned tid;
+        std::atomic<uint64_t> head = {0};   // Events ever recorded (next slot is head % s_ringSize)
+        std::atomic<uint64_t> tail = {0};   // Events before tail are cleared
+        std::unique_ptr<TraceEvent[]> events{new TraceEvent[s_ringSize]};
+    };
+
+    static void record(char const* _name, char _phase, uint32_t _job, int64_t _value);
+    static Ring& ring();
+
+    static std::atomic<bool> s_enabled;
+    static std::mutex s_mutex;
+    static std::vector<std::shared_ptr<Ring>> s_rings;
+};
+
+}   // namespace dev
@@ -0,0 +1,117 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <cmath>
+
+#include "EffectiveHashRate.h"
+
+using namespace std;
+using namespace dev::eth;
+
+const array<unsigned, EffectiveHashRate::s_windows> EffectiveHashRate::s_windowMinutes = {15, 60, 360};
+
+namespace {
+const double c_z = 1.96;   // Two sided 95%
+
+// Bounds of the confidence interval of a Poisson count _n
+double poissonLow(uint64_t _n) {
+    if (!_n) return 0;
+    double n = double(_n);
+    return n * pow(1.0 - 1.0 / (9.0 * n) - c_z / (3.0 * sqrt(n)), 3);
+}
+
+double poissonHigh(uint64_t _n) {
+    double n = double(_n + 1);
+    return n * pow(1.0 - 1.0 / (9.0 * n) + c_z / (3.0 * sqrt(n)), 3);
+}
+}   // namespace
+
+void EffectiveHashRate::start(chrono::steady_clock::time_point _when) {
+    if (m_started) return;
+    m_started = true;
+    m_start = _when;
+    m_lastHashesAt = _when;
+}
+
+int64_t EffectiveHashRate::minute(chrono::steady_clock::time_point _when) const {
+    return max(int64_t(0), int64_t(chrono::duration_cast<chrono::minutes>(_when - m_start).count()));
+}
+
+EffectiveHashRate::Bucket& EffectiveHashRate::bucket(int64_t _minute) {
+    Bucket& b = m_buckets[size_t(_minute % s_buckets)];
+    if (b.minute != _minute) {
+        b = Bucket();
+        b.minute = _minute;
+    }
+    return b;
+}
+
+void EffectiveHashRate::share(double _difficulty, chrono::steady_clock::time_point _when) {
+    lock_guard<mutex> l(x_buckets);
+    start(_when);
+    Bucket& b = bucket(minute(_when));
+    b.shares++;
+    b.difficulty += _difficulty;
+    m_lastDifficulty = _difficulty;
+}
+
+void EffectiveHashRate::hashes(uint64_t _total, chrono::steady_clock::time_point _when) {
+    lock_guard<mutex> l(x_buckets);
+    if (!_total && !m_started) return;
+    start(_when);
+    Bucket& b = bucket(minute(_when));
+    if (!b.sampled) {
+        b.sampled = true;
+        b.hashes = _total;
+        b.sampledAt = _when;
+    }
+    m_lastHashes = _total;
+    m_lastHashesAt = _when;
+}
+
+double EffectiveHashRate::lastDifficulty() const {
+    lock_guard<mutex> l(x_buckets);
+    return m_lastDifficulty;
+}
+
+array<EffectiveHashRateType, EffectiveHashRate::s_windows> EffectiveHashRate::estimates(chrono::steady_clock::time_point _now, double _difficulty) const {
+    lock_guard<mutex> l(x_buckets);
+    array<EffectiveHashRateType, s_windows> ret;
+    int64_t current = minute(_now);
+    for (unsigned w = 0; w < s_windows; w++) {
+        EffectiveHashRateType& e = ret[w];
+        e.minutes = s_windowMinutes[w];
+        if (!m_started) continue;
+        int64_t from = max(int64_t(0), current - int64_t(e.minutes) + 1);
+        e.seconds = chrono::duration<double>(_now - (m_start + chrono::minutes(from))).count();
+        if (e.seconds <= 0) continue;
+
+        double difficulty = 0;
+        Bucket const* oldest = nullptr;   // Oldest hashes sample of the window
+        for (int64_t m = from; m <= current; m++) {
+            Bucket const& b = m_buckets[size_t(m % s_buckets)];
+            if (b.minute != m) continue;
+            e.shares += b.shares;
+            difficulty += b.difficulty;
+            if (b.sampled && !oldest) oldest = &b;
+        }
+        if (oldest && m_lastHashesAt > oldest->sampledAt)
+            e.reported = (m_lastHashes - oldest->hashes) / chrono::duration<double>(m_lastHashesAt - oldest->sampledAt).count();
+
+        double mean = e.shares ? difficulty / e.shares : (_difficulty > 0 ? _difficulty : m_lastDifficulty);
+        e.rate = difficulty / e.seconds;
+        e.low = poissonLow(e.shares) * mean / e.seconds;
+        e.high = poissonHigh(e.shares) * mean / e.seconds;
+
+        // Judged only once the reported rate should have found enough
+        // shares for the interval to be meaningful
+        e.alert = mean > 0 && e.reported * e.seconds / mean >= s_alertMinShares && e.reported > e.high;
+    }
+    return ret;
+}
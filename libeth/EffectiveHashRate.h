@@ -0,0 +1,82 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace dev::eth {
+
+/// Effective hash rate of a window (rates in hashes per second)
+struct EffectiveHashRateType {
+    unsigned minutes = 0;          // Window width
+    double seconds = 0;            // Time covered (less than the window until that much elapsed)
+    uint64_t shares = 0;           // Shares accepted in window
+    double rate = 0;               // Accepted difficulty over time covered
+    double low = 0, high = 0;      // 95% confidence interval of rate
+    double reported = 0;           // Mean of the hash rate counted by miners
+    bool alert = false;            // Reported rate significantly above effective one
+};
+
+/// Estimates the hash rate from the difficulty of accepted shares, which
+/// unlike miners' own hash counts accounts for wrong results and lost
+/// shares. Difficulties integrate over sliding windows of one minute
+/// buckets. Share counts being Poisson distributed, the confidence
+/// interval is the one of the count (Wilson-Hilferty approximation of
+/// Garwood's interval) scaled by the mean share difficulty.
+class EffectiveHashRate {
+public:
+    static const unsigned s_windows = 3;
+    static const std::array<unsigned, s_windows> s_windowMinutes;   // 15 minutes, 1 and 6 hours
+    static const unsigned s_alertWindow = 1;                        // Window the alert is raised from
+    static constexpr double s_alertMinShares = 10;                  // Expected shares before judging
+
+    // Accounts an accepted share of _difficulty hashes
+    void share(double _difficulty, std::chrono::steady_clock::time_point _when = std::chrono::steady_clock::now());
+    // Samples the total of hashes counted by miners
+    void hashes(uint64_t _total, std::chrono::steady_clock::time_point _when = std::chrono::steady_clock::now());
+
+    // Difficulty of last accepted share (0 if none)
+    double lastDifficulty() const;
+
+    // Estimates over each window. _difficulty stands for the share difficulty
+    // where none was accepted yet (defaults to the last one accepted)
+    std::array<EffectiveHashRateType, s_windows> estimates(std::chrono::steady_clock::time_point _now, double _difficulty = 0) const;
+
+private:
+    static const unsigned s_buckets = 360;   // Minutes of history (longest window)
+
+    struct Bucket {
+        int64_t minute = -1;   // Since m_start
+        uint64_t shares = 0;
+        double difficulty = 0;
+        bool sampled = false;   // First hashes sample of the minute
+        uint64_t hashes = 0;
+        std::chrono::steady_clock::time_point sampledAt;
+    };
+
+    // Windows start from the first hashes counted or share accepted, so
+    // the time a miner takes to get going doesn't weigh on its rates
+    void start(std::chrono::steady_clock::time_point _when);
+    int64_t minute(std::chrono::steady_clock::time_point _when) const;
+    Bucket& bucket(int64_t _minute);
+
+    mutable std::mutex x_buckets;
+    bool m_started = false;
+    std::chrono::steady_clock::time_point m_start;
+    std::array<Bucket, s_buckets> m_buckets;
+    double m_lastDifficulty = 0;
+    uint64_t m_lastHashes = 0;
+    std::chrono::steady_clock::time_point m_lastHashesAt;
+};
+
+}   // namespace dev::eth
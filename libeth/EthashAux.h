@@ -52,6 +52,8 @@ struct WorkPackage {
     uint64_t startNonce = 0;
     uint16_t exSizeBytes = 0;
     double difficulty = 0;
+
+    std::chrono::steady_clock::time_point received;   // Timestamp of reception from pool
 };
 
 struct Solution {
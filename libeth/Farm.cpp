@@ -9,6 +9,7 @@
  */
 
 #include <libeth/Farm.h>
+#include <libeth/MinerEvents.h>
 
 #if ETH_ETHASHCL
 #    include <libcl/CLMiner.h>
@@ -139,6 +140,7 @@ Farm::~Farm() {
 void Farm::setWork(WorkPackage const& _newWp) {
     // Set work to each miner giving its own starting nonce
     unique_lock<mutex> l(farmWorkMutex);
+    Trace::begin("farm setWork", Trace::job(_newWp.header));
 
     m_currentWp = _newWp;
 
@@ -159,6 +161,7 @@ void Farm::setWork(WorkPackage const& _newWp) {
         m_miner->setWork(m_currentWp);
         m_currentWp.startNonce += 1ULL << segmentBits;
     }
+    Trace::end("farm setWork", Trace::job(_newWp.header));
 }
 
 /**
@@ -185,6 +188,7 @@ bool Farm::start() {
 #if ETH_ETHASHSYCL
             if (it.second.subscriptionType == DeviceSubscriptionTypeEnum::SYCL_Device) {
                 minerTelemetry.prefix = "SYCL";
+                it.second.syclProfile = m_Settings.syclProfile;
                 m_miners.push_back(shared_ptr<Miner>(new SYCLMiner(m_miners.size(), it.second)));
             }
 #endif
@@ -194,6 +198,7 @@ bool Farm::start() {
                 minerTelemetry.prefix = "cl";
                 if (m_Settings.clGroupSize) it.second.clGroupSize = m_Settings.clGroupSize;
                 it.second.clSplit = m_Settings.clSplit;
+                it.second.clProfile = m_Settings.clProfile;
                 m_miners.push_back(shared_ptr<Miner>(new CLMiner(m_miners.size(), it.second)));
             }
 #endif
@@ -294,40 +299,28 @@ bool Farm::reboot(const vector<string>& args) {
 /**
  * @brief Account solutions for miner and for farm
  */
-void Farm::accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accounting) {
-    m_telemetry.farm.solutions.tstamp = chrono::steady_clock::now();
-    if (_accounting == SolutionAccountingEnum::Accepted) {
-        m_telemetry.farm.solutions.accepted++;
-        atomic_fetch_add((atomic<unsigned>*) &m_telemetry.farm.solutions.collectAcceptd, 1u);
-        m_telemetry.miners.at(_minerIdx).solutions.accepted++;
-        atomic_fetch_add((atomic<unsigned>*) &m_telemetry.miners.at(_minerIdx).solutions.collectAcceptd, 1u);
-    } else if (_accounting == SolutionAccountingEnum::Wasted) {
-        m_telemetry.farm.solutions.wasted++;
-        m_telemetry.miners.at(_minerIdx).solutions.wasted++;
-    } else if (_accounting == SolutionAccountingEnum::Rejected) {
-        m_telemetry.farm.solutions.rejected++;
-        m_telemetry.miners.at(_minerIdx).solutions.rejected++;
-    } else if (_accounting == SolutionAccountingEnum::Failed) {
-        m_telemetry.farm.solutions.failed++;
-        m_telemetry.miners.at(_minerIdx).solutions.failed++;
+void Farm::accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accounting, double _difficulty) {
+    bool effective = (_accounting == SolutionAccountingEnum::Accepted && _difficulty > 0);
+    m_solutions.account(_accounting);
+    if (effective) m_effective.share(_difficulty);
+    if (auto miner = getMiner(_minerIdx)) {
+        miner->solutions().account(_accounting);
+        if (effective) miner->effective().share(_difficulty);
     }
-    m_telemetry.miners.at(_minerIdx).solutions.tstamp = chrono::steady_clock::now();
 }
 
 /**
  * @brief Gets the solutions account for the whole farm
  */
 
-SolutionAccountType& Farm::getSolutions() { return m_telemetry.farm.solutions; }
+SolutionAccountType Farm::getSolutions() const { return m_solutions.snapshot(); }
 
 /**
  * @brief Gets the solutions account for single miner
  */
-SolutionAccountType& Farm::getSolutions(unsigned _minerIdx) {
-    static SolutionAccountType nullSolAccount;
-    try {
-        return m_telemetry.miners.at(_minerIdx).solutions;
-    } catch (const exception&) { return nullSolAccount; }
+SolutionAccountType Farm::getSolutions(unsigned _minerIdx) {
+    if (auto miner = getMiner(_minerIdx)) return miner->solutions().snapshot();
+    return SolutionAccountType();
 }
 
 void Farm::setTStartTStop(unsigned start, unsigned stop) {
@@ -336,11 +329,14 @@ void Farm::setTStartTStop(unsigned start, unsigned stop) {
 }
 
 void Farm::submitProof(Solution const& _s) {
+    Trace::instant("solution", Trace::job(_s.work.header), int64_t(_s.nonce));
     g_io_service.post(m_io_strand.wrap([this, _s] { submitProofAsync(_s); }));
 }
 
 void Farm::submitProofAsync(Solution const& _s) {
+    Trace::begin("verify", Trace::job(_s.work.header), int64_t(_s.nonce));
     Result r = EthashAux::eval(_s.work.epoch, _s.work.header, _s.nonce);
+    Trace::end("verify", Trace::job(_s.work.header), int64_t(_s.nonce));
     if (r.value > _s.work.boundary) {
         accountSolution(_s.midx, SolutionAccountingEnum::Failed);
         cwarn << "GPU " << _s.midx << " gave incorrect result. Lower overclocking values if it happens frequently.";
@@ -358,6 +354,9 @@ void Farm::submitProofAsync(Solution const& _s) {
 void Farm::collectData(const boost::system::error_code& ec) {
     if (ec) return;
 
+    // Miners and their telemetry must not go away (Farm::stop) while collecting
+    unique_lock<mutex> l(farmWorkMutex);
+
     // check for hung miners
     for (auto const& miner: m_miners)
         if (!miner->paused() && miner->m_initialized) {
@@ -373,13 +372,28 @@ void Farm::collectData(const boost::system::error_code& ec) {
     // Reset hashrate (it will accumulate from miners)
     float farm_hr = 0.0f;
 
+    // Hash rates are derived from the counters progress since last collection
+    auto now = chrono::steady_clock::now();
+    auto us = chrono::duration_cast<chrono::microseconds>(now - m_lastCollect).count();
+    m_lastCollect = now;
+
     // Process miners
     for (auto const& miner: m_miners) {
         int minerIdx = miner->Index();
-        float hr = (miner->paused() ? 0.0f : miner->RetrieveHashRate());
+        TelemetryAccountType& minerTelemetry = m_telemetry.miners.at(minerIdx);
+        uint64_t hashes = miner->hashes();
+        uint64_t delta = hashes - minerTelemetry.hashes;
+        float hr = (miner->paused() || us <= 0 ? 0.0f : float(delta * 1e6 / us));
+        miner->setHashRate(hr);
         farm_hr += hr;
-        m_telemetry.miners.at(minerIdx).hashrate = hr;
+        m_telemetry.farm.hashes += delta;
+        minerTelemetry.hashes = hashes;
+        minerTelemetry.solutions = miner->solutions().snapshot();
+        miner->effective().hashes(hashes, now);
+        minerTelemetry.effective = miner->effective().estimates(now, m_effective.lastDifficulty());
+        minerTelemetry.hashrate = hr;
         m_telemetry.miners.at(minerIdx).paused = miner->paused();
+        m_telemetry.miners.at(minerIdx).profile = miner->RetrieveKernelProfile();
 
         if (m_Settings.hwMon) {
             HwMonitorInfo hwInfo = miner->hwmonInfo();
@@ -466,8 +480,14 @@ void Farm::collectData(const boost::system::error_code& ec) {
             m_telemetry.miners.at(minerIdx).sensors.powerW = powerW / ((double) 1000.0);
         }
         m_telemetry.farm.hashrate = farm_hr;
-        miner->TriggerHashRateUpdate();
     }
+    m_telemetry.farm.solutions = m_solutions.snapshot();
+    m_effective.hashes(m_telemetry.farm.hashes, now);
+    m_telemetry.farm.effective = m_effective.estimates(now);
+    l.unlock();
+
+    if (m_onTelemetryCollected) m_onTelemetryCollected();
+    if (MinerEvents::listening()) MinerEvents::publish({MinerEvent::Type::Telemetry, -1, 0, ""});
 
     // Resubmit timer for another loop
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
@@ -52,6 +52,10 @@ struct FarmSettings {
 #ifdef ETH_ETHASHCL
     unsigned clGroupSize = 0;
     bool clSplit = false;
+    bool clProfile = false;
+#endif
+#ifdef ETH_ETHASHSYCL
+    bool syclProfile = false;
 #endif
 };
 
@@ -78,9 +82,16 @@ public:
     void restart_async();
     bool isMining() const { return m_isMining.load(std::memory_order_relaxed); }
     static bool reboot(const std::vector<std::string>& args);
-    TelemetryType& Telemetry() { return m_telemetry; }
+    // Copies are taken under the work lock : miners may be stopped meanwhile
+    TelemetryType Telemetry() const {
+        std::lock_guard<std::mutex> l(farmWorkMutex);
+        return m_telemetry;
+    }
     float HashRate() const { return m_telemetry.farm.hashrate; };
-    std::vector<std::shared_ptr<Miner>> getMiners() { return m_miners; }
+    std::vector<std::shared_ptr<Miner>> getMiners() {
+        std::lock_guard<std::mutex> l(farmWorkMutex);
+        return m_miners;
+    }
     unsigned getMinersCount() { return (unsigned) m_miners.size(); };
 
     std::shared_ptr<Miner> getMiner(unsigned index) {
@@ -89,15 +100,18 @@ public:
         } catch (const std::exception&) { return nullptr; }
     }
 
-    void accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accounting);
-    SolutionAccountType& getSolutions();
-    SolutionAccountType& getSolutions(unsigned _minerIdx);
+    // _difficulty (hashes) of accepted shares feeds the effective hash rate
+    void accountSolution(unsigned _minerIdx, SolutionAccountingEnum _accounting, double _difficulty = 0);
+    SolutionAccountType getSolutions() const;
+    SolutionAccountType getSolutions(unsigned _minerIdx);
 
     using SolutionFound = std::function<void(const Solution&)>;
     using MinerRestart = std::function<void()>;
+    using TelemetryCollected = std::function<void()>;
 
     void onSolutionFound(SolutionFound const& _handler) { m_onSolutionFound = _handler; }
     void onMinerRestart(MinerRestart const& _handler) { m_onMinerRestart = _handler; }
+    void onTelemetryCollected(TelemetryCollected const& _handler) { m_onTelemetryCollected = _handler; }
 
     void setTStartTStop(unsigned tstart, unsigned tstop);
     unsigned get_tstart() const { return m_Settings.tempStart; }
@@ -126,10 +140,14 @@ private:
 
     std::atomic<bool> m_isMining = {false};
 
-    TelemetryType m_telemetry;   // Holds progress and status info for farm and miners
+    TelemetryType m_telemetry;       // Holds progress and status info for farm and miners
+    SolutionCounters m_solutions;    // Farm wide (survive miners restarts)
+    EffectiveHashRate m_effective;   // Farm wide
+    std::chrono::steady_clock::time_point m_lastCollect = std::chrono::steady_clock::now();
 
     SolutionFound m_onSolutionFound;
     MinerRestart m_onMinerRestart;
+    TelemetryCollected m_onTelemetryCollected;   // Runs in Farm's strand after each collectData
 
     FarmSettings m_Settings;   // Own Farm Settings
 
@@ -11,9 +11,30 @@
 #include "libpool/PoolManager.h"
 
 #include "Miner.h"
+#include "MinerEvents.h"
 
 namespace dev::eth {
 
+void SolutionCounters::account(SolutionAccountingEnum _accounting) noexcept {
+    switch (_accounting) {
+    case SolutionAccountingEnum::Accepted: accepted.add(1); break;
+    case SolutionAccountingEnum::Rejected: rejected.add(1); break;
+    case SolutionAccountingEnum::Wasted: wasted.add(1); break;
+    case SolutionAccountingEnum::Failed: failed.add(1); break;
+    }
+    tstamp.store(chrono::steady_clock::now().time_since_epoch().count(), memory_order_relaxed);
+}
+
+SolutionAccountType SolutionCounters::snapshot() const noexcept {
+    SolutionAccountType s;
+    s.accepted = accepted.value();
+    s.rejected = rejected.value();
+    s.wasted = wasted.value();
+    s.failed = failed.value();
+    s.tstamp = chrono::steady_clock::time_point(chrono::steady_clock::duration(tstamp.load(memory_order_relaxed)));
+    return s;
+}
+
 DeviceDescriptor Miner::getDescriptor() { return m_deviceDescriptor; }
 
 void Miner::setWork(WorkPackage const& _work) {
@@ -24,18 +45,32 @@ void Miner::setWork(WorkPackage const& _work) {
         if (paused()) m_work.header = h256();
         else
             m_work = _work;
-#ifdef DEV_BUILD
-        m_workSwitchStart = chrono::steady_clock::now();
-#endif
+        auto received = (_work.received != chrono::steady_clock::time_point() ? _work.received : chrono::steady_clock::now());
+        m_workSwitchStart.store(received.time_since_epoch().count(), memory_order_relaxed);
     }
     kick_miner();
 }
 
-void Miner::ReportSolution(const h256& header, uint64_t nonce) { cnote << EthWhite << "Job: " << header.abridged() << " Solution: " << toHex(nonce, HexPrefix::Add); }
+void Miner::ReportWorkSwitched() {
+    auto start = m_workSwitchStart.exchange(0, memory_order_relaxed);
+    if (!start) return;
+    auto elapsed = chrono::steady_clock::now() - chrono::steady_clock::time_point(chrono::steady_clock::duration(start));
+    m_switchLatency.record(elapsed);
+#ifdef DEV_BUILD
+    if (g_logOptions & LOG_SWITCH) cnote << "Switch time: " << chrono::duration_cast<chrono::microseconds>(elapsed).count() << " us.";
+#endif
+}
+
+void Miner::ReportSolution(const h256& header, uint64_t nonce) {
+    cnote << EthWhite << "Job: " << header.abridged() << " Solution: " << toHex(nonce, HexPrefix::Add) << LogField("miner", m_index) << LogField("job", header.abridged())
+          << LogField("nonce", toHex(nonce, HexPrefix::Add));
+}
 
 void Miner::ReportDAGDone(uint64_t dagSize, uint32_t dagTime, bool notSplit) {
+    m_dagBuildTime.record(uint64_t(dagTime) * 1000);
     cextr << dev::getFormattedMemory(float(dagSize)) << " of " << (notSplit ? "" : "(split) ") << "DAG data generated in " << fixed << setprecision(1)
-          << dagTime / 1000.0f << " seconds";
+          << dagTime / 1000.0f << " seconds" << LogField("miner", m_index) << LogField("epoch", m_epochContext.epochNumber) << LogField("dag_ms", dagTime)
+          << LogField("dag_bytes", dagSize);
 }
 
 void Miner::ReportGPUMemoryRequired(uint32_t lightSize, uint64_t dagSize, uint32_t misc) {
@@ -54,10 +89,15 @@ void Miner::ReportGPUNoMemoryAndPause(const string& mem, uint64_t requiredMemory
 }
 
 void Miner::pause(MinerPauseEnum what) {
-    lock_guard<mutex> l(x_pause);
-    m_pauseFlags.set(what);
-    m_work.header = h256();
-    kick_miner();
+    bool wasPaused;
+    {
+        lock_guard<mutex> l(x_pause);
+        wasPaused = m_pauseFlags.any();
+        m_pauseFlags.set(what);
+        m_work.header = h256();
+        kick_miner();
+    }
+    if (!wasPaused && MinerEvents::listening()) MinerEvents::publish({MinerEvent::Type::Paused, int(m_index), 0, pausedString()});
 }
 
 bool Miner::paused() {
@@ -94,25 +134,73 @@ string Miner::pausedString() {
 }
 
 void Miner::resume(MinerPauseEnum fromwhat) {
-    lock_guard<mutex> l(x_pause);
-    m_pauseFlags.reset(fromwhat);
-    // if (!m_pauseFlags.any())
-    //{
-    //    // TODO Push most recent job from farm ?
-    //    // If we do not push a new job the miner will stay idle
-    //    // till a new job arrives
-    //}
+    bool resumed;
+    {
+        lock_guard<mutex> l(x_pause);
+        resumed = m_pauseFlags.test(fromwhat) && (m_pauseFlags.count() == 1);
+        m_pauseFlags.reset(fromwhat);
+        // if (!m_pauseFlags.any())
+        //{
+        //    // TODO Push most recent job from farm ?
+        //    // If we do not push a new job the miner will stay idle
+        //    // till a new job arrives
+        //}
+    }
+    if (resumed && MinerEvents::listening()) MinerEvents::publish({MinerEvent::Type::Resumed, int(m_index), 0, ""});
 }
 
 float Miner::RetrieveHashRate() noexcept { return m_hashRate.load(memory_order_relaxed); }
 
-void Miner::TriggerHashRateUpdate() noexcept {
-    bool b = false;
-    if (m_hashRateUpdate.compare_exchange_weak(b, true)) return;
-    // GPU didn't respond to last trigger, assume it's dead.
-    // This can happen on CUDA if:
-    //   runtime of --cuda-grid-size * --cuda-streams exceeds time of m_collectInterval
-    m_hashRate = 0.0;
+void Miner::ReportProfiled(ProfiledCommand _command, uint64_t _queued, uint64_t _submit, uint64_t _start, uint64_t _end) {
+    (void) _submit;
+    if (_end < _start) return;   // Not a valid timestamp set
+    lock_guard<mutex> l(x_profile);
+    switch (_command) {
+    case ProfiledCommand::Search:
+        m_profile.kernels++;
+        m_profileSums.kernels++;
+        m_profileSums.kernelNs += _end - _start;
+        if (_start > _queued) m_profileSums.queueNs += _start - _queued;
+        // Kernels of a single queue don't overlap, others (if any) only
+        // shorten the gap
+        if (m_lastKernelEnd && _start > m_lastKernelEnd) m_profileSums.gapNs += _start - m_lastKernelEnd;
+        if (_end > m_lastKernelEnd) m_lastKernelEnd = _end;
+        break;
+    case ProfiledCommand::DAG:
+        // First DAG kernel after searching starts a new epoch: time spent
+        // generating it isn't idle time
+        if (m_lastKernelEnd || !m_dagStart) {
+            m_dagStart = _start;
+            m_dagEnd = _end;
+            m_lastKernelEnd = 0;
+        }
+        m_dagStart = min(m_dagStart, _start);
+        m_dagEnd = max(m_dagEnd, _end);
+        m_profile.dagKernels++;
+        m_profile.dagMs = (m_dagEnd - m_dagStart) / 1e6;
+        break;
+    case ProfiledCommand::Transfer:
+        m_profile.transfers++;
+        m_profileSums.transfers++;
+        m_profileSums.transferNs += _end - _start;
+        break;
+    }
+}
+
+KernelProfileType Miner::RetrieveKernelProfile() {
+    lock_guard<mutex> l(x_profile);
+    KernelProfileType profile = m_profile;
+    profile.enabled = m_profiling;
+    ProfileSums& s = m_profileSums;
+    if (s.kernels) {
+        profile.kernelUs = s.kernelNs / 1e3 / s.kernels;
+        profile.queueUs = s.queueNs / 1e3 / s.kernels;
+        profile.gapUs = s.gapNs / 1e3 / s.kernels;
+        profile.utilization = 100.0 * s.kernelNs / (s.kernelNs + s.gapNs);
+    }
+    if (s.transfers) profile.transferUs = s.transferNs / 1e3 / s.transfers;
+    s = ProfileSums();
+    return profile;
 }
 
 WorkPackage Miner::work() const {
@@ -120,24 +208,10 @@ WorkPackage Miner::work() const {
     return m_work;
 }
 
-void Miner::updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept {
-    m_groupCount += _increment * _groupSize;
-
-    bool b = true;
-    if (!m_hashRateUpdate.compare_exchange_weak(b, false)) return;
-
-    using namespace chrono;
-    auto t = steady_clock::now();
-    auto us = duration_cast<microseconds>(t - m_hashTime).count();
-
-    m_hashTime = t;
-
-    m_hashRate.store(us ? float(m_groupCount * 1e6) / us : 0.0f, memory_order_relaxed);
-    m_groupCount = 0;
-}
-
 void Miner::setEpoch(WorkPackage const& w) {
+    auto start = chrono::steady_clock::now();
     ethash::epoch_context ec = ethash::get_global_epoch_context(w.epoch);
+    m_lightBuildTime.record(chrono::steady_clock::now() - start);
     m_epochContext.epochNumber = w.epoch;
     m_epochContext.lightNumItems = ec.light_cache_num_items;
     m_epochContext.lightSize = ethash::get_light_cache_size(ec.light_cache_num_items);
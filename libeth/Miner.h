@@ -16,10 +16,14 @@
 #include <numeric>
 #include <string>
 
+#include "EffectiveHashRate.h"
 #include "EthashAux.h"
 
 #include <libdev/Common.h>
+#include <libdev/Counter.h>
+#include <libdev/LatencyHistogram.h>
 #include <libdev/Log.h>
+#include <libdev/Trace.h>
 #include <libdev/Worker.h>
 
 #include <boost/format.hpp>
@@ -47,11 +51,10 @@ struct MinerSettings {
 };
 
 struct SolutionAccountType {
-    unsigned accepted = 0U;
-    unsigned rejected = 0U;
-    unsigned wasted = 0U;
-    unsigned failed = 0U;
-    unsigned collectAcceptd = 0U;
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;
+    uint64_t wasted = 0;
+    uint64_t failed = 0;
     std::chrono::steady_clock::time_point tstamp = std::chrono::steady_clock::now();
     [[nodiscard]] std::string str() const {
         std::string _ret = "A" + std::to_string(accepted);
@@ -62,6 +65,19 @@ struct SolutionAccountType {
     };
 };
 
+/// Monotonic solution counters of a miner or of the farm. Solutions are
+/// accounted on the io thread only, readers take snapshots
+struct alignas(c_cacheLineSize) SolutionCounters {
+    SingleWriterCounter accepted;
+    SingleWriterCounter rejected;
+    SingleWriterCounter wasted;
+    SingleWriterCounter failed;
+    std::atomic<std::chrono::steady_clock::rep> tstamp = {std::chrono::steady_clock::now().time_since_epoch().count()};
+
+    void account(SolutionAccountingEnum _accounting) noexcept;
+    [[nodiscard]] SolutionAccountType snapshot() const noexcept;
+};
+
 struct HwSensorsType {
     int tempC = 0;
     int memtempC = 0;
@@ -92,6 +108,7 @@ struct DeviceDescriptor {
     size_t sycl_work_items_gen_kernel;
     size_t sycl_work_items_search_kernel;
     size_t sycl_device_idx;
+    bool syclProfile;
 #endif
 
 #ifdef ETH_ETHASHCUDA
@@ -125,6 +142,7 @@ struct DeviceDescriptor {
     unsigned clGroupSize;
     bool clBin;
     bool clSplit;
+    bool clProfile;
 #endif
 };
 
@@ -144,12 +162,33 @@ enum MinerPauseEnum {
     Pause_MAX   // Must always be last as a placeholder of max count
 };
 
+/// Device timestamped commands of a profiled miner
+enum class ProfiledCommand { Search, DAG, Transfer };
+
+/// Kernel profiling (device clock) of a miner. Counts and DAG figures are
+/// totals since start, the others are averaged over the last telemetry interval
+struct KernelProfileType {
+    bool enabled = false;
+    uint64_t kernels = 0;      // Search kernels profiled
+    uint64_t dagKernels = 0;   // DAG generation kernels profiled
+    uint64_t transfers = 0;    // Result buffer reads and resets profiled
+    double dagMs = 0;          // Execution of DAG generation kernels of last epoch
+    double utilization = 0;    // Percent of device time spent running search kernels
+    double kernelUs = 0;       // Search kernel execution (start to end)
+    double gapUs = 0;          // Idle between end of a search kernel and start of next one
+    double queueUs = 0;        // Search kernel queued to start on device
+    double transferUs = 0;     // Result buffer transfer execution
+};
+
 struct TelemetryAccountType {
     std::string prefix;
+    uint64_t hashes = 0;   // Computed since start (as of last collection)
     float hashrate = 0.0f;
     bool paused = false;
     HwSensorsType sensors;
     SolutionAccountType solutions;
+    KernelProfileType profile;
+    std::array<EffectiveHashRateType, EffectiveHashRate::s_windows> effective;
 };
 
 /// Keeps track of progress for farm and miners
@@ -252,7 +291,20 @@ public:
     std::string pausedString();
     void resume(MinerPauseEnum fromwhat);
     float RetrieveHashRate() noexcept;
-    void TriggerHashRateUpdate() noexcept;
+    // Published by the telemetry collector from hashes() differences
+    void setHashRate(float _hashRate) noexcept { m_hashRate.store(_hashRate, std::memory_order_relaxed); }
+    uint64_t hashes() const noexcept { return m_hashes.value(); }
+    SolutionCounters& solutions() noexcept { return m_solutions; }
+    EffectiveHashRate& effective() noexcept { return m_effective; }
+
+    // Job received from pool to first kernel running on its header
+    LatencyHistogram const& switchLatency() const { return m_switchLatency; }
+    // DAG generation and light cache build (or fetch) per epoch
+    LatencyHistogram const& dagBuildTime() const { return m_dagBuildTime; }
+    LatencyHistogram const& lightBuildTime() const { return m_lightBuildTime; }
+
+    // Kernel profile since last call (enabled only when the backend profiles)
+    KernelProfileType RetrieveKernelProfile();
 
     std::atomic<bool> m_hung_miner = {false};
     bool m_initialized = false;
@@ -264,20 +316,27 @@ protected:
     void freeCache();
 
     WorkPackage work() const;
-    static void ReportSolution(const h256& header, uint64_t nonce);
-    static void ReportDAGDone(uint64_t dagSize, uint32_t dagTime, bool notSplit);
+    void ReportSolution(const h256& header, uint64_t nonce);
+    void ReportDAGDone(uint64_t dagSize, uint32_t dagTime, bool notSplit);
+    void ReportWorkSwitched();
     void ReportGPUNoMemoryAndPause(const std::string& mem, uint64_t requiredTotalMemory, uint64_t totalMemory);
     static void ReportGPUMemoryRequired(uint32_t lightSize, uint64_t dagSize, uint32_t misc);
-    void updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept;
+    // Counts _increment groups of _groupSize hashes (miner thread only)
+    void countHashes(uint32_t _groupSize, uint32_t _increment) noexcept { m_hashes.add(uint64_t(_groupSize) * _increment); }
+    // Accounts a completed command from its device timestamps (nanoseconds)
+    void ReportProfiled(ProfiledCommand _command, uint64_t _queued, uint64_t _submit, uint64_t _start, uint64_t _end);
 
     const unsigned m_index = 0;            // Ordinal index of the Instance (not the device)
     DeviceDescriptor m_deviceDescriptor;   // Info about the device
 
     EpochContext m_epochContext;
 
-#ifdef DEV_BUILD
-    std::chrono::steady_clock::time_point m_workSwitchStart;
-#endif
+    std::atomic<std::chrono::steady_clock::rep> m_workSwitchStart = {0};   // Reception of last job set (0 once switched)
+    LatencyHistogram m_switchLatency;
+    LatencyHistogram m_dagBuildTime;
+    LatencyHistogram m_lightBuildTime;
+
+    bool m_profiling = false;   // Set by backends which record device timestamps
 
     HwMonitorInfo m_hwmoninfo;
     mutable std::mutex miner_work_mutex;
@@ -291,10 +350,25 @@ private:
 
     WorkPackage m_work;
 
-    std::chrono::steady_clock::time_point m_hashTime = std::chrono::steady_clock::now();
     std::atomic<float> m_hashRate = {0.0};
-    std::atomic<bool> m_hashRateUpdate = {false};
-    uint64_t m_groupCount = 0;
+
+    // Hot counters, each writer on cache lines of its own: hashes are only
+    // counted by the miner thread, solutions by the io thread
+    alignas(c_cacheLineSize) SingleWriterCounter m_hashes;
+    SolutionCounters m_solutions;
+
+    EffectiveHashRate m_effective;   // From shares accepted
+
+    // Kernel profile accounting: totals and sums over current interval
+    struct ProfileSums {
+        uint64_t kernels = 0, transfers = 0;
+        uint64_t kernelNs = 0, gapNs = 0, queueNs = 0, transferNs = 0;
+    };
+    mutable std::mutex x_profile;
+    KernelProfileType m_profile;
+    ProfileSums m_profileSums;
+    uint64_t m_lastKernelEnd = 0;   // Device time the previous search kernel ended (0 after DAG)
+    uint64_t m_dagStart = 0, m_dagEnd = 0;
 };
 
 }   // namespace dev::eth
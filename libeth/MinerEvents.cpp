@@ -0,0 +1,28 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include "MinerEvents.h"
+
+using namespace std;
+using namespace dev::eth;
+
+mutex MinerEvents::s_mutex;
+MinerEvents::Listener MinerEvents::s_listener;
+atomic<bool> MinerEvents::s_listening = {false};
+
+void MinerEvents::listen(Listener const& _listener) {
+    lock_guard<mutex> l(s_mutex);
+    s_listener = _listener;
+    s_listening.store(bool(_listener), memory_order_relaxed);
+}
+
+void MinerEvents::publish(MinerEvent const& _event) {
+    lock_guard<mutex> l(s_mutex);
+    if (s_listener) s_listener(_event);
+}
@@ -0,0 +1,47 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+namespace dev::eth {
+
+// Something live observers (API subscribers) want to hear about as it happens
+struct MinerEvent {
+    enum class Type { Job, Epoch, Solution, Accepted, Rejected, Paused, Resumed, Telemetry };
+
+    Type type;
+    int miner = -1;       // Device index (-1 for farm wide events)
+    int64_t value = 0;    // Block, epoch, nonce or response milliseconds
+    std::string text;     // Header, pause reason or "stale"
+};
+
+// Fan-in point for miner events with a single listener. Nothing is built
+// nor locked while nobody listens, so publishers only check listening()
+// first. The listener runs on the publisher's thread and must not block.
+class MinerEvents {
+public:
+    using Listener = std::function<void(MinerEvent const&)>;
+
+    static void listen(Listener const& _listener);
+    static bool listening() { return s_listening.load(std::memory_order_relaxed); }
+    static void publish(MinerEvent const& _event);
+
+private:
+    static std::mutex s_mutex;
+    static Listener s_listener;
+    static std::atomic<bool> s_listening;
+};
+
+}   // namespace dev::eth
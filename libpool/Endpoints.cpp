@@ -0,0 +1,177 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+
+#include <boost/bind/bind.hpp>
+
+#include "Endpoints.h"
+
+using namespace std;
+using namespace dev::eth;
+using boost::asio::ip::tcp;
+
+mutex ResolverCache::s_mutex;
+map<string, ResolverCache::Entry> ResolverCache::s_entries;
+unsigned ResolverCache::s_ttl = 300;
+
+vector<tcp::endpoint> ResolverCache::lookup(string const& host, unsigned short port) {
+    lock_guard<mutex> l(s_mutex);
+    vector<tcp::endpoint> ret;
+
+    auto it = s_entries.find(key(host, port));
+    if (it == s_entries.end()) return ret;
+    if (chrono::steady_clock::now() > it->second.expires) {
+        s_entries.erase(it);
+        return ret;
+    }
+
+    Entry& e = it->second;
+    if (e.lastGood != tcp::endpoint()) ret.push_back(e.lastGood);
+
+    // Split by family preserving resolver order
+    vector<tcp::endpoint> v4, v6;
+    for (auto const& ep: e.endpoints) {
+        if (ep == e.lastGood) continue;
+        (ep.address().is_v6() ? v6 : v4).push_back(ep);
+    }
+
+    // Interleave families starting with the one resolver gave first
+    bool v6first = !e.endpoints.empty() && e.endpoints.front().address().is_v6();
+    vector<tcp::endpoint>& a = (v6first ? v6 : v4);
+    vector<tcp::endpoint>& b = (v6first ? v4 : v6);
+    for (size_t i = 0; i < max(a.size(), b.size()); i++) {
+        if (i < a.size()) ret.push_back(a[i]);
+        if (i < b.size()) ret.push_back(b[i]);
+    }
+
+    return ret;
+}
+
+void ResolverCache::store(string const& host, unsigned short port, vector<tcp::endpoint> const& endpoints) {
+    lock_guard<mutex> l(s_mutex);
+    Entry& e = s_entries[key(host, port)];
+    if (find(endpoints.begin(), endpoints.end(), e.lastGood) == endpoints.end()) e.lastGood = tcp::endpoint();
+    e.endpoints = endpoints;
+    e.expires = chrono::steady_clock::now() + chrono::seconds(s_ttl);
+}
+
+void ResolverCache::markGood(string const& host, unsigned short port, tcp::endpoint const& endpoint) {
+    lock_guard<mutex> l(s_mutex);
+    auto it = s_entries.find(key(host, port));
+    if (it != s_entries.end()) it->second.lastGood = endpoint;
+}
+
+void ResolverCache::markBad(string const& host, unsigned short port, tcp::endpoint const& endpoint) {
+    lock_guard<mutex> l(s_mutex);
+    auto it = s_entries.find(key(host, port));
+    if (it == s_entries.end()) return;
+
+    // Move it at the end of the list so it's the last to be tried
+    Entry& e = it->second;
+    if (e.lastGood == endpoint) e.lastGood = tcp::endpoint();
+    auto ep = find(e.endpoints.begin(), e.endpoints.end(), endpoint);
+    if (ep != e.endpoints.end()) rotate(ep, ep + 1, e.endpoints.end());
+}
+
+void ResolverCache::invalidate(string const& host, unsigned short port) {
+    lock_guard<mutex> l(s_mutex);
+    s_entries.erase(key(host, port));
+}
+
+const unsigned EndpointRace::s_staggerDelay;
+
+EndpointRace::EndpointRace(boost::asio::io_service::strand& _strand, vector<tcp::endpoint> _endpoints)
+    : m_io_strand(_strand), m_stagger_timer(_strand.context()), m_endpoints(move(_endpoints)) {}
+
+void EndpointRace::start(Completed const& _handler) {
+    m_onCompleted = _handler;
+    if (m_endpoints.empty()) {
+        auto self(shared_from_this());
+        m_io_strand.post([self] { self->finish(boost::asio::error::host_not_found, tcp::endpoint()); });
+        return;
+    }
+    launch();
+}
+
+void EndpointRace::launch() {
+    size_t idx = m_attempts.size();
+    Attempt a{make_shared<tcp::socket>(m_io_strand.context()), m_endpoints.at(idx)};
+    m_attempts.push_back(a);
+    m_pending++;
+
+    a.socket->async_connect(a.endpoint, m_io_strand.wrap(boost::bind(&EndpointRace::attempt_completed, shared_from_this(), boost::asio::placeholders::error, idx)));
+
+    // Arm next attempt if there are other endpoints to try
+    if (m_attempts.size() < m_endpoints.size()) {
+        m_stagger_timer.expires_from_now(boost::posix_time::milliseconds(s_staggerDelay));
+        m_stagger_timer.async_wait(m_io_strand.wrap(boost::bind(&EndpointRace::stagger_elapsed, shared_from_this(), boost::asio::placeholders::error)));
+    }
+}
+
+void EndpointRace::stagger_elapsed(const boost::system::error_code& ec) {
+    if (ec || m_done) return;
+    launch();
+}
+
+void EndpointRace::attempt_completed(const boost::system::error_code& ec, size_t idx) {
+    m_pending--;
+    Attempt& a = m_attempts.at(idx);
+
+    if (m_done) {
+        boost::system::error_code cec;
+        a.socket->close(cec);
+        return;
+    }
+
+    if (!ec && a.socket->is_open()) {
+        m_winner = a.socket;
+        finish(ec, a.endpoint);
+        return;
+    }
+
+    m_lastError = (ec ? ec : boost::asio::error::timed_out);
+    boost::system::error_code cec;
+    a.socket->close(cec);
+
+    if (m_attempts.size() < m_endpoints.size()) {
+        // Don't wait for the stagger delay : a failure frees the slot
+        m_stagger_timer.cancel();
+        launch();
+    } else if (!m_pending) {
+        finish(m_lastError, a.endpoint);
+    }
+}
+
+void EndpointRace::cancel(boost::system::error_code const& _ec) {
+    if (m_done) return;
+    auto self(shared_from_this());
+    m_io_strand.post([self, _ec] { self->finish(_ec, tcp::endpoint()); });
+}
+
+void EndpointRace::finish(const boost::system::error_code& ec, tcp::endpoint const& endpoint) {
+    if (m_done) return;
+    m_done = true;
+    m_stagger_timer.cancel();
+
+    // Drop all the losers
+    for (auto& a: m_attempts) {
+        if (a.socket == m_winner) continue;
+        boost::system::error_code cec;
+        a.socket->close(cec);
+    }
+
+    if (m_onCompleted) m_onCompleted(ec, endpoint);
+}
+
+void EndpointRace::claim(tcp::socket& _socket) {
+    if (!m_winner) return;
+    _socket = move(*m_winner);
+    m_winner = nullptr;
+}
@@ -0,0 +1,103 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace dev::eth {
+
+// Process wide cache of resolved pool endpoints.
+// Pool clients are recreated on every rotation (see PoolManager::rotateConnect)
+// thus the cache must not be owned by any of them.
+class ResolverCache {
+public:
+    // Returns endpoints for host:port ready to be raced : last known good first
+    // then the remaining ones alternating address families (RFC 8305).
+    // Returns an empty list if nothing cached or entry expired.
+    static std::vector<boost::asio::ip::tcp::endpoint> lookup(std::string const& host, unsigned short port);
+
+    // Stores a fresh resolver result. Last known good endpoint is preserved
+    // if it is still among the resolved ones.
+    static void store(std::string const& host, unsigned short port, std::vector<boost::asio::ip::tcp::endpoint> const& endpoints);
+
+    static void markGood(std::string const& host, unsigned short port, boost::asio::ip::tcp::endpoint const& endpoint);
+    static void markBad(std::string const& host, unsigned short port, boost::asio::ip::tcp::endpoint const& endpoint);
+    static void invalidate(std::string const& host, unsigned short port);
+
+    // Time to live of cached entries in seconds (0 disables caching)
+    static void setTtl(unsigned seconds) { s_ttl = seconds; }
+
+private:
+    struct Entry {
+        std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+        boost::asio::ip::tcp::endpoint lastGood;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    static std::string key(std::string const& host, unsigned short port) { return host + ":" + std::to_string(port); }
+
+    static std::mutex s_mutex;
+    static std::map<std::string, Entry> s_entries;
+    static unsigned s_ttl;
+};
+
+// Races connections to a list of endpoints "happy eyeballs" style :
+// an attempt is launched on first endpoint and, if it doesn't complete within
+// the stagger delay (or it fails), next endpoint is tried in parallel.
+// The first attempt to succeed wins and all others are dropped.
+class EndpointRace : public std::enable_shared_from_this<EndpointRace> {
+public:
+    using Completed = std::function<void(boost::system::error_code const&, boost::asio::ip::tcp::endpoint const&)>;
+
+    EndpointRace(boost::asio::io_service::strand& _strand, std::vector<boost::asio::ip::tcp::endpoint> _endpoints);
+
+    // Handler is invoked exactly once within the strand
+    void start(Completed const& _handler);
+
+    // Aborts all pending attempts. Handler gets called with _ec
+    // (operation_aborted unless the caller gave up on a timeout)
+    void cancel(boost::system::error_code const& _ec = boost::asio::error::operation_aborted);
+
+    // Moves the connected socket of the winning attempt into _socket
+    void claim(boost::asio::ip::tcp::socket& _socket);
+
+    static const unsigned s_staggerDelay = 250;   // Milliseconds (RFC 8305 recommended value)
+
+private:
+    struct Attempt {
+        std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+        boost::asio::ip::tcp::endpoint endpoint;
+    };
+
+    void launch();
+    void attempt_completed(const boost::system::error_code& ec, size_t idx);
+    void stagger_elapsed(const boost::system::error_code& ec);
+    void finish(const boost::system::error_code& ec, boost::asio::ip::tcp::endpoint const& endpoint);
+
+    boost::asio::io_service::strand& m_io_strand;
+    boost::asio::deadline_timer m_stagger_timer;
+    std::vector<boost::asio::ip::tcp::endpoint> m_endpoints;
+    std::vector<Attempt> m_attempts;
+    std::shared_ptr<boost::asio::ip::tcp::socket> m_winner;
+    boost::system::error_code m_lastError;
+    unsigned m_pending = 0;
+    bool m_done = false;
+    Completed m_onCompleted;
+};
+
+}   // namespace dev::eth
@@ -15,6 +15,7 @@
 #include <utility>
 
 #include <libeth/Miner.h>
+#include <libpool/PoolProber.h>
 #include <libpool/PoolURI.h>
 
 extern boost::asio::io_service g_io_service;
@@ -60,6 +61,7 @@ public:
     void setConnection(std::shared_ptr<URI> _conn) {
         m_conn = std::move(_conn);
         m_conn->Responds(false);
+        m_histograms = PoolProber::histograms(m_conn->Host(), m_conn->Port());
     }
 
     // Gets a pointer to the currently active connection definition
@@ -68,10 +70,14 @@ public:
     // Releases the pointer to the connection definition
     void unsetConnection() { m_conn = nullptr; }
 
+    // Latency histograms of the pool set by setConnection (kept when unset)
+    std::shared_ptr<PoolHistograms> histograms() { return m_histograms; }
+
     virtual void connect() = 0;
     virtual void disconnect() = 0;
     virtual void submitHashrate(uint64_t const& rate, std::string const& id) = 0;
-    virtual void submitSolution(const Solution& solution) = 0;
+    // Returns false when the solution could not be queued (it's lost)
+    virtual bool submitSolution(const Solution& solution) = 0;
     virtual bool isConnected() { return m_connected.load(std::memory_order_relaxed); }
     virtual bool isPendingState() { return false; }
 
@@ -85,12 +91,15 @@ public:
     using Disconnected = std::function<void()>;
     using Connected = std::function<void()>;
     using WorkReceived = std::function<void(WorkPackage const&)>;
+    using DifficultyAccepted = std::function<void(double)>;
 
     void onSolutionAccepted(SolutionAccepted const& _handler) { m_onSolutionAccepted = _handler; }
     void onSolutionRejected(SolutionRejected const& _handler) { m_onSolutionRejected = _handler; }
     void onDisconnected(Disconnected const& _handler) { m_onDisconnected = _handler; }
     void onConnected(Connected const& _handler) { m_onConnected = _handler; }
     void onWorkReceived(WorkReceived const& _handler) { m_onWorkReceived = _handler; }
+    // Share difficulty (in hashes) the pool agreed to after a suggestion
+    void onDifficultyAccepted(DifficultyAccepted const& _handler) { m_onDifficultyAccepted = _handler; }
 
     std::unique_ptr<Session> m_session = nullptr;
 
@@ -100,11 +109,17 @@ protected:
     boost::asio::ip::basic_endpoint<boost::asio::ip::tcp> m_endpoint;
 
     std::shared_ptr<URI> m_conn = nullptr;
+    std::shared_ptr<PoolHistograms> m_histograms;
+
+    // Expires with the client. Handlers which may outlive it (e.g. the ones
+    // of an EndpointRace) hold a weak_ptr and bail out once it expired.
+    std::shared_ptr<bool> m_alive = std::make_shared<bool>(true);
 
     SolutionAccepted m_onSolutionAccepted;
     SolutionRejected m_onSolutionRejected;
     Disconnected m_onDisconnected;
     Connected m_onConnected;
     WorkReceived m_onWorkReceived;
+    DifficultyAccepted m_onDifficultyAccepted;
 };
 }   // namespace dev::eth
@@ -10,7 +10,14 @@
 
 #include <chrono>
 
+#include <libeth/MinerEvents.h>
+
+#include "Endpoints.h"
 #include "PoolManager.h"
+#include "PoolProber.h"
+#include "stratum/StratumCapture.h"
+#include "stratum/StratumModeCache.h"
+#include "stratum/TlsSessionCache.h"
 
 using namespace std;
 using namespace dev;
@@ -20,10 +27,23 @@ PoolManager* PoolManager::m_this = nullptr;
 
 PoolManager::PoolManager(PoolSettings _settings)
     : m_Settings(move(_settings)), m_io_strand(g_io_service), m_failovertimer(g_io_service), m_submithrtimer(g_io_service), m_reconnecttimer(g_io_service),
-      m_lastBlock(-1) {
+      m_probetimer(g_io_service), m_lastBlock(-1) {
     m_this = this;
 
     m_currentWp.header = h256();
+    ResolverCache::setTtl(m_Settings.dnsCacheTtl);
+    StratumModeCache::load(m_Settings.stateFile);
+    if (!m_Settings.captureFile.empty() && !StratumCapture::open(m_Settings.captureFile))
+        cwarn << "Could not create stratum capture " << m_Settings.captureFile;
+    m_shareFilter.setMaxAge(m_Settings.staleAge);
+
+    if (m_Settings.proxyPort) {
+        m_proxy = make_shared<ProxyServer>(m_Settings.proxyAddress, m_Settings.proxyPort);
+        m_proxy->onSolutionFound([this](Solution const& sol) {
+            if (!p_client || !p_client->isConnected() || !filterSolution(sol)) return false;
+            return p_client->submitSolution(sol);
+        });
+    }
 
     Farm::f().onMinerRestart([&]() {
         cnote << "Restart miners...";
@@ -43,7 +63,24 @@ PoolManager::PoolManager(PoolSettings _settings)
         // to log nonce submission but receive no response
 
         if (p_client && p_client->isConnected()) {
-            p_client->submitSolution(sol);
+            if (!filterSolution(sol)) return false;
+            if (MinerEvents::listening()) MinerEvents::publish({MinerEvent::Type::Solution, int(sol.midx), int64_t(sol.nonce), "0x" + sol.work.header.hex()});
+            Trace::instant("submit", Trace::job(sol.work.header), int64_t(sol.nonce));
+
+            // Queued before submitting as some clients answer right away
+            auto& pending = m_pendingShares[sol.midx];
+            pending.push_back(dev::getHashesToTarget(sol.work.boundary.hex(HexPrefix::Add)));
+            bool submitted;
+            if (m_proxy) {
+                Solution s = sol;
+                m_proxy->localSolution(s);
+                submitted = p_client->submitSolution(s);
+            } else
+                submitted = p_client->submitSolution(sol);
+            if (!submitted) {
+                pending.pop_back();
+                Farm::f().accountSolution(sol.midx, SolutionAccountingEnum::Failed);
+            }
         } else {
             cnote << string(EthOrange "Solution 0x") + toHex(sol.nonce) << " wasted. Waiting for connection...";
         }
@@ -61,6 +98,9 @@ void PoolManager::setClientHandlers() {
             // Reset current WorkPackage
             m_currentWp.job.clear();
             m_currentWp.header = h256();
+            m_shareFilter.reset();
+            m_pendingShares.clear();
+            m_requestedDifficulty.store(0, memory_order_relaxed);
 
             // Rough implementation to return to primary pool
             // after specified amount of time
@@ -95,6 +135,8 @@ void PoolManager::setClientHandlers() {
         // Clear current connection
         p_client->unsetConnection();
         m_currentWp.header = h256();
+        m_requestedDifficulty.store(0, memory_order_relaxed);
+        if (m_proxy) m_proxy->setWork(m_currentWp);
 
         // Stop timing actors
         m_failovertimer.cancel();
@@ -117,6 +159,8 @@ void PoolManager::setClientHandlers() {
         }
     });
 
+    p_client->onDifficultyAccepted([&](double _hashes) { m_requestedDifficulty.store(_hashes, memory_order_relaxed); });
+
     p_client->onWorkReceived([&](WorkPackage const& wp) {
         // Should not happen !
         if (!wp) return;
@@ -132,9 +176,12 @@ void PoolManager::setClientHandlers() {
         }
 
         bool newDiff = (wp.boundary != m_currentWp.boundary);
+        m_shareFilter.newJob(wp.header);
         m_currentWp.difficulty = wp.difficulty;
 
         m_currentWp = wp;
+        m_currentWp.received = chrono::steady_clock::now();
+        Trace::instant("job received", Trace::job(wp.header), wp.block);
 
         if (newEpoch) {
             m_epochChanges.fetch_add(1, memory_order_relaxed);
@@ -145,36 +192,91 @@ void PoolManager::setClientHandlers() {
                 else
                     m_currentWp.epoch = ethash::find_epoch_number(ethash::hash256_from_bytes(m_currentWp.seed.data()));
             }
+            if (MinerEvents::listening()) MinerEvents::publish({MinerEvent::Type::Epoch, -1, m_currentWp.epoch, ""});
         } else {
             m_currentWp.epoch = _currentEpoch;
         }
+        if (MinerEvents::listening()) MinerEvents::publish({MinerEvent::Type::Job, -1, m_currentWp.block, "0x" + m_currentWp.header.hex()});
 
         if (newDiff || newEpoch) showMiningAt();
 
         cnote << "Job: " EthWhite << m_currentWp.header.abridged() << EthGray << (m_currentWp.block != -1 ? " blk: " : "")
               << (m_lastBlock == m_currentWp.block ? EthGray : EthWhite) << (m_currentWp.block != -1 ? to_string(m_currentWp.block) : "") << EthReset << " "
-              << m_selectedHost;
+              << m_selectedHost << LogField("job", m_currentWp.header.abridged()) << LogField("epoch", m_currentWp.epoch) << LogField("block", m_currentWp.block)
+              << LogField("pool", m_selectedHost);
         m_lastBlock = m_currentWp.block;
 
-        Farm::f().setWork(m_currentWp);
+        if (m_proxy) {
+            m_proxy->setWork(m_currentWp);
+            Farm::f().setWork(m_proxy->localWork(m_currentWp));
+        } else
+            Farm::f().setWork(m_currentWp);
     });
 
     p_client->onSolutionAccepted([&](chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx, bool _asStale) {
+        if (auto conn = p_client->getConnection()) PoolProber::shareAnswered(conn->Host(), conn->Port(), unsigned(_responseDelay.count()));
+        if (auto histograms = p_client->histograms()) histograms->ack.record(_responseDelay);
+        Trace::instant("accepted", 0, _responseDelay.count());
+        if (ProxyServer::proxied(_minerIdx)) {
+            if (m_proxy) m_proxy->accountSolution(_minerIdx, true, _asStale, _responseDelay);
+            return;
+        }
         stringstream ss;
         ss << setw(4) << setfill(' ') << _responseDelay.count() << " ms. " << m_selectedHost;
-        cnote << EthLime "**Accepted" << (_asStale ? " stale" : "") << EthReset << ss.str();
-        Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
+        double difficulty = pendingShare(_minerIdx);
+        cnote << EthLime "**Accepted" << (_asStale ? " stale" : "") << EthReset << ss.str() << LogField("miner", _minerIdx)
+              << LogField("latency_ms", _responseDelay.count()) << LogField("difficulty", difficulty) << LogField("stale", _asStale);
+        if (MinerEvents::listening()) MinerEvents::publish({MinerEvent::Type::Accepted, int(_minerIdx), _responseDelay.count(), _asStale ? "stale" : ""});
+        Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted, difficulty);
     });
 
     p_client->onSolutionRejected([&](chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx) {
+        if (auto conn = p_client->getConnection()) PoolProber::shareAnswered(conn->Host(), conn->Port(), unsigned(_responseDelay.count()));
+        if (auto histograms = p_client->histograms()) histograms->ack.record(_responseDelay);
+        Trace::instant("rejected", 0, _responseDelay.count());
+        if (ProxyServer::proxied(_minerIdx)) {
+            if (m_proxy) m_proxy->accountSolution(_minerIdx, false, false, _responseDelay);
+            return;
+        }
         stringstream ss;
         ss << setw(4) << setfill(' ') << _responseDelay.count() << " ms. " << m_selectedHost;
-        cwarn << EthRed "**Rejected" EthReset << ss.str();
+        double difficulty = pendingShare(_minerIdx);
+        cwarn << EthRed "**Rejected" EthReset << ss.str() << LogField("miner", _minerIdx) << LogField("latency_ms", _responseDelay.count())
+              << LogField("difficulty", difficulty);
+        if (MinerEvents::listening()) MinerEvents::publish({MinerEvent::Type::Rejected, int(_minerIdx), _responseDelay.count(), ""});
         Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
     });
 }
 
+bool PoolManager::filterSolution(Solution const& _sol) {
+    unsigned age;
+    switch (m_shareFilter.check(_sol.work.header, _sol.nonce, age)) {
+        case ShareFilter::Verdict::Duplicate:
+            cwarn << "Solution 0x" << toHex(_sol.nonce) << " already submitted. Dropped";
+            return false;
+        case ShareFilter::Verdict::Expired:
+            cnote << string(EthOrange "Solution 0x") + toHex(_sol.nonce) << " dropped. Its job is " << age << " behind" EthReset;
+            if (!ProxyServer::proxied(_sol.midx)) Farm::f().accountSolution(_sol.midx, SolutionAccountingEnum::Wasted);
+            return false;
+        case ShareFilter::Verdict::Stale:
+            cnote << string(EthOrange "Solution 0x") + toHex(_sol.nonce) << " is stale. Its job is " << age << " behind" EthReset;
+            break;
+        case ShareFilter::Verdict::Submit: break;
+    }
+    return true;
+}
+
+double PoolManager::pendingShare(unsigned _minerIdx) {
+    auto it = m_pendingShares.find(_minerIdx);
+    if (it == m_pendingShares.end() || it->second.empty()) return 0;
+    double difficulty = it->second.front();
+    it->second.pop_front();
+    return difficulty;
+}
+
 void PoolManager::stop() {
+    if (m_proxy) m_proxy->stop();
+    m_probetimer.cancel();
     if (m_running.load(memory_order_relaxed)) {
         m_async_pending.store(true, memory_order_relaxed);
         m_stopping.store(true, memory_order_relaxed);
@@ -274,16 +376,71 @@ Json::Value PoolManager::getConnectionsJson() {
         JConn["index"] = (unsigned) i;
         JConn["active"] = i == m_activeConnectionIdx;
         JConn["uri"] = m_Settings.connections[i]->str();
+        if (m_Settings.connections[i]->SecLevel() != SecureLevel::NONE) {
+            TlsHandshakeStats s = TlsSessionCache::stats(m_Settings.connections[i]->Host(), m_Settings.connections[i]->Port());
+            Json::Value jTls;
+            jTls["full"] = s.full;
+            jTls["resumed"] = s.resumed;
+            jTls["failed"] = s.failed;
+            jTls["lastms"] = s.lastMs;
+            jTls["avgms"] = (s.full + s.resumed) ? unsigned(s.totalMs / (s.full + s.resumed)) : 0u;
+            JConn["tls"] = jTls;
+        }
+        if (m_Settings.connections[i]->Family() == ProtocolFamily::GETWORK) {
+            EthGetworkClient::RequestStats s = EthGetworkClient::stats(m_Settings.connections[i]->Host(), m_Settings.connections[i]->Port());
+            auto latency = [](EthGetworkClient::RequestLatency const& l) {
+                Json::Value jLat;
+                jLat["count"] = Json::UInt64(l.count);
+                jLat["lastus"] = l.lastUs;
+                jLat["maxus"] = l.maxUs;
+                jLat["avgus"] = l.count ? Json::UInt64(l.totalUs / l.count) : Json::UInt64(0);
+                return jLat;
+            };
+            Json::Value jHttp;
+            jHttp["connections"] = s.connections;
+            jHttp["requests"] = Json::UInt64(s.requests);
+            jHttp["pipelined"] = Json::UInt64(s.pipelined);
+            jHttp["getwork"] = latency(s.getWork);
+            jHttp["submit"] = latency(s.submit);
+            if (!m_Settings.getWorkPushUrl.empty()) {
+                Json::Value jPush = latency(s.push);
+                jPush["subscribed"] = s.pushSubscribed;
+                jPush["notified"] = Json::UInt64(s.pushNotified);
+                jHttp["push"] = jPush;
+            }
+            JConn["http"] = jHttp;
+        }
+        if (m_Settings.probeInterval) {
+            PoolLatency l = PoolProber::stats(m_Settings.connections[i]->Host(), m_Settings.connections[i]->Port());
+            Json::Value jLat;
+            jLat["probes"] = l.probes;
+            jLat["failures"] = l.failures;
+            jLat["reachable"] = l.reachable;
+            jLat["lastus"] = l.lastRttUs;
+            jLat["avgus"] = unsigned(l.avgRttUs);
+            jLat["shares"] = l.shares;
+            jLat["sharelastms"] = l.lastShareMs;
+            jLat["shareavgms"] = unsigned(l.avgShareMs);
+            JConn["latency"] = jLat;
+        }
         jRes.append(JConn);
     }
     return jRes;
 }
 
+Json::Value PoolManager::getProxyJson() { return m_proxy ? m_proxy->getJson() : Json::Value::null; }
+
 void PoolManager::start() {
+    if (m_proxy) m_proxy->start();
     m_running.store(true, memory_order_relaxed);
     m_async_pending.store(true, memory_order_relaxed);
     m_connectionSwitches.fetch_add(1, memory_order_relaxed);
     g_io_service.post(m_io_strand.wrap([this] { rotateConnect(); }));
+
+    if (m_Settings.probeInterval) {
+        m_probetimer.expires_from_now(boost::posix_time::seconds(1));
+        m_probetimer.async_wait(m_io_strand.wrap(boost::bind(&PoolManager::probetimer_elapsed, this, boost::asio::placeholders::error)));
+    }
 }
 
 void PoolManager::rotateConnect() {
@@ -316,11 +473,14 @@ void PoolManager::rotateConnect() {
         if (p_client) p_client = nullptr;
 
         if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::GETWORK)
-            p_client = unique_ptr<PoolClient>(new EthGetworkClient(m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval));
+            p_client = unique_ptr<PoolClient>(new EthGetworkClient(m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval, m_Settings.getWorkPushUrl));
         if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::STRATUM)
-            p_client = unique_ptr<PoolClient>(new EthStratumClient(m_Settings.noWorkTimeout, m_Settings.noResponseTimeout));
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::SIMULATION)
-            p_client = unique_ptr<PoolClient>(new SimulateClient(m_Settings.benchmarkBlock));
+            p_client = unique_ptr<PoolClient>(new EthStratumClient(m_Settings.noWorkTimeout, m_Settings.noResponseTimeout, m_Settings.shareRate));
+        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::SIMULATION) {
+            if (!m_Settings.replayFile.empty()) p_client = unique_ptr<PoolClient>(new ReplayClient(m_Settings.replayFile, m_Settings.replaySpeed));
+            else
+                p_client = unique_ptr<PoolClient>(new SimulateClient(m_Settings.simulation));
+        }
 
         if (p_client) setClientHandlers();
 
@@ -359,7 +519,10 @@ void PoolManager::showMiningAt() {
     if (!m_currentWp) return;
 
     double d = dev::getHashesToTarget(m_currentWp.boundary.hex(HexPrefix::Add));
-    cnote << "Epoch : " EthWhite << m_currentWp.epoch << EthReset << " Difficulty : " EthWhite << dev::getFormattedHashes(d) << EthReset;
+    double r = getRequestedDifficulty();
+    cnote << "Epoch : " EthWhite << m_currentWp.epoch << EthReset << " Difficulty : " EthWhite << dev::getFormattedHashes(d) << EthReset
+          << (r ? " Requested : " + dev::getFormattedHashes(r) : "") << LogField("epoch", m_currentWp.epoch) << LogField("difficulty", d)
+          << LogField("requested", r);
 }
 
 void PoolManager::failovertimer_elapsed(const boost::system::error_code& ec) {
@@ -376,10 +539,66 @@ void PoolManager::failovertimer_elapsed(const boost::system::error_code& ec) {
     }
 }
 
+void PoolManager::probetimer_elapsed(const boost::system::error_code& ec) {
+    if (ec || !m_running.load(memory_order_relaxed)) return;
+
+    // Results of previous round decide before new probes go out
+    switchToFasterPool();
+    for (auto const& conn: m_Settings.connections)
+        if (conn->Host() != "exit" && conn->Family() != ProtocolFamily::SIMULATION) PoolProber::probe(conn->Host(), conn->Port());
+
+    m_probetimer.expires_from_now(boost::posix_time::seconds(m_Settings.probeInterval));
+    m_probetimer.async_wait(m_io_strand.wrap(boost::bind(&PoolManager::probetimer_elapsed, this, boost::asio::placeholders::error)));
+}
+
+void PoolManager::switchToFasterPool() {
+    if (!m_Settings.poolSwitchMargin || !p_client || !p_client->isConnected() || m_async_pending.load(memory_order_relaxed)) return;
+    if (m_activeConnectionIdx >= m_Settings.connections.size()) return;
+
+    // Another pool must beat the active one by the margin
+    // on round trip averages for several rounds in a row
+    auto const& active = m_Settings.connections[m_activeConnectionIdx];
+    PoolLatency a = PoolProber::stats(active->Host(), active->Port());
+    if (!a.probes) return;
+
+    unsigned best = m_activeConnectionIdx;
+    double bestUs = a.avgRttUs - m_Settings.poolSwitchMargin * 1000.0;
+    for (unsigned i = 0; i < m_Settings.connections.size(); i++) {
+        auto const& conn = m_Settings.connections[i];
+        if (i == m_activeConnectionIdx || conn->Host() == "exit" || conn->Family() == ProtocolFamily::SIMULATION) continue;
+        PoolLatency l = PoolProber::stats(conn->Host(), conn->Port());
+        if (l.reachable && l.avgRttUs < bestUs) {
+            best = i;
+            bestUs = l.avgRttUs;
+        }
+    }
+
+    if (best == m_activeConnectionIdx) {
+        m_fasterRounds = 0;
+        return;
+    }
+    if (best != m_fasterIdx) {
+        m_fasterIdx = best;
+        m_fasterRounds = 0;
+    }
+    if (++m_fasterRounds < s_switchRounds) return;
+
+    m_fasterRounds = 0;
+    cnote << "Switching to faster pool " << m_Settings.connections[best]->Host() << " (" << fixed << setprecision(1) << bestUs / 1000 << " ms vs "
+          << a.avgRttUs / 1000 << " ms)";
+    try {
+        setActiveConnectionCommon(best);
+    } catch (const exception&) {
+        // Outstanding operations : try again next round
+    }
+}
+
 void PoolManager::submithrtimer_elapsed(const boost::system::error_code& ec) {
     if (!ec) {
         if (m_running.load(memory_order_relaxed)) {
-            if (p_client && p_client->isConnected()) p_client->submitHashrate((uint32_t) Farm::f().HashRate(), m_Settings.hashRateId);
+            // Downstream miners of the proxy are part of this rig for the pool
+            uint64_t rate = uint64_t(Farm::f().HashRate()) + (m_proxy ? m_proxy->hashRate() : 0);
+            if (p_client && p_client->isConnected()) p_client->submitHashrate(rate, m_Settings.hashRateId);
 
             // Resubmit actor
             m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
@@ -404,6 +623,10 @@ double PoolManager::getPoolDifficulty() {
     return m_currentWp.difficulty;
 }
 
+double PoolManager::getRequestedDifficulty() { return m_requestedDifficulty.load(memory_order_relaxed); }
+
 unsigned PoolManager::getConnectionSwitches() { return m_connectionSwitches.load(memory_order_relaxed); }
 
 unsigned PoolManager::getEpochChanges() { return m_epochChanges.load(memory_order_relaxed); }
+
+Json::Value PoolManager::getShareFilterJson() const { return m_shareFilter.getJson(); }
@@ -9,7 +9,9 @@
 
 #pragma once
 
+#include <deque>
 #include <iostream>
+#include <map>
 
 #include <json/json.h>
 
@@ -18,8 +20,11 @@
 #include <libeth/Miner.h>
 
 #include "PoolClient.h"
+#include "ShareFilter.h"
 #include "getwork/EthGetworkClient.h"
+#include "proxy/ProxyServer.h"
 #include "stratum/EthStratumClient.h"
+#include "testing/ReplayClient.h"
 #include "testing/SimulateClient.h"
 
 using namespace std;
@@ -28,6 +33,7 @@ namespace dev::eth {
 struct PoolSettings {
     std::vector<std::shared_ptr<URI>> connections;                 // List of connection definitions
     unsigned getWorkPollInterval = 500;                            // Interval (ms) between getwork requests
+    std::string getWorkPushUrl;                                    // Node endpoint to subscribe new heads on (empty disables)
     unsigned noWorkTimeout = 180;                                  // If no new jobs in this number of seconds drop connection
     unsigned noResponseTimeout = 2;                                // If no response in this number of seconds drop connection
     unsigned poolFailoverTimeout = 0;                              // Return to primary pool after this number of minutes
@@ -36,7 +42,18 @@ struct PoolSettings {
     std::string hashRateId = h256::random().hex(HexPrefix::Add);   // Unique identifier for HashRate submission
     unsigned connectionMaxRetries = 3;                             // Max number of connection retries
     unsigned delayBeforeRetry = 0;                                 // Delay seconds before connect retry
-    unsigned benchmarkBlock = 0;                                   // Block number used by SimulateClient to test performances
+    SimulationSettings simulation;                                 // Job stream generated by SimulateClient to test performances
+    std::string replayFile;                                        // Stratum capture fed back by ReplayClient instead (empty disables)
+    double replaySpeed = 1.0;                                      // Replay speed factor over recorded timings
+    unsigned dnsCacheTtl = 300;                                    // Seconds resolved pool addresses are reused (0 disables)
+    std::string stateFile;                                         // File where detected stratum modes are persisted (empty disables)
+    std::string captureFile;                                       // File where stratum messages are recorded (empty disables)
+    std::string proxyAddress = "0.0.0.0";                          // Address downstream miners connect to in proxy mode
+    unsigned short proxyPort = 0;                                  // Port downstream miners connect to in proxy mode (0 disables)
+    double shareRate = 0;                                          // Shares per minute difficulty suggestions aim at (0 disables)
+    unsigned staleAge = 0;                                         // Drop solutions on jobs this many jobs old (0 submits them)
+    unsigned probeInterval = 0;                                    // Seconds between pool latency probes (0 disables)
+    unsigned poolSwitchMargin = 0;                                 // Milliseconds another pool must be faster by to switch to it (0 disables)
 };
 
 class PoolManager {
@@ -63,17 +80,26 @@ public:
         }
     };
     double getPoolDifficulty();
+    double getRequestedDifficulty();
+    Json::Value getProxyJson();
     unsigned getConnectionSwitches();
     unsigned getEpochChanges();
+    Json::Value getShareFilterJson() const;
 
 private:
     void rotateConnect();
     void setClientHandlers();
+    // Runs a solution, local or proxied, through the share filter. Returns whether to submit it
+    bool filterSolution(Solution const& _sol);
+    // Difficulty of the oldest share of _minerIdx awaiting an answer (0 if unknown), now answered
+    double pendingShare(unsigned _minerIdx);
     void showMiningAt();
     void setActiveConnectionCommon(unsigned int idx);
     void failovertimer_elapsed(const boost::system::error_code& ec);
     void submithrtimer_elapsed(const boost::system::error_code& ec);
     void reconnecttimer_elapsed(const boost::system::error_code& ec);
+    void probetimer_elapsed(const boost::system::error_code& ec);
+    void switchToFasterPool();
 
     PoolSettings m_Settings;
     std::atomic<bool> m_running = {false};
@@ -88,8 +114,16 @@ private:
     boost::asio::deadline_timer m_failovertimer;
     boost::asio::deadline_timer m_submithrtimer;
     boost::asio::deadline_timer m_reconnecttimer;
+    boost::asio::deadline_timer m_probetimer;
     std::unique_ptr<PoolClient> p_client = nullptr;
+    std::shared_ptr<ProxyServer> m_proxy = nullptr;
     std::atomic<unsigned> m_epochChanges = {0};
+    std::atomic<double> m_requestedDifficulty = {0};   // Suggested share difficulty the pool accepted (read by the API)
+    ShareFilter m_shareFilter;
+    std::map<unsigned, std::deque<double>> m_pendingShares;   // Difficulty of shares awaiting an answer by miner (answered in order)
+    static const unsigned s_switchRounds = 3;   // Probe rounds a pool must stay faster before switching to it
+    unsigned m_fasterIdx = 0;
+    unsigned m_fasterRounds = 0;
     static PoolManager* m_this;
     int m_lastBlock;
 };
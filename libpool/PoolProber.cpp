@@ -0,0 +1,110 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <chrono>
+#include <memory>
+
+#include <boost/asio.hpp>
+
+#include "Endpoints.h"
+#include "PoolClient.h"
+#include "PoolProber.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+using boost::asio::ip::tcp;
+
+const unsigned PoolProber::s_timeout;
+constexpr double PoolProber::s_alpha;
+
+mutex PoolProber::s_mutex;
+map<string, PoolLatency> PoolProber::s_stats;
+map<string, shared_ptr<PoolHistograms>> PoolProber::s_histograms;
+
+void PoolProber::probe(string const& host, unsigned short port) {
+    struct Probe {
+        boost::asio::io_service::strand strand{g_io_service};
+        tcp::resolver resolver{g_io_service};
+        tcp::socket socket{g_io_service};
+        boost::asio::deadline_timer timer{g_io_service};
+        chrono::steady_clock::time_point start;
+    };
+    auto p = make_shared<Probe>();
+    string k = key(host, port);
+
+    auto connect = [p, k](tcp::endpoint const& ep) {
+        p->timer.expires_from_now(boost::posix_time::milliseconds(s_timeout));
+        p->timer.async_wait(p->strand.wrap([p](boost::system::error_code const& ec) {
+            boost::system::error_code ignored;
+            if (!ec) p->socket.close(ignored);
+        }));
+        p->start = chrono::steady_clock::now();
+        p->socket.async_connect(ep, p->strand.wrap([p, k](boost::system::error_code const& ec) {
+            auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - p->start).count();
+            p->timer.cancel();
+            boost::system::error_code ignored;
+            p->socket.close(ignored);
+            probed(k, !ec, unsigned(us));
+        }));
+    };
+
+    // Same address the client would connect to first
+    auto endpoints = ResolverCache::lookup(host, port);
+    if (!endpoints.empty()) {
+        p->strand.post([connect, ep = endpoints.front()] { connect(ep); });
+        return;
+    }
+    p->resolver.async_resolve(tcp::resolver::query(host, to_string(port)),
+                              p->strand.wrap([p, k, connect](boost::system::error_code const& ec, tcp::resolver::iterator it) {
+                                  if (ec || it == tcp::resolver::iterator()) probed(k, false, 0);
+                                  else
+                                      connect(it->endpoint());
+                              }));
+}
+
+void PoolProber::probed(string const& key, bool success, unsigned rttUs) {
+    lock_guard<mutex> l(s_mutex);
+    PoolLatency& s = s_stats[key];
+    s.reachable = success;
+    if (!success) {
+        s.failures++;
+        return;
+    }
+    s.avgRttUs = (s.probes ? s_alpha * rttUs + (1 - s_alpha) * s.avgRttUs : rttUs);
+    s.lastRttUs = rttUs;
+    s.probes++;
+}
+
+void PoolProber::shareAnswered(string const& host, unsigned short port, unsigned delayMs) {
+    lock_guard<mutex> l(s_mutex);
+    PoolLatency& s = s_stats[key(host, port)];
+    s.avgShareMs = (s.shares ? s_alpha * delayMs + (1 - s_alpha) * s.avgShareMs : delayMs);
+    s.lastShareMs = delayMs;
+    s.shares++;
+}
+
+PoolLatency PoolProber::stats(string const& host, unsigned short port) {
+    lock_guard<mutex> l(s_mutex);
+    auto it = s_stats.find(key(host, port));
+    return it == s_stats.end() ? PoolLatency() : it->second;
+}
+
+shared_ptr<PoolHistograms> PoolProber::histograms(string const& host, unsigned short port) {
+    lock_guard<mutex> l(s_mutex);
+    auto& h = s_histograms[key(host, port)];
+    if (!h) h = make_shared<PoolHistograms>();
+    return h;
+}
+
+map<string, shared_ptr<PoolHistograms>> PoolProber::histograms() {
+    lock_guard<mutex> l(s_mutex);
+    return s_histograms;
+}
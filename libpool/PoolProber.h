@@ -0,0 +1,69 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <libdev/LatencyHistogram.h>
+
+namespace dev::eth {
+
+struct PoolLatency {
+    unsigned probes = 0;        // Number of successful probes
+    unsigned failures = 0;      // Number of failed or timed out probes
+    bool reachable = false;     // Whether last probe succeeded
+    unsigned lastRttUs = 0;     // TCP handshake round trip of last successful probe
+    double avgRttUs = 0;        // Moving average of round trips
+    unsigned shares = 0;        // Number of solutions answered by the pool
+    unsigned lastShareMs = 0;   // Response delay of last answered solution
+    double avgShareMs = 0;      // Moving average of response delays
+};
+
+// Latency distributions of a pool, recorded by its clients
+struct PoolHistograms {
+    LatencyHistogram submit;   // Solution found to submit written on the socket
+    LatencyHistogram ack;      // Submit to pool answer (accepted or rejected)
+};
+
+// Process wide latency figures of pools (host:port).
+// Round trips are measured by probes which only open and close a TCP
+// connection, so every configured pool can be compared while mining on
+// one of them. Share response delays come from the active connection.
+class PoolProber {
+public:
+    static const unsigned s_timeout = 3000;   // Milliseconds a probe waits for the connection
+
+    // Launches an asynchronous probe on g_io_service
+    static void probe(std::string const& host, unsigned short port);
+
+    static void shareAnswered(std::string const& host, unsigned short port, unsigned delayMs);
+
+    static PoolLatency stats(std::string const& host, unsigned short port);
+
+    // Histograms of a pool, created on first request and kept for the process
+    // lifetime. Clients hold on to them so recording does not look them up
+    static std::shared_ptr<PoolHistograms> histograms(std::string const& host, unsigned short port);
+    static std::map<std::string, std::shared_ptr<PoolHistograms>> histograms();
+
+private:
+    static void probed(std::string const& key, bool success, unsigned rttUs);
+    static std::string key(std::string const& host, unsigned short port) { return host + ":" + std::to_string(port); }
+
+    static constexpr double s_alpha = 0.25;   // Weight of newest sample in moving averages
+
+    static std::mutex s_mutex;
+    static std::map<std::string, PoolLatency> s_stats;
+    static std::map<std::string, std::shared_ptr<PoolHistograms>> s_histograms;
+};
+
+}   // namespace dev::eth
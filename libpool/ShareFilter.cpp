@@ -0,0 +1,54 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include "ShareFilter.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+const unsigned ShareFilter::s_maxJobs;
+
+void ShareFilter::newJob(h256 const& header) {
+    lock_guard<mutex> l(m_mutex);
+    if (!m_jobs.empty() && m_jobs.front().header == header) return;
+    m_jobs.push_front({header, {}});
+    if (m_jobs.size() > s_maxJobs) m_jobs.pop_back();
+}
+
+void ShareFilter::reset() {
+    lock_guard<mutex> l(m_mutex);
+    m_jobs.clear();
+}
+
+ShareFilter::Verdict ShareFilter::check(h256 const& header, uint64_t nonce, unsigned& age) {
+    lock_guard<mutex> l(m_mutex);
+    age = 0;
+    while (age < m_jobs.size() && m_jobs[age].header != header) age++;
+
+    if (age < m_jobs.size() && !m_jobs[age].nonces.insert(nonce).second) {
+        m_duplicates.fetch_add(1, memory_order_relaxed);
+        return Verdict::Duplicate;
+    }
+    if (!age) return Verdict::Submit;
+    if (m_maxAge && age >= m_maxAge) {
+        m_expired.fetch_add(1, memory_order_relaxed);
+        return Verdict::Expired;
+    }
+    m_stale.fetch_add(1, memory_order_relaxed);
+    return Verdict::Stale;
+}
+
+Json::Value ShareFilter::getJson() const {
+    Json::Value jRes;
+    jRes["duplicates"] = m_duplicates.load(memory_order_relaxed);
+    jRes["stale"] = m_stale.load(memory_order_relaxed);
+    jRes["expired"] = m_expired.load(memory_order_relaxed);
+    return jRes;
+}
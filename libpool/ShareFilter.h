@@ -0,0 +1,65 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+
+#include <json/json.h>
+
+#include <libdev/FixedHash.h>
+
+namespace dev::eth {
+
+// Screens solutions before they reach the pool client.
+// Nonces already submitted for a job (e.g. reported twice by a device
+// after an abort race, or found again on overlapping nonce ranges) are
+// always dropped. Solutions for a job superseded by newer ones are stale :
+// they're flagged, and dropped if the job is at least maxAge jobs old.
+class ShareFilter {
+public:
+    enum class Verdict { Submit, Stale, Duplicate, Expired };
+
+    static const unsigned s_maxJobs = 16;   // Jobs remembered. Older ones count as this old
+
+    // Shares maxAge jobs old or older are dropped (0 never drops stale shares)
+    void setMaxAge(unsigned maxAge) { m_maxAge = maxAge; }
+
+    // Registers the job now being mined. Same header means same job
+    // (e.g. only the boundary changed) and keeps its nonces
+    void newJob(h256 const& header);
+
+    // Forgets all jobs : they mean nothing to a new pool session
+    void reset();
+
+    // Classifies a solution and records its nonce. Age is the number of
+    // jobs received after the one the solution was found on
+    Verdict check(h256 const& header, uint64_t nonce, unsigned& age);
+
+    Json::Value getJson() const;
+
+private:
+    struct Job {
+        h256 header;
+        std::unordered_set<uint64_t> nonces;
+    };
+
+    std::mutex m_mutex;
+    std::deque<Job> m_jobs;   // Newest first
+    unsigned m_maxAge = 0;
+
+    std::atomic<unsigned> m_duplicates = {0};
+    std::atomic<unsigned> m_stale = {0};     // Stale shares submitted anyway
+    std::atomic<unsigned> m_expired = {0};   // Stale shares dropped
+};
+
+}   // namespace dev::eth
@@ -21,10 +21,16 @@ using namespace eth;
 
 using boost::asio::ip::tcp;
 
-EthGetworkClient::EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod)
-    : PoolClient(), m_farmRecheckPeriod(farmRecheckPeriod), m_io_strand(g_io_service), m_socket(g_io_service), m_resolver(g_io_service), m_endpoints(),
-      m_getwork_timer(g_io_service), m_worktimeout(worktimeout) {
+mutex EthGetworkClient::s_statsMutex;
+map<string, EthGetworkClient::RequestStats> EthGetworkClient::s_stats;
+
+const unsigned EthGetworkClient::s_pushRecheckPeriod;
+
+EthGetworkClient::EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod, string const& pushUrl)
+    : PoolClient(), m_farmRecheckPeriod(farmRecheckPeriod), m_txQueue(64), m_io_strand(g_io_service), m_socket(g_io_service), m_resolver(g_io_service),
+      m_endpoints(), m_getwork_timer(g_io_service), m_worktimeout(worktimeout), m_pushUrl(pushUrl) {
     m_jSwBuilder.settings_["indentation"] = "";
+    m_jsonReader.reset(Json::CharReaderBuilder().newCharReader());
 
     Json::Value jGetWork;
     jGetWork["id"] = unsigned(1);
@@ -37,6 +43,7 @@ EthGetworkClient::EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod)
 EthGetworkClient::~EthGetworkClient() {
     // Do not stop io service.
     // It's global
+    if (m_push) m_push->stop();
 }
 
 void EthGetworkClient::connect() {
@@ -48,10 +55,18 @@ void EthGetworkClient::connect() {
     m_getwork_timer.cancel();
 
     // Initialize a new queue of end points
-    m_endpoints = queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>>();
+    m_endpoints.clear();
     m_endpoint = boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>();
 
     if (m_conn->HostNameType() == dev::UriHostNameType::Dns || m_conn->HostNameType() == dev::UriHostNameType::Basic) {
+        // Reuse still valid resolutions (last known good endpoint first)
+        auto cached = ResolverCache::lookup(m_conn->Host(), m_conn->Port());
+        if (!cached.empty()) {
+            m_endpoints.assign(cached.begin(), cached.end());
+            send(m_jsonGetWork, 1);
+            return;
+        }
+
         // Begin resolve all ips associated to hostname
         // calling the resolver each time is useful as most
         // load balancers will give Ips in different order
@@ -63,8 +78,8 @@ void EthGetworkClient::connect() {
                 q, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_resolve, this, boost::asio::placeholders::error, boost::asio::placeholders::iterator)));
     } else {
         // No need to use the resolver if host is already an IP address
-        m_endpoints.push(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(m_conn->Host()), m_conn->Port()));
-        send(m_jsonGetWork);
+        m_endpoints.push_back(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(m_conn->Host()), m_conn->Port()));
+        send(m_jsonGetWork, 1);
     }
 }
 
@@ -77,20 +92,47 @@ void EthGetworkClient::disconnect() {
     m_connecting.store(false, memory_order_relaxed);
     m_txPending.store(false, memory_order_relaxed);
     m_getwork_timer.cancel();
+    if (m_race) m_race->cancel();
+    if (m_push) {
+        m_push->stop();
+        m_push = nullptr;
+    }
+    m_pushTstamp.store(chrono::steady_clock::duration::zero(), memory_order_relaxed);
 
-    m_txQueue.consume_all([](string* l) { delete l; });
-    m_request.consume(m_request.capacity());
-    m_response.consume(m_response.capacity());
+    close_socket();
+    m_txQueue.consume_all([](Request* r) { delete r; });
 
     if (m_onDisconnected) m_onDisconnected();
 }
 
 void EthGetworkClient::begin_connect() {
     if (!m_endpoints.empty()) {
-        // Pick the first endpoint in list.
+        // Race all endpoints in list (first one is the last known good).
         // Eventually endpoints get discarded on connection errors
         m_endpoint = m_endpoints.front();
-        m_socket.async_connect(m_endpoint, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_connect, this, boost::asio::placeholders::error)));
+        m_race = make_shared<EndpointRace>(m_io_strand, vector<tcp::endpoint>(m_endpoints.begin(), m_endpoints.end()));
+        weak_ptr<bool> alive = m_alive;
+        EndpointRace* race = m_race.get();
+        m_race->start([this, alive, race](const boost::system::error_code& ec, tcp::endpoint const& ep) {
+            // Client gone or race superseded by a newer one
+            if (alive.expired() || race != m_race.get()) return;
+            if (ec == boost::asio::error::operation_aborted) {
+                m_race = nullptr;
+                return;
+            }
+            if (!ec) {
+                // Take ownership of the winning socket and remember it
+                // so it's tried first on next request
+                m_race->claim(m_socket);
+                m_endpoint = ep;
+                ResolverCache::markGood(m_conn->Host(), m_conn->Port(), ep);
+                auto it = find(m_endpoints.begin(), m_endpoints.end(), ep);
+                if (it != m_endpoints.end()) m_endpoints.erase(it);
+                m_endpoints.push_front(ep);
+            }
+            m_race = nullptr;
+            handle_connect(ec);
+        });
     } else {
         cwarn << "No more IP addresses to try for host: " << m_conn->Host();
         disconnect();
@@ -111,196 +153,283 @@ void EthGetworkClient::handle_connect(const boost::system::error_code& ec) {
 
             if (m_onConnected) m_onConnected();
             m_current_tstamp = chrono::steady_clock::now();
-        }
-
-        // Retrieve 1st line waiting in the queue and submit
-        // if other lines waiting they will be processed
-        // at the end of the processed request
-        JSONCPP_STRING err;
-        Json::CharReaderBuilder builder;
-        const std::unique_ptr<Json::CharReader> jRdr(builder.newCharReader());
-        string* line;
-        ostream os(&m_request);
-        if (!m_txQueue.empty()) {
-            while (m_txQueue.pop(line)) {
-                if (!line->empty()) {
-                    jRdr->parse(line->c_str(), line->c_str() + line->length(), &m_pendingJReq, &err);
-                    m_pending_tstamp = chrono::steady_clock::now();
-
-                    // Make sure path begins with "/"
-                    string _path = (m_conn->Path().empty() ? "/" : m_conn->Path());
-
-                    os << "POST " << _path << " HTTP/1.0\r\n";
-                    os << "Host: " << m_conn->Host() << "\r\n";
-                    os << "Content-Type: application/json"
-                       << "\r\n";
-                    os << "Content-Length: " << line->length() << "\r\n";
-                    os << "Connection: close\r\n\r\n";   // Double line feed to mark the
-                                                         // beginning of body
-                    // The payload
-                    os << *line;
 
-#ifdef DEV_BUILD
-                    // Out received message only for debug purpouses
-                    if (g_logOptions & LOG_JSON) cnote << " >> " << *line;
-#endif
-
-                    delete line;
-
-                    async_write(m_socket, m_request, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_write, this, boost::asio::placeholders::error)));
-                    break;
-                }
-                delete line;
+            // New heads subscription runs alongside polling
+            if (!m_pushUrl.empty() && !m_push) {
+                string key = m_conn->Host() + ":" + toString(m_conn->Port());
+                m_push = make_shared<NewHeadsSubscriber>(m_pushUrl);
+                m_push->start([this] { newHeadNotified(); },
+                              [key](bool subscribed) {
+                                  lock_guard<mutex> l(s_statsMutex);
+                                  s_stats[key].pushSubscribed = subscribed;
+                              });
             }
-        } else {
-            m_txPending.store(false, memory_order_relaxed);
         }
+
+        // Connection is kept open for all further requests
+        {
+            lock_guard<mutex> l(s_statsMutex);
+            s_stats[m_conn->Host() + ":" + toString(m_conn->Port())].connections++;
+        }
+        m_pipelining = false;
+        m_response.clear();
+        recv();
+        flush();
     } else {
         if (ec != boost::asio::error::operation_aborted) {
-            // This endpoint does not respond
-            // Pop it and retry
+            // None of the endpoints respond : cached resolution
+            // is no longer trusted
             cwarn << "Error connecting to " << m_conn->Host() << ":" << toString(m_conn->Port()) << " : " << ec.message();
-            m_endpoints.pop();
+            ResolverCache::invalidate(m_conn->Host(), m_conn->Port());
+            m_endpoints.clear();
             begin_connect();
         }
     }
 }
 
+void EthGetworkClient::discard_endpoint() {
+    // Demote the endpoint in use so next request
+    // starts from another one
+    ResolverCache::markBad(m_conn->Host(), m_conn->Port(), m_endpoint);
+    auto it = find(m_endpoints.begin(), m_endpoints.end(), m_endpoint);
+    if (it != m_endpoints.end()) m_endpoints.erase(it);
+}
+
+void EthGetworkClient::close_socket() {
+    boost::system::error_code ec;
+    if (m_socket.is_open()) m_socket.close(ec);
+    m_request.consume(m_request.size());
+    m_response.clear();
+    m_pipelining = false;
+
+    // Requests are sent again on next connection but written submissions :
+    // they may have been processed and sending them again could duplicate
+    // shares. Work and hashrate requests are harmless to repeat, and the
+    // getwork poll timer is only rearmed by a getwork response
+    for (auto& r: m_inflight) {
+        if (!r.written || r.id < 40) {
+            Request* p = new Request{r.id, std::move(r.body), {}, false, r.found};
+            if (!m_txQueue.bounded_push(p)) delete p;
+        } else if (r.id >= 40)
+            cwarn << "No response to solution submitted to " << m_conn->Host() << ":" << toString(m_conn->Port()) << " before connection loss";
+    }
+    m_inflight.clear();
+}
+
+void EthGetworkClient::flush() {
+    // A new connection flushes the queue once established
+    if (!m_socket.is_open()) {
+        begin_connect();
+        return;
+    }
+
+    // Until the server proves it keeps the connection alive
+    // wait for each response before sending next request
+    string path = (m_conn->Path().empty() ? "/" : m_conn->Path());
+    ostream os(&m_request);
+    Request* r;
+    while ((m_pipelining || m_inflight.empty()) && m_txQueue.pop(r)) {
+        os << "POST " << path << " HTTP/1.1\r\n";
+        os << "Host: " << m_conn->Host() << "\r\n";
+        os << "Content-Type: application/json\r\n";
+        os << "Content-Length: " << r->body.length() << "\r\n";
+        os << "Connection: keep-alive\r\n\r\n";   // Double line feed to mark the
+                                                   // beginning of body
+        // The payload
+        os << r->body;
+
+#ifdef DEV_BUILD
+        // Out sent message only for debug purpouses
+        if (g_logOptions & LOG_JSON) cnote << " >> " << r->body;
+#endif
+
+        if (!m_inflight.empty()) {
+            lock_guard<mutex> l(s_statsMutex);
+            s_stats[m_conn->Host() + ":" + toString(m_conn->Port())].pipelined++;
+        }
+        m_inflight.push_back({r->id, std::move(r->body), chrono::steady_clock::now(), false, r->found});
+        delete r;
+    }
+
+    if (!m_request.size()) {
+        // Nothing sendable now. A response will trigger next flush
+        m_txPending.store(false, memory_order_relaxed);
+        return;
+    }
+
+    // All requests ready go in a single write
+    async_write(m_socket, m_request, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_write, this, boost::asio::placeholders::error)));
+}
+
+void EthGetworkClient::recv() {
+    m_socket.async_read_some(boost::asio::buffer(m_recvBuffer), m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read, this, boost::asio::placeholders::error,
+                                                                                            boost::asio::placeholders::bytes_transferred)));
+}
+
 void EthGetworkClient::handle_write(const boost::system::error_code& ec) {
     if (!ec) {
-        // Transmission succesfully sent.
-        // Read the response async.
-        async_read(m_socket, m_response, boost::asio::transfer_all(),
-                   m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+        // Requests sent. Responses are read by the pending recv()
+        auto now = chrono::steady_clock::now();
+        for (auto& r: m_inflight) {
+            if (!r.written && r.found != chrono::steady_clock::time_point() && m_histograms) m_histograms->submit.record(now - r.found);
+            r.written = true;
+        }
+        m_txPending.store(false, memory_order_relaxed);
+        bool ex = false;
+        if (!m_txQueue.empty() && m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed)) flush();
     } else {
         if (ec != boost::asio::error::operation_aborted) {
-            cwarn << "Error writing to " << m_conn->Host() << ":" << toString(m_conn->Port()) << " : " << ec.message();
-            m_endpoints.pop();
+            // Socket already closed on our side (server closed
+            // the connection) is not an endpoint failure
+            if (m_socket.is_open()) {
+                cwarn << "Error writing to " << m_conn->Host() << ":" << toString(m_conn->Port()) << " : " << ec.message();
+                discard_endpoint();
+            }
+            close_socket();
             begin_connect();
         }
     }
 }
 
 void EthGetworkClient::handle_read(const boost::system::error_code& ec, size_t bytes_transferred) {
-    if (!ec || ec == boost::asio::error::eof) {
-        // Close socket
-        if (m_socket.is_open()) m_socket.close();
-
-        // Get the whole message
-        string rx_message(boost::asio::buffer_cast<const char*>(m_response.data()), bytes_transferred);
-        m_response.consume(bytes_transferred);
+    if (ec == boost::asio::error::operation_aborted) return;
+
+    bool eof = (ec == boost::asio::error::eof);
+    if (ec && !eof) {
+        // Connection reset (e.g. a stale keep alive one). Requests waiting
+        // for a response are sent again on a new one
+        if (!m_inflight.empty() || m_response.pending())
+            cnote << "Error reading from " << m_conn->Host() << ":" << toString(m_conn->Port()) << " : " << ec.message() << ". Reconnecting";
+        close_socket();
+        bool ex = false;
+        if (!m_txQueue.empty() && m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed)) flush();
+        return;
+    }
+    if (eof && m_inflight.empty() && !m_response.pending()) {
+        // Idle connection closed by server (keep alive timeout).
+        // Next request will open a new one
+        close_socket();
+        return;
+    }
 
-        // Empty response ?
-        if (rx_message.empty()) {
-            cwarn << "Invalid response from " << m_conn->Host() << ":" << toString(m_conn->Port());
+    m_response.append(m_recvBuffer.data(), bytes_transferred);
+
+    // Extract all complete responses. Http guarantees they come in
+    // the same order requests have been sent
+    bool keepAlive = !eof;
+    for (;;) {
+        auto result = m_response.next(eof);
+        if (result == HttpResponseParser::Result::NeedMore) break;
+        if (result == HttpResponseParser::Result::Error || m_inflight.empty()) {
+            cwarn << "Invalid response from " << m_conn->Host() << ":" << toString(m_conn->Port()) << " "
+                  << (result == HttpResponseParser::Result::Error ? m_response.error() : string("Unexpected response"));
             disconnect();
             return;
         }
 
-        // Read message by lines.
-        // First line is http status
-        // Other lines are headers
-        // A double "\r\n" identifies begin of body
-        // The rest is body
-        string line;
-        string linedelimiter = "\r\n";
-        size_t delimiteroffset = rx_message.find(linedelimiter);
-
-        unsigned int linenum = 0;
-        bool isHeader = true;
-        while (rx_message.length() && delimiteroffset != string::npos) {
-            linenum++;
-            line = rx_message.substr(0, delimiteroffset);
-            rx_message.erase(0, delimiteroffset + 2);
-
-            // This identifies the beginning of body
-            if (line.empty()) {
-                isHeader = false;
-                delimiteroffset = rx_message.find(linedelimiter);
-                if (delimiteroffset != string::npos) continue;
-                boost::replace_all(rx_message, "\n", "");
-                line = rx_message;
-            }
+        Request r = std::move(m_inflight.front());
+        m_inflight.pop_front();
+        account(r.id, r.tstamp);
 
-            // Http status
-            if (isHeader && linenum == 1) {
-                if (line.substr(0, 7) != "HTTP/1.") {
-                    cwarn << "Invalid response from " << m_conn->Host() << ":" << toString(m_conn->Port());
-                    disconnect();
-                    return;
-                }
-                size_t spaceoffset = line.find(' ');
-                if (spaceoffset == string::npos) {
-                    cwarn << "Invalid response from " << m_conn->Host() << ":" << toString(m_conn->Port());
-                    disconnect();
-                    return;
-                }
-                string status = line.substr(spaceoffset + 1);
-                if (status.substr(0, 3) != "200") {
-                    cwarn << m_conn->Host() << ":" << toString(m_conn->Port()) << " reported status " << status;
-                    disconnect();
-                    return;
-                }
-            }
+        if (m_response.status() != 200) {
+            cwarn << m_conn->Host() << ":" << toString(m_conn->Port()) << " reported status " << m_response.status() << " " << m_response.reason();
+            disconnect();
+            return;
+        }
+
+        // Server tells whether it keeps the connection alive
+        keepAlive = keepAlive && m_response.keepAlive();
+        m_pipelining = keepAlive;
 
-            // Body
-            if (!isHeader) {
+        string const& body = m_response.body();
 #ifdef DEV_BUILD
-                // Out received message only for debug purpouses
-                if (g_logOptions & LOG_JSON) cnote << " << " << line;
+        // Out received message only for debug purpouses
+        if (g_logOptions & LOG_JSON) cnote << " << " << body;
 #endif
 
-                // Test validity of chunk and process
-                //https://github.com/open-source-parsers/jsoncpp/issues/815
+        Json::Value jRes;
+        JSONCPP_STRING err;
+        if (m_jsonReader->parse(body.c_str(), body.c_str() + body.length(), &jRes, &err)) {
+            // Run in sync so no 2 different async reads may overlap
+            processResponse(jRes, r.id, r.tstamp);
+        } else {
+            boost::replace_all(err, "\n", " ");
+            cwarn << "Got invalid Json message : " << err;
+        }
 
-                Json::Value jRes;
-                JSONCPP_STRING err;
-                Json::CharReaderBuilder builder;
-                const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
-                if (reader->parse(line.c_str(), line.c_str() + line.length(), &jRes, &err)) {
-                    // Run in sync so no 2 different async reads may overlap
-                    processResponse(jRes);
-                } else {
-                    boost::replace_all(err, "\n", " ");
-                    cwarn << "Got invalid Json message : " << err;
-                }
-            }
+        if (!keepAlive) break;
+    }
 
-            delimiteroffset = rx_message.find(linedelimiter);
-        }
+    if (keepAlive) recv();
+    else
+        close_socket();
 
-        // Is there anything else in the queue
-        if (!m_txQueue.empty()) {
-            begin_connect();
-        } else {
-            // Signal end of async send/receive operations
-            m_txPending.store(false, memory_order_relaxed);
-        }
-    } else {
-        if (ec != boost::asio::error::operation_aborted) {
-            cwarn << "Error reading from :" << m_conn->Host() << ":" << toString(m_conn->Port()) << " : " << ec.message();
-            disconnect();
-        }
+    // Is there anything else in the queue
+    bool ex = false;
+    if (!m_txQueue.empty() && m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed)) flush();
+}
+
+void EthGetworkClient::account(unsigned id, chrono::steady_clock::time_point tstamp) {
+    unsigned us = unsigned(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - tstamp).count());
+    lock_guard<mutex> l(s_statsMutex);
+    RequestStats& stats = s_stats[m_conn->Host() + ":" + toString(m_conn->Port())];
+    stats.requests++;
+    if (id == 0 || id == 1) stats.getWork.add(us);
+    else if (id >= 40)
+        stats.submit.add(us);
+}
+
+void EthGetworkClient::newHeadNotified() {
+    // Only the first notification not yet turned into
+    // new work counts for latency
+    auto none = chrono::steady_clock::duration::zero();
+    m_pushTstamp.compare_exchange_strong(none, chrono::steady_clock::now().time_since_epoch(), memory_order_relaxed);
+    {
+        lock_guard<mutex> l(s_statsMutex);
+        s_stats[m_conn->Host() + ":" + toString(m_conn->Port())].pushNotified++;
     }
+    send(m_jsonGetWork, 1);
+}
+
+unsigned EthGetworkClient::recheckPeriod() const {
+    if (!m_push || !m_push->subscribed()) return m_farmRecheckPeriod;
+
+    // Node may announce the block slightly before it updates the
+    // work package : keep asking until the notification is served
+    if (m_pushTstamp.load(memory_order_relaxed) != chrono::steady_clock::duration::zero()) return min(m_farmRecheckPeriod, 100u);
+    return max(m_farmRecheckPeriod, s_pushRecheckPeriod);
+}
+
+EthGetworkClient::RequestStats EthGetworkClient::stats(string const& host, unsigned short port) {
+    lock_guard<mutex> l(s_statsMutex);
+    auto it = s_stats.find(host + ":" + toString(port));
+    return (it == s_stats.end() ? RequestStats() : it->second);
 }
 
 void EthGetworkClient::handle_resolve(const boost::system::error_code& ec, tcp::resolver::iterator i) {
     if (!ec) {
+        vector<tcp::endpoint> endpoints;
         while (i != tcp::resolver::iterator()) {
-            m_endpoints.push(i->endpoint());
+            endpoints.push_back(i->endpoint());
             i++;
         }
         m_resolver.cancel();
 
+        // Cache results and get them back ordered for racing
+        ResolverCache::store(m_conn->Host(), m_conn->Port(), endpoints);
+        auto ordered = ResolverCache::lookup(m_conn->Host(), m_conn->Port());
+        if (ordered.empty()) ordered = endpoints;   // Caching disabled
+        m_endpoints.assign(ordered.begin(), ordered.end());
+
         // Resolver has finished so invoke connection asynchronously
-        send(m_jsonGetWork);
+        send(m_jsonGetWork, 1);
     } else {
         cwarn << "Could not resolve host " << m_conn->Host() << ", " << ec.message();
         disconnect();
     }
 }
 
-void EthGetworkClient::processResponse(Json::Value& JRes) {
+void EthGetworkClient::processResponse(Json::Value& JRes, unsigned id, chrono::steady_clock::time_point tstamp) {
     unsigned _id = 0;          // This SHOULD be the same id as the request it is responding to
     bool _isSuccess = false;   // Whether this is a succesful or failed response
     string _errReason;         // Content of the error reason
@@ -309,10 +438,10 @@ void EthGetworkClient::processResponse(Json::Value& JRes) {
         cwarn << "Missing id member in response from " << m_conn->Host() << ":" << toString(m_conn->Port());
         return;
     }
-    // We get the id from pending jrequest
+    // We get the id from the request this response pairs with
     // It's not guaranteed we get response labelled with same id
     // For instance Dwarfpool always responds with "id":0
-    _id = m_pendingJReq.get("id", unsigned(0)).asUInt();
+    _id = id;
     _isSuccess = JRes.get("error", Json::Value::null).empty();
     _errReason = (_isSuccess ? "" : processError(JRes));
 
@@ -326,7 +455,8 @@ void EthGetworkClient::processResponse(Json::Value& JRes) {
         // In such case delay further requests
         // by 30 seconds.
         // Otherwise, resubmit another getwork request
-        // with a delay of m_farmRecheckPeriod ms.
+        // with a delay of m_farmRecheckPeriod ms (relaxed while
+        // new heads subscription is active).
         if (!_isSuccess) {
             cwarn << "Got " << _errReason << " from " << m_conn->Host() << ":" << toString(m_conn->Port());
             m_getwork_timer.expires_from_now(boost::posix_time::seconds(30));
@@ -347,8 +477,21 @@ void EthGetworkClient::processResponse(Json::Value& JRes) {
                     m_current_tstamp = chrono::steady_clock::now();
 
                     if (m_onWorkReceived) m_onWorkReceived(m_current);
+
+                    // Account the delay from new head notification to farm
+                    auto notified = m_pushTstamp.exchange(chrono::steady_clock::duration::zero(), memory_order_relaxed);
+                    if (notified != chrono::steady_clock::duration::zero()) {
+                        auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch() - notified).count();
+                        lock_guard<mutex> l(s_statsMutex);
+                        s_stats[m_conn->Host() + ":" + toString(m_conn->Port())].push.add(unsigned(us));
+                    }
+                } else {
+                    // Notification not followed by new work : stop insisting
+                    auto notified = m_pushTstamp.load(memory_order_relaxed);
+                    if (notified != chrono::steady_clock::duration::zero() && chrono::steady_clock::now().time_since_epoch() - notified > chrono::seconds(5))
+                        m_pushTstamp.store(chrono::steady_clock::duration::zero(), memory_order_relaxed);
                 }
-                m_getwork_timer.expires_from_now(boost::posix_time::milliseconds(m_farmRecheckPeriod));
+                m_getwork_timer.expires_from_now(boost::posix_time::milliseconds(recheckPeriod()));
                 m_getwork_timer.async_wait(m_io_strand.wrap(boost::bind(&EthGetworkClient::getwork_timer_elapsed, this, boost::asio::placeholders::error)));
             }
         }
@@ -358,7 +501,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes) {
     } else if (_id >= 40 && _id <= m_solution_submitted_max_id) {
         if (_isSuccess && JRes["result"].isConvertibleTo(Json::ValueType::booleanValue)) _isSuccess = JRes["result"].asBool();
 
-        chrono::milliseconds _delay = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_pending_tstamp);
+        chrono::milliseconds _delay = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - tstamp);
 
         const unsigned miner_index = _id - 40;
         if (_isSuccess) {
@@ -391,14 +534,20 @@ string EthGetworkClient::processError(Json::Value& JRes) {
     return retVar;
 }
 
-void EthGetworkClient::send(Json::Value const& jReq) { send(string(Json::writeString(m_jSwBuilder, jReq))); }
+bool EthGetworkClient::send(Json::Value const& jReq, chrono::steady_clock::time_point found) {
+    return send(string(Json::writeString(m_jSwBuilder, jReq)), jReq.get("id", unsigned(0)).asUInt(), found);
+}
 
-void EthGetworkClient::send(string const& sReq) {
-    auto* line = new string(sReq);
-    m_txQueue.bounded_push(line);
+bool EthGetworkClient::send(string const& sReq, unsigned id, chrono::steady_clock::time_point found) {
+    Request* r = new Request{id, sReq, {}, false, found};
+    if (!m_txQueue.bounded_push(r)) {
+        delete r;
+        return false;
+    }
 
     bool ex = false;
-    if (m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed)) begin_connect();
+    if (m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed)) m_io_strand.post(boost::bind(&EthGetworkClient::flush, this));
+    return true;
 }
 
 void EthGetworkClient::submitHashrate(uint64_t const& rate, string const& id) {
@@ -415,7 +564,7 @@ void EthGetworkClient::submitHashrate(uint64_t const& rate, string const& id) {
     }
 }
 
-void EthGetworkClient::submitSolution(const Solution& solution) {
+bool EthGetworkClient::submitSolution(const Solution& solution) {
     if (m_session) {
         Json::Value jReq;
         string nonceHex = toHex(solution.nonce);
@@ -429,8 +578,9 @@ void EthGetworkClient::submitSolution(const Solution& solution) {
         jReq["params"].append("0x" + nonceHex);
         jReq["params"].append("0x" + solution.work.header.hex());
         jReq["params"].append("0x" + solution.mixHash.hex());
-        send(jReq);
+        return send(jReq, solution.tstamp);
     }
+    return false;
 }
 
 void EthGetworkClient::getwork_timer_elapsed(const boost::system::error_code& ec) {
@@ -440,10 +590,10 @@ void EthGetworkClient::getwork_timer_elapsed(const boost::system::error_code& ec
         chrono::seconds _delay = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - m_current_tstamp);
         if (_delay.count() > m_worktimeout) {
             cwarn << "No new work received in " << m_worktimeout << " seconds.";
-            m_endpoints.pop();
+            discard_endpoint();
             disconnect();
         } else {
-            send(m_jsonGetWork);
+            send(m_jsonGetWork, 1);
         }
     }
 }
@@ -9,7 +9,11 @@
 
 #pragma once
 
+#include <array>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
 
 #include <boost/algorithm/string/predicate.hpp>
@@ -20,7 +24,10 @@
 
 #include <json/json.h>
 
+#include "../Endpoints.h"
 #include "../PoolClient.h"
+#include "HttpResponseParser.h"
+#include "NewHeadsSubscriber.h"
 
 using namespace std;
 using namespace dev;
@@ -28,46 +35,94 @@ using namespace eth;
 
 class EthGetworkClient : public PoolClient {
 public:
-    EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod);
+    EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod, std::string const& pushUrl = std::string());
     ~EthGetworkClient() override;
 
     void connect() override;
     void disconnect() override;
     void submitHashrate(uint64_t const& rate, string const& id) override;
-    void submitSolution(const Solution& solution) override;
+    bool submitSolution(const Solution& solution) override;
+
+    struct RequestLatency {
+        uint64_t count = 0;     // Number of responses
+        unsigned lastUs = 0;    // Latency of last response
+        unsigned maxUs = 0;     // Worst latency
+        uint64_t totalUs = 0;   // Cumulated latency
+
+        void add(unsigned us) {
+            count++;
+            lastUs = us;
+            maxUs = std::max(maxUs, us);
+            totalUs += us;
+        }
+    };
+    struct RequestStats {
+        unsigned connections = 0;   // Number of TCP connections opened
+        uint64_t requests = 0;      // Number of requests answered
+        uint64_t pipelined = 0;     // Number of requests sent while others were still waiting for response
+        RequestLatency getWork;     // eth_getWork round trips
+        RequestLatency submit;      // eth_submitWork round trips
+        bool pushSubscribed = false;   // Whether new heads subscription is active
+        uint64_t pushNotified = 0;     // Number of new heads notifications
+        RequestLatency push;           // Delay from new head notification to new work dispatched to farm
+    };
+
+    // Http requests statistics for host:port. Kept for the whole life of the miner
+    static RequestStats stats(std::string const& host, unsigned short port);
 
 private:
     unsigned m_farmRecheckPeriod = 500;   // In milliseconds
 
+    // While subscribed to new heads polling only acts as a safety net
+    static const unsigned s_pushRecheckPeriod = 5000;   // In milliseconds
+
     void begin_connect();
     void handle_resolve(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
     void handle_connect(const boost::system::error_code& ec);
+    void discard_endpoint();
+    void close_socket();
+    void flush();
+    void recv();
     void handle_write(const boost::system::error_code& ec);
     void handle_read(const boost::system::error_code& ec, std::size_t bytes_transferred);
     static std::string processError(Json::Value& JRes);
-    void processResponse(Json::Value& JRes);
-    void send(Json::Value const& jReq);
-    void send(std::string const& sReq);
+    void processResponse(Json::Value& JRes, unsigned id, std::chrono::steady_clock::time_point tstamp);
+    bool send(Json::Value const& jReq, std::chrono::steady_clock::time_point found = {});
+    bool send(std::string const& sReq, unsigned id, std::chrono::steady_clock::time_point found = {});
     void getwork_timer_elapsed(const boost::system::error_code& ec);
+    void account(unsigned id, std::chrono::steady_clock::time_point tstamp);
+    void newHeadNotified();
+    unsigned recheckPeriod() const;
 
     WorkPackage m_current;
 
+    struct Request {
+        unsigned id;
+        std::string body;
+        std::chrono::steady_clock::time_point tstamp;
+        bool written = false;   // Whole request handed to the socket
+        std::chrono::steady_clock::time_point found;   // When the solution was found (submissions only)
+    };
+
     std::atomic<bool> m_connecting = {false};   // Whether socket is on first try connect
-    std::atomic<bool> m_txPending = {false};    // Whether an async socket operation is pending
-    boost::lockfree::queue<std::string*> m_txQueue;
+    std::atomic<bool> m_txPending = {false};    // Whether a connection or write is pending
+    boost::lockfree::queue<Request*> m_txQueue;
+    std::deque<Request> m_inflight;   // Requests sent and waiting for response (in order)
+    bool m_pipelining = false;        // Whether server keeps current connection alive
 
     boost::asio::io_service::strand m_io_strand;
 
     boost::asio::ip::tcp::socket m_socket;
     boost::asio::ip::tcp::resolver m_resolver;
-    std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
+    std::deque<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
+    std::shared_ptr<EndpointRace> m_race;   // Pending happy eyeballs connection attempts
 
     boost::asio::streambuf m_request;
-    boost::asio::streambuf m_response;
+    std::array<char, 4096> m_recvBuffer;
+    HttpResponseParser m_response;
     Json::StreamWriterBuilder m_jSwBuilder;
+    std::unique_ptr<Json::CharReader> m_jsonReader;
     std::string m_jsonGetWork;
-    Json::Value m_pendingJReq;
-    std::chrono::time_point<std::chrono::steady_clock> m_pending_tstamp;
 
     boost::asio::deadline_timer m_getwork_timer;   // The timer which triggers getWork requests
 
@@ -75,5 +130,12 @@ private:
     int m_worktimeout;
     std::chrono::time_point<std::chrono::steady_clock> m_current_tstamp;
 
+    std::string m_pushUrl;
+    std::shared_ptr<NewHeadsSubscriber> m_push;
+    std::atomic<std::chrono::steady_clock::duration> m_pushTstamp = {std::chrono::steady_clock::duration::zero()};   // First not served notification
+
     unsigned m_solution_submitted_max_id;   // maximum json id we used to send a solution
+
+    static std::mutex s_statsMutex;
+    static std::map<std::string, RequestStats> s_stats;   // Keyed by host:port
 };
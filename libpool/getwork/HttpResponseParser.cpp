@@ -0,0 +1,149 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <cstdlib>
+
+#include <boost/algorithm/string.hpp>
+
+#include "HttpResponseParser.h"
+
+using namespace std;
+using namespace dev::eth;
+
+const size_t HttpResponseParser::s_maxHeaderSize;
+
+void HttpResponseParser::clear() {
+    m_buffer.clear();
+    m_status = 0;
+    m_reason.clear();
+    m_keepAlive = false;
+    m_body.clear();
+    m_error.clear();
+}
+
+HttpResponseParser::Result HttpResponseParser::fail(string const& _error) {
+    m_error = _error;
+    m_buffer.clear();
+    return Result::Error;
+}
+
+HttpResponseParser::Result HttpResponseParser::next(bool _eof) {
+    for (;;) {
+        size_t headerEnd = m_buffer.find("\r\n\r\n");
+        if (headerEnd == string::npos) {
+            if (m_buffer.size() > s_maxHeaderSize) return fail("Headers too large");
+            if (_eof && !m_buffer.empty()) return fail("Truncated response");
+            return Result::NeedMore;
+        }
+
+        // Status line
+        size_t lineEnd = m_buffer.find("\r\n");
+        string line = m_buffer.substr(0, lineEnd);
+        if (line.compare(0, 7, "HTTP/1.") != 0 || line.size() < 12 || line[8] != ' ') return fail("Invalid status line");
+        bool http11 = (line[7] != '0');
+        m_status = unsigned(atoi(line.c_str() + 9));
+        m_reason = (line.size() > 13 ? line.substr(13) : string());
+
+        // Headers we care of
+        bool chunked = false;
+        bool hasLength = false;
+        size_t length = 0;
+        m_keepAlive = http11;
+        size_t pos = lineEnd + 2;
+        while (pos < headerEnd) {
+            size_t eol = m_buffer.find("\r\n", pos);
+            string header = m_buffer.substr(pos, eol - pos);
+            pos = eol + 2;
+
+            size_t colon = header.find(':');
+            if (colon == string::npos) continue;
+            string name = boost::to_lower_copy(header.substr(0, colon));
+            string value = boost::to_lower_copy(boost::trim_copy(header.substr(colon + 1)));
+
+            if (name == "content-length") {
+                hasLength = true;
+                length = strtoul(value.c_str(), nullptr, 10);
+            } else if (name == "transfer-encoding") {
+                chunked = (value.find("chunked") != string::npos);
+            } else if (name == "connection") {
+                if (value.find("close") != string::npos) m_keepAlive = false;
+                else if (value.find("keep-alive") != string::npos)
+                    m_keepAlive = true;
+            }
+        }
+
+        size_t bodyBegin = headerEnd + 4;
+        size_t end = 0;
+        m_body.clear();
+
+        if (m_status / 100 == 1) {
+            // Interim response (100 Continue and alike) : skip it
+            m_buffer.erase(0, bodyBegin);
+            continue;
+        } else if (m_status == 204 || m_status == 304) {
+            end = bodyBegin;
+        } else if (chunked) {
+            if (!parseChunked(bodyBegin, end)) {
+                if (!m_error.empty()) return fail(m_error);
+                if (_eof) return fail("Truncated response");
+                return Result::NeedMore;
+            }
+        } else if (hasLength) {
+            if (m_buffer.size() - bodyBegin < length) {
+                if (_eof) return fail("Truncated response");
+                return Result::NeedMore;
+            }
+            m_body = m_buffer.substr(bodyBegin, length);
+            end = bodyBegin + length;
+        } else {
+            // Body delimited by connection close
+            if (!_eof) return Result::NeedMore;
+            m_body = m_buffer.substr(bodyBegin);
+            end = m_buffer.size();
+            m_keepAlive = false;
+        }
+
+        m_buffer.erase(0, end);
+        return Result::Complete;
+    }
+}
+
+bool HttpResponseParser::parseChunked(size_t _offset, size_t& _end) {
+    size_t pos = _offset;
+    for (;;) {
+        size_t eol = m_buffer.find("\r\n", pos);
+        if (eol == string::npos) return false;
+
+        // Chunk size, eventually followed by extensions
+        char* last = nullptr;
+        unsigned long size = strtoul(m_buffer.c_str() + pos, &last, 16);
+        if (last == m_buffer.c_str() + pos) {
+            m_error = "Invalid chunk size";
+            return false;
+        }
+        pos = eol + 2;
+
+        if (size == 0) {
+            // Skip trailers up to the empty line
+            for (;;) {
+                eol = m_buffer.find("\r\n", pos);
+                if (eol == string::npos) return false;
+                bool empty = (eol == pos);
+                pos = eol + 2;
+                if (empty) break;
+            }
+            _end = pos;
+            return true;
+        }
+
+        if (m_buffer.size() < pos + size + 2) return false;
+        m_body.append(m_buffer, pos, size);
+        pos += size + 2;
+    }
+}
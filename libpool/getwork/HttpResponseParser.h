@@ -0,0 +1,58 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace dev::eth {
+
+// Incremental HTTP/1.x response parser.
+// Bytes are appended as they come from the socket and complete responses
+// are extracted one at a time, so several pipelined responses arriving in
+// the same read (or one response spread over many reads) are handled alike.
+// Bodies may be delimited by Content-Length, chunked transfer encoding or,
+// as a last resort, by the server closing the connection.
+class HttpResponseParser {
+public:
+    enum class Result { NeedMore, Complete, Error };
+
+    void append(const char* _data, size_t _size) { m_buffer.append(_data, _size); }
+
+    // Extracts next response. With _eof a body delimited by connection close completes
+    Result next(bool _eof = false);
+
+    void clear();
+
+    bool pending() const { return !m_buffer.empty(); }
+
+    // Valid after next() returned Complete
+    unsigned status() const { return m_status; }
+    std::string const& reason() const { return m_reason; }
+    bool keepAlive() const { return m_keepAlive; }
+    std::string const& body() const { return m_body; }
+
+    // Valid after next() returned Error
+    std::string const& error() const { return m_error; }
+
+    static const size_t s_maxHeaderSize = 16384;
+
+private:
+    Result fail(std::string const& _error);
+    bool parseChunked(size_t _offset, size_t& _end);
+
+    std::string m_buffer;
+    unsigned m_status = 0;
+    std::string m_reason;
+    bool m_keepAlive = false;
+    std::string m_body;
+    std::string m_error;
+};
+
+}   // namespace dev::eth
@@ -0,0 +1,297 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <libdev/Log.h>
+
+#include "../PoolClient.h"
+#include "NewHeadsSubscriber.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+using boost::asio::ip::tcp;
+namespace websocket = boost::beast::websocket;
+
+const unsigned NewHeadsSubscriber::s_retryDelay;
+
+bool NewHeadsSubscriber::validUrl(string const& _url) {
+    if (_url.compare(0, 5, "ws://") == 0) return _url.size() > 5;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    if (_url.compare(0, 6, "ipc://") == 0) return _url.size() > 6;
+#endif
+    return false;
+}
+
+NewHeadsSubscriber::NewHeadsSubscriber(string const& _url)
+    : m_url(_url), m_strand(g_io_service), m_resolver(g_io_service), m_retryTimer(g_io_service) {
+    m_jsonReader.reset(Json::CharReaderBuilder().newCharReader());
+
+    if (m_url.compare(0, 6, "ipc://") == 0) {
+        m_ipc = true;
+        m_target = m_url.substr(6);
+        return;
+    }
+
+    // ws://host[:port][/path]
+    string rest = m_url.substr(5);
+    size_t slash = rest.find('/');
+    m_target = (slash == string::npos ? "/" : rest.substr(slash));
+    string authority = rest.substr(0, slash);
+    size_t colon = authority.rfind(':');
+    if (colon != string::npos && authority.find(']', colon) == string::npos) {
+        m_host = authority.substr(0, colon);
+        m_port = authority.substr(colon + 1);
+    } else {
+        m_host = authority;
+        m_port = "8546";
+    }
+    if (m_host.size() > 1 && m_host.front() == '[' && m_host.back() == ']') m_host = m_host.substr(1, m_host.size() - 2);
+}
+
+void NewHeadsSubscriber::start(Notified const& _onNotified, StateChanged const& _onStateChanged) {
+    {
+        lock_guard<mutex> l(m_mutex);
+        m_onNotified = _onNotified;
+        m_onStateChanged = _onStateChanged;
+    }
+    m_stopped.store(false, memory_order_relaxed);
+    m_strand.post([self = shared_from_this()] { self->connect(); });
+}
+
+void NewHeadsSubscriber::stop() {
+    {
+        lock_guard<mutex> l(m_mutex);
+        m_onNotified = nullptr;
+        m_onStateChanged = nullptr;
+    }
+    m_stopped.store(true, memory_order_relaxed);
+    m_strand.post([self = shared_from_this()] {
+        self->m_retryTimer.cancel();
+        self->m_resolver.cancel();
+        self->close();
+    });
+}
+
+void NewHeadsSubscriber::setSubscribed(bool _subscribed) {
+    if (m_subscribed.exchange(_subscribed, memory_order_relaxed) == _subscribed) return;
+    lock_guard<mutex> l(m_mutex);
+    if (m_onStateChanged) m_onStateChanged(_subscribed);
+}
+
+void NewHeadsSubscriber::close() {
+    boost::system::error_code ec;
+    if (m_ws) {
+        // Say goodbye if the session is up. Pending operations complete
+        // (or time out) before the handler drops the last reference
+        auto ws = m_ws;
+        if (ws->is_open())
+            ws->async_close(websocket::close_code::normal, m_strand.wrap([ws](boost::system::error_code const&) {
+                boost::system::error_code ignored;
+                ws->next_layer().close(ignored);
+            }));
+        else
+            ws->next_layer().close(ec);
+        m_ws.reset();
+        m_wsBuffer.reset();
+    }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    if (m_ipcSocket) m_ipcSocket->close(ec);
+    m_ipcSocket.reset();
+#endif
+    m_ipcBuffer.clear();
+}
+
+void NewHeadsSubscriber::fail(string const& _what, boost::system::error_code const& _ec) {
+    if (m_stopped.load(memory_order_relaxed) || _ec == boost::asio::error::operation_aborted) return;
+
+    // Warn once per subscription lost (or never established), not on every retry
+    if (subscribed() || !m_warned) cwarn << "New heads subscription to " << m_url << " failed (" << _what << " : " << _ec.message() << "). Falling back to polling";
+    m_warned = true;
+    close();
+    setSubscribed(false);
+
+    m_retryTimer.expires_from_now(boost::posix_time::seconds(s_retryDelay));
+    m_retryTimer.async_wait(m_strand.wrap([self = shared_from_this()](boost::system::error_code const& ec) {
+        if (!ec && !self->m_stopped.load(memory_order_relaxed)) self->connect();
+    }));
+}
+
+void NewHeadsSubscriber::connect() {
+    if (m_stopped.load(memory_order_relaxed)) return;
+    auto self = shared_from_this();
+
+    if (m_ipc) {
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+        m_ipcSocket = make_unique<boost::asio::local::stream_protocol::socket>(g_io_service);
+        m_ipcSocket->async_connect(boost::asio::local::stream_protocol::endpoint(m_target), m_strand.wrap([self](boost::system::error_code const& ec) {
+            if (ec) self->fail("connect", ec);
+            else
+                self->subscribe();
+        }));
+#endif
+        return;
+    }
+
+    m_resolver.async_resolve(tcp::resolver::query(m_host, m_port), m_strand.wrap([self](boost::system::error_code const& ec, tcp::resolver::iterator it) {
+        if (ec) {
+            self->fail("resolve", ec);
+            return;
+        }
+        auto ws = make_shared<websocket::stream<tcp::socket>>(g_io_service);
+        // Bounds the closing handshake too
+        ws->set_option(websocket::stream_base::timeout{chrono::seconds(s_retryDelay), websocket::stream_base::none(), false});
+        self->m_ws = ws;
+        self->m_wsBuffer = make_shared<boost::beast::flat_buffer>();
+        boost::asio::async_connect(ws->next_layer(), it, self->m_strand.wrap([self, ws](boost::system::error_code const& ec, tcp::resolver::iterator) {
+            if (ws != self->m_ws) return;
+            if (ec) self->fail("connect", ec);
+            else
+                self->handshake();
+        }));
+    }));
+}
+
+void NewHeadsSubscriber::handshake() {
+    auto self = shared_from_this();
+    auto ws = m_ws;
+    boost::system::error_code ignored;
+    ws->next_layer().set_option(tcp::no_delay(true), ignored);
+    ws->async_handshake(m_host + ":" + m_port, m_target, m_strand.wrap([self, ws](boost::system::error_code const& ec) {
+        if (ws != self->m_ws) return;
+        if (ec) self->fail("handshake", ec);
+        else
+            self->subscribe();
+    }));
+}
+
+void NewHeadsSubscriber::subscribe() {
+    auto self = shared_from_this();
+    m_request = R"({"id":1,"jsonrpc":"2.0","method":"eth_subscribe","params":["newHeads"]})";
+    auto written = m_strand.wrap([self, ws = m_ws](boost::system::error_code const& ec, size_t) {
+        if (ec && ws == self->m_ws) self->fail("write", ec);
+    });
+
+    if (m_ws) {
+        m_ws->text(true);
+        m_ws->async_write(boost::asio::buffer(m_request), written);
+    }
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    else {
+        m_request.push_back('\n');
+        boost::asio::async_write(*m_ipcSocket, boost::asio::buffer(m_request), written);
+    }
+#endif
+    read();
+}
+
+void NewHeadsSubscriber::read() {
+    auto self = shared_from_this();
+
+    if (m_ws) {
+        auto ws = m_ws;
+        auto buffer = m_wsBuffer;
+        ws->async_read(*buffer, m_strand.wrap([self, ws, buffer](boost::system::error_code const& ec, size_t) {
+            if (ws != self->m_ws) return;
+            if (ec) {
+                self->fail("read", ec);
+                return;
+            }
+            auto data = buffer->data();
+            const char* first = static_cast<const char*>(data.data());
+            self->process(first, first + data.size());
+            buffer->consume(buffer->size());
+            // Processing may have closed the stream
+            if (ws == self->m_ws) self->read();
+        }));
+        return;
+    }
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    auto socket = m_ipcSocket.get();
+    m_ipcSocket->async_read_some(boost::asio::buffer(m_ipcRecvBuffer), m_strand.wrap([self, socket](boost::system::error_code const& ec, size_t bytes) {
+        if (socket != self->m_ipcSocket.get()) return;
+        if (ec) {
+            self->fail("read", ec);
+            return;
+        }
+
+        // Nodes write one json object after the other (usually,
+        // but not necessarily, newline separated) : split them
+        // on balanced braces outside of strings
+        string& buf = self->m_ipcBuffer;
+        buf.append(self->m_ipcRecvBuffer.data(), bytes);
+        size_t begin = 0;
+        int depth = 0;
+        bool inString = false, escaped = false;
+        for (size_t i = 0; i < buf.size(); i++) {
+            char c = buf[i];
+            if (inString) {
+                if (escaped) escaped = false;
+                else if (c == '\\')
+                    escaped = true;
+                else if (c == '"')
+                    inString = false;
+                continue;
+            }
+            if (c == '"') inString = true;
+            else if (c == '{')
+                depth++;
+            else if (c == '}' && --depth == 0) {
+                self->process(buf.data() + begin, buf.data() + i + 1);
+                // Processing may have closed the socket
+                if (socket != self->m_ipcSocket.get()) return;
+                begin = i + 1;
+            }
+        }
+        buf.erase(0, begin);
+        if (buf.size() > 1048576) {
+            self->fail("read", boost::asio::error::message_size);
+            return;
+        }
+        self->read();
+    }));
+#endif
+}
+
+void NewHeadsSubscriber::process(const char* _first, const char* _last) {
+    // Skip separators before the object
+    while (_first < _last && *_first != '{') _first++;
+    if (_first == _last) return;
+
+    Json::Value jMsg;
+    JSONCPP_STRING err;
+    if (!m_jsonReader->parse(_first, _last, &jMsg, &err)) {
+        cwarn << "Got invalid Json message from " << m_url;
+        return;
+    }
+
+    Json::Value const& jId = jMsg.get("id", Json::Value::null);
+    if (jId.isUInt() && jId.asUInt() == 1) {
+        // Response to eth_subscribe
+        if (!jMsg.get("error", Json::Value::null).isNull() || !jMsg["result"].isString()) {
+            cwarn << "Node at " << m_url << " refused newHeads subscription. Falling back to polling";
+            close();
+            m_retryTimer.expires_from_now(boost::posix_time::seconds(s_retryDelay * 12));
+            m_retryTimer.async_wait(m_strand.wrap([self = shared_from_this()](boost::system::error_code const& ec) {
+                if (!ec && !self->m_stopped.load(memory_order_relaxed)) self->connect();
+            }));
+            return;
+        }
+        cnote << "Subscribed to new heads on " << m_url;
+        m_warned = false;
+        setSubscribed(true);
+        return;
+    }
+
+    if (jMsg.get("method", "").asString() == "eth_subscription") {
+        lock_guard<mutex> l(m_mutex);
+        if (m_onNotified) m_onNotified();
+    }
+}
@@ -0,0 +1,91 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <json/json.h>
+
+namespace dev::eth {
+
+// Keeps an eth_subscribe("newHeads") subscription open on a node and
+// reports each announced block, so the getwork client can request work
+// immediately instead of waiting for next poll.
+// Endpoint is either a WebSocket JSON-RPC url (ws://host:port[/path]) or,
+// where unix domain sockets are available, the node's IPC socket
+// (ipc:///path/to/node.ipc). Lost connections are retried every
+// s_retryDelay seconds.
+class NewHeadsSubscriber : public std::enable_shared_from_this<NewHeadsSubscriber> {
+public:
+    using Notified = std::function<void()>;
+    using StateChanged = std::function<void(bool)>;
+
+    explicit NewHeadsSubscriber(std::string const& _url);
+
+    // Whether _url is an endpoint we can subscribe to
+    static bool validUrl(std::string const& _url);
+
+    void start(Notified const& _onNotified, StateChanged const& _onStateChanged);
+    void stop();
+
+    bool subscribed() const { return m_subscribed.load(std::memory_order_relaxed); }
+    std::string const& url() const { return m_url; }
+
+    static const unsigned s_retryDelay = 5;
+
+private:
+    void connect();
+    void handshake();
+    void subscribe();
+    void read();
+    void process(const char* _first, const char* _last);
+    void fail(std::string const& _what, boost::system::error_code const& _ec);
+    void close();
+    void setSubscribed(bool _subscribed);
+
+    std::string m_url;
+    bool m_ipc = false;
+    std::string m_host;
+    std::string m_port;
+    std::string m_target;   // WebSocket resource or IPC socket path
+
+    boost::asio::io_service::strand m_strand;
+    boost::asio::ip::tcp::resolver m_resolver;
+    boost::asio::deadline_timer m_retryTimer;
+    // Both shared with pending handlers : a closed stream lives until they have completed
+    std::shared_ptr<boost::beast::websocket::stream<boost::asio::ip::tcp::socket>> m_ws;
+    std::shared_ptr<boost::beast::flat_buffer> m_wsBuffer;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    std::unique_ptr<boost::asio::local::stream_protocol::socket> m_ipcSocket;
+#endif
+    std::array<char, 4096> m_ipcRecvBuffer;
+    std::string m_ipcBuffer;   // IPC stream is a sequence of json objects
+    std::string m_request;
+    std::unique_ptr<Json::CharReader> m_jsonReader;
+
+    std::atomic<bool> m_subscribed = {false};
+    std::atomic<bool> m_stopped = {false};
+    bool m_warned = false;   // Whether failure has already been reported
+
+    std::mutex m_mutex;   // Guards handlers against stop()
+    Notified m_onNotified;
+    StateChanged m_onStateChanged;
+};
+
+}   // namespace dev::eth
@@ -0,0 +1,652 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <libdev/Log.h>
+
+#include "../PoolClient.h"
+#include "ProxyServer.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+using boost::asio::ip::tcp;
+
+const unsigned ProxyServer::s_sliceNibbles;
+const unsigned ProxyServer::s_maxSlices;
+const unsigned ProxyServer::s_minerBase;
+const unsigned ProxyServer::s_maxJobs;
+
+ProxyServer::ProxyServer(string const& _address, unsigned short _port)
+    : m_address(_address), m_port(_port), m_strand(g_io_service), m_acceptor(g_io_service), m_slices(s_maxSlices, false) {
+    // Slice 0 is for local devices
+    m_slices[0] = true;
+}
+
+ProxyServer::~ProxyServer() { stop(); }
+
+void ProxyServer::start() {
+    tcp::endpoint endpoint(boost::asio::ip::address::from_string(m_address), m_port);
+    try {
+        m_acceptor.open(endpoint.protocol());
+        m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+        m_acceptor.bind(endpoint);
+        m_acceptor.listen(64);
+    } catch (const exception& _ex) {
+        cwarn << "Could not start proxy on " << m_address << ":" << m_port << " : " << _ex.what();
+        cwarn << "Ensure port is not in use by another service";
+        return;
+    }
+
+    cnote << "Proxy listening on " << m_address << ":" << m_port;
+    m_running.store(true, memory_order_relaxed);
+    m_verifier = thread([this] { verifyLoop(); });
+    m_strand.post([self = shared_from_this()] { self->accept(); });
+}
+
+void ProxyServer::stop() {
+    if (!m_running.exchange(false, memory_order_relaxed)) return;
+
+    boost::system::error_code ec;
+    m_acceptor.close(ec);
+
+    // Shares still waiting for verification are never forwarded
+    deque<function<void()>> dropped;
+    {
+        lock_guard<mutex> l(m_verifyMutex);
+        dropped.swap(m_verifyQueue);
+    }
+    m_verifyCv.notify_all();
+    if (m_verifier.joinable()) {
+        if (m_verifier.get_id() == this_thread::get_id()) m_verifier.detach();
+        else
+            m_verifier.join();
+    }
+
+    vector<shared_ptr<ProxyConnection>> connections;
+    {
+        lock_guard<mutex> l(m_mutex);
+        connections = m_connections;
+    }
+    m_strand.post([connections] {
+        for (auto& c: connections) c->close();
+    });
+}
+
+void ProxyServer::accept() {
+    if (!m_running.load(memory_order_relaxed)) return;
+
+    auto self = shared_from_this();
+    auto connection = make_shared<ProxyConnection>(self);
+    m_acceptor.async_accept(connection->socket(), m_strand.wrap([this, self, connection](boost::system::error_code const& ec) {
+        if (ec) {
+            if (ec != boost::asio::error::operation_aborted) accept();
+            return;
+        }
+
+        // Look for a free slice starting after the last one handed out
+        unsigned slice = 0;
+        for (unsigned i = 0; i < s_maxSlices - 1 && !slice; i++) {
+            unsigned s = 1 + (m_nextSlice - 1 + i) % (s_maxSlices - 1);
+            if (!m_slices[s]) slice = s;
+        }
+
+        if (!slice) {
+            m_refused.fetch_add(1, memory_order_relaxed);
+            boost::system::error_code ignored;
+            cwarn << "Proxy : no more nonce slices available. Connection from " << connection->socket().remote_endpoint(ignored) << " refused";
+            connection->socket().close(ignored);
+        } else {
+            m_slices[slice] = true;
+            m_nextSlice = slice % (s_maxSlices - 1) + 1;
+            {
+                lock_guard<mutex> l(m_mutex);
+                m_connections.push_back(connection);
+            }
+            connection->start(slice);
+        }
+
+        accept();
+    }));
+}
+
+void ProxyServer::release(unsigned _slice) {
+    m_slices[_slice] = false;
+
+    lock_guard<mutex> l(m_mutex);
+    auto it = find_if(m_connections.begin(), m_connections.end(), [_slice](shared_ptr<ProxyConnection> const& c) { return c->slice() == _slice; });
+    if (it != m_connections.end()) m_connections.erase(it);
+}
+
+WorkPackage ProxyServer::slice(WorkPackage const& _wp, unsigned _slice) {
+    WorkPackage wp = _wp;
+    uint64_t prefixMask = (_wp.exSizeBytes ? ~0ULL << (64 - 4 * _wp.exSizeBytes) : 0ULL);
+    wp.startNonce = (_wp.startNonce & prefixMask) | (uint64_t(_slice) << (64 - 4 * (_wp.exSizeBytes + s_sliceNibbles)));
+    wp.exSizeBytes = _wp.exSizeBytes + s_sliceNibbles;
+    return wp;
+}
+
+WorkPackage ProxyServer::localWork(WorkPackage const& _wp) {
+    if (!_wp || !sliceable(_wp)) return _wp;
+
+    lock_guard<mutex> l(m_localMutex);
+    m_localJobs.push_front(_wp);
+    if (m_localJobs.size() > s_maxJobs) m_localJobs.pop_back();
+    return slice(_wp, 0);
+}
+
+void ProxyServer::localSolution(Solution& _sol) {
+    lock_guard<mutex> l(m_localMutex);
+    for (auto const& wp: m_localJobs)
+        if (wp.header == _sol.work.header && wp.job == _sol.work.job) {
+            _sol.work.startNonce = wp.startNonce;
+            _sol.work.exSizeBytes = wp.exSizeBytes;
+            return;
+        }
+}
+
+void ProxyServer::setWork(WorkPackage const& _wp) {
+    m_strand.post([this, self = shared_from_this(), wp = _wp]() mutable {
+        if (wp && !sliceable(wp)) {
+            if (!m_warned) cwarn << "Proxy : pool extranonce too long to split nonce space among workers. Not serving work";
+            m_warned = true;
+            wp = WorkPackage();
+        }
+
+        m_current = wp;
+        if (wp) {
+            m_jobs.emplace_front(toCompactHex(++m_jobSeq), wp);
+            if (m_jobs.size() > s_maxJobs) m_jobs.pop_back();
+        } else {
+            m_jobs.clear();
+        }
+
+        vector<shared_ptr<ProxyConnection>> connections;
+        {
+            lock_guard<mutex> l(m_mutex);
+            connections = m_connections;
+        }
+        for (auto& c: connections) {
+            if (!wp) c->abort("Pool connection lost");
+            c->notify();
+        }
+    });
+}
+
+void ProxyServer::accountSolution(unsigned _midx, bool _accepted, bool _stale, chrono::milliseconds const& _delay) {
+    m_strand.post([this, self = shared_from_this(), _midx, _accepted, _stale, _delay] {
+        shared_ptr<ProxyConnection> connection;
+        {
+            lock_guard<mutex> l(m_mutex);
+            for (auto& c: m_connections)
+                if (c->slice() == _midx - s_minerBase) connection = c;
+        }
+        if (connection) connection->answer(_accepted, _stale, _delay);
+    });
+}
+
+WorkPackage const* ProxyServer::findJob(string const& _job) const {
+    for (auto const& j: m_jobs)
+        if (j.first == _job) return &j.second;
+    return nullptr;
+}
+
+WorkPackage const* ProxyServer::findHeader(h256 const& _header) const {
+    for (auto const& j: m_jobs)
+        if (j.second.header == _header) return &j.second;
+    return nullptr;
+}
+
+void ProxyServer::verify(function<void()> _task) {
+    {
+        lock_guard<mutex> l(m_verifyMutex);
+        if (!m_running.load(memory_order_relaxed)) return;
+        m_verifyQueue.push_back(move(_task));
+    }
+    m_verifyCv.notify_one();
+}
+
+void ProxyServer::verifyLoop() {
+    setThreadName("proxy");
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> l(m_verifyMutex);
+            m_verifyCv.wait(l, [this] { return !m_verifyQueue.empty() || !m_running.load(memory_order_relaxed); });
+            if (!m_running.load(memory_order_relaxed)) return;
+            task = move(m_verifyQueue.front());
+            m_verifyQueue.pop_front();
+        }
+        task();
+    }
+}
+
+uint64_t ProxyServer::hashRate() {
+    uint64_t rate = 0;
+    lock_guard<mutex> l(m_mutex);
+    for (auto& c: m_connections) rate += c->stats().hashrate;
+    return rate;
+}
+
+Json::Value ProxyServer::getJson() {
+    auto now = chrono::steady_clock::now();
+
+    Json::Value jRes;
+    jRes["listen"] = m_address + ":" + to_string(m_port);
+    jRes["refused"] = m_refused.load(memory_order_relaxed);
+
+    Json::Value jWorkers = Json::Value(Json::arrayValue);
+    lock_guard<mutex> l(m_mutex);
+    for (auto& c: m_connections) {
+        ProxyConnection::Stats s = c->stats();
+        Json::Value jWorker;
+        jWorker["slice"] = c->slice();
+        jWorker["address"] = s.address;
+        jWorker["protocol"] = s.protocol;
+        jWorker["worker"] = s.worker;
+        jWorker["runtime"] = Json::UInt64(chrono::duration_cast<chrono::seconds>(now - s.start).count());
+        jWorker["hashrate"] = Json::UInt64(s.hashrate);
+
+        Json::Value jShares;
+        jShares["submitted"] = s.submitted;
+        jShares["forwarded"] = s.forwarded;
+        jShares["accepted"] = s.accepted;
+        jShares["stale"] = s.stale;
+        jShares["rejected"] = s.rejected;
+        jShares["invalid"] = s.invalid;
+        jShares["pending"] = s.pending;
+        jShares["avgms"] = (s.accepted + s.rejected) ? Json::UInt64(s.totalDelayMs / (s.accepted + s.rejected)) : Json::UInt64(0);
+        jShares["lastsecs"] = s.submitted ? Json::UInt64(chrono::duration_cast<chrono::seconds>(now - s.lastShare).count()) : Json::UInt64(0);
+        jWorker["shares"] = jShares;
+
+        jWorkers.append(jWorker);
+    }
+    jRes["workers"] = jWorkers;
+
+    return jRes;
+}
+
+ProxyConnection::ProxyConnection(shared_ptr<ProxyServer> const& _server) : m_server(_server), m_socket(g_io_service) {
+    m_jsonReader.reset(Json::CharReaderBuilder().newCharReader());
+    m_jSwBuilder.settings_["indentation"] = "";
+}
+
+void ProxyConnection::start(unsigned _slice) {
+    m_slice = _slice;
+
+    boost::system::error_code ec;
+    auto ep = m_socket.remote_endpoint(ec);
+    m_socket.set_option(tcp::no_delay(true), ec);
+    {
+        lock_guard<mutex> l(m_statsMutex);
+        m_stats.address = toString(ep);
+    }
+    cnote << "Proxy : connection from " << ep << " on nonce slice " << m_slice;
+
+    recv();
+}
+
+void ProxyConnection::close() {
+    if (m_closed) return;
+    m_closed = true;
+
+    boost::system::error_code ec;
+    m_socket.shutdown(tcp::socket::shutdown_both, ec);
+    m_socket.close(ec);
+    m_pending.clear();
+
+    cnote << "Proxy : worker " << (m_stats.worker.empty() ? m_stats.address : m_stats.worker) << " disconnected";
+
+    // Last as it may drop the last reference to this connection
+    m_server->release(m_slice);
+}
+
+ProxyConnection::Stats ProxyConnection::stats() {
+    lock_guard<mutex> l(m_statsMutex);
+    return m_stats;
+}
+
+void ProxyConnection::recv() {
+    auto self = shared_from_this();
+    m_socket.async_read_some(m_framer.prepare(), m_server->m_strand.wrap([self](boost::system::error_code const& ec, size_t bytes) {
+        if (self->m_closed) return;
+        if (ec) {
+            self->close();
+            return;
+        }
+
+        self->m_framer.commit(bytes);
+        if (!self->m_framer.lines([&self](const char* first, const char* last) { self->processLine(first, last); })) {
+            cwarn << "Proxy : worker " << self->m_stats.address << " sent a line too long";
+            self->close();
+            return;
+        }
+        if (!self->m_closed) self->recv();
+    }));
+}
+
+void ProxyConnection::processLine(const char* _first, const char* _last) {
+    if (m_closed) return;
+
+    Json::Value jReq;
+    JSONCPP_STRING err;
+    if (!m_jsonReader->parse(_first, _last, &jReq, &err) || !jReq.isObject()) {
+        cwarn << "Proxy : got invalid Json message from " << m_stats.address;
+        close();
+        return;
+    }
+    processRequest(jReq);
+}
+
+void ProxyConnection::processRequest(Json::Value& _jReq) {
+    Json::Value id = _jReq.get("id", Json::Value::null);
+    string method = _jReq.get("method", "").asString();
+    Json::Value params = _jReq.get("params", Json::Value(Json::arrayValue));
+    if (!params.isArray()) params = Json::Value(Json::arrayValue);
+
+    auto setWorker = [this](string const& _worker, string const& _protocol) {
+        lock_guard<mutex> l(m_statsMutex);
+        m_stats.worker = _worker;
+        m_stats.protocol = _protocol;
+    };
+
+    if (method == "mining.subscribe" && m_protocol != Protocol::EthProxy) {
+        // EthereumStratum/1.0.0 only : plain stratum has no way
+        // to tell the miner its extranonce
+        string proto = params.get(Json::Value::ArrayIndex(1), "").asString();
+        if (proto != "EthereumStratum/1.0.0") {
+            reply(id, Json::Value::null, "Unsupported protocol");
+            return;
+        }
+        m_protocol = Protocol::EthereumStratum;
+        m_sentExtraNonce = extraNonce();
+
+        Json::Value jNotify = Json::Value(Json::arrayValue);
+        jNotify.append("mining.notify");
+        jNotify.append(toHex(uint32_t(m_slice)));
+        jNotify.append("EthereumStratum/1.0.0");
+        Json::Value jResult = Json::Value(Json::arrayValue);
+        jResult.append(jNotify);
+        jResult.append(m_sentExtraNonce);
+        reply(id, jResult);
+        setWorker("", "EthereumStratum/1.0.0");
+    }
+
+    else if (method == "mining.extranonce.subscribe" && m_protocol == Protocol::EthereumStratum) {
+        reply(id, true);
+    }
+
+    else if (method == "mining.authorize" && m_protocol == Protocol::EthereumStratum) {
+        m_authorized = true;
+        setWorker(params.get(Json::Value::ArrayIndex(0), "").asString(), "EthereumStratum/1.0.0");
+        reply(id, true);
+        notify();
+    }
+
+    else if (method == "eth_submitLogin" && m_protocol != Protocol::EthereumStratum) {
+        m_protocol = Protocol::EthProxy;
+        m_authorized = true;
+        string worker = params.get(Json::Value::ArrayIndex(0), "").asString();
+        if (_jReq.isMember("worker")) worker += "." + _jReq["worker"].asString();
+        setWorker(worker, "Eth-Proxy");
+        reply(id, true);
+    }
+
+    else if (method == "eth_getWork" && m_protocol == Protocol::EthProxy) {
+        if (!m_server->m_current) {
+            reply(id, Json::Value::null, "No work available");
+            return;
+        }
+        WorkPackage const& wp = m_server->m_current;
+        Json::Value jResult = Json::Value(Json::arrayValue);
+        jResult.append(wp.header.hex(HexPrefix::Add));
+        jResult.append(wp.seed.hex(HexPrefix::Add));
+        jResult.append(wp.boundary.hex(HexPrefix::Add));
+        if (wp.block >= 0) jResult.append(toCompactHex(uint32_t(wp.block), HexPrefix::Add));
+        reply(id, jResult);
+    }
+
+    else if (method == "mining.submit" && m_authorized && m_protocol == Protocol::EthereumStratum) {
+        // [worker, job, nonce] where nonce usually lacks the extranonce
+        WorkPackage const* wp = m_server->findJob(params.get(Json::Value::ArrayIndex(1), "").asString());
+        string nonce = params.get(Json::Value::ArrayIndex(2), "").asString();
+        if (nonce.compare(0, 2, "0x") == 0) nonce.erase(0, 2);
+        if (wp) {
+            WorkPackage mine = ProxyServer::slice(*wp, m_slice);
+            string full = toHex(mine.startNonce).substr(0, mine.exSizeBytes);
+            if (nonce.size() == 16 - full.size()) nonce = full + nonce;
+            if (nonce.size() != 16 || nonce.compare(0, full.size(), full) != 0 || nonce.find_first_not_of("0123456789abcdefABCDEF") != string::npos) {
+                {
+                    lock_guard<mutex> l(m_statsMutex);
+                    m_stats.submitted++;
+                    m_stats.invalid++;
+                }
+                reply(id, false, "Invalid nonce");
+                return;
+            }
+        }
+        submit(id, wp, wp ? stoull(nonce, nullptr, 16) : 0);
+    }
+
+    else if (method == "eth_submitWork" && m_authorized && m_protocol == Protocol::EthProxy) {
+        // [nonce, header, mix] : miner picks its own nonces which must at
+        // least stay within the pool extranonce
+        WorkPackage const* wp = nullptr;
+        string nonce = params.get(Json::Value::ArrayIndex(0), "").asString();
+        h256 header;
+        if (hexToHash(params.get(Json::Value::ArrayIndex(1), "").asString(), header, false)) wp = m_server->findHeader(header);
+        if (nonce.compare(0, 2, "0x") == 0) nonce.erase(0, 2);
+        if (wp) {
+            string prefix = toHex(wp->startNonce).substr(0, wp->exSizeBytes);
+            if (nonce.size() != 16 || nonce.compare(0, prefix.size(), prefix) != 0 || nonce.find_first_not_of("0123456789abcdefABCDEF") != string::npos) {
+                {
+                    lock_guard<mutex> l(m_statsMutex);
+                    m_stats.submitted++;
+                    m_stats.invalid++;
+                }
+                reply(id, false, "Invalid nonce");
+                return;
+            }
+        }
+        submit(id, wp, wp ? stoull(nonce, nullptr, 16) : 0);
+    }
+
+    else if (method == "eth_submitHashrate" && m_authorized) {
+        string rate = params.get(Json::Value::ArrayIndex(0), "").asString();
+        {
+            lock_guard<mutex> l(m_statsMutex);
+            m_stats.hashrate = strtoull(rate.c_str(), nullptr, 16);
+        }
+        reply(id, true);
+    }
+
+    else if (!id.isNull()) {
+        reply(id, Json::Value::null, "Method not found");
+    }
+}
+
+void ProxyConnection::submit(Json::Value const& _id, WorkPackage const* _wp, uint64_t _nonce) {
+    auto now = chrono::steady_clock::now();
+    {
+        lock_guard<mutex> l(m_statsMutex);
+        m_stats.submitted++;
+        m_stats.lastShare = now;
+    }
+
+    if (!_wp) {
+        invalid(_id, "Job not found");
+        return;
+    }
+
+    // Verification may have to build the epoch light cache : keep it off the
+    // io strand. The verifier is a single thread so shares keep their order
+    auto self = shared_from_this();
+    Solution sol{_nonce, h256(), *_wp, now, ProxyServer::s_minerBase + m_slice};
+    m_server->verify([self, id = _id, sol]() mutable {
+        Result r = EthashAux::eval(sol.work.epoch, sol.work.header, sol.nonce);
+        sol.mixHash = r.mixHash;
+        bool valid = r.value <= sol.work.boundary;
+        self->m_server->m_strand.post([self, id, sol, valid] { self->forward(id, sol, valid); });
+    });
+}
+
+void ProxyConnection::forward(Json::Value const& _id, Solution const& _sol, bool _valid) {
+    if (m_closed) return;
+
+    // Never bother the pool with shares it would reject
+    if (!_valid) {
+        invalid(_id, "Low difficulty share");
+        return;
+    }
+    if (!m_server->m_onSolutionFound || !m_server->m_onSolutionFound(_sol)) {
+        invalid(_id, "Not submitted to pool");
+        return;
+    }
+
+    // Pool outcomes come back in submission order
+    m_pending.push_back({_id, _sol.tstamp});
+    lock_guard<mutex> l(m_statsMutex);
+    m_stats.forwarded++;
+    m_stats.pending = m_pending.size();
+}
+
+void ProxyConnection::invalid(Json::Value const& _id, string const& _reason) {
+    {
+        lock_guard<mutex> l(m_statsMutex);
+        m_stats.invalid++;
+    }
+    reply(_id, false, _reason);
+}
+
+void ProxyConnection::answer(bool _accepted, bool _stale, chrono::milliseconds const& _delay) {
+    if (m_closed || m_pending.empty()) return;
+
+    Json::Value id = m_pending.front().id;
+    m_pending.pop_front();
+    {
+        lock_guard<mutex> l(m_statsMutex);
+        if (_accepted) m_stats.accepted++;
+        else
+            m_stats.rejected++;
+        if (_stale) m_stats.stale++;
+        m_stats.totalDelayMs += _delay.count();
+        m_stats.pending = m_pending.size();
+    }
+    reply(id, _accepted, _accepted ? "" : "Rejected by pool");
+}
+
+void ProxyConnection::abort(string const& _reason) {
+    while (!m_pending.empty()) {
+        reply(m_pending.front().id, false, _reason);
+        m_pending.pop_front();
+    }
+    lock_guard<mutex> l(m_statsMutex);
+    m_stats.pending = 0;
+}
+
+string ProxyConnection::extraNonce() const {
+    WorkPackage mine = ProxyServer::slice(m_server->m_current, m_slice);
+    return toHex(mine.startNonce).substr(0, mine.exSizeBytes);
+}
+
+void ProxyConnection::notify() {
+    if (m_closed || !m_authorized || !m_server->m_current || m_server->m_jobs.empty()) return;
+
+    WorkPackage const& wp = m_server->m_current;
+    Json::Value jMsg;
+
+    if (m_protocol == Protocol::EthereumStratum) {
+        jMsg["id"] = Json::Value::null;
+
+        string enonce = extraNonce();
+        if (enonce != m_sentExtraNonce) {
+            jMsg["method"] = "mining.set_extranonce";
+            jMsg["params"] = Json::Value(Json::arrayValue);
+            jMsg["params"].append(enonce);
+            send(jMsg);
+            m_sentExtraNonce = enonce;
+        }
+
+        // EthereumStratum/1.0.0 difficulty 1 is target 0x00000000ffff000...
+        double difficulty = getHashesToTarget(wp.boundary.hex(HexPrefix::Add)) * 65535.0 / 281474976710656.0;
+        if (difficulty != m_sentDifficulty) {
+            jMsg["method"] = "mining.set_difficulty";
+            jMsg["params"] = Json::Value(Json::arrayValue);
+            jMsg["params"].append(difficulty);
+            send(jMsg);
+            m_sentDifficulty = difficulty;
+        }
+
+        jMsg["method"] = "mining.notify";
+        jMsg["params"] = Json::Value(Json::arrayValue);
+        jMsg["params"].append(m_server->m_jobs.front().first);
+        jMsg["params"].append(wp.seed.hex());
+        jMsg["params"].append(wp.header.hex());
+        jMsg["params"].append(true);
+        send(jMsg);
+    } else if (m_protocol == Protocol::EthProxy) {
+        jMsg["id"] = 0;
+        jMsg["jsonrpc"] = "2.0";
+        jMsg["result"] = Json::Value(Json::arrayValue);
+        jMsg["result"].append(wp.header.hex(HexPrefix::Add));
+        jMsg["result"].append(wp.seed.hex(HexPrefix::Add));
+        jMsg["result"].append(wp.boundary.hex(HexPrefix::Add));
+        if (wp.block >= 0) jMsg["result"].append(toCompactHex(uint32_t(wp.block), HexPrefix::Add));
+        send(jMsg);
+    }
+}
+
+void ProxyConnection::reply(Json::Value const& _id, Json::Value const& _result, string const& _error) {
+    Json::Value jRes;
+    jRes["id"] = _id;
+    if (m_protocol == Protocol::EthProxy) jRes["jsonrpc"] = "2.0";
+    jRes["result"] = _result;
+    if (_error.empty()) {
+        jRes["error"] = Json::Value::null;
+    } else if (m_protocol == Protocol::EthProxy) {
+        jRes["error"]["code"] = -1;
+        jRes["error"]["message"] = _error;
+    } else {
+        jRes["error"] = Json::Value(Json::arrayValue);
+        jRes["error"].append(20);
+        jRes["error"].append(_error);
+        jRes["error"].append(Json::Value::null);
+    }
+    send(jRes);
+}
+
+void ProxyConnection::send(Json::Value const& _jMsg) {
+    if (m_closed) return;
+
+    string line = m_txQueue.acquire();
+    line.append(Json::writeString(m_jSwBuilder, _jMsg));
+    line.push_back('\n');
+    if (!m_txQueue.push(std::move(line), false)) {
+        cwarn << "Proxy : worker " << m_stats.address << " does not read. Dropping it";
+        close();
+        return;
+    }
+    flush();
+}
+
+void ProxyConnection::flush() {
+    if (m_txPending || m_closed || m_txQueue.empty()) return;
+    m_txPending = true;
+
+    auto self = shared_from_this();
+    boost::asio::async_write(m_socket, m_txQueue.flight(), m_server->m_strand.wrap([self](boost::system::error_code const& ec, size_t) {
+        self->m_txQueue.landed();
+        self->m_txPending = false;
+        if (ec) {
+            self->close();
+            return;
+        }
+        self->flush();
+    }));
+}
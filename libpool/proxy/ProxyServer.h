@@ -0,0 +1,209 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <json/json.h>
+
+#include <libeth/EthashAux.h>
+
+#include "../stratum/StratumParser.h"
+#include "../stratum/StratumSender.h"
+
+namespace dev::eth {
+
+class ProxyServer;
+
+// One downstream miner connected to the proxy.
+// Protocol is detected on the first request : mining.subscribe selects
+// EthereumStratum/1.0.0, eth_submitLogin selects Eth-Proxy.
+class ProxyConnection : public std::enable_shared_from_this<ProxyConnection> {
+public:
+    enum class Protocol { Unknown, EthereumStratum, EthProxy };
+
+    explicit ProxyConnection(std::shared_ptr<ProxyServer> const& _server);
+
+    void start(unsigned _slice);
+    void close();
+
+    // Sends current job to the miner (if already able to mine)
+    void notify();
+    // Delivers pool outcome of the oldest forwarded share
+    void answer(bool _accepted, bool _stale, std::chrono::milliseconds const& _delay);
+    // Fails all forwarded shares still waiting for an outcome
+    void abort(std::string const& _reason);
+
+    boost::asio::ip::tcp::socket& socket() { return m_socket; }
+    unsigned slice() const { return m_slice; }
+
+    // Counters are written in server strand and read by the API
+    struct Stats {
+        std::string address;
+        std::string protocol;
+        std::string worker;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point lastShare;
+        uint64_t hashrate = 0;   // As reported by the miner
+        unsigned submitted = 0;
+        unsigned forwarded = 0;
+        unsigned accepted = 0;
+        unsigned stale = 0;
+        unsigned rejected = 0;
+        unsigned invalid = 0;   // Not forwarded : malformed, out of range or above target
+        unsigned pending = 0;
+        uint64_t totalDelayMs = 0;
+    };
+    Stats stats();
+
+private:
+    void recv();
+    void processLine(const char* _first, const char* _last);
+    void processRequest(Json::Value& _jReq);
+    void submit(Json::Value const& _id, WorkPackage const* _wp, uint64_t _nonce);
+    void forward(Json::Value const& _id, Solution const& _sol, bool _valid);
+    void invalid(Json::Value const& _id, std::string const& _reason);
+    void reply(Json::Value const& _id, Json::Value const& _result, std::string const& _error = "");
+    void send(Json::Value const& _jMsg);
+    void flush();
+    std::string extraNonce() const;
+
+    std::shared_ptr<ProxyServer> m_server;   // Kept alive until the connection is done with it
+    unsigned m_slice = 0;
+    Protocol m_protocol = Protocol::Unknown;
+    bool m_authorized = false;
+    std::string m_sentExtraNonce;
+    double m_sentDifficulty = 0;
+
+    boost::asio::ip::tcp::socket m_socket;
+    LineFramer m_framer;
+    std::unique_ptr<Json::CharReader> m_jsonReader;
+    Json::StreamWriterBuilder m_jSwBuilder;
+    StratumSendQueue m_txQueue;
+    bool m_txPending = false;
+    bool m_closed = false;
+
+    // Ids of requests forwarded upstream waiting for their outcome (oldest first)
+    struct Pending {
+        Json::Value id;
+        std::chrono::steady_clock::time_point tstamp;
+    };
+    std::deque<Pending> m_pending;
+
+    std::mutex m_statsMutex;
+    Stats m_stats;
+};
+
+// Stratum proxy serving work from the single upstream connection held by
+// PoolManager to downstream miners speaking EthereumStratum/1.0.0 or
+// Eth-Proxy. Upstream nonce space (whatever is left after the upstream
+// extranonce) is split in slices of s_sliceNibbles hex digits : slice 0
+// goes to local devices, the others are handed out to downstream miners
+// as their extranonce so no two rigs ever scan the same nonces.
+// Shares are verified before being forwarded upstream as if found by miner
+// s_minerBase + slice so the pool outcome can be routed back.
+// Must be owned by a shared_ptr : pending handlers hold a reference.
+class ProxyServer : public std::enable_shared_from_this<ProxyServer> {
+public:
+    static const unsigned s_sliceNibbles = 2;
+    static const unsigned s_maxSlices = 1 << (4 * s_sliceNibbles);
+    static const unsigned s_minerBase = 1000;
+    static const unsigned s_maxJobs = 8;   // Jobs kept to validate late shares against
+
+    using SolutionFound = std::function<bool(Solution const&)>;
+
+    ProxyServer(std::string const& _address, unsigned short _port);
+    ~ProxyServer();
+
+    void start();
+    void stop();
+
+    // Handler which forwards a verified share upstream. Returns false if it could not
+    void onSolutionFound(SolutionFound const& _handler) { m_onSolutionFound = _handler; }
+
+    // New upstream job (empty package suspends downstream miners)
+    void setWork(WorkPackage const& _wp);
+
+    // Upstream outcome for a share submitted on behalf of miner _midx
+    void accountSolution(unsigned _midx, bool _accepted, bool _stale, std::chrono::milliseconds const& _delay);
+
+    // Whether miner index belongs to a downstream miner
+    static bool proxied(unsigned _midx) { return _midx >= s_minerBase && _midx < s_minerBase + s_maxSlices; }
+
+    // Whether upstream nonce space is wide enough to be sliced : each slice
+    // must keep at least 32 bits for a rig not to run out of nonces on a job
+    static bool sliceable(WorkPackage const& _wp) { return _wp.exSizeBytes + s_sliceNibbles <= 8; }
+
+    // Work restricted to nonce slice _slice
+    static WorkPackage slice(WorkPackage const& _wp, unsigned _slice);
+
+    // Work for local devices
+    WorkPackage localWork(WorkPackage const& _wp);
+    // Gives back the pool nonce layout to a solution found by local devices
+    void localSolution(Solution& _sol);
+
+    // Sum of hashrates reported by downstream miners
+    uint64_t hashRate();
+
+    Json::Value getJson();
+
+private:
+    friend class ProxyConnection;
+
+    void accept();
+    void release(unsigned _slice);
+    WorkPackage const* findJob(std::string const& _job) const;
+    WorkPackage const* findHeader(h256 const& _header) const;
+    // Runs a share verification on the verifier thread, off the io strand
+    void verify(std::function<void()> _task);
+    void verifyLoop();
+
+    std::string m_address;
+    unsigned short m_port;
+    std::atomic<bool> m_running = {false};
+
+    boost::asio::io_service::strand m_strand;   // Serializes server and all of its connections
+    boost::asio::ip::tcp::acceptor m_acceptor;
+
+    std::mutex m_mutex;   // Guards m_connections against API readers
+    std::vector<std::shared_ptr<ProxyConnection>> m_connections;
+    std::vector<bool> m_slices;   // Slices in use
+    unsigned m_nextSlice = 1;     // Slices are handed out round robin to delay reuse
+
+    WorkPackage m_current;
+    std::deque<std::pair<std::string, WorkPackage>> m_jobs;   // Recent jobs by downstream job id, newest first
+    unsigned m_jobSeq = 0;
+    bool m_warned = false;   // Whether upstream nonce space too narrow has been reported
+
+    std::atomic<unsigned> m_refused = {0};   // Connections refused for lack of slices
+
+    std::mutex m_localMutex;
+    std::deque<WorkPackage> m_localJobs;   // Recent pool jobs given sliced to local devices
+
+    SolutionFound m_onSolutionFound;
+
+    std::thread m_verifier;   // Verifies shares in arrival order
+    std::mutex m_verifyMutex;
+    std::condition_variable m_verifyCv;
+    std::deque<std::function<void()>> m_verifyQueue;
+};
+
+}   // namespace dev::eth
@@ -8,23 +8,28 @@
  * this file.
  */
 
+#include <cmath>
 #include <ethash/ethash.hpp>
 #include <memory>
 #include <eaminer/buildinfo.h>
 
 #include "EthStratumClient.h"
-
-#ifdef _WIN32
-// Needed for certificates validation on TLS connections
-#    include <wincrypt.h>
-#endif
+#include "StratumCapture.h"
+#include "StratumModeCache.h"
+#include "TlsSessionCache.h"
 
 using boost::asio::ip::tcp;
 
-EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
-    : PoolClient(), m_worktimeout(worktimeout), m_responsetimeout(responsetimeout), m_io_service(g_io_service), m_io_strand(g_io_service), m_socket(nullptr),
-      m_workloop_timer(g_io_service), m_response_plea_times(64), m_txQueue(64), m_resolver(g_io_service), m_endpoints() {
+std::mutex EthStratumClient::s_resumableMutex;
+std::map<std::string, EthStratumClient::ResumableSession> EthStratumClient::s_resumable;
+
+const unsigned EthStratumClient::s_suggestionInterval;
+
+EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout, double shareRate)
+    : PoolClient(), m_worktimeout(worktimeout), m_responsetimeout(responsetimeout), m_shareRate(shareRate), m_io_service(g_io_service), m_io_strand(g_io_service), m_socket(nullptr),
+      m_workloop_timer(g_io_service), m_response_plea_times(64), m_resolver(g_io_service), m_endpoints() {
     m_jSwBuilder.settings_["indentation"] = "";
+    m_jsonReader.reset(Json::CharReaderBuilder().newCharReader());
 
     // Initialize workloop_timer to infinite wait
     m_workloop_timer.expires_at(boost::posix_time::pos_infin);
@@ -35,46 +40,13 @@ EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
 void EthStratumClient::init_socket() {
     // Prepare Socket
     if (m_conn->SecLevel() != SecureLevel::NONE) {
-        boost::asio::ssl::context::method method = boost::asio::ssl::context::tls_client;
-        if (m_conn->SecLevel() == SecureLevel::TLS) method = boost::asio::ssl::context::tlsv12;
-
-        boost::asio::ssl::context ctx(method);
-        m_securesocket = make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(m_io_service, ctx);
+        // Context (and loaded certificates) is shared among all connections
+        m_securesocket = make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(m_io_service, TlsSessionCache::context(m_conn->SecLevel()));
         m_socket = &m_securesocket->next_layer();
 
         m_securesocket->set_verify_mode(boost::asio::ssl::verify_peer);
         m_securesocket->set_verify_callback(make_verbose_verification(boost::asio::ssl::rfc2818_verification(m_conn->Host())));
-
-#ifdef _WIN32
-        HCERTSTORE hStore = CertOpenSystemStore(0, "ROOT");
-        if (hStore == nullptr) { return; }
-
-        X509_STORE* store = X509_STORE_new();
-        PCCERT_CONTEXT pContext = nullptr;
-        while ((pContext = CertEnumCertificatesInStore(hStore, pContext)) != nullptr) {
-            X509* x509 = d2i_X509(nullptr, (const unsigned char**) &pContext->pbCertEncoded, pContext->cbCertEncoded);
-            if (x509 != nullptr) {
-                X509_STORE_add_cert(store, x509);
-                X509_free(x509);
-            }
-        }
-
-        CertFreeCertificateContext(pContext);
-        CertCloseStore(hStore, 0);
-
-        SSL_CTX_set_cert_store(ctx.native_handle(), store);
-#else
-        char* certPath = getenv("SSL_CERT_FILE");
-        try {
-            ctx.load_verify_file(certPath ? certPath : "/etc/ssl/certs/ca-certificates.crt");
-        } catch (...) {
-            cwarn << "Failed to load ca certificates. Either the file "
-                     "'/etc/ssl/certs/ca-certificates.crt' does not exist";
-            cwarn << "or the environment variable SSL_CERT_FILE is set to an invalid or "
-                     "inaccessible file.";
-            cwarn << "It is possible that certificate verification can fail.";
-        }
-#endif
+        TlsSessionCache::prepare(*m_securesocket, m_conn->Host(), m_conn->Port(), m_conn->HostNameType() != dev::UriHostNameType::IPV4 && m_conn->HostNameType() != dev::UriHostNameType::IPV6);
     } else {
         m_nonsecuresocket = make_shared<boost::asio::ip::tcp::socket>(m_io_service);
         m_socket = m_nonsecuresocket.get();
@@ -109,10 +81,18 @@ void EthStratumClient::connect() {
     if (!m_socket) init_socket();
 
     // Initialize a new queue of end points
-    m_endpoints = queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>>();
+    m_endpoints.clear();
     m_endpoint = boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>();
 
     if (m_conn->HostNameType() == dev::UriHostNameType::Dns || m_conn->HostNameType() == dev::UriHostNameType::Basic) {
+        // Reuse still valid resolutions (last known good endpoint first)
+        auto cached = ResolverCache::lookup(m_conn->Host(), m_conn->Port());
+        if (!cached.empty()) {
+            m_endpoints.assign(cached.begin(), cached.end());
+            m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
+            return;
+        }
+
         // Begin resolve all ips associated to hostname
         // calling the resolver each time is useful as most
         // load balancer will give Ips in different order
@@ -124,7 +104,7 @@ void EthStratumClient::connect() {
                 q, m_io_strand.wrap(boost::bind(&EthStratumClient::resolve_handler, this, boost::asio::placeholders::error, boost::asio::placeholders::iterator)));
     } else {
         // No need to use the resolver if host is already an IP address
-        m_endpoints.push(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(m_conn->Host()), m_conn->Port()));
+        m_endpoints.push_back(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(m_conn->Host()), m_conn->Port()));
         m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
     }
 }
@@ -137,6 +117,7 @@ void EthStratumClient::disconnect() {
     m_connected.store(false, memory_order_relaxed);
 
     // Cancel any outstanding async operation
+    if (m_race) m_race->cancel();
     if (m_socket) m_socket->cancel();
 
     if (m_socket && m_socket->is_open()) {
@@ -171,6 +152,7 @@ void EthStratumClient::disconnect_finalize() {
     }
     m_socket = nullptr;
     m_nonsecuresocket = nullptr;
+    if (StratumCapture::enabled()) StratumCapture::record('-', string());
 
     // Release locking flag and set connection status
 #ifdef DEV_BUILD
@@ -178,7 +160,10 @@ void EthStratumClient::disconnect_finalize() {
 #endif
 
     // Release session if exits
-    if (m_session) m_conn->addDuration(m_session->duration());
+    if (m_session) {
+        m_conn->addDuration(m_session->duration());
+        saveResumableSession();
+    }
     m_session = nullptr;
 
     m_authpending.store(false, memory_order_relaxed);
@@ -192,7 +177,14 @@ void EthStratumClient::disconnect_finalize() {
         // remote endpoint rejects connections attempts persistently since the first
         if (!m_conn->StratumModeConfirmed() && m_conn->Responds()) {
             // Repost a new connection attempt and advance to next stratum test
-            if (m_conn->StratumMode() > 0) {
+            if (m_modeHinted) {
+                // Pool no longer speaks the remembered flavour : run full detection
+                m_modeHinted = false;
+                StratumModeCache::forget(m_conn->Host(), m_conn->Port());
+                m_conn->SetStratumMode(3);
+                m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
+                return;
+            } else if (m_conn->StratumMode() > 0) {
                 m_conn->SetStratumMode(m_conn->StratumMode() - 1);
                 m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
                 return;
@@ -218,12 +210,19 @@ void EthStratumClient::disconnect_finalize() {
 
 void EthStratumClient::resolve_handler(const boost::system::error_code& ec, tcp::resolver::iterator i) {
     if (!ec) {
+        vector<tcp::endpoint> endpoints;
         while (i != tcp::resolver::iterator()) {
-            m_endpoints.push(i->endpoint());
+            endpoints.push_back(i->endpoint());
             i++;
         }
         m_resolver.cancel();
 
+        // Cache results and get them back ordered for racing
+        ResolverCache::store(m_conn->Host(), m_conn->Port(), endpoints);
+        auto ordered = ResolverCache::lookup(m_conn->Host(), m_conn->Port());
+        if (ordered.empty()) ordered = endpoints;   // Caching disabled
+        m_endpoints.assign(ordered.begin(), ordered.end());
+
         // Resolver has finished so invoke connection asynchronously
         m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
     } else {
@@ -242,7 +241,7 @@ void EthStratumClient::start_connect() {
     m_connecting.store(true, memory_order::memory_order_relaxed);
 
     if (!m_endpoints.empty()) {
-        // Pick the first endpoint in list.
+        // Race all endpoints in list (first one is the last known good).
         // Eventually endpoints get discarded on connection errors
         m_endpoint = m_endpoints.front();
 
@@ -250,7 +249,7 @@ void EthStratumClient::start_connect() {
         if (m_socket == nullptr) init_socket();
 
 #ifdef DEV_BUILD
-        if (g_logOptions & LOG_CONNECT) cnote << ("Trying " + toString(m_endpoint) + " ...");
+        if (g_logOptions & LOG_CONNECT) cnote << ("Trying " + toString(m_endpoints.size()) + " endpoint(s) starting with " + toString(m_endpoint) + " ...");
 #endif
 
         clear_response_pleas();
@@ -259,11 +258,14 @@ void EthStratumClient::start_connect() {
         m_solution_submitted_max_id = 0;
 
         // Start connecting async
-        if (m_conn->SecLevel() != SecureLevel::NONE) {
-            m_securesocket->lowest_layer().async_connect(m_endpoint, m_io_strand.wrap(boost::bind(&EthStratumClient::connect_handler, this, _1)));
-        } else {
-            m_socket->async_connect(m_endpoint, m_io_strand.wrap(boost::bind(&EthStratumClient::connect_handler, this, _1)));
-        }
+        m_race = make_shared<EndpointRace>(m_io_strand, vector<tcp::endpoint>(m_endpoints.begin(), m_endpoints.end()));
+        weak_ptr<bool> alive = m_alive;
+        EndpointRace* race = m_race.get();
+        m_race->start([this, alive, race](const boost::system::error_code& ec, tcp::endpoint const& ep) {
+            // Client gone or race superseded by a newer one
+            if (alive.expired() || race != m_race.get()) return;
+            connect_handler(ec, ep);
+        });
     } else {
         m_connecting.store(false, memory_order_relaxed);
         cwarn << "No more IP addresses to try for host: " << m_conn->Host();
@@ -273,6 +275,14 @@ void EthStratumClient::start_connect() {
     }
 }
 
+void EthStratumClient::discard_endpoint() {
+    // Demote the endpoint we're connected to so next
+    // connection attempt starts from another one
+    ResolverCache::markBad(m_conn->Host(), m_conn->Port(), m_endpoint);
+    auto it = find(m_endpoints.begin(), m_endpoints.end(), m_endpoint);
+    if (it != m_endpoints.end()) m_endpoints.erase(it);
+}
+
 void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& ec) {
     using namespace chrono;
 
@@ -291,6 +301,8 @@ void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& e
         }
     }
 
+    if (isConnected() && isAuthorized()) suggestDifficulty();
+
     if (m_response_pleas_count.load(memory_order_relaxed)) {
         milliseconds response_delay_ms(0);
         steady_clock::time_point response_plea_time(m_response_plea_older.load(memory_order_relaxed));
@@ -299,11 +311,11 @@ void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& e
         if (isPendingState()) {
             response_delay_ms = duration_cast<milliseconds>(steady_clock::now() - response_plea_time);
 
-            if ((m_responsetimeout * 1000) >= response_delay_ms.count()) {
+            if (response_delay_ms.count() >= (m_responsetimeout * 1000)) {
                 if (m_connecting.load(memory_order_relaxed)) {
-                    // The socket is closed so that any outstanding
-                    // asynchronous connection operations are cancelled.
-                    m_socket->close();
+                    // Any outstanding asynchronous connection
+                    // attempt gets cancelled.
+                    if (m_race) m_race->cancel(boost::asio::error::timed_out);
                     return;
                 }
 
@@ -336,7 +348,7 @@ void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& e
                 } else {
                     // Waiting for a response to solution submission
                     cwarn << "No response received in " << m_responsetimeout << " seconds.";
-                    m_endpoints.pop();
+                    discard_endpoint();
                     clear_response_pleas();
                     m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::disconnect, this)));
                 }
@@ -344,7 +356,7 @@ void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& e
             // No work timeout
             else if (m_session && (duration_cast<seconds>(steady_clock::now() - m_current_timestamp).count() > m_worktimeout)) {
                 cwarn << "No new work received in " << m_worktimeout << " seconds.";
-                m_endpoints.pop();
+                discard_endpoint();
                 clear_response_pleas();
                 m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::disconnect, this)));
             }
@@ -356,37 +368,52 @@ void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& e
     m_workloop_timer.async_wait(m_io_strand.wrap(boost::bind(&EthStratumClient::workloop_timer_elapsed, this, boost::asio::placeholders::error)));
 }
 
-void EthStratumClient::connect_handler(const boost::system::error_code& ec) {
+void EthStratumClient::connect_handler(const boost::system::error_code& ec, tcp::endpoint const& ep) {
     // Set status completion
     m_connecting.store(false, memory_order_relaxed);
 
-    // Timeout has run before or we got error
-    if (ec || !m_socket->is_open()) {
-        cwarn << ("Error  " + toString(m_endpoint) + " [ " + (ec ? ec.message() : "Timeout") + " ]");
+    // Cancelled by a disconnection which takes care of the rest
+    if (ec == boost::asio::error::operation_aborted) {
+        m_race = nullptr;
+        return;
+    }
 
-        // We need to close the socket used in the previous connection attempt
-        // before starting a new one.
-        // In case of error, in fact, boost does not close the socket
-        // If socket is not opened it means we got timed out
-        if (m_socket->is_open()) m_socket->close();
+    // Timeout has run before or all endpoints failed
+    if (ec) {
+        cwarn << ("Error  " + m_conn->Host() + " [ " + (ec == boost::asio::error::timed_out ? "Timeout" : ec.message()) + " ]");
+        m_race = nullptr;
 
-        // Discard this endpoint and try the next available.
+        // All endpoints have been raced : cached resolution is
+        // no longer trusted.
         // Eventually is start_connect which will check for an
         // empty list.
-        m_endpoints.pop();
+        ResolverCache::invalidate(m_conn->Host(), m_conn->Port());
+        m_endpoints.clear();
         m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
 
         return;
     }
 
+    // Take ownership of the winning socket and remember it
+    // so it's tried first on next connection
+    m_race->claim(*m_socket);
+    m_race = nullptr;
+    m_endpoint = ep;
+    ResolverCache::markGood(m_conn->Host(), m_conn->Port(), ep);
+    auto it = find(m_endpoints.begin(), m_endpoints.end(), ep);
+    if (it != m_endpoints.end()) m_endpoints.erase(it);
+    m_endpoints.push_front(ep);
+
     // We got a socket connection established
     m_conn->Responds(true);
     m_connected.store(true, memory_order_relaxed);
+    if (StratumCapture::enabled()) StratumCapture::record('+', m_conn->Host() + ":" + to_string(m_conn->Port()));
 
-    m_message.clear();
+    m_framer.clear();
 
     // Clear txqueue
-    m_txQueue.consume_all([](string* l) { delete l; });
+    m_txQueue.clear();
+    m_submitTemplate.invalidate();
 
 #ifdef DEV_BUILD
     if (g_logOptions & LOG_CONNECT) cnote << "Socket connected to " << ActiveEndPoint();
@@ -397,7 +424,15 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec) {
         m_securesocket->lowest_layer().set_option(boost::asio::socket_base::keep_alive(true));
         m_securesocket->lowest_layer().set_option(tcp::no_delay(true));
 
+        auto handshake_start = chrono::steady_clock::now();
         m_securesocket->handshake(boost::asio::ssl::stream_base::client, hec);
+        auto handshake_ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - handshake_start).count();
+        TlsSessionCache::completed(*m_securesocket, m_conn->Host(), m_conn->Port(), !hec, unsigned(handshake_ms));
+
+#ifdef DEV_BUILD
+        if (!hec && (g_logOptions & LOG_CONNECT))
+            cnote << "TLS handshake " << (SSL_session_reused(m_securesocket->native_handle()) ? "resumed" : "full") << " in " << handshake_ms << " ms";
+#endif
 
         if (hec) {
             cwarn << "SSL/TLS Handshake failed: " << hec.message();
@@ -437,8 +472,6 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec) {
         m_nonsecuresocket->set_option(tcp::no_delay(true));
     }
 
-    // Clean buffer from any previous stale data
-    m_sendBuffer.consume(4096);
     clear_response_pleas();
 
     /*
@@ -458,7 +491,12 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec) {
     if (m_conn->Version() < 999) {
         m_conn->SetStratumMode(m_conn->Version(), true);
     } else {
-        if (!m_conn->StratumModeConfirmed() && m_conn->StratumMode() == 999) m_conn->SetStratumMode(3, false);
+        if (!m_conn->StratumModeConfirmed() && m_conn->StratumMode() == 999) {
+            // Start from the flavour detected on previous runs (if any)
+            unsigned mode = 3;
+            m_modeHinted = StratumModeCache::lookup(m_conn->Host(), m_conn->Port(), mode);
+            m_conn->SetStratumMode(m_modeHinted ? mode : 3, false);
+        }
     }
 
     Json::Value jReq;
@@ -515,15 +553,49 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec) {
     send(jReq);
 }
 
+void EthStratumClient::saveResumableSession() {
+    // Only EthereumStratum/2.0.0 sessions fully set up can be resumed
+    if (!m_canResume || m_conn->StratumMode() != ETHEREUMSTRATUM2 || m_session->sessionId.empty() || !m_session->firstMiningSet) return;
+
+    ResumableSession rs;
+    rs.sessionId = m_session->sessionId;
+    rs.extraNonce = m_session->extraNonce;
+    rs.extraNonceSizeBytes = m_session->extraNonceSizeBytes;
+    rs.epoch = m_session->epoch;
+    rs.timeout = m_session->timeout;
+    rs.nextWorkBoundary = m_session->nextWorkBoundary;
+    rs.nextWorkDifficulty = m_session->nextWorkDifficulty;
+    rs.job = m_current;
+    rs.expires = chrono::steady_clock::now() + chrono::seconds(m_session->timeout);
+
+    lock_guard<mutex> l(s_resumableMutex);
+    s_resumable[m_conn->Host() + ":" + to_string(m_conn->Port())] = rs;
+}
+
 void EthStratumClient::startSession() {
     // Start a new session of data
     m_session = std::make_unique<Session>();
     m_current_timestamp = chrono::steady_clock::now();
+    if (StratumCapture::enabled()) StratumCapture::record('=', to_string(m_conn->StratumMode()));
+    m_suggestionRefused = false;
+    m_suggestedDifficulty = 0;
+    m_lastSuggestion = chrono::steady_clock::time_point();
+
+    // EthereumStratum/2.0.0 is only remembered once subscribed
+    if (m_conn->StratumMode() != ETHEREUMSTRATUM2) rememberStratumMode();
 
     // Invoke higher level handlers
     if (m_onConnected) m_onConnected();
 }
 
+void EthStratumClient::rememberStratumMode() {
+    // Remember autodetected flavour for next runs
+    if (m_conn->Version() == 999) {
+        m_modeHinted = false;
+        StratumModeCache::store(m_conn->Host(), m_conn->Port(), m_conn->StratumMode());
+    }
+}
+
 string EthStratumClient::processError(Json::Value& responseObject) {
     string retVar;
 
@@ -650,9 +722,26 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
                         cnote << "Stratum mode : EthereumStratum/2.0.0";
                         startSession();
 
+                        string resume = jResult["resume"].asString();
+                        m_canResume = (resume == "1" || resume == "true");
+                        string timeout = jResult["timeout"].asString();
+                        if (!timeout.empty()) m_session->timeout = stoi(timeout, nullptr, 16);
+
                         // Send request for subscription
                         jReq["id"] = unsigned(2);
                         jReq["method"] = "mining.subscribe";
+
+                        // Try to resume previous session if pool allows it
+                        // https://github.com/AndreaLanfranchi/EthereumStratum-2.0.0#session-handling---subscription
+                        if (m_canResume) {
+                            lock_guard<mutex> l(s_resumableMutex);
+                            auto it = s_resumable.find(m_conn->Host() + ":" + to_string(m_conn->Port()));
+                            if (it != s_resumable.end() && chrono::steady_clock::now() < it->second.expires) {
+                                jReq["params"] = Json::Value(Json::arrayValue);
+                                jReq["params"].append(it->second.sessionId);
+                                m_resuming = true;
+                            }
+                        }
                         enqueue_response_plea();
                     } else {
                         // If no autodetection the connection is not usable
@@ -815,6 +904,10 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
                 if (!jResult.isString() || jResult.asString().empty()) {
                     // Got invalid session id which is mandatory
                     cwarn << "Got invalid or missing session id. Disconnecting ... ";
+                    if (m_modeHinted) {
+                        m_modeHinted = false;
+                        StratumModeCache::forget(m_conn->Host(), m_conn->Port());
+                    }
                     m_conn->MarkUnrecoverable();
                     m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::disconnect, this)));
                     return;
@@ -822,6 +915,28 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
 
                 m_session->sessionId = jResult.asString();
                 m_session->subscribed.store(true, memory_order_relaxed);
+                rememberStratumMode();
+
+                if (m_resuming) {
+                    // Pool replies with the very same session id if it
+                    // has been able to resume it
+                    lock_guard<mutex> l(s_resumableMutex);
+                    string key = m_conn->Host() + ":" + to_string(m_conn->Port());
+                    auto it = s_resumable.find(key);
+                    if (it != s_resumable.end() && it->second.sessionId == m_session->sessionId) {
+                        m_resumed = true;
+                        m_session->extraNonce = it->second.extraNonce;
+                        m_session->extraNonceSizeBytes = it->second.extraNonceSizeBytes;
+                        m_session->epoch = it->second.epoch;
+                        m_session->nextWorkBoundary = it->second.nextWorkBoundary;
+                        m_session->nextWorkDifficulty = it->second.nextWorkDifficulty;
+                        m_session->firstMiningSet = true;
+                        m_current = it->second.job;
+                        cnote << "Resumed session " << m_session->sessionId;
+                    }
+                    s_resumable.erase(key);
+                    m_resuming = false;
+                }
 
                 // Request authorization
                 m_authpending.store(true, memory_order_relaxed);
@@ -873,7 +988,12 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
             m_session->workerId = jResult.asString();
             cnote << "Authorized worker " << m_conn->UserDotWorker();
 
-            // Nothing else to here. Wait for notifications from pool
+            // On resumed session keep mining previous job till pool notifies a new one.
+            // Otherwise nothing else to here. Wait for notifications from pool
+            if (m_resumed && m_current) {
+                m_current_timestamp = chrono::steady_clock::now();
+                m_newjobprocessed = true;
+            }
         }
 
         else if ((_id >= 40 && _id <= m_solution_submitted_max_id) && m_conn->StratumMode() != ETHEREUMSTRATUM2) {
@@ -930,6 +1050,17 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
             }
         }
 
+        else if (_id == 8) {
+            // Response to difficulty suggestion. Pools not supporting
+            // it are not bothered again for this session
+            if (!_isSuccess || (jResult.isBool() && !jResult.asBool())) {
+                cnote << "Pool ignores difficulty suggestions";
+                m_suggestionRefused = true;
+            } else if (m_onDifficultyAccepted) {
+                m_onDifficultyAccepted(m_suggestedDifficulty);
+            }
+        }
+
         else if (_id == 9) {
             // Response to hashrate submit
             // Shall we do anything ?
@@ -1017,67 +1148,15 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
             }
 
             if (jPrm.isArray() && !jPrm.empty()) {
-                m_current.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
-
-                if (m_conn->StratumMode() == EthStratumClient::ETHEREUMSTRATUM) {
-                    string sSeedHash = jPrm.get(Json::Value::ArrayIndex(1), "").asString();
-                    string sHeaderHash = jPrm.get(Json::Value::ArrayIndex(2), "").asString();
-
-                    if (!sHeaderHash.empty() && !sSeedHash.empty()) {
-                        m_current.seed = h256(sSeedHash);
-                        m_current.header = h256(sHeaderHash);
-                        m_current.boundary = m_session->nextWorkBoundary;
-                        m_current.startNonce = m_session->extraNonce;
-                        m_current.exSizeBytes = m_session->extraNonceSizeBytes;
-                        m_current_timestamp = chrono::steady_clock::now();
-                        m_current.block = -1;
-                        if (m_session->nextWorkDifficulty) m_current.difficulty = m_session->nextWorkDifficulty;
-                        else
-                            m_current.difficulty = getHashesToTarget(m_current.boundary.hex(HexPrefix::Add));
-
-                        // This will signal to dispatch the job
-                        // at the end of the transmission.
-                        m_newjobprocessed = true;
-                    }
-                } else {
-                    string sHeaderHash = jPrm.get(Json::Value::ArrayIndex(prmIdx++), "").asString();
-                    string sSeedHash = jPrm.get(Json::Value::ArrayIndex(prmIdx++), "").asString();
-                    string sShareTarget = jPrm.get(Json::Value::ArrayIndex(prmIdx++), "").asString();
-
-                    // Only some eth-proxy compatible implementations carry the block number
-                    // namely ethermine.org
-                    m_current.block = -1;
-                    if (m_conn->StratumMode() == EthStratumClient::ETHPROXY && jPrm.size() > prmIdx &&
-                        jPrm.get(Json::Value::ArrayIndex(prmIdx), "").asString().substr(0, 2) == "0x") {
-                        try {
-                            m_current.block = stoul(jPrm.get(Json::Value::ArrayIndex(prmIdx), "").asString(), nullptr, 16);
-                            /*
-                            check if the block number is in a valid range
-                            A year has ~31536000 seconds
-                            50 years have ~1576800000
-                            assuming a (very fast) blocktime of 10s:
-                            ==> in 50 years we get 157680000 (=0x9660180) blocks
-                            */
-                            if (m_current.block > 0x9660180) throw new exception();
-                        } catch (const exception&) { m_current.block = -1; }
-                    }
-
-                    // coinmine.pl fix
-                    int l = sShareTarget.length();
-                    if (l < 66) sShareTarget = "0x" + string(66 - l, '0') + sShareTarget.substr(2);
-
-                    m_current.seed = h256(sSeedHash);
-                    m_current.header = h256(sHeaderHash);
-                    m_current.boundary = h256(sShareTarget);
-                    m_current_timestamp = chrono::steady_clock::now();
-                    if (m_session->nextWorkDifficulty) m_current.difficulty = m_session->nextWorkDifficulty;
-                    else
-                        m_current.difficulty = getHashesToTarget(m_current.boundary.hex(HexPrefix::Add));
-
-                    // This will signal to dispatch the job
-                    // at the end of the transmission.
-                    m_newjobprocessed = true;
-                }
+                // Same handling as fast path. Only the params processNotify
+                // reads get converted, pools may append anything else
+                StratumNotification n;
+                vector<string> sPrm;
+                size_t used = min(size_t(m_conn->StratumMode() == ETHEREUMSTRATUM ? 3 : prmIdx + 4), n.params.size());
+                for (Json::Value::ArrayIndex i = 0; i < jPrm.size() && i < used; i++)
+                    sPrm.push_back(jPrm[i].isConvertibleTo(Json::stringValue) ? jPrm[i].asString() : "");
+                for (auto const& p: sPrm) n.params[n.paramsCount++] = p;
+                processNotify(n, prmIdx);
             }
         } else if (_method == "mining.notify" && m_conn->StratumMode() == ETHEREUMSTRATUM2) {
             /*
@@ -1101,13 +1180,15 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
                 return;
             }
 
+            // Job state only changes once all params are valid
             jPrm = responseObject["params"];
-            m_current.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
-            m_current.block = stoul(jPrm.get(Json::Value::ArrayIndex(1), "").asString(), nullptr, 16);
-
-            string header = "0x" + dev::padLeft(jPrm.get(Json::Value::ArrayIndex(2), "").asString(), 64, '0');
+            string job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+            int block = int(stoul(jPrm.get(Json::Value::ArrayIndex(1), "").asString(), nullptr, 16));
+            h256 header("0x" + dev::padLeft(jPrm.get(Json::Value::ArrayIndex(2), "").asString(), 64, '0'));
 
-            m_current.header = h256(header);
+            m_current.job = job;
+            m_current.block = block;
+            m_current.header = header;
             m_current.boundary = h256(m_session->nextWorkBoundary.hex(HexPrefix::Add));
             m_current.epoch = m_session->epoch;
             m_current.startNonce = m_session->extraNonce;
@@ -1130,25 +1211,8 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
                 m_session->nextWorkBoundary = h256(target);
             }
         } else if (_method == "mining.set_difficulty" && m_conn->StratumMode() == ETHEREUMSTRATUM) {
-            if (m_conn->StratumMode() == EthStratumClient::ETHEREUMSTRATUM) {
-                jPrm = responseObject.get("params", Json::Value::null);
-                if (jPrm.isArray()) {
-                    double nextWorkDifficulty = max(jPrm.get(Json::Value::ArrayIndex(0), 1).asDouble(), 0.0001);
-
-                    m_session->nextWorkBoundary = h256(dev::getTargetFromDiff(nextWorkDifficulty));
-                    m_session->nextWorkDifficulty = nextWorkDifficulty;
-                }
-            } else if (m_conn->StratumMode() == EthStratumClient::STRATUM) {
-                jPrm = responseObject.get("params", Json::Value::null);
-                if (jPrm.isArray()) {
-                    double nextWorkDifficulty = max(jPrm[0].asDouble(), 0.0001);
-                    m_session->nextWorkBoundary = h256(dev::getTargetFromDiff(nextWorkDifficulty));
-                }
-            } else {
-                cwarn << "Invalid mining.set_difficulty rpc method. Disconnecting ...";
-                if (m_conn->StratumModeConfirmed()) { m_conn->MarkUnrecoverable(); }
-                m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::disconnect, this)));
-            }
+            jPrm = responseObject.get("params", Json::Value::null);
+            if (jPrm.isArray()) processSetDifficulty(jPrm.get(Json::Value::ArrayIndex(0), 1).asDouble());
         } else if (_method == "mining.set_extranonce" && m_conn->StratumMode() == ETHEREUMSTRATUM) {
             jPrm = responseObject.get("params", Json::Value::null);
             if (jPrm.isArray()) {
@@ -1217,6 +1281,140 @@ void EthStratumClient::processResponse(Json::Value& responseObject) {
     }
 }
 
+bool EthStratumClient::processNotification(StratumNotification const& n) {
+    if (n.method == "mining.notify" && m_conn->StratumMode() != ETHEREUMSTRATUM2) {
+        // Discard jobs if not properly subscribed
+        // or if a job for this transmission has already
+        // been processed
+        if (isSubscribed() && !m_newjobprocessed) processNotify(n, 1);
+        return true;
+    }
+    if (n.method == "mining.set_difficulty" && m_conn->StratumMode() == ETHEREUMSTRATUM && m_session) {
+        processSetDifficulty(strtod(string(n.param(0)).c_str(), nullptr));
+        return true;
+    }
+    return false;
+}
+
+void EthStratumClient::processNotify(StratumNotification const& n, unsigned prmIdx) {
+    // Hashes are decoded straight from their hex representation
+    auto hash = [](string_view hex, bool pad) {
+        h256 h;
+        if (!hexToHash(hex, h, pad)) throw runtime_error("Invalid hex");
+        return h;
+    };
+
+    // Job state only changes once all params are valid
+    if (m_conn->StratumMode() == EthStratumClient::ETHEREUMSTRATUM) {
+        string_view sSeedHash = n.param(1);
+        string_view sHeaderHash = n.param(2);
+
+        if (!sHeaderHash.empty() && !sSeedHash.empty()) {
+            h256 seed = hash(sSeedHash, false);
+            h256 header = hash(sHeaderHash, false);
+            m_current.job = string(n.param(0));
+            m_current.seed = seed;
+            m_current.header = header;
+            m_current.boundary = m_session->nextWorkBoundary;
+            m_current.startNonce = m_session->extraNonce;
+            m_current.exSizeBytes = m_session->extraNonceSizeBytes;
+            m_current_timestamp = chrono::steady_clock::now();
+            m_current.block = -1;
+            if (m_session->nextWorkDifficulty) m_current.difficulty = m_session->nextWorkDifficulty;
+            else
+                m_current.difficulty = getHashesToTarget(m_current.boundary.hex(HexPrefix::Add));
+
+            // This will signal to dispatch the job
+            // at the end of the transmission.
+            m_newjobprocessed = true;
+        }
+    } else {
+        string_view sHeaderHash = n.param(prmIdx++);
+        string_view sSeedHash = n.param(prmIdx++);
+        string_view sShareTarget = n.param(prmIdx++);
+
+        // Share target gets left padded (coinmine.pl fix)
+        h256 seed = hash(sSeedHash, false);
+        h256 header = hash(sHeaderHash, false);
+        h256 boundary = hash(sShareTarget, true);
+
+        // Only some eth-proxy compatible implementations carry the block number
+        // namely ethermine.org
+        int block = -1;
+        if (m_conn->StratumMode() == EthStratumClient::ETHPROXY && n.paramsCount > prmIdx && n.param(prmIdx).substr(0, 2) == "0x") {
+            try {
+                block = stoul(string(n.param(prmIdx)), nullptr, 16);
+                /*
+                check if the block number is in a valid range
+                A year has ~31536000 seconds
+                50 years have ~1576800000
+                assuming a (very fast) blocktime of 10s:
+                ==> in 50 years we get 157680000 (=0x9660180) blocks
+                */
+                if (block > 0x9660180) throw new exception();
+            } catch (const exception&) { block = -1; }
+        }
+
+        m_current.job = string(n.param(0));
+        m_current.block = block;
+        m_current.seed = seed;
+        m_current.header = header;
+        m_current.boundary = boundary;
+        m_current_timestamp = chrono::steady_clock::now();
+        if (m_session->nextWorkDifficulty) m_current.difficulty = m_session->nextWorkDifficulty;
+        else
+            m_current.difficulty = getHashesToTarget(m_current.boundary.hex(HexPrefix::Add));
+
+        // This will signal to dispatch the job
+        // at the end of the transmission.
+        m_newjobprocessed = true;
+    }
+}
+
+void EthStratumClient::processSetDifficulty(double difficulty) {
+    double nextWorkDifficulty = max(difficulty, 0.0001);
+
+    m_session->nextWorkBoundary = h256(dev::getTargetFromDiff(nextWorkDifficulty));
+    m_session->nextWorkDifficulty = nextWorkDifficulty;
+}
+
+void EthStratumClient::suggestDifficulty() {
+    // Only Stratum (mining.suggest_target) and EthereumStratum/1.0.0
+    // (mining.suggest_difficulty) have a way to ask for a difficulty
+    unsigned mode = m_conn->StratumMode();
+    if (!m_shareRate || !m_session || m_suggestionRefused || (mode != STRATUM && mode != ETHEREUMSTRATUM)) return;
+
+    auto now = chrono::steady_clock::now();
+    if (now - m_lastSuggestion < chrono::seconds(s_suggestionInterval)) return;
+
+    // Hashes per share for the wanted share rate at current hashrate.
+    // Small hashrate swings don't deserve a new suggestion
+    double hashrate = Farm::f().HashRate();
+    if (hashrate <= 0) return;
+    double hashes = hashrate * 60 / m_shareRate;
+    double last = m_suggestedDifficulty;
+    if (last && fabs(hashes - last) < last / 4) return;
+
+    m_lastSuggestion = now;
+    m_suggestedDifficulty = hashes;
+
+    // Stratum difficulty 1 is 2^32 hashes
+    Json::Value jReq;
+    jReq["id"] = unsigned(8);
+    jReq["params"] = Json::Value(Json::arrayValue);
+    if (mode == ETHEREUMSTRATUM) {
+        jReq["method"] = "mining.suggest_difficulty";
+        jReq["params"].append(hashes / 4294967296.0);
+    } else {
+        jReq["jsonrpc"] = "2.0";
+        jReq["method"] = "mining.suggest_target";
+        jReq["params"].append(getTargetFromDiff(hashes / 4294967296.0));
+    }
+    cnote << "Suggesting difficulty " << EthWhite << dev::getFormattedHashes(hashes) << EthReset << " for " << m_shareRate << " shares per minute";
+
+    send(jReq);
+}
+
 void EthStratumClient::submitHashrate(uint64_t const& rate, string const& id) {
     if (!isConnected()) return;
 
@@ -1255,74 +1453,68 @@ void EthStratumClient::submitHashrate(uint64_t const& rate, string const& id) {
     send(jReq);
 }
 
-void EthStratumClient::submitSolution(const Solution& solution) {
+bool EthStratumClient::submitSolution(const Solution& solution) {
     if (!isAuthorized()) {
         cwarn << "Solution not submitted. Not authorized.";
-        return;
+        return false;
     }
 
-    Json::Value jReq;
-
     unsigned id = 40 + solution.midx;
-    jReq["id"] = id;
     m_solution_submitted_max_id = max(m_solution_submitted_max_id, id);
-    jReq["method"] = "mining.submit";
-    jReq["params"] = Json::Value(Json::arrayValue);
 
-    switch (m_conn->StratumMode()) {
-        case EthStratumClient::STRATUM:
-
-            jReq["jsonrpc"] = "2.0";
-            jReq["params"].append(m_conn->User());
-            jReq["params"].append(solution.work.job);
-            jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
-            jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
-            jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
-            if (!m_conn->Workername().empty()) jReq["worker"] = m_conn->Workername();
-
-            break;
+    // Request is patched from a per job template (see SubmitTemplate for
+    // the layout in each stratum mode) and jumps ahead of any other queued message
+    string line = m_txQueue.acquire();
+    m_submitTemplate.render(line, id, solution, m_conn->StratumMode(), (m_conn->StratumMode() == ETHEREUMSTRATUM ? m_conn->UserDotWorker() : m_conn->User()),
+                            m_conn->Workername(), m_session->workerId);
 
-        case EthStratumClient::ETHPROXY:
-
-            jReq["method"] = "eth_submitWork";
-            jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
-            jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
-            jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
-            if (!m_conn->Workername().empty()) jReq["worker"] = m_conn->Workername();
-
-            break;
-
-        case EthStratumClient::ETHEREUMSTRATUM:
-
-            jReq["params"].append(m_conn->UserDotWorker());
-            jReq["params"].append(solution.work.job);
-            jReq["params"].append(toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
-            break;
-
-        case EthStratumClient::ETHEREUMSTRATUM2:
-
-            jReq["params"].append(solution.work.job);
-            jReq["params"].append(toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
-            jReq["params"].append(m_session->workerId);
-            break;
+    if (!m_txQueue.push(std::move(line), true, solution.tstamp)) {
+        cwarn << "Solution " << toHex(solution.nonce, HexPrefix::Add) << " not submitted. Send queue full.";
+        return false;
     }
-
     enqueue_response_plea();
-    send(jReq);
+
+    bool ex = false;
+    if (m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed)) sendSocketData();
+    return true;
 }
 
 void EthStratumClient::recvSocketData() {
+    // Read straight into the framer
     if (m_conn->SecLevel() != SecureLevel::NONE) {
-        async_read(*m_securesocket, m_recvBuffer, boost::asio::transfer_at_least(1),
-                   m_io_strand.wrap(boost::bind(&EthStratumClient::onRecvSocketDataCompleted, this, boost::asio::placeholders::error,
-                                                boost::asio::placeholders::bytes_transferred)));
+        m_securesocket->async_read_some(m_framer.prepare(), m_io_strand.wrap(boost::bind(&EthStratumClient::onRecvSocketDataCompleted, this,
+                                                                                          boost::asio::placeholders::error,
+                                                                                          boost::asio::placeholders::bytes_transferred)));
     } else {
-        async_read(*m_nonsecuresocket, m_recvBuffer, boost::asio::transfer_at_least(1),
-                   m_io_strand.wrap(boost::bind(&EthStratumClient::onRecvSocketDataCompleted, this, boost::asio::placeholders::error,
-                                                boost::asio::placeholders::bytes_transferred)));
+        m_nonsecuresocket->async_read_some(m_framer.prepare(), m_io_strand.wrap(boost::bind(&EthStratumClient::onRecvSocketDataCompleted, this,
+                                                                                             boost::asio::placeholders::error,
+                                                                                             boost::asio::placeholders::bytes_transferred)));
     }
 }
 
+void EthStratumClient::processLine(const char* first, const char* last) {
+#ifdef DEV_BUILD
+    // Out received message only for debug purpouses
+    if (g_logOptions & LOG_JSON) cnote << " << " << string(first, last);
+#endif
+    if (StratumCapture::enabled()) StratumCapture::record('<', first, last);
+
+    try {
+        // Most frequent notifications skip json parsing. As on the json path
+        // none is processed before stratum mode is confirmed (a remembered one included)
+        if (m_conn->StratumModeConfirmed() && parseNotification(first, last, m_notification) && processNotification(m_notification)) return;
+
+        // Test validity of chunk and process
+        Json::Value jMsg;
+        JSONCPP_STRING err;
+        if (m_jsonReader->parse(first, last, &jMsg, &err)) {
+            // Run in sync so no 2 different async reads may overlap
+            processResponse(jMsg);
+        } else
+            cwarn << "Stratum got invalid Json message";
+    } catch (const exception&) { cwarn << "Stratum got invalid Json message"; }
+}
+
 void EthStratumClient::onRecvSocketDataCompleted(const boost::system::error_code& ec, size_t bytes_transferred) {
     // Due to the nature of io_service's queue and
     // the implementation of the loop this event may trigger
@@ -1330,64 +1522,14 @@ void EthStratumClient::onRecvSocketDataCompleted(const boost::system::error_code
     // before triggering all stack of calls
 
     if (!ec) {
-        // DO NOT DO THIS !!!!!
-        // istream is(&m_recvBuffer);
-        // string message;
-        // getline(is, message)
-        /*
-        There are three reasons :
-        1 - Previous async_read_until calls this handler (aside from error codes)
-            with the number of bytes in the buffer's get area up to and including
-            the delimiter. So we know where to split the line
-        2 - Boost's documentation clearly states that after a succesfull
-            async_read_until operation the stream buffer MAY contain additional
-            data which HAVE to be left in the buffer for subsequent read operations.
-            If another delimiter exists in the buffer, then it will get caught
-            by the next async_read_until()
-        3 - istream is(&m_recvBuffer) will CONSUME ALL data in the buffer
-            thus invalidating the previous point 2
-        */
-
-        // Extract received message and free the buffer
-        string rx_message(boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
-        m_recvBuffer.consume(bytes_transferred);
-        m_message.append(rx_message);
+        m_framer.commit(bytes_transferred);
 
         // Process each line in the transmission
         // NOTE : as multiple jobs may come in with
         // a single transmission only the last will be dispatched
         m_newjobprocessed = false;
-        string line;
-        size_t offset = m_message.find('\n');
-        while (offset != string::npos) {
-            if (offset > 0) {
-                line = m_message.substr(0, offset);
-                boost::trim(line);
-
-                if (!line.empty()) {
-#ifdef DEV_BUILD
-                    // Out received message only for debug purpouses
-                    if (g_logOptions & LOG_JSON) cnote << " << " << line;
-#endif
-
-                    // Test validity of chunk and process
-                    Json::Value jMsg;
-                    JSONCPP_STRING err;
-                    Json::CharReaderBuilder builder;
-                    const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
-                    if (reader->parse(line.c_str(), line.c_str() + line.length(), &jMsg, &err)) {
-                        try {
-                            // Run in sync so no 2 different async reads may overlap
-                            processResponse(jMsg);
-                        } catch (const exception&) { cwarn << "Stratum got invalid Json message"; }
-                    } else
-                        cwarn << "Stratum got invalid Json message";
-                }
-            }
-
-            m_message.erase(0, offset + 1);
-            offset = m_message.find('\n');
-        }
+        if (!m_framer.lines([this](const char* first, const char* last) { processLine(first, last); }))
+            cwarn << "Stratum got a message longer than " << LineFramer::s_maxLineLength << " bytes. Discarding ...";
 
         // There is a new job - dispatch it
         if (m_newjobprocessed)
@@ -1416,8 +1558,10 @@ void EthStratumClient::onRecvSocketDataCompleted(const boost::system::error_code
 }
 
 void EthStratumClient::send(Json::Value const& jReq) {
-    string* line = new string(Json::writeString(m_jSwBuilder, jReq));
-    m_txQueue.bounded_push(line);
+    string line = m_txQueue.acquire();
+    line.assign(Json::writeString(m_jSwBuilder, jReq));
+    line.push_back('\n');
+    m_txQueue.push(std::move(line), false);
 
     bool ex = false;
     if (m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed)) sendSocketData();
@@ -1425,36 +1569,38 @@ void EthStratumClient::send(Json::Value const& jReq) {
 
 void EthStratumClient::sendSocketData() {
     if (!isConnected() || m_txQueue.empty()) {
-        m_sendBuffer.consume(m_sendBuffer.capacity());
-        m_txQueue.consume_all([](string* l) { delete l; });
+        m_txQueue.clear();
         m_txPending.store(false, memory_order_relaxed);
         return;
     }
 
-    string* line;
-    ostream os(&m_sendBuffer);
-    while (m_txQueue.pop(line)) {
-        os << *line << endl;
+    // All pending lines go out in a single gather write
+    auto const& buffers = m_txQueue.flight();
+
 #ifdef DEV_BUILD
-        // Out received message only for debug purpouses
-        if (g_logOptions & LOG_JSON) cnote << " >> " << *line;
+    // Out sent messages only for debug purpouses
+    if (g_logOptions & LOG_JSON)
+        for (auto const& line: m_txQueue.inFlight()) cnote << " >> " << line.substr(0, line.size() - 1);
 #endif
-
-        delete line;
-    }
+    if (StratumCapture::enabled())
+        for (auto const& line: m_txQueue.inFlight()) StratumCapture::record('>', line);
 
     if (m_conn->SecLevel() != SecureLevel::NONE) {
-        async_write(*m_securesocket, m_sendBuffer, m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this, boost::asio::placeholders::error)));
+        async_write(*m_securesocket, buffers, m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this, boost::asio::placeholders::error)));
     } else {
-        async_write(*m_nonsecuresocket, m_sendBuffer,
-                    m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this, boost::asio::placeholders::error)));
+        async_write(*m_nonsecuresocket, buffers, m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this, boost::asio::placeholders::error)));
     }
 }
 
 void EthStratumClient::onSendSocketDataCompleted(const boost::system::error_code& ec) {
+    if (!ec && m_histograms) {
+        auto now = chrono::steady_clock::now();
+        for (auto const& found: m_txQueue.inFlightStamps()) m_histograms->submit.record(now - found);
+    }
+    m_txQueue.landed();
+
     if (ec) {
-        m_sendBuffer.consume(m_sendBuffer.capacity());
-        m_txQueue.consume_all([](string* l) { delete l; });
+        m_txQueue.clear();
         m_txPending.store(false, memory_order_relaxed);
 
         if ((ec.category() == boost::asio::error::get_ssl_category()) && (SSL_R_PROTOCOL_IS_SHUTDOWN == ERR_GET_REASON(ec.value()))) {
@@ -10,6 +10,8 @@
 #pragma once
 
 #include <iostream>
+#include <map>
+#include <mutex>
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
@@ -25,7 +27,10 @@
 #include <libeth/Farm.h>
 #include <libeth/Miner.h>
 
+#include "../Endpoints.h"
 #include "../PoolClient.h"
+#include "StratumParser.h"
+#include "StratumSender.h"
 
 using namespace std;
 using namespace dev;
@@ -59,7 +64,7 @@ class EthStratumClient : public PoolClient {
 public:
     enum StratumProtocol { STRATUM = 0, ETHPROXY, ETHEREUMSTRATUM, ETHEREUMSTRATUM2 };
 
-    EthStratumClient(int worktimeout, int responsetimeout);
+    EthStratumClient(int worktimeout, int responsetimeout, double shareRate = 0);
 
     void init_socket();
     void connect() override;
@@ -74,21 +79,29 @@ public:
     bool isPendingState() override { return (m_connecting.load(std::memory_order_relaxed) || m_disconnecting.load(std::memory_order_relaxed)); }
 
     void submitHashrate(uint64_t const& rate, string const& id) override;
-    void submitSolution(const Solution& solution) override;
+    bool submitSolution(const Solution& solution) override;
     h256 currentHeaderHash() { return m_current.header; }
     bool current() { return static_cast<bool>(m_current); }
 
 private:
     void startSession();
+    void saveResumableSession();
+    void rememberStratumMode();
     void disconnect_finalize();
     void enqueue_response_plea();
     std::chrono::milliseconds dequeue_response_plea();
     void clear_response_pleas();
     void resolve_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
     void start_connect();
-    void connect_handler(const boost::system::error_code& ec);
+    void connect_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::endpoint const& ep);
+    void discard_endpoint();
     void workloop_timer_elapsed(const boost::system::error_code& ec);
     void processResponse(Json::Value& responseObject);
+    bool processNotification(StratumNotification const& n);
+    void processNotify(StratumNotification const& n, unsigned prmIdx);
+    void processSetDifficulty(double difficulty);
+    void suggestDifficulty();
+    void processLine(const char* first, const char* last);
     static std::string processError(Json::Value& erroresponseObject);
     void processExtranonce(std::string& enonce);
     void recvSocketData();
@@ -101,6 +114,10 @@ private:
     std::atomic<bool> m_disconnecting = {false};
     std::atomic<bool> m_connecting = {false};
     std::atomic<bool> m_authpending = {false};
+    bool m_modeHinted = false;   // Whether stratum mode under test comes from StratumModeCache
+    bool m_canResume = false;    // Whether pool advertised EthereumStratum/2.0.0 session resume
+    bool m_resuming = false;     // Whether a session resume has been requested
+    bool m_resumed = false;      // Whether current session has been resumed
 
     // seconds to trigger a work_timeout (overwritten in constructor)
     int m_worktimeout;
@@ -108,6 +125,13 @@ private:
     // seconds timeout for responses and connection (overwritten in constructor)
     int m_responsetimeout;
 
+    // shares per minute difficulty suggestions aim at (0 disables)
+    double m_shareRate;
+    std::chrono::steady_clock::time_point m_lastSuggestion;
+    double m_suggestedDifficulty = 0;   // Share difficulty (in hashes) last suggested in this session
+    bool m_suggestionRefused = false;
+    static const unsigned s_suggestionInterval = 60;   // Minimum seconds between two suggestions
+
     // default interval for workloop timer (milliseconds)
     int m_workloop_interval = 1000;
 
@@ -117,7 +141,9 @@ private:
     boost::asio::io_service& m_io_service;   // The IO service reference passed in the constructor
     boost::asio::io_service::strand m_io_strand;
     boost::asio::ip::tcp::socket* m_socket;
-    std::string m_message;   // The internal message string buffer
+    LineFramer m_framer;   // Receive buffer
+    std::unique_ptr<Json::CharReader> m_jsonReader;
+    StratumNotification m_notification;
     bool m_newjobprocessed = false;
 
     // Use shared ptrs to avoid crashes due to async_writes
@@ -126,9 +152,8 @@ private:
     std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> m_securesocket;
     std::shared_ptr<boost::asio::ip::tcp::socket> m_nonsecuresocket;
 
-    boost::asio::streambuf m_sendBuffer;
-    boost::asio::streambuf m_recvBuffer;
     Json::StreamWriterBuilder m_jSwBuilder;
+    SubmitTemplate m_submitTemplate;
 
     boost::asio::deadline_timer m_workloop_timer;
 
@@ -137,13 +162,30 @@ private:
     boost::lockfree::queue<std::chrono::steady_clock::time_point> m_response_plea_times;
 
     std::atomic<bool> m_txPending = {false};
-    boost::lockfree::queue<std::string*> m_txQueue;
+    StratumSendQueue m_txQueue;
 
     boost::asio::ip::tcp::resolver m_resolver;
-    std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
+    std::deque<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
+    std::shared_ptr<EndpointRace> m_race;   // Pending happy eyeballs connection attempts
 
     unsigned m_solution_submitted_max_id;   // maximum json id we used to send a solution
 
+    // EthereumStratum/2.0.0 session state kept after a disconnection
+    // so next connection (made by a new client instance) can resume it
+    struct ResumableSession {
+        std::string sessionId;
+        uint64_t extraNonce = 0;
+        unsigned int extraNonceSizeBytes = 0;
+        unsigned int epoch = 0;
+        unsigned int timeout = 0;
+        h256 nextWorkBoundary;
+        double nextWorkDifficulty = 0;
+        WorkPackage job;
+        std::chrono::steady_clock::time_point expires;
+    };
+    static std::mutex s_resumableMutex;
+    static std::map<std::string, ResumableSession> s_resumable;   // Keyed by host:port
+
     ///@brief Auxiliary function to make verbose_verification objects.
     template<typename Verifier> verbose_verification<Verifier> make_verbose_verification(Verifier verifier) { return verbose_verification<Verifier>(verifier); }
 };
@@ -0,0 +1,62 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include "StratumCapture.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace dev;
+using namespace dev::eth;
+
+const char* StratumCapture::s_magic = "# eaminer stratum capture 1";
+
+mutex StratumCapture::s_mutex;
+ofstream StratumCapture::s_out;
+atomic<bool> StratumCapture::s_enabled{false};
+steady_clock::time_point StratumCapture::s_last;
+steady_clock::time_point StratumCapture::s_lastFlush;
+
+bool StratumCapture::open(string const& path) {
+    lock_guard<mutex> l(s_mutex);
+    if (s_out.is_open()) s_out.close();
+    s_out.open(path, ios::out | ios::trunc);
+    if (!s_out) return false;
+
+    s_out << s_magic << '\n';
+    s_last = s_lastFlush = steady_clock::now();
+    s_enabled.store(true, memory_order_relaxed);
+    return true;
+}
+
+void StratumCapture::close() {
+    lock_guard<mutex> l(s_mutex);
+    s_enabled.store(false, memory_order_relaxed);
+    if (s_out.is_open()) s_out.close();
+}
+
+void StratumCapture::record(char tag, const char* first, const char* last) {
+    // Lines are framed without their terminator but payloads
+    // from the send queue still carry it
+    while (last > first && (last[-1] == '\n' || last[-1] == '\r')) last--;
+
+    lock_guard<mutex> l(s_mutex);
+    if (!s_out.is_open()) return;
+
+    auto now = steady_clock::now();
+    s_out << duration_cast<microseconds>(now - s_last).count() << ' ' << tag << ' ';
+    s_out.write(first, last - first);
+    s_out.put('\n');
+    s_last = now;
+
+    // Keep the file usable if the process gets killed
+    if (tag == '-' || now - s_lastFlush > seconds(1)) {
+        s_out.flush();
+        s_lastFlush = now;
+    }
+}
@@ -0,0 +1,47 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+namespace dev::eth {
+
+// Records every stratum line sent and received, whatever the build type,
+// so a production session can be replayed later (see ReplayClient).
+// The file is plain text, one record per line :
+//   <microseconds since previous record> <tag> <payload>
+// where tag is '<' for a received line, '>' for a sent line, '+' for a
+// connection to host:port, '=' for the confirmed stratum mode and '-'
+// for a disconnection.
+class StratumCapture {
+public:
+    static const char* s_magic;
+
+    // Starts recording to file. Returns false if it can't be created
+    static bool open(std::string const& path);
+    static void close();
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    static void record(char tag, const char* first, const char* last);
+    static void record(char tag, std::string const& payload) { record(tag, payload.data(), payload.data() + payload.size()); }
+
+private:
+    static std::mutex s_mutex;
+    static std::ofstream s_out;
+    static std::atomic<bool> s_enabled;
+    static std::chrono::steady_clock::time_point s_last;
+    static std::chrono::steady_clock::time_point s_lastFlush;
+};
+
+}   // namespace dev::eth
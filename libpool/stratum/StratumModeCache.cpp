@@ -0,0 +1,82 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <libdev/Log.h>
+
+#include "StratumModeCache.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+mutex StratumModeCache::s_mutex;
+string StratumModeCache::s_path;
+map<string, unsigned> StratumModeCache::s_modes;
+
+void StratumModeCache::load(string const& path) {
+    lock_guard<mutex> l(s_mutex);
+    s_path = path;
+    s_modes.clear();
+    if (s_path.empty()) return;
+
+    // Missing file is not an error : it will be created
+    // as soon as a pool flavour gets detected
+    ifstream ifs(s_path);
+    string line;
+    while (getline(ifs, line)) {
+        istringstream is(line);
+        string k;
+        unsigned mode;
+        if ((is >> k >> mode) && mode <= 3) s_modes[k] = mode;
+    }
+}
+
+bool StratumModeCache::lookup(string const& host, unsigned short port, unsigned& mode) {
+    lock_guard<mutex> l(s_mutex);
+    auto it = s_modes.find(key(host, port));
+    if (it == s_modes.end()) return false;
+    mode = it->second;
+    return true;
+}
+
+void StratumModeCache::store(string const& host, unsigned short port, unsigned mode) {
+    lock_guard<mutex> l(s_mutex);
+    auto it = s_modes.find(key(host, port));
+    if (it != s_modes.end() && it->second == mode) return;
+    s_modes[key(host, port)] = mode;
+    save();
+}
+
+void StratumModeCache::forget(string const& host, unsigned short port) {
+    lock_guard<mutex> l(s_mutex);
+    if (s_modes.erase(key(host, port))) save();
+}
+
+void StratumModeCache::save() {
+    if (s_path.empty()) return;
+
+    // Write aside and swap so a crash never leaves a truncated file
+    string tmp = s_path + ".tmp";
+    {
+        ofstream ofs(tmp, ios::trunc);
+        for (auto const& m: s_modes) ofs << m.first << " " << m.second << "\n";
+        if (!ofs) {
+            cwarn << "Unable to write pool state file " << tmp;
+            return;
+        }
+    }
+#ifdef _WIN32
+    remove(s_path.c_str());
+#endif
+    if (rename(tmp.c_str(), s_path.c_str()) != 0) cwarn << "Unable to write pool state file " << s_path;
+}
@@ -0,0 +1,40 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace dev::eth {
+
+// Remembers, across runs, the stratum flavour each pool (host:port)
+// has been detected to speak so autodetection can start from it
+// instead of probing all flavours.
+// State is kept in a plain text file with one "host:port mode" per line.
+class StratumModeCache {
+public:
+    // Loads state from file. An empty path disables persistence
+    static void load(std::string const& path);
+
+    static bool lookup(std::string const& host, unsigned short port, unsigned& mode);
+    static void store(std::string const& host, unsigned short port, unsigned mode);
+    static void forget(std::string const& host, unsigned short port);
+
+private:
+    static void save();
+    static std::string key(std::string const& host, unsigned short port) { return host + ":" + std::to_string(port); }
+
+    static std::mutex s_mutex;
+    static std::string s_path;
+    static std::map<std::string, unsigned> s_modes;
+};
+
+}   // namespace dev::eth
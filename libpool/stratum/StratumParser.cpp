@@ -0,0 +1,242 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+
+#include <json/json.h>
+
+#include "StratumParser.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+const size_t LineFramer::s_maxLineLength;
+
+boost::asio::mutable_buffer LineFramer::prepare() {
+    const size_t minRead = 4096;
+    if (m_buffer.size() - m_end < minRead) {
+        // Move the partial line at the beginning of the buffer
+        // and grow it only if still not enough
+        if (m_begin) {
+            memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+            m_end -= m_begin;
+            m_scan -= m_begin;
+            m_begin = 0;
+        }
+        if (m_buffer.size() - m_end < minRead) m_buffer.resize(m_buffer.size() * 2);
+    }
+    return boost::asio::buffer(m_buffer.data() + m_end, m_buffer.size() - m_end);
+}
+
+namespace {
+struct Scanner {
+    const char* p;
+    const char* e;
+
+    void ws() {
+        while (p < e && isspace((unsigned char) *p)) p++;
+    }
+    bool eat(char c) {
+        ws();
+        if (p < e && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+    // Plain string without escapes
+    bool str(string_view& out) {
+        if (!eat('"')) return false;
+        const char* s = p;
+        while (p < e && *p != '"') {
+            if (*p == '\\') return false;
+            p++;
+        }
+        if (p == e) return false;
+        out = string_view(s, p - s);
+        p++;
+        return true;
+    }
+    // Number or literal
+    bool token(string_view& out) {
+        ws();
+        const char* s = p;
+        while (p < e && *p != ',' && *p != '}' && *p != ']' && !isspace((unsigned char) *p)) {
+            if (*p == '{' || *p == '[' || *p == '"') return false;
+            p++;
+        }
+        out = string_view(s, p - s);
+        return !out.empty();
+    }
+    bool value(string_view& out) {
+        ws();
+        return (p < e && *p == '"') ? str(out) : token(out);
+    }
+};
+}   // namespace
+
+bool dev::eth::parseNotification(const char* _first, const char* _last, StratumNotification& _out) {
+    Scanner sc{_first, _last};
+    bool hasParams = false;
+    _out.method = string_view();
+    _out.paramsCount = 0;
+
+    if (!sc.eat('{')) return false;
+    if (sc.eat('}')) return false;
+
+    do {
+        string_view key, val;
+        if (!sc.str(key) || !sc.eat(':')) return false;
+
+        if (key == "params") {
+            if (!sc.eat('[')) return false;
+            if (!sc.eat(']')) {
+                do {
+                    if (_out.paramsCount == _out.params.size() || !sc.value(val)) return false;
+                    _out.params[_out.paramsCount++] = val;
+                } while (sc.eat(','));
+                if (!sc.eat(']')) return false;
+            }
+            hasParams = true;
+            continue;
+        }
+
+        if (!sc.value(val)) return false;
+        if (key == "method") {
+            _out.method = val;
+        } else if (key == "jsonrpc") {
+            if (val != "2.0") return false;
+        } else if (key == "result" || key == "error") {
+            if (val != "null") return false;
+        } else if (key != "id" && key != "worker") {
+            // Anything unexpected is left to the json parser
+            return false;
+        }
+    } while (sc.eat(','));
+
+    if (!sc.eat('}')) return false;
+    sc.ws();
+    return (sc.p == sc.e && hasParams && _out.paramsCount && (_out.method == "mining.notify" || _out.method == "mining.set_difficulty"));
+}
+
+bool dev::eth::hexToHash(string_view _hex, h256& _out, bool _pad) {
+    if (_hex.size() >= 2 && _hex[0] == '0' && (_hex[1] == 'x' || _hex[1] == 'X')) _hex.remove_prefix(2);
+
+    _out = h256();
+    if (_hex.size() > 64 || (!_pad && _hex.size() != 64)) {
+        // Validate anyway so behavior matches h256(string)
+        for (char c: _hex)
+            if (!isxdigit((unsigned char) c)) return false;
+        return true;
+    }
+
+    // Fill from the least significant nibble
+    ::byte* d = _out.data();
+    size_t nibble = 63;
+    for (size_t i = _hex.size(); i-- > 0; nibble--) {
+        char c = _hex[i];
+        ::byte v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v = c - 'A' + 10;
+        else
+            return false;
+        d[nibble / 2] |= (nibble & 1) ? v : (v << 4);
+    }
+    return true;
+}
+
+void dev::eth::benchmarkStratumParser(unsigned _messages) {
+    using namespace chrono;
+
+    // Build a synthetic stream with a realistic mix of messages
+    const string notify = R"({"id":null,"method":"mining.notify","params":["bf0488aa","645cf20198c2f3861e947d4f67e3ab63b7b2e24dcc9095bd9123e7b33371f6cc",)"
+                          R"("4d0a8c2c8d0c4f45a35be9f2de7db5b6f3e2a5f1e9c8b7a6d5c4b3a2f1e0d9c8",true]})";
+    const string notifyProxy = R"({"id":0,"jsonrpc":"2.0","method":"mining.notify","params":["0x1a2b3c","0x645cf20198c2f3861e947d4f67e3ab63b7b2e24dcc9095bd9123e7b33371f6cc",)"
+                               R"("0x4d0a8c2c8d0c4f45a35be9f2de7db5b6f3e2a5f1e9c8b7a6d5c4b3a2f1e0d9c8","0x00000000ffff0000000000000000000000000000000000000000000000000000"]})";
+    const string setDiff = R"({"id":null,"method":"mining.set_difficulty","params":[4.294967296]})";
+    string stream;
+    for (unsigned i = 0; i < _messages; i++) stream += ((i % 3) == 0 ? setDiff : ((i % 3) == 1 ? notify : notifyProxy)) + "\n";
+
+    // Data is delivered in chunks the size of a typical TCP segment
+    const size_t chunk = 1460;
+
+    auto report = [&](const char* label, steady_clock::duration elapsed, unsigned count) {
+        double secs = duration_cast<duration<double>>(elapsed).count();
+        cout << "  " << left << setw(28) << label << right << setw(12) << fixed << setprecision(0) << (secs > 0 ? count / secs : 0) << " msg/s" << endl;
+    };
+
+    cout << "Stratum receive path benchmark (" << _messages << " messages, " << stream.size() << " bytes)" << endl;
+
+    // 1 - Legacy : copy to string, substr each line, new reader per line
+    {
+        unsigned count = 0;
+        string message;
+        auto start = steady_clock::now();
+        for (size_t off = 0; off < stream.size(); off += chunk) {
+            message.append(stream, off, chunk);
+            size_t offset = message.find('\n');
+            while (offset != string::npos) {
+                string line = message.substr(0, offset);
+                boost::trim(line);
+                Json::Value jMsg;
+                JSONCPP_STRING err;
+                Json::CharReaderBuilder builder;
+                const unique_ptr<Json::CharReader> reader(builder.newCharReader());
+                if (reader->parse(line.c_str(), line.c_str() + line.length(), &jMsg, &err)) {
+                    h256 header(jMsg["params"].get(Json::Value::ArrayIndex(1), "").asString());
+                    count++;
+                }
+                message.erase(0, offset + 1);
+                offset = message.find('\n');
+            }
+        }
+        report("legacy", steady_clock::now() - start, count);
+    }
+
+    // 2 - Framer with persistent json reader
+    // 3 - Framer with notification fast path
+    for (int fast = 0; fast < 2; fast++) {
+        unsigned count = 0;
+        LineFramer framer;
+        Json::CharReaderBuilder builder;
+        const unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        StratumNotification n;
+        auto start = steady_clock::now();
+        for (size_t off = 0; off < stream.size(); off += chunk) {
+            size_t len = min(chunk, stream.size() - off);
+            auto buf = framer.prepare();
+            memcpy(buf.data(), stream.data() + off, len);   // Stands for the socket read
+            framer.commit(len);
+            framer.lines([&](const char* first, const char* last) {
+                if (fast && parseNotification(first, last, n)) {
+                    h256 header;
+                    if (hexToHash(n.param(1), header, false)) count++;
+                    return;
+                }
+                Json::Value jMsg;
+                JSONCPP_STRING err;
+                if (reader->parse(first, last, &jMsg, &err)) {
+                    h256 header(jMsg["params"].get(Json::Value::ArrayIndex(1), "").asString());
+                    count++;
+                }
+            });
+        }
+        report(fast ? "framer + fast path" : "framer + persistent reader", steady_clock::now() - start, count);
+    }
+}
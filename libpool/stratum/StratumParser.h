@@ -0,0 +1,101 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+#include <libdev/FixedHash.h>
+
+namespace dev::eth {
+
+// Receive buffer which frames newline delimited messages in place.
+// Socket reads land directly in the buffer, complete lines are handed out
+// as [first, last) ranges pointing into it and only the trailing partial
+// line (if any) is moved back to the front when room is needed.
+class LineFramer {
+public:
+    explicit LineFramer(size_t _capacity = 16384) : m_buffer(_capacity) {}
+
+    // Free space for next socket read
+    boost::asio::mutable_buffer prepare();
+
+    // Accounts bytes written by socket read in the space returned by prepare()
+    void commit(size_t _bytes) { m_end += _bytes; }
+
+    // Invokes _f(first, last) for each complete, whitespace trimmed, not empty line.
+    // Returns false if a partial line grew beyond s_maxLineLength and got discarded
+    template<typename F> bool lines(F&& _f) {
+        while (m_scan < m_end) {
+            auto* nl = static_cast<char*>(memchr(m_buffer.data() + m_scan, '\n', m_end - m_scan));
+            if (!nl) {
+                m_scan = m_end;
+                break;
+            }
+
+            const char* first = m_buffer.data() + m_begin;
+            const char* last = nl;
+            while (first < last && isspace((unsigned char) *first)) first++;
+            while (last > first && isspace((unsigned char) *(last - 1))) last--;
+
+            m_begin = m_scan = (nl - m_buffer.data()) + 1;
+            if (first != last) _f(first, last);
+        }
+        if (m_begin == m_end) m_begin = m_scan = m_end = 0;
+
+        if ((m_end - m_begin) > s_maxLineLength) {
+            clear();
+            return false;
+        }
+        return true;
+    }
+
+    void clear() { m_begin = m_scan = m_end = 0; }
+
+    static const size_t s_maxLineLength = 65536;
+
+private:
+    std::vector<char> m_buffer;
+    size_t m_begin = 0;   // Begin of first not processed line
+    size_t m_scan = 0;    // Where to resume searching for newline
+    size_t m_end = 0;     // End of valid data
+};
+
+// Flat view over a stratum notification.
+// All views point into the framed line
+struct StratumNotification {
+    std::string_view method;
+    std::array<std::string_view, 8> params;
+    unsigned paramsCount = 0;
+
+    std::string_view param(unsigned _idx) const { return (_idx < paramsCount ? params[_idx] : std::string_view()); }
+};
+
+// Fast path for the most frequent messages (mining.notify and mining.set_difficulty).
+// Scans a line without building a Json::Value. Returns false whenever the line
+// is not a flat notification with a "params" array (nested objects, escaped
+// strings, responses, too many params ...) : such lines must go through the
+// regular json parser.
+bool parseNotification(const char* _first, const char* _last, StratumNotification& _out);
+
+// Decodes a (optionally 0x prefixed) hex string straight into a hash.
+// Shorter strings are left padded with zeroes if _pad, otherwise they yield
+// an empty hash. Returns false on invalid hex digits.
+bool hexToHash(std::string_view _hex, h256& _out, bool _pad);
+
+// Measures messages per second through the legacy (copy and per line json
+// reader), persistent json reader and fast path receive pipelines
+void benchmarkStratumParser(unsigned _messages);
+
+}   // namespace dev::eth
@@ -0,0 +1,175 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <json/json.h>
+
+#include "StratumSender.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+const size_t StratumSendQueue::s_maxPending;
+
+namespace {
+const char c_hexDigits[] = "0123456789abcdef";
+
+// Writes the _count least significant hex digits of _n at _p
+void putHex(char* _p, uint64_t _n, size_t _count) {
+    for (size_t i = _count; i-- > 0; _n >>= 4) _p[i] = c_hexDigits[_n & 0xf];
+}
+
+void putHex(char* _p, h256 const& _h) {
+    for (size_t i = 0; i < h256::size; i++) {
+        ::byte b = _h[i];
+        *_p++ = c_hexDigits[b >> 4];
+        *_p++ = c_hexDigits[b & 0xf];
+    }
+}
+}   // namespace
+
+string StratumSendQueue::acquire() {
+    lock_guard<mutex> l(m_mutex);
+    if (m_free.empty()) {
+        string s;
+        s.reserve(512);
+        return s;
+    }
+    string s(std::move(m_free.back()));
+    m_free.pop_back();
+    s.clear();
+    return s;
+}
+
+bool StratumSendQueue::push(string&& _msg, bool _priority, chrono::steady_clock::time_point _stamp) {
+    lock_guard<mutex> l(m_mutex);
+    auto& lane = m_lanes[_priority ? 0 : 1];
+    if (lane.size() >= s_maxPending) {
+        m_free.push_back(std::move(_msg));
+        return false;
+    }
+    lane.push_back(std::move(_msg));
+    if (_stamp != chrono::steady_clock::time_point()) m_stamps.push_back(_stamp);
+    return true;
+}
+
+bool StratumSendQueue::empty() {
+    lock_guard<mutex> l(m_mutex);
+    return m_lanes[0].empty() && m_lanes[1].empty();
+}
+
+vector<boost::asio::const_buffer> const& StratumSendQueue::flight() {
+    lock_guard<mutex> l(m_mutex);
+    for (auto& lane: m_lanes) {
+        for (auto& msg: lane) m_inflight.push_back(std::move(msg));
+        lane.clear();
+    }
+    m_inflightStamps.swap(m_stamps);
+    m_buffers.clear();
+    for (auto const& msg: m_inflight) m_buffers.push_back(boost::asio::buffer(msg));
+    return m_buffers;
+}
+
+void StratumSendQueue::landed() {
+    lock_guard<mutex> l(m_mutex);
+    for (auto& msg: m_inflight) m_free.push_back(std::move(msg));
+    m_inflight.clear();
+    m_inflightStamps.clear();
+    m_buffers.clear();
+}
+
+void StratumSendQueue::clear() {
+    landed();
+    lock_guard<mutex> l(m_mutex);
+    for (auto& lane: m_lanes) {
+        for (auto& msg: lane) m_free.push_back(std::move(msg));
+        lane.clear();
+    }
+    m_stamps.clear();
+}
+
+void SubmitTemplate::invalidate() {
+    lock_guard<mutex> l(m_mutex);
+    m_sessionReady = m_jobReady = false;
+}
+
+void SubmitTemplate::render(string& _out, unsigned _id, Solution const& _solution, unsigned _mode, string const& _user, string const& _worker,
+                            string const& _workerId) {
+    lock_guard<mutex> l(m_mutex);
+
+    if (!m_sessionReady || m_mode != _mode) renderSession(_mode, _user, _worker, _workerId);
+    if (!m_jobReady || m_header != _solution.work.header || m_exSizeBytes != _solution.work.exSizeBytes || m_job != _solution.work.job)
+        renderJob(_solution.work);
+
+    // Same layout Json::StreamWriter gives (keys sorted, no spaces)
+    // so pools see exactly the same bytes as before
+    _out.assign("{\"id\":");
+    _out.append(to_string(_id));
+    size_t base = _out.size();
+    _out.append(m_body);
+
+    putHex(&_out[base + m_nonceOffset], _solution.nonce, m_nonceLength);
+    if (m_mixOffset != string::npos) putHex(&_out[base + m_mixOffset], _solution.mixHash);
+}
+
+void SubmitTemplate::renderSession(unsigned _mode, string const& _user, string const& _worker, string const& _workerId) {
+    m_mode = _mode;
+    m_user = Json::valueToQuotedString(_user.c_str());
+    m_worker = _worker.empty() ? string() : Json::valueToQuotedString(_worker.c_str());
+    m_workerId = Json::valueToQuotedString(_workerId.c_str());
+    m_sessionReady = true;
+    m_jobReady = false;
+}
+
+void SubmitTemplate::renderJob(WorkPackage const& _work) {
+    m_job = _work.job;
+    m_header = _work.header;
+    m_exSizeBytes = _work.exSizeBytes;
+
+    string job = Json::valueToQuotedString(m_job.c_str());
+    string header = "\"" + m_header.hex(HexPrefix::Add) + "\"";
+    string mix = "\"0x" + string(64, '0') + "\"";
+
+    // Full nonce in STRATUM and ETHPROXY, only the part not
+    // covered by extranonce in EthereumStratum flavours
+    m_nonceLength = (m_mode <= 1 ? 16 : 16 - min<size_t>(m_exSizeBytes, 16));
+    string nonce = (m_mode <= 1 ? "\"0x" : "\"") + string(m_nonceLength, '0') + "\"";
+    m_mixOffset = string::npos;
+
+    switch (m_mode) {
+        case 0:   // STRATUM
+            m_body = ",\"jsonrpc\":\"2.0\",\"method\":\"mining.submit\",\"params\":[" + m_user + "," + job + ",";
+            m_nonceOffset = m_body.size() + 3;
+            m_body += nonce + "," + header + ",";
+            m_mixOffset = m_body.size() + 3;
+            m_body += mix + "]";
+            if (!m_worker.empty()) m_body += ",\"worker\":" + m_worker;
+            break;
+        case 1:   // ETHPROXY
+            m_body = ",\"method\":\"eth_submitWork\",\"params\":[";
+            m_nonceOffset = m_body.size() + 3;
+            m_body += nonce + "," + header + ",";
+            m_mixOffset = m_body.size() + 3;
+            m_body += mix + "]";
+            if (!m_worker.empty()) m_body += ",\"worker\":" + m_worker;
+            break;
+        case 2:   // ETHEREUMSTRATUM
+            m_body = ",\"method\":\"mining.submit\",\"params\":[" + m_user + "," + job + ",";
+            m_nonceOffset = m_body.size() + 1;
+            m_body += nonce + "]";
+            break;
+        default:   // ETHEREUMSTRATUM2
+            m_body = ",\"method\":\"mining.submit\",\"params\":[" + job + ",";
+            m_nonceOffset = m_body.size() + 1;
+            m_body += nonce + "," + m_workerId + "]";
+            break;
+    }
+    m_body += "}\n";
+    m_jobReady = true;
+}
@@ -0,0 +1,101 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+#include <libeth/EthashAux.h>
+
+namespace dev::eth {
+
+// Outgoing messages queue.
+// Message buffers are taken from a free list and given back once written
+// so, in steady state, sending does not allocate. Shares are pushed in a
+// priority lane which is always put on the wire before any other traffic
+// (hashrate reports, keep alives ...) still waiting.
+class StratumSendQueue {
+public:
+    // Empty buffer (with its capacity preserved) to render a message into
+    std::string acquire();
+
+    // Queues a newline terminated message. Returns false if the lane is full.
+    // A _stamp (e.g. when a share was found) is given back by inFlightStamps()
+    // while the message is written, to time it until it hits the socket
+    bool push(std::string&& _msg, bool _priority, std::chrono::steady_clock::time_point _stamp = {});
+
+    bool empty();
+
+    // Moves all pending messages, priority lane first, in flight and returns
+    // the gather list for a single write. Must not be called again before landed()
+    std::vector<boost::asio::const_buffer> const& flight();
+    std::vector<std::string> const& inFlight() const { return m_inflight; }
+    std::vector<std::chrono::steady_clock::time_point> const& inFlightStamps() const { return m_inflightStamps; }
+
+    // Gives in flight buffers back to the free list
+    void landed();
+
+    // Drops everything
+    void clear();
+
+    static const size_t s_maxPending = 64;
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::string> m_free;
+    std::vector<std::string> m_lanes[2];   // [0] priority, [1] normal
+    std::vector<std::string> m_inflight;
+    std::vector<boost::asio::const_buffer> m_buffers;
+    std::vector<std::chrono::steady_clock::time_point> m_stamps;   // Of pending messages
+    std::vector<std::chrono::steady_clock::time_point> m_inflightStamps;
+};
+
+// Pre-rendered mining.submit (or eth_submitWork) request.
+// The parts which depend on the session only (user, worker) are rendered
+// once per session, the ones which depend on the job (job id, header) once
+// per job. Each share then only copies the template and patches nonce and
+// mix hex digits in place.
+class SubmitTemplate {
+public:
+    // Forgets everything. Next render() rebuilds from scratch
+    void invalidate();
+
+    // Renders the request for _solution into _out (newline terminated).
+    // _user is the login expected by _mode (user or user.worker)
+    void render(std::string& _out, unsigned _id, Solution const& _solution, unsigned _mode, std::string const& _user, std::string const& _worker,
+                std::string const& _workerId);
+
+private:
+    void renderSession(unsigned _mode, std::string const& _user, std::string const& _worker, std::string const& _workerId);
+    void renderJob(WorkPackage const& _work);
+
+    std::mutex m_mutex;
+    bool m_sessionReady = false;
+    unsigned m_mode = 0;
+    std::string m_user;       // Json quoted
+    std::string m_worker;     // Json quoted, empty if none
+    std::string m_workerId;   // Json quoted
+
+    std::string m_job;
+    h256 m_header;
+    unsigned m_exSizeBytes = 0;
+    bool m_jobReady = false;
+
+    std::string m_body;   // Request after the id
+    size_t m_nonceOffset = 0;
+    size_t m_nonceLength = 0;
+    size_t m_mixOffset = std::string::npos;
+};
+
+}   // namespace dev::eth
@@ -0,0 +1,136 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#ifdef _WIN32
+// Needed for certificates validation on TLS connections
+#    include <wincrypt.h>
+#endif
+
+#include <libdev/Log.h>
+
+#include "TlsSessionCache.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+mutex TlsSessionCache::s_mutex;
+map<SecureLevel, unique_ptr<boost::asio::ssl::context>> TlsSessionCache::s_contexts;
+map<string, SSL_SESSION*> TlsSessionCache::s_sessions;
+map<string, TlsHandshakeStats> TlsSessionCache::s_stats;
+
+namespace {
+// Index of the ex_data slot holding the cache key of each SSL object
+int keyIndex() {
+    static int idx = SSL_get_ex_new_index(
+            0, nullptr, nullptr, nullptr, [](void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) { delete static_cast<string*>(ptr); });
+    return idx;
+}
+}   // namespace
+
+boost::asio::ssl::context& TlsSessionCache::context(SecureLevel level) {
+    lock_guard<mutex> l(s_mutex);
+    auto it = s_contexts.find(level);
+    if (it != s_contexts.end()) return *it->second;
+
+    boost::asio::ssl::context::method method = boost::asio::ssl::context::tls_client;
+    if (level == SecureLevel::TLS) method = boost::asio::ssl::context::tlsv12;
+    auto ctx = make_unique<boost::asio::ssl::context>(method);
+
+#ifdef _WIN32
+    HCERTSTORE hStore = CertOpenSystemStore(0, "ROOT");
+    if (hStore != nullptr) {
+        X509_STORE* store = X509_STORE_new();
+        PCCERT_CONTEXT pContext = nullptr;
+        while ((pContext = CertEnumCertificatesInStore(hStore, pContext)) != nullptr) {
+            X509* x509 = d2i_X509(nullptr, (const unsigned char**) &pContext->pbCertEncoded, pContext->cbCertEncoded);
+            if (x509 != nullptr) {
+                X509_STORE_add_cert(store, x509);
+                X509_free(x509);
+            }
+        }
+
+        CertFreeCertificateContext(pContext);
+        CertCloseStore(hStore, 0);
+
+        SSL_CTX_set_cert_store(ctx->native_handle(), store);
+    }
+#else
+    char* certPath = getenv("SSL_CERT_FILE");
+    try {
+        ctx->load_verify_file(certPath ? certPath : "/etc/ssl/certs/ca-certificates.crt");
+    } catch (...) {
+        cwarn << "Failed to load ca certificates. Either the file "
+                 "'/etc/ssl/certs/ca-certificates.crt' does not exist";
+        cwarn << "or the environment variable SSL_CERT_FILE is set to an invalid or "
+                 "inaccessible file.";
+        cwarn << "It is possible that certificate verification can fail.";
+    }
+#endif
+
+    // Sessions are kept by us (per pool) not by OpenSSL internal cache.
+    // New session callback is also the only reliable way to catch
+    // TLS 1.3 tickets which are sent after the handshake
+    SSL_CTX_set_session_cache_mode(ctx->native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx->native_handle(), &TlsSessionCache::onNewSession);
+
+    return *(s_contexts[level] = move(ctx));
+}
+
+void TlsSessionCache::prepare(boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& stream, string const& host, unsigned short port, bool sni) {
+    SSL* ssl = stream.native_handle();
+    if (sni) SSL_set_tlsext_host_name(ssl, host.c_str());
+    SSL_set_ex_data(ssl, keyIndex(), new string(key(host, port)));
+
+    lock_guard<mutex> l(s_mutex);
+    auto it = s_sessions.find(key(host, port));
+    if (it != s_sessions.end()) SSL_set_session(ssl, it->second);
+}
+
+void TlsSessionCache::completed(
+        boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& stream, string const& host, unsigned short port, bool success, unsigned durationMs) {
+    lock_guard<mutex> l(s_mutex);
+    TlsHandshakeStats& s = s_stats[key(host, port)];
+
+    if (!success) {
+        s.failed++;
+        auto it = s_sessions.find(key(host, port));
+        if (it != s_sessions.end()) {
+            SSL_SESSION_free(it->second);
+            s_sessions.erase(it);
+        }
+        return;
+    }
+
+    if (SSL_session_reused(stream.native_handle()))
+        s.resumed++;
+    else
+        s.full++;
+    s.lastMs = durationMs;
+    s.totalMs += durationMs;
+}
+
+TlsHandshakeStats TlsSessionCache::stats(string const& host, unsigned short port) {
+    lock_guard<mutex> l(s_mutex);
+    auto it = s_stats.find(key(host, port));
+    return (it != s_stats.end() ? it->second : TlsHandshakeStats());
+}
+
+int TlsSessionCache::onNewSession(SSL* ssl, SSL_SESSION* session) {
+    auto* k = static_cast<string*>(SSL_get_ex_data(ssl, keyIndex()));
+    if (!k) return 0;
+
+    lock_guard<mutex> l(s_mutex);
+    SSL_SESSION*& slot = s_sessions[*k];
+    if (slot) SSL_SESSION_free(slot);
+    slot = session;
+
+    // We keep the reference OpenSSL handed over
+    return 1;
+}
@@ -0,0 +1,60 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/asio/ssl.hpp>
+
+#include "../PoolURI.h"
+
+namespace dev::eth {
+
+struct TlsHandshakeStats {
+    unsigned full = 0;        // Number of full handshakes
+    unsigned resumed = 0;     // Number of abbreviated (resumed) handshakes
+    unsigned failed = 0;      // Number of failed handshakes
+    unsigned lastMs = 0;      // Duration of last successful handshake
+    uint64_t totalMs = 0;     // Cumulated duration of successful handshakes
+};
+
+// Process wide TLS client state.
+// Holds one ssl context per security level (so CA certificates are loaded
+// only once) and the last session ticket/id received from each pool so
+// reconnects and failover rotations can resume instead of running a full
+// handshake.
+class TlsSessionCache {
+public:
+    static boost::asio::ssl::context& context(SecureLevel level);
+
+    // Prepares a stream for the handshake : sets SNI and offers the
+    // cached session for host:port if any
+    static void prepare(boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& stream, std::string const& host, unsigned short port, bool sni);
+
+    // Accounts a completed handshake. A failed one also drops the cached session
+    static void completed(
+            boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& stream, std::string const& host, unsigned short port, bool success, unsigned durationMs);
+
+    static TlsHandshakeStats stats(std::string const& host, unsigned short port);
+
+private:
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+    static std::string key(std::string const& host, unsigned short port) { return host + ":" + std::to_string(port); }
+
+    static std::mutex s_mutex;
+    static std::map<SecureLevel, std::unique_ptr<boost::asio::ssl::context>> s_contexts;
+    static std::map<std::string, SSL_SESSION*> s_sessions;
+    static std::map<std::string, TlsHandshakeStats> s_stats;
+};
+
+}   // namespace dev::eth
@@ -0,0 +1,351 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <ethash/ethash.hpp>
+#include <json/json.h>
+
+#include <libdev/Log.h>
+
+#include "../stratum/StratumCapture.h"
+#include "../stratum/StratumParser.h"
+#include "ReplayClient.h"
+
+using namespace std;
+using namespace chrono;
+using namespace dev;
+using namespace eth;
+
+ReplayClient::ReplayClient(string const& _file, double _speed) : PoolClient(), Worker("replay"), m_file(_file), m_speed(_speed) { load(); }
+
+ReplayClient::~ReplayClient() = default;
+
+// Rebuilds the jobs the recorded client dispatched, decoding pool
+// messages the same way EthStratumClient does for the confirmed stratum
+// mode, and pairs each recorded submission with its answer.
+void ReplayClient::load() {
+    ifstream in(m_file);
+    string line;
+    if (!getline(in, line) || line != StratumCapture::s_magic) {
+        cwarn << m_file << " is not a stratum capture";
+        return;
+    }
+
+    Json::CharReaderBuilder builder;
+    unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    auto hash = [](string const& hex, bool pad) {
+        h256 h;
+        if (!hexToHash(hex, h, pad)) throw runtime_error("Invalid hex");
+        return h;
+    };
+
+    // Session state
+    int mode = -1;
+    Json::Value subscribed;   // Response to first request, carries the EthereumStratum/1.0.0 extranonce
+    h256 boundary;
+    double difficulty = 0;
+    uint64_t extraNonce = 0;
+    uint16_t extraNonceSize = 0;
+    int epoch = -1;
+    string sessionId;   // EthereumStratum/2.0.0 session id granted by the pool
+    string resumeId;    // EthereumStratum/2.0.0 session id asked to be resumed
+    map<unsigned, deque<uint64_t>> submits;   // Submission times by request id
+
+    // State of the last EthereumStratum/2.0.0 session : a resumed session
+    // doesn't get mining.set again so it carries on from here
+    struct {
+        string sessionId;
+        h256 boundary;
+        double difficulty = 0;
+        uint64_t extraNonce = 0;
+        uint16_t extraNonceSize = 0;
+        int epoch = -1;
+    } resumable;
+
+    auto setExtraNonce = [&](string enonce) {
+        extraNonceSize = enonce.length();
+        enonce.resize(16, '0');
+        extraNonce = stoull(enonce, nullptr, 16);
+    };
+    auto setDifficulty = [&](double d) {
+        difficulty = max(d, 0.0001);
+        boundary = h256(getTargetFromDiff(difficulty));
+    };
+
+    uint64_t at = 0;
+    unsigned sessions = 0, invalid = 0;
+    for (unsigned n = 2; getline(in, line); n++) {
+        istringstream ss(line);
+        uint64_t delta;
+        char tag;
+        if (!(ss >> delta >> tag)) {
+            invalid++;
+            continue;
+        }
+        at += delta;
+        string payload;
+        getline(ss >> ws, payload);
+
+        if (tag == '+') {
+            sessions++;
+            if (mode == 3 && !sessionId.empty() && epoch >= 0)
+                resumable = {sessionId, boundary, difficulty, extraNonce, extraNonceSize, epoch};
+            mode = -1;
+            subscribed = Json::Value();
+            boundary = h256();
+            difficulty = 0;
+            extraNonce = extraNonceSize = 0;
+            epoch = -1;
+            sessionId.clear();
+            resumeId.clear();
+            submits.clear();
+            continue;
+        }
+        if (tag == '=') {
+            mode = atoi(payload.c_str());
+            if (mode == 2 && subscribed["result"].isArray() && subscribed["result"].size() > 1) {
+                string enonce = subscribed["result"].get(Json::Value::ArrayIndex(1), "").asString();
+                if (!enonce.empty()) setExtraNonce(enonce);
+            }
+            continue;
+        }
+        if (tag != '<' && tag != '>') continue;
+
+        Json::Value jMsg;
+        JSONCPP_STRING err;
+        if (!reader->parse(payload.data(), payload.data() + payload.size(), &jMsg, &err) || !jMsg.isObject()) {
+            invalid++;
+            continue;
+        }
+        unsigned id = jMsg.get("id", unsigned(0)).isUInt() ? jMsg.get("id", unsigned(0)).asUInt() : 0;
+        string method = jMsg.get("method", "").asString();
+
+        if (tag == '>') {
+            if (id >= 40) submits[id].push_back(at);
+            if (mode == 3 && method == "mining.subscribe" && jMsg["params"].isArray() && jMsg["params"].size())
+                resumeId = jMsg["params"].get(Json::Value::ArrayIndex(0), "").asString();
+            continue;
+        }
+
+        if (mode == -1) {
+            if (id == 1) subscribed = jMsg;
+            continue;
+        }
+
+        try {
+            // Answer to a submission
+            if (method.empty() && id >= 40 && !submits[id].empty()) {
+                Answer a;
+                a.delay = at - submits[id].front();
+                submits[id].pop_front();
+                a.accepted = jMsg.get("error", Json::Value::null).empty();
+                a.stale = false;
+                if (a.accepted && jMsg["result"].isBool()) a.accepted = jMsg["result"].asBool();
+                if (!a.accepted && mode == 3 && jMsg["error"].isObject() && jMsg["error"].get("code", "").asString().substr(0, 1) == "2")
+                    a.accepted = a.stale = true;
+                m_answers.push_back(a);
+                continue;
+            }
+
+            // Pool replies with the very same session id if it has been able to resume it
+            if (mode == 3 && method.empty() && id == 2 && jMsg["result"].isString()) {
+                sessionId = jMsg["result"].asString();
+                if (!resumeId.empty() && resumeId == sessionId && resumable.sessionId == sessionId) {
+                    boundary = resumable.boundary;
+                    difficulty = resumable.difficulty;
+                    extraNonce = resumable.extraNonce;
+                    extraNonceSize = resumable.extraNonceSize;
+                    epoch = resumable.epoch;
+                }
+                continue;
+            }
+
+            Json::Value jPrm = jMsg.get("params", Json::Value::null);
+            WorkPackage wp;
+            if (method == "mining.set_target" && jPrm.isArray()) {
+                boundary = hash(jPrm.get(Json::Value::ArrayIndex(0), "").asString(), true);
+                difficulty = 0;
+            } else if (mode == 2 && method == "mining.set_difficulty" && jPrm.isArray()) {
+                setDifficulty(jPrm.get(Json::Value::ArrayIndex(0), 1).asDouble());
+            } else if (mode == 2 && method == "mining.set_extranonce" && jPrm.isArray()) {
+                string enonce = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+                if (!enonce.empty()) setExtraNonce(enonce);
+            } else if (mode == 3 && method == "mining.set" && jPrm.isObject()) {
+                string e = jPrm.get("epoch", "").asString();
+                string target = jPrm.get("target", "").asString();
+                string enonce = jPrm.get("extranonce", "").asString();
+                if (!e.empty()) epoch = stoi(e, nullptr, 16);
+                if (!target.empty()) {
+                    boundary = hash(target, true);
+                    difficulty = getHashesToTarget(boundary.hex(HexPrefix::Add));
+                }
+                if (!enonce.empty()) setExtraNonce(enonce);
+            } else if (mode == 3 && method == "mining.notify" && jPrm.isArray() && jPrm.size() == 4 && epoch >= 0) {
+                wp.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+                wp.block = stoul(jPrm.get(Json::Value::ArrayIndex(1), "").asString(), nullptr, 16);
+                wp.header = hash(jPrm.get(Json::Value::ArrayIndex(2), "").asString(), true);
+                wp.epoch = epoch;
+
+                // Seed is what tells PoolManager epoch changed when not
+                // connected to an EthereumStratum/2.0.0 pool
+                wp.seed = h256(ethash::calculate_epoch_seed(epoch).bytes, h256::ConstructFromPointer);
+            } else if (mode == 2 && method == "mining.notify" && jPrm.isArray() && jPrm.size() >= 3) {
+                wp.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+                wp.seed = hash(jPrm.get(Json::Value::ArrayIndex(1), "").asString(), false);
+                wp.header = hash(jPrm.get(Json::Value::ArrayIndex(2), "").asString(), false);
+            } else if ((mode == 0 && method == "mining.notify" && jPrm.isArray()) ||
+                       (mode == 1 && method.empty() && (id == 0 || id == 5) && jMsg["result"].isArray())) {
+                // Eth-Proxy jobs come as results without a job id
+                unsigned i = (mode == 1 ? 0 : 1);
+                if (mode == 1) jPrm = jMsg["result"];
+                else
+                    wp.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+                if (jPrm.size() >= i + 3) {
+                    wp.header = hash(jPrm.get(i, "").asString(), false);
+                    wp.seed = hash(jPrm.get(i + 1, "").asString(), false);
+                    wp.boundary = hash(jPrm.get(i + 2, "").asString(), true);
+                    if (mode == 1 && jPrm.size() > i + 3) {
+                        string block = jPrm.get(i + 3, "").asString();
+                        if (block.substr(0, 2) == "0x") wp.block = stoul(block, nullptr, 16);
+                        if (wp.block > 0x9660180) wp.block = -1;
+                    }
+                }
+            }
+
+            if (!wp) continue;
+            if (mode >= 2) {
+                wp.boundary = boundary;
+                wp.startNonce = extraNonce;
+                wp.exSizeBytes = extraNonceSize;
+            }
+            wp.difficulty = (mode >= 2 && difficulty ? difficulty : getHashesToTarget(wp.boundary.hex(HexPrefix::Add)));
+            m_jobs.push_back({at, wp});
+        } catch (const exception&) { invalid++; }
+    }
+    m_length = at;
+
+    cnote << "Replaying " << m_file << " : " << m_jobs.size() << " jobs, " << m_answers.size() << " answers, " << sessions << " sessions over " << fixed
+          << setprecision(1) << m_length / 1e6 << " s at " << m_speed << "x";
+    if (invalid) cwarn << "Replay skipped " << invalid << " unreadable records";
+}
+
+void ReplayClient::connect() {
+    // Initialize new session
+    m_connected.store(true, memory_order_relaxed);
+    m_session = unique_ptr<Session>(new Session);
+    m_session->subscribed.store(true, memory_order_relaxed);
+    m_session->authorized.store(true, memory_order_relaxed);
+
+    if (m_onConnected) m_onConnected();
+
+    startWorking();
+}
+
+void ReplayClient::disconnect() {
+    // Worker reads the session : it must be done before it goes away
+    stopWorking();
+    report();
+
+    m_conn->addDuration(m_session->duration());
+    m_session = nullptr;
+    m_connected.store(false, memory_order_relaxed);
+
+    if (m_onDisconnected) m_onDisconnected();
+}
+
+void ReplayClient::report() {
+    lock_guard<mutex> l(m_mutex);
+    double elapsed = duration_cast<milliseconds>(steady_clock::now() - m_start).count() / 1000.0;
+    cnote << "Replay results : " << m_replayed << " of " << m_jobs.size() << " jobs in " << fixed << setprecision(1) << elapsed << " s";
+
+    if (!m_lateness.empty()) {
+        vector<uint32_t> sorted(m_lateness);
+        sort(sorted.begin(), sorted.end());
+        auto pct = [&sorted](double p) { return sorted[min(sorted.size() - 1, size_t(p * sorted.size()))]; };
+        cnote << "Job dispatch lateness (us) : p50 " << pct(0.50) << " p90 " << pct(0.90) << " p99 " << pct(0.99) << " max " << sorted.back();
+    }
+    cnote << "Submissions : " << m_answered << " answered as recorded, " << m_unrecorded << " past end of recording, " << m_answers.size()
+          << " recorded answers left";
+}
+
+void ReplayClient::submitHashrate(uint64_t const& rate, string const& id) {
+    (void) rate;
+    (void) id;
+}
+
+bool ReplayClient::submitSolution(const Solution& solution) {
+    Answer a{true, false, 0};
+    {
+        lock_guard<mutex> l(m_mutex);
+        if (m_answers.empty()) m_unrecorded++;
+        else {
+            a = m_answers.front();
+            m_answers.pop_front();
+            m_answered++;
+        }
+    }
+
+    // Answer does not reference the client : it may be delivered
+    // after a disconnection
+    auto answer = [a, submit_start = steady_clock::now(), midx = solution.midx, onAccepted = m_onSolutionAccepted, onRejected = m_onSolutionRejected]() {
+        milliseconds response_delay_ms = duration_cast<milliseconds>(steady_clock::now() - submit_start);
+        if (a.accepted) {
+            if (onAccepted) onAccepted(response_delay_ms, midx, a.stale);
+        } else {
+            if (onRejected) onRejected(response_delay_ms, midx);
+        }
+    };
+
+    auto delay = uint64_t(a.delay / m_speed);
+    if (!delay) {
+        answer();
+        return true;
+    }
+    auto timer = make_shared<boost::asio::deadline_timer>(g_io_service, boost::posix_time::microseconds(delay));
+    timer->async_wait([timer, answer](boost::system::error_code const& ec) {
+        if (!ec) answer();
+    });
+    return true;
+}
+
+void ReplayClient::workLoop() {
+    {
+        lock_guard<mutex> l(m_mutex);
+        m_start = steady_clock::now();
+        m_lateness.reserve(m_jobs.size());
+    }
+
+    // Jobs only get appended at load : no need to lock for reading them
+    size_t next = 0;
+    while (!shouldStop()) {
+        auto now = steady_clock::now();
+        if (next < m_jobs.size()) {
+            auto const& job = m_jobs[next];
+            auto due = m_start + microseconds(uint64_t(job.at / m_speed));
+            if (now >= due) {
+                m_onWorkReceived(job.wp);
+                uint32_t late = uint32_t(duration_cast<microseconds>(steady_clock::now() - due).count());
+                {
+                    lock_guard<mutex> l(m_mutex);
+                    m_lateness.push_back(late);
+                    m_replayed = ++next;
+                }
+                if (next == m_jobs.size()) cnote << "Replay reached end of recording";
+                continue;
+            }
+            this_thread::sleep_until(min(due, now + milliseconds(200)));
+        } else
+            this_thread::sleep_for(milliseconds(200));
+    }
+}
@@ -0,0 +1,70 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <libdev/Worker.h>
+#include <libeth/EthashAux.h>
+
+#include "../PoolClient.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+// Feeds back a session recorded with --stratum-capture (see StratumCapture).
+// Jobs reach the farm with their recorded spacing divided by speed and
+// every submission gets, in order, the answer the pool gave to the recorded
+// ones after the recorded delay. Submissions past the end of the recording
+// are accepted at once.
+class ReplayClient : public PoolClient, Worker {
+public:
+    ReplayClient(string const& _file, double _speed);
+    ~ReplayClient() override;
+
+    void connect() override;
+    void disconnect() override;
+    bool isPendingState() override { return false; }
+    string ActiveEndPoint() override { return ""; };
+    void submitHashrate(uint64_t const& rate, string const& id) override;
+    bool submitSolution(const Solution& solution) override;
+
+private:
+    struct Job {
+        uint64_t at;   // Microseconds since recording start
+        WorkPackage wp;
+    };
+    struct Answer {
+        bool accepted;
+        bool stale;
+        uint64_t delay;   // Microseconds between submission and answer
+    };
+
+    void load();
+    void workLoop() override;
+    void report();
+
+    string m_file;
+    double m_speed;
+    vector<Job> m_jobs;
+    uint64_t m_length = 0;   // Microseconds covered by the recording
+
+    // Replay progress, shared by worker thread, miners and io_service
+    std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_start;
+    unsigned m_replayed = 0;
+    vector<uint32_t> m_lateness;   // Microseconds each job was dispatched behind schedule
+    std::deque<Answer> m_answers;
+    unsigned m_answered = 0;     // Submissions given a recorded answer
+    unsigned m_unrecorded = 0;   // Submissions past the end of the recording
+};
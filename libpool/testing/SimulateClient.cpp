@@ -1,4 +1,3 @@
-
 /* Copyright (C) 1883 Thomas Edison - All Rights Reserved
  * You may use, distribute and modify this code under the
  * terms of the GPLv3 license, which unfortunately won't be
@@ -8,6 +7,7 @@
  * this file.
  */
 
+#include <algorithm>
 #include <chrono>
 #include <libdev/Log.h>
 
@@ -18,7 +18,11 @@ using namespace chrono;
 using namespace dev;
 using namespace eth;
 
-SimulateClient::SimulateClient(unsigned const& block) : PoolClient(), Worker("sim") { m_block = block; }
+const size_t SimulateClient::s_maxLatencies;
+
+SimulateClient::SimulateClient(SimulationSettings const& _settings) : PoolClient(), Worker("sim"), m_settings(_settings) {
+    m_results->latencies.reserve(4096);
+}
 
 SimulateClient::~SimulateClient() = default;
 
@@ -37,8 +41,11 @@ void SimulateClient::connect() {
 }
 
 void SimulateClient::disconnect() {
+    // Worker reads the session and the rate samples : it must be done first
+    stopWorking();
     cnote << "Simulation results : " << EthWhiteBold << "Max " << dev::getFormattedHashes((double) hr_max, ScaleSuffix::Add, 6) << " Mean "
           << dev::getFormattedHashes((double) hr_mean, ScaleSuffix::Add, 6) << EthReset;
+    report();
 
     m_conn->addDuration(m_session->duration());
     m_session = nullptr;
@@ -47,41 +54,169 @@ void SimulateClient::disconnect() {
     if (m_onDisconnected) m_onDisconnected();
 }
 
+void SimulateClient::report() {
+    lock_guard<mutex> l(m_results->mutex);
+    Results& r = *m_results;
+    double elapsed = duration_cast<milliseconds>(steady_clock::now() - m_start_time).count() / 1000.0;
+    if (elapsed <= 0) return;
+
+    cnote << "Job stream : " << r.jobs << " jobs, " << r.boundaryUpdates << " boundary updates, " << r.epochSwitches << " epoch switches in " << fixed << setprecision(1)
+          << elapsed << " s";
+    cnote << "Solutions : " << r.solutions << " found, " << r.accepted << " accepted, " << r.stale << " stale, " << r.rejected << " rejected";
+
+    // Shares prove on average hashes-to-target work each : an estimate
+    // which converges as the number of shares grows
+    cnote << "Effective hashrate : " << EthWhiteBold << dev::getFormattedHashes(r.acceptedHashes / elapsed, ScaleSuffix::Add, 6) << EthReset
+          << " Lost to switches : " << dev::getFormattedHashes(r.staleHashes / elapsed, ScaleSuffix::Add, 6) << " ("
+          << setprecision(2) << (r.acceptedHashes + r.staleHashes > 0 ? 100.0 * r.staleHashes / (r.acceptedHashes + r.staleHashes) : 0.0) << "%)";
+
+    if (!r.epochDelays.empty()) {
+        uint64_t total = 0;
+        for (auto d : r.epochDelays) total += d;
+        cnote << "Epoch switch to first solution : mean " << total / r.epochDelays.size() << " ms max "
+              << *max_element(r.epochDelays.begin(), r.epochDelays.end()) << " ms";
+    }
+
+    if (!r.latencies.empty()) {
+        vector<uint32_t> sorted(r.latencies);
+        sort(sorted.begin(), sorted.end());
+        auto pct = [&sorted](double p) { return sorted[min(sorted.size() - 1, size_t(p * sorted.size()))]; };
+        cnote << "Solution path latency (us) : p50 " << pct(0.50) << " p90 " << pct(0.90) << " p99 " << pct(0.99) << " max " << sorted.back();
+    }
+}
+
 void SimulateClient::submitHashrate(uint64_t const& rate, string const& id) {
     (void) rate;
     (void) id;
 }
 
-void SimulateClient::submitSolution(const Solution& solution) {
+void SimulateClient::Results::answered(steady_clock::time_point const& _found) {
+    uint32_t us = uint32_t(duration_cast<microseconds>(steady_clock::now() - _found).count());
+    lock_guard<std::mutex> l(mutex);
+    if (latencies.size() < s_maxLatencies) latencies.push_back(us);
+}
+
+bool SimulateClient::submitSolution(const Solution& solution) {
     // This is a fake submission only evaluated locally
     chrono::steady_clock::time_point submit_start = chrono::steady_clock::now();
+
+    bool stale;
+    h256 seed;
+    {
+        lock_guard<mutex> l(m_workMutex);
+        stale = (solution.work.header != m_current.header);
+        seed = m_current.seed;
+    }
+
     bool accepted = EthashAux::eval(solution.work.epoch, solution.work.header, solution.nonce).value <= solution.work.boundary;
-    chrono::milliseconds response_delay_ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - submit_start);
+    double hashes = getHashesToTarget(solution.work.boundary.hex(HexPrefix::Add));
+
+    {
+        lock_guard<mutex> l(m_results->mutex);
+        Results& r = *m_results;
+        r.solutions++;
+        if (!accepted) r.rejected++;
+        else if (stale) {
+            r.stale++;
+            r.staleHashes += hashes;
+        } else {
+            r.accepted++;
+            r.acceptedHashes += hashes;
+        }
+        if (r.epochPending && solution.work.seed == seed) {
+            r.epochDelays.push_back(uint32_t(duration_cast<milliseconds>(submit_start - r.epochStart).count()));
+            r.epochPending = false;
+        }
+    }
+
+    // Answer does not reference the client : with submit latency it may
+    // be delivered after a disconnection
+    auto answer = [results = m_results, accepted, stale, found = solution.tstamp, submit_start, midx = solution.midx, onAccepted = m_onSolutionAccepted,
+                   onRejected = m_onSolutionRejected]() {
+        results->answered(found);
+        chrono::milliseconds response_delay_ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - submit_start);
+        if (accepted) {
+            if (onAccepted) onAccepted(response_delay_ms, midx, stale);
+        } else {
+            if (onRejected) onRejected(response_delay_ms, midx);
+        }
+    };
+
+    if (!m_settings.submitLatency) {
+        answer();
+        return true;
+    }
+    auto timer = make_shared<boost::asio::deadline_timer>(g_io_service, boost::posix_time::milliseconds(m_settings.submitLatency));
+    timer->async_wait([timer, answer](boost::system::error_code const& ec) {
+        if (!ec) answer();
+    });
+    return true;
+}
 
-    if (accepted) {
-        if (m_onSolutionAccepted) m_onSolutionAccepted(response_delay_ms, solution.midx, false);
-    } else {
-        if (m_onSolutionRejected) m_onSolutionRejected(response_delay_ms, solution.midx);
+void SimulateClient::sendWork(bool _boundaryOnly) {
+    WorkPackage wp;
+    {
+        lock_guard<mutex> l(m_workMutex);
+        lock_guard<mutex> r(m_results->mutex);
+        auto now = steady_clock::now();
+
+        if (!m_current) {
+            // We don't actually need a real seed as the epoch
+            // is calculated upon block number (see poolmanager)
+            m_current.seed = h256::random();
+            m_current.block = m_settings.block;
+            m_current.boundary = h256(dev::getTargetFromDiff(m_settings.difficulty));
+        } else if (_boundaryOnly) {
+            // Same job, difficulty alternates between set value and its double
+            m_results->boundaryUpdates++;
+            m_current.boundary = h256(dev::getTargetFromDiff(m_settings.difficulty * (m_results->boundaryUpdates % 2 ? 2 : 1)));
+        } else if (m_settings.epochEvery && m_results->jobs % m_settings.epochEvery == 0) {
+            // Seed change is what tells PoolManager a new epoch begins
+            m_current.block = (m_current.block / 30000 + 1) * 30000;
+            m_current.seed = h256::random();
+            m_results->epochSwitches++;
+            m_results->epochStart = now;
+            m_results->epochPending = true;
+        }
+
+        if (!_boundaryOnly) {
+            m_current.header = h256::random();
+            m_results->jobs++;
+        }
+        m_current.difficulty = getHashesToTarget(m_current.boundary.hex(HexPrefix::Add));
+        wp = m_current;
     }
+    m_onWorkReceived(wp);   // submit new fake job
 }
 
 // Handles all logic here
 void SimulateClient::workLoop() {
     m_start_time = chrono::steady_clock::now();
-
-    WorkPackage current;
-    current.seed = h256::random();   // We don't actually need a real seed as the epoch
-                                     // is calculated upon block number (see poolmanager)
-    current.header = h256::random();
-    current.block = m_block;
-    current.boundary = h256(dev::getTargetFromDiff(1));
-    m_onWorkReceived(current);   // submit new fake job
-
-    while (m_session) {
-        float hr = Farm::f().HashRate();
-        hr_max = max(hr_max, hr);
-        hr_mean = hr_alpha * hr_mean + (1.0f - hr_alpha) * hr;
-
-        this_thread::sleep_for(chrono::milliseconds(200));
+    sendWork(false);
+
+    auto nextSample = m_start_time;
+    auto nextUpdate = steady_clock::time_point::max();
+    auto schedule = [this]() {
+        int ms = int(m_settings.jobInterval);
+        if (m_settings.jobJitter) ms += uniform_int_distribution<int>(-int(m_settings.jobJitter), int(m_settings.jobJitter))(m_random);
+        return steady_clock::now() + milliseconds(max(ms, 1));
+    };
+    if (m_settings.jobInterval) nextUpdate = schedule();
+
+    while (!shouldStop()) {
+        auto now = steady_clock::now();
+        if (now >= nextSample) {
+            float hr = Farm::f().HashRate();
+            hr_max = max(hr_max, hr);
+            hr_mean = hr_alpha * hr_mean + (1.0f - hr_alpha) * hr;
+            nextSample = now + milliseconds(200);
+        }
+        if (now >= nextUpdate) {
+            m_updates++;
+            sendWork(m_settings.boundaryEvery && m_updates % m_settings.boundaryEvery == 0);
+            nextUpdate = schedule();
+        }
+
+        this_thread::sleep_until(min(nextSample, nextUpdate));
     }
 }
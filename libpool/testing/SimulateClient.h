@@ -10,6 +10,9 @@
 #pragma once
 
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <vector>
 
 #include <libdev/Worker.h>
 #include <libeth/EthashAux.h>
@@ -22,9 +25,20 @@ using namespace std;
 using namespace dev;
 using namespace eth;
 
+// Shape of the job stream generated by SimulateClient
+struct SimulationSettings {
+    unsigned block = 0;           // Block number of the first job
+    unsigned jobInterval = 0;     // Milliseconds between updates (0 sends a single job)
+    unsigned jobJitter = 0;       // Random +/- milliseconds added to each interval
+    unsigned boundaryEvery = 0;   // Every n-th update only changes the boundary (0 disables)
+    unsigned epochEvery = 0;      // Every n-th new job advances to next epoch (0 disables)
+    double difficulty = 1.0;      // Share difficulty
+    unsigned submitLatency = 0;   // Milliseconds before a submitted solution is answered
+};
+
 class SimulateClient : public PoolClient, Worker {
 public:
-    SimulateClient(unsigned const& block);
+    explicit SimulateClient(SimulationSettings const& _settings);
     ~SimulateClient() override;
 
     void connect() override;
@@ -32,14 +46,45 @@ public:
     bool isPendingState() override { return false; }
     string ActiveEndPoint() override { return ""; };
     void submitHashrate(uint64_t const& rate, string const& id) override;
-    void submitSolution(const Solution& solution) override;
+    bool submitSolution(const Solution& solution) override;
 
 private:
     void workLoop() override;
+    void sendWork(bool _boundaryOnly);
+    void report();
 
-    unsigned m_block;
+    SimulationSettings m_settings;
+    std::mt19937 m_random{std::random_device{}()};
     std::chrono::steady_clock::time_point m_start_time;
     float hr_alpha = 0.45f;
     float hr_max = 0.0f;
     float hr_mean = 0.0f;
+
+    // Job stream state and results. Solutions come from miner threads and,
+    // with submit latency, are answered by io_service after the client may
+    // be gone : results are shared with pending answers
+    struct Results {
+        std::mutex mutex;
+        unsigned jobs = 0;
+        unsigned boundaryUpdates = 0;
+        unsigned epochSwitches = 0;
+        std::chrono::steady_clock::time_point epochStart;
+        bool epochPending = false;           // Waiting for first solution since last epoch switch
+        std::vector<uint32_t> epochDelays;   // Milliseconds from epoch switch to first solution
+        unsigned solutions = 0;
+        unsigned accepted = 0;
+        unsigned stale = 0;   // Found on a job superseded when submitted
+        unsigned rejected = 0;
+        double acceptedHashes = 0;         // Work proven by shares on current job
+        double staleHashes = 0;            // Work proven by shares on superseded jobs
+        std::vector<uint32_t> latencies;   // Microseconds from solution found to its answer
+
+        void answered(std::chrono::steady_clock::time_point const& _found);
+    };
+    static const size_t s_maxLatencies = 1 << 20;
+
+    std::mutex m_workMutex;
+    WorkPackage m_current;
+    unsigned m_updates = 0;
+    std::shared_ptr<Results> m_results = std::make_shared<Results>();
 };
@@ -59,6 +59,8 @@ public:
 
     sycl_device_task new_search_task{};
     //sycl_device_task previous_search_task{};
+
+    std::vector<std::pair<ProfiledCommand, sycl::event>> profiled;
 };
 
 
@@ -68,7 +70,10 @@ public:
  * @param _device
  */
 SYCLMiner::SYCLMiner(unsigned _index, DeviceDescriptor& _device) : Miner("SYCL-", _index), impl(new SYCLMiner::sycl_impl) {
-    impl->q = sycl::queue{get_platform_devices()[_device.sycl_device_idx]};   //, sycl::property::queue::enable_profiling{}};
+    m_profiling = _device.syclProfile;
+    if (m_profiling) impl->q = sycl::queue{get_platform_devices()[_device.sycl_device_idx], sycl::property::queue::enable_profiling{}};
+    else
+        impl->q = sycl::queue{get_platform_devices()[_device.sycl_device_idx]};
     m_deviceDescriptor = _device;
     m_block_multiple = 1024;
 }
@@ -216,6 +221,10 @@ bool SYCLMiner::initEpoch() {
                 light_dag_copy_evt);
 
         for (auto& e: gen_events) { e.wait_and_throw(); }
+        if (m_profiling) {
+            for (auto& e: gen_events) impl->profiled.emplace_back(ProfiledCommand::DAG, e);
+            reportProfiled();
+        }
 
         ReportDAGDone(m_epochContext.dagSize,                                                                                                  //
                       uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startInit).count()),   //
@@ -269,6 +278,7 @@ void SYCLMiner::workLoop() {
             // Persist most recent job.
             // Job's differences should be handled at higher level
             last = current;
+            Trace::instant("job picked up", Trace::job(current.header), m_index);
 
             auto upper64OfBoundary = ((u64) ((u256) current.boundary >> 192)).template convert_to<uint64_t>();
 
@@ -344,6 +354,7 @@ void SYCLMiner::enumDevices(minerMap& DevicesCollection) {
  * @param w
  */
 void SYCLMiner::search(uint8_t const* header, uint64_t target, uint64_t start_nonce, const dev::eth::WorkPackage& w) {
+    uint32_t job = Trace::job(w.header);
     impl->d_header_global = *(reinterpret_cast<const hash32_t*>(header));
     impl->d_target_global = target;
 
@@ -363,9 +374,11 @@ void SYCLMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
                 impl->d_header_global,                              //
                 impl->d_target_global,                              //
                 impl->d_kill_signal_host);
+        Trace::launch("kernel", job, 0);
         start_nonce += batch_blocks;
         m_done = false;
     }
+    ReportWorkSwitched();
 
     bool busy = true;
 
@@ -379,7 +392,15 @@ void SYCLMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
         // We switch the futures as `previous_job` was already consumed in the previous loop iteration.
         //std::swap(impl->previous_search_task, impl->new_search_task);
 
+        sycl::event kernel = impl->new_search_task.e;
         Search_results results = impl->new_search_task.get_result(impl->q);
+        Trace::complete("kernel", job, 0);
+        if (m_profiling) {
+            impl->profiled.emplace_back(ProfiledCommand::Transfer, impl->new_search_task.init);
+            impl->profiled.emplace_back(ProfiledCommand::Search, kernel);
+            impl->profiled.emplace_back(ProfiledCommand::Transfer, impl->new_search_task.read);
+            reportProfiled();
+        }
         // Eventually enqueue new work on the device
         if (m_done) {
             busy = false;
@@ -396,6 +417,7 @@ void SYCLMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
                     impl->d_header_global,                              //
                     impl->d_target_global,                              //
                     impl->d_kill_signal_host);
+            Trace::launch("kernel", job, 0);
         }
 
 
@@ -414,13 +436,23 @@ void SYCLMiner::search(uint8_t const* header, uint64_t target, uint64_t start_no
         }
 
         start_nonce += batch_blocks;
-        updateHashRate(m_deviceDescriptor.sycl_work_items_search_kernel, results.hashCount);
+        countHashes(m_deviceDescriptor.sycl_work_items_search_kernel, results.hashCount);
     }
+}
 
-#ifdef DEV_BUILD
-    // Optionally log job switch time
-    if (!shouldStop() && (g_logOptions & LOG_SWITCH)) {
-        cnote << "Switch time: " << std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_workSwitchStart).count() << " us.";
+/**
+ * Accounts device timestamps of profiled commands (there's no queued time in
+ * SYCL, submission stands for it)
+ */
+void SYCLMiner::reportProfiled() {
+    for (auto& p: impl->profiled) {
+        try {
+            auto submit = p.second.get_profiling_info<sycl::info::event_profiling::command_submit>();
+            ReportProfiled(p.first, submit, submit, p.second.get_profiling_info<sycl::info::event_profiling::command_start>(),
+                           p.second.get_profiling_info<sycl::info::event_profiling::command_end>());
+        } catch (sycl::exception const&) {
+            // Timestamps not available (e.g. default constructed event): skip it
+        }
     }
-#endif
+    impl->profiled.clear();
 }
@@ -49,6 +49,9 @@ private:
 
     void search(uint8_t const* header, uint64_t target, uint64_t _startN, const dev::eth::WorkPackage& w);
 
+    // Accounts profiled commands, which must all be complete
+    void reportProfiled();
+
 private:
 
     volatile bool m_done = {true};
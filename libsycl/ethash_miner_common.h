@@ -59,9 +59,11 @@ typedef union {
 struct sycl_device_task {
     Search_results* res = nullptr;
     sycl::event e{};
+    sycl::event init{}, read{};   // Reset and read of the results by last run (kept for profiling)
     inline Search_results get_result(sycl::queue& q) {
         Search_results local{};
-        q.memcpy(&local, res, sizeof(Search_results), e).wait();
+        read = q.memcpy(&local, res, sizeof(Search_results), e);
+        read.wait();
         e = sycl::event{};
         return local;
     }
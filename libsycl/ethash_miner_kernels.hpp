@@ -34,6 +34,7 @@ static constexpr Search_results empty_res{};
     using uint_atomic_ref_t = SYCL_ATOMIC_REF<uint32_t, sycl::memory_order::relaxed, sycl::memory_scope::work_group, sycl::access::address_space::global_space>;
     using uint_atomic_ref_host_t = SYCL_ATOMIC_REF<uint32_t, sycl::memory_order::relaxed, sycl::memory_scope::system, sycl::access::address_space::global_space>;
     auto init_evt = q.memcpy(task.res, &empty_res, sizeof(Search_results), task.e);
+    task.init = init_evt;
     task.e = q.submit([&](sycl::handler& cgh) {
         cgh.depends_on(init_evt);
         cgh.parallel_for<sycl_ethash_search_kernel_tag>(                   //
@@ -0,0 +1,764 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <algorithm>
+
+#include <ethash/ethash.hpp>
+
+#include <libdev/Log.h>
+#include <libeth/EthashAux.h>
+#include <libpool/PoolClient.h>
+
+#include "MockPool.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+using boost::asio::ip::tcp;
+
+const unsigned MockPool::s_maxJobs;
+
+MockPool::MockPool(MockPoolSettings const& _settings)
+    : m_settings(_settings), m_acceptor(g_io_service), m_jobTimer(g_io_service), m_scriptTimer(g_io_service), m_block(_settings.block),
+      m_difficulty(_settings.difficulty), m_latency(_settings.latency) {}
+
+MockPool::~MockPool() {
+    m_verifyWork.reset();
+    m_verifyService.stop();
+    if (m_verifier.joinable()) m_verifier.join();
+}
+
+char const* MockPool::flavourName(MockSession::Flavour _flavour) {
+    switch (_flavour) {
+        case MockSession::Flavour::Stratum: return "Stratum";
+        case MockSession::Flavour::EthProxy: return "Eth-Proxy";
+        case MockSession::Flavour::EthereumStratum: return "EthereumStratum/1.0.0";
+        case MockSession::Flavour::EthereumStratum2: return "EthereumStratum/2.0.0";
+        default: return "Unknown";
+    }
+}
+
+bool MockPool::start() {
+    tcp::endpoint endpoint(boost::asio::ip::address::from_string(m_settings.address), m_settings.port);
+    try {
+        m_acceptor.open(endpoint.protocol());
+        m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+        m_acceptor.bind(endpoint);
+        m_acceptor.listen(64);
+    } catch (const exception& _ex) {
+        cwarn << "Could not listen on " << m_settings.address << ":" << m_settings.port << " : " << _ex.what();
+        return false;
+    }
+
+    cnote << "Mock pool listening on " << m_settings.address << ":" << m_settings.port << " serving "
+          << (m_settings.flavour < 0 ? "any stratum flavour" : flavourName(MockSession::Flavour(m_settings.flavour)));
+    m_running = true;
+    m_start = chrono::steady_clock::now();
+
+    if (m_settings.verify) {
+        m_verifyWork = make_unique<boost::asio::io_service::work>(m_verifyService);
+        m_verifier = thread([this] {
+            setThreadName("verify");
+            m_verifyService.run();
+        });
+    }
+
+    newJob(false);
+    accept();
+    scheduleJob();
+    if (!m_settings.script.empty()) {
+        m_scriptStart = m_start;
+        scheduleScript();
+    }
+    return true;
+}
+
+void MockPool::stop() {
+    if (!m_running) return;
+    m_running = false;
+
+    boost::system::error_code ec;
+    m_acceptor.close(ec);
+    m_jobTimer.cancel();
+    m_scriptTimer.cancel();
+
+    auto sessions = m_sessions;
+    for (auto& s: sessions) s.second->close();
+}
+
+void MockPool::accept() {
+    if (!m_running) return;
+
+    auto session = make_shared<MockSession>(*this, ++m_sessionSeq);
+    m_acceptor.async_accept(session->socket(), [this, session](boost::system::error_code const& ec) {
+        if (ec) {
+            if (ec != boost::asio::error::operation_aborted) accept();
+            return;
+        }
+        m_sessions[session->id()] = session;
+        m_stats.sessions++;
+        session->start();
+        accept();
+    });
+}
+
+void MockPool::release(unsigned _id) { m_sessions.erase(_id); }
+
+void MockPool::authorized() {
+    if (!m_awaitingReconnect) return;
+    m_awaitingReconnect = false;
+    auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_lastForced).count();
+    m_stats.reconnects.push_back(uint32_t(ms));
+    cnote << "Miner back " << ms << " ms after disconnection";
+}
+
+void MockPool::scheduleJob() {
+    if (!m_running || !m_settings.jobInterval) return;
+
+    int ms = int(m_settings.jobInterval);
+    if (m_settings.jobJitter) ms += uniform_int_distribution<int>(-int(m_settings.jobJitter), int(m_settings.jobJitter))(m_random);
+    m_jobTimer.expires_from_now(boost::posix_time::milliseconds(max(ms, 1)));
+    m_jobTimer.async_wait([this](boost::system::error_code const& ec) {
+        if (ec || !m_running) return;
+        if (!m_paused) newJob(false);
+        scheduleJob();
+    });
+}
+
+void MockPool::scheduleScript() {
+    if (!m_running) return;
+
+    if (m_scriptNext >= m_settings.script.size()) {
+        if (!m_settings.scriptLoop) return;
+        m_scriptStart += chrono::milliseconds(m_settings.scriptLoop);
+        m_scriptNext = 0;
+    }
+
+    auto due = m_scriptStart + m_settings.script[m_scriptNext].at;
+    auto wait = chrono::duration_cast<chrono::milliseconds>(due - chrono::steady_clock::now()).count();
+    m_scriptTimer.expires_from_now(boost::posix_time::milliseconds(max<int64_t>(wait, 0)));
+    m_scriptTimer.async_wait([this](boost::system::error_code const& ec) {
+        if (ec || !m_running) return;
+        auto now = chrono::steady_clock::now();
+        while (m_scriptNext < m_settings.script.size() && m_scriptStart + m_settings.script[m_scriptNext].at <= now)
+            runEvent(m_settings.script[m_scriptNext++]);
+        scheduleScript();
+    });
+}
+
+void MockPool::runEvent(MockEvent const& _event) {
+    auto sessions = m_sessions;
+
+    switch (_event.type) {
+        case MockEvent::Type::Job: newJob(false); break;
+        case MockEvent::Type::Epoch: newJob(true); break;
+        case MockEvent::Type::Difficulty:
+            cnote << "Script : difficulty " << _event.value;
+            m_difficulty = _event.value;
+            for (auto& s: sessions) s.second->notify(true);
+            break;
+        case MockEvent::Type::ExtraNonce:
+            cnote << "Script : new extranonces";
+            for (auto& s: sessions) s.second->setExtraNonce(newExtraNonce());
+            break;
+        case MockEvent::Type::Latency:
+            cnote << "Script : latency " << _event.value << " ms";
+            m_latency = unsigned(_event.value);
+            break;
+        case MockEvent::Type::Reject:
+            cnote << "Script : rejecting next " << _event.value << " shares";
+            m_reject = unsigned(_event.value);
+            break;
+        case MockEvent::Type::Stale:
+            cnote << "Script : answering next " << _event.value << " shares as stale";
+            m_stale = unsigned(_event.value);
+            break;
+        case MockEvent::Type::Disconnect:
+        case MockEvent::Type::Bye:
+            cnote << "Script : " << (_event.type == MockEvent::Type::Bye ? "saying bye to " : "disconnecting ") << sessions.size() << " miners";
+            if (sessions.empty()) break;
+            m_stats.forced++;
+            m_lastForced = chrono::steady_clock::now();
+            m_awaitingReconnect = true;
+            for (auto& s: sessions) {
+                if (_event.type == MockEvent::Type::Bye) s.second->bye();
+                else
+                    s.second->close();
+            }
+            break;
+        case MockEvent::Type::Pause:
+            cnote << "Script : jobs paused";
+            m_paused = true;
+            break;
+        case MockEvent::Type::Resume:
+            cnote << "Script : jobs resumed";
+            m_paused = false;
+            break;
+    }
+}
+
+void MockPool::newJob(bool _newEpoch) {
+    if (_newEpoch) m_block = (m_block / 30000 + 1) * 30000;
+    else if (!m_jobs.empty())
+        m_block++;
+
+    Job job;
+    job.id = toCompactHex(++m_jobSeq, HexPrefix::DontAdd);
+    job.header = h256::random();
+    job.block = m_block;
+    job.epoch = m_block / 30000;
+    auto seed = ethash::calculate_epoch_seed(int(job.epoch));
+    job.seed = h256(seed.bytes, h256::ConstructFromPointer);
+
+    if (_newEpoch || m_jobs.empty() || m_jobs.front().epoch != job.epoch) {
+        cnote << "Epoch " << job.epoch << " block " << job.block;
+        // Have the light cache ready before first shares come in
+        if (m_settings.verify) m_verifyService.post([epoch = int(job.epoch)] { EthashAux::eval(epoch, h256(), 0); });
+    }
+
+    m_jobs.push_front(job);
+    if (m_jobs.size() > s_maxJobs) {
+        m_nonces.erase(m_jobs.back().id);
+        m_jobs.pop_back();
+    }
+    m_stats.jobs++;
+
+    auto sessions = m_sessions;
+    for (auto& s: sessions) s.second->notify();
+}
+
+MockPool::Job const* MockPool::findJob(string const& _id) const {
+    for (auto const& j: m_jobs)
+        if (j.id == _id) return &j;
+    return nullptr;
+}
+
+MockPool::Job const* MockPool::findHeader(h256 const& _header) const {
+    for (auto const& j: m_jobs)
+        if (j.header == _header) return &j;
+    return nullptr;
+}
+
+string MockPool::newExtraNonce() {
+    uint64_t r = (uint64_t(m_random()) << 32) | m_random();
+    return toHex(r).substr(0, 2 * m_settings.extraNonceSize);
+}
+
+h256 MockPool::boundary() const { return h256(getTargetFromDiff(m_difficulty)); }
+
+void MockPool::report() {
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_start).count() / 1000.0;
+    auto stats = [](vector<uint32_t> v) {
+        if (v.empty()) return string("n/a");
+        sort(v.begin(), v.end());
+        uint64_t total = 0;
+        for (auto x: v) total += x;
+        stringstream ss;
+        ss << "mean " << total / v.size() << " p50 " << v[v.size() / 2] << " p99 " << v[min(v.size() - 1, v.size() * 99 / 100)] << " max " << v.back()
+           << " ms";
+        return ss.str();
+    };
+
+    cnote << "Mock pool results after " << fixed << setprecision(1) << elapsed << " s";
+    cnote << "Sessions : " << m_stats.sessions << " (Stratum " << m_stats.flavours[0] << ", Eth-Proxy " << m_stats.flavours[1] << ", EthereumStratum/1.0.0 "
+          << m_stats.flavours[2] << ", EthereumStratum/2.0.0 " << m_stats.flavours[3] << ")";
+    cnote << "Jobs : " << m_stats.jobs;
+    cnote << "Shares : " << m_stats.submitted << " submitted, " << m_stats.accepted << " accepted, " << m_stats.stale << " stale, " << m_stats.rejected
+          << " rejected, " << m_stats.invalid << " invalid, " << m_stats.duplicates << " duplicate";
+    cnote << "Job to first share : " << stats(m_stats.firstShares);
+    cnote << "Reconnection after " << m_stats.forced << " forced disconnections : " << stats(m_stats.reconnects);
+}
+
+MockSession::MockSession(MockPool& _pool, unsigned _id) : m_pool(_pool), m_id(_id), m_socket(g_io_service), m_delayTimer(g_io_service) {
+    m_jsonReader.reset(Json::CharReaderBuilder().newCharReader());
+    m_jSwBuilder.settings_["indentation"] = "";
+}
+
+void MockSession::start() {
+    boost::system::error_code ec;
+    m_address = toString(m_socket.remote_endpoint(ec));
+    m_socket.set_option(tcp::no_delay(true), ec);
+    cnote << "Session " << m_id << " : connection from " << m_address;
+    recv();
+}
+
+void MockSession::close() {
+    if (m_closed) return;
+    m_closed = true;
+
+    boost::system::error_code ec;
+    m_delayTimer.cancel();
+    m_socket.shutdown(tcp::socket::shutdown_both, ec);
+    m_socket.close(ec);
+    cnote << "Session " << m_id << " : closed";
+
+    // Allow the miner to resume its session
+    if (m_flavour == Flavour::EthereumStratum2 && !m_sessionId.empty()) {
+        if (m_pool.m_resumable.size() > 1024) m_pool.m_resumable.clear();
+        m_pool.m_resumable[m_sessionId] = m_extraNonce;
+    }
+
+    // Last as it may drop the last reference to this session
+    m_pool.release(m_id);
+}
+
+void MockSession::recv() {
+    auto self = shared_from_this();
+    m_socket.async_read_some(m_framer.prepare(), [self](boost::system::error_code const& ec, size_t bytes) {
+        if (self->m_closed) return;
+        if (ec) {
+            self->close();
+            return;
+        }
+
+        self->m_framer.commit(bytes);
+        bool framed = self->m_framer.lines([&self](const char* first, const char* last) {
+            if (self->m_closed) return;
+            Json::Value jReq;
+            JSONCPP_STRING err;
+            if (!self->m_jsonReader->parse(first, last, &jReq, &err) || !jReq.isObject()) {
+                cwarn << "Session " << self->m_id << " : got invalid Json message";
+                self->close();
+                return;
+            }
+            self->processRequest(jReq);
+        });
+        if (!framed) {
+            cwarn << "Session " << self->m_id << " : line too long";
+            self->close();
+            return;
+        }
+        if (!self->m_closed) self->recv();
+    });
+}
+
+void MockSession::processRequest(Json::Value& _jReq) {
+    Json::Value id = _jReq.get("id", Json::Value::null);
+    string method = _jReq.get("method", "").asString();
+    Json::Value params = _jReq.get("params", Json::Value::null);
+    auto param = [&params](Json::Value::ArrayIndex i) { return params.isArray() ? params.get(i, "").asString() : string(); };
+
+    // First request decides the flavour unless pool is restricted to one
+    auto serve = [this](Flavour _flavour) {
+        if (m_flavour != Flavour::Unknown) return m_flavour == _flavour;
+        if (m_pool.m_settings.flavour >= 0 && m_pool.m_settings.flavour != int(_flavour)) return false;
+        m_flavour = _flavour;
+        m_pool.m_stats.flavours[int(_flavour)]++;
+        cnote << "Session " << m_id << " : " << MockPool::flavourName(_flavour);
+        return true;
+    };
+
+    if (method == "mining.hello") {
+        if (!serve(Flavour::EthereumStratum2)) {
+            reply(id, Json::Value::null, "Unsupported protocol");
+            return;
+        }
+        Json::Value jResult;
+        jResult["proto"] = "EthereumStratum/2.0.0";
+        jResult["encoding"] = "plain";
+        jResult["resume"] = "1";
+        jResult["timeout"] = "1e";
+        jResult["maxerrors"] = "5";
+        jResult["node"] = "mockpool";
+        reply(id, jResult);
+    }
+
+    else if (method == "mining.subscribe" && m_flavour == Flavour::EthereumStratum2) {
+        auto it = m_pool.m_resumable.find(param(0));
+        if (it != m_pool.m_resumable.end()) {
+            m_sessionId = it->first;
+            m_extraNonce = it->second;
+            m_pool.m_resumable.erase(it);
+            cnote << "Session " << m_id << " : resumed " << m_sessionId;
+        } else {
+            m_sessionId = toHex(uint32_t(m_pool.m_random()));
+            m_extraNonce = m_pool.newExtraNonce();
+        }
+        reply(id, m_sessionId);
+    }
+
+    else if (method == "mining.subscribe") {
+        bool es1 = (param(1) == "EthereumStratum/1.0.0");
+        if (!serve(es1 ? Flavour::EthereumStratum : Flavour::Stratum)) {
+            reply(id, Json::Value::null, "Unsupported protocol");
+            return;
+        }
+        if (!es1) {
+            reply(id, true);
+            return;
+        }
+        m_sessionId = toHex(uint32_t(m_pool.m_random()));
+        m_extraNonce = m_pool.newExtraNonce();
+        Json::Value jNotify = Json::Value(Json::arrayValue);
+        jNotify.append("mining.notify");
+        jNotify.append(m_sessionId);
+        jNotify.append("EthereumStratum/1.0.0");
+        Json::Value jResult = Json::Value(Json::arrayValue);
+        jResult.append(jNotify);
+        jResult.append(m_extraNonce);
+        reply(id, jResult);
+    }
+
+    else if (method == "mining.extranonce.subscribe") {
+        reply(id, true);
+    }
+
+    else if (method == "mining.authorize" && m_flavour != Flavour::Unknown) {
+        m_authorized = true;
+        cnote << "Session " << m_id << " : authorized " << param(0);
+        if (m_flavour == Flavour::EthereumStratum2) reply(id, "w-" + to_string(m_id));
+        else
+            reply(id, true);
+        m_pool.authorized();
+        notify();
+    }
+
+    else if (method == "eth_submitLogin") {
+        if (!serve(Flavour::EthProxy)) {
+            reply(id, Json::Value::null, "Unsupported protocol");
+            return;
+        }
+        m_authorized = true;
+        cnote << "Session " << m_id << " : authorized " << param(0);
+        reply(id, true);
+        m_pool.authorized();
+    }
+
+    else if (method == "eth_getWork" && m_flavour == Flavour::EthProxy) {
+        MockPool::Job const& j = m_pool.m_jobs.front();
+        Json::Value jResult = Json::Value(Json::arrayValue);
+        jResult.append(j.header.hex(HexPrefix::Add));
+        jResult.append(j.seed.hex(HexPrefix::Add));
+        jResult.append(boundary().hex(HexPrefix::Add));
+        jResult.append(toCompactHex(j.block, HexPrefix::Add));
+        m_timedJob = j.id;
+        m_timedJobSent = chrono::steady_clock::now();
+        reply(id, jResult);
+    }
+
+    else if (method == "mining.submit" && m_authorized) {
+        // Stratum     [worker, job, nonce, header, mix]
+        // ES/1.0.0    [worker, job, nonce]
+        // ES/2.0.0    [job, nonce, worker]
+        if (m_flavour == Flavour::EthereumStratum2) submit(id, param(0), h256(), param(1));
+        else
+            submit(id, param(1), h256(), param(2));
+    }
+
+    else if (method == "eth_submitWork" && m_authorized) {
+        h256 header;
+        hexToHash(param(1), header, false);
+        submit(id, "", header, param(0));
+    }
+
+    else if (method == "eth_submitHashrate" || method == "mining.hashrate") {
+        reply(id, true);
+    }
+
+    else if (method == "mining.suggest_difficulty" || method == "mining.suggest_target") {
+        // Taken from next job on
+        double d = 0;
+        if (method == "mining.suggest_difficulty") d = atof(param(0).c_str());
+        else {
+            h256 target;
+            if (hexToHash(param(0), target, true) && target) d = getHashesToTarget(target.hex(HexPrefix::Add)) / 4294967296.0;
+        }
+        if (d <= 0) {
+            reply(id, false, "Invalid difficulty", 20);
+            return;
+        }
+        m_suggested = d;
+        cnote << "Session " << m_id << " : difficulty " << d << " suggested";
+        reply(id, true);
+    }
+
+    else if (method == "mining.noop") {
+        // Keeps EthereumStratum/2.0.0 session alive. Nothing to answer
+    }
+
+    else if (!id.isNull()) {
+        reply(id, Json::Value::null, "Method not found");
+    }
+}
+
+void MockSession::submit(Json::Value const& _id, string const& _job, h256 const& _header, string _nonce) {
+    auto& stats = m_pool.m_stats;
+    stats.submitted++;
+
+    MockPool::Job const* j = (_job.empty() ? m_pool.findHeader(_header) : m_pool.findJob(_job));
+    if (!j) {
+        stats.invalid++;
+        reply(_id, false, "Job not found", 21);
+        return;
+    }
+
+    if (_nonce.compare(0, 2, "0x") == 0) _nonce.erase(0, 2);
+    if ((m_flavour == Flavour::EthereumStratum || m_flavour == Flavour::EthereumStratum2) && _nonce.size() == 16 - m_extraNonce.size())
+        _nonce = m_extraNonce + _nonce;
+    if (_nonce.size() != 16 || _nonce.find_first_not_of("0123456789abcdefABCDEF") != string::npos) {
+        stats.invalid++;
+        reply(_id, false, "Invalid nonce", 20);
+        return;
+    }
+    uint64_t nonce = stoull(_nonce, nullptr, 16);
+
+    auto& nonces = m_pool.m_nonces[j->id];
+    if (find(nonces.begin(), nonces.end(), nonce) != nonces.end()) {
+        stats.duplicates++;
+        reply(_id, false, "Duplicate share", 22);
+        return;
+    }
+    nonces.push_back(nonce);
+
+    if (m_timedJob == j->id) {
+        stats.firstShares.push_back(uint32_t(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_timedJobSent).count()));
+        m_timedJob.clear();
+    }
+
+    bool stale = (j != &m_pool.m_jobs.front());
+    if (!m_pool.m_settings.verify) {
+        answer(_id, true, stale);
+        return;
+    }
+
+    // Answered back on the io thread once verified
+    h256 target = boundary();
+    m_pool.m_verifyService.post([self = shared_from_this(), id = _id, epoch = int(j->epoch), header = j->header, nonce, target, stale] {
+        bool valid = !(EthashAux::eval(epoch, header, nonce).value > target);
+        g_io_service.post([self, id, valid, stale] { self->answer(id, valid, stale); });
+    });
+}
+
+void MockSession::answer(Json::Value const& _id, bool _valid, bool _stale) {
+    auto& stats = m_pool.m_stats;
+    if (!_valid) {
+        stats.invalid++;
+        reply(_id, false, "Low difficulty share", 23);
+        return;
+    }
+
+    if (m_pool.m_reject) {
+        m_pool.m_reject--;
+        stats.rejected++;
+        reply(_id, false, "Rejected by script", 20);
+        return;
+    }
+
+    bool stale = _stale;
+    if (m_pool.m_stale) {
+        m_pool.m_stale--;
+        stale = true;
+    }
+    if (stale) {
+        // EthereumStratum/2.0.0 tells stale shares apart with 2xx codes
+        stats.stale++;
+        reply(_id, false, "Stale share", m_flavour == Flavour::EthereumStratum2 ? 201 : 21);
+        return;
+    }
+
+    stats.accepted++;
+    reply(_id, true);
+}
+
+double MockSession::difficulty() const { return m_suggested ? m_suggested : m_pool.m_difficulty; }
+
+h256 MockSession::boundary() const { return h256(getTargetFromDiff(difficulty())); }
+
+void MockSession::notify(bool _force) {
+    if (m_closed || !m_authorized || m_pool.m_jobs.empty()) return;
+
+    MockPool::Job const& j = m_pool.m_jobs.front();
+    if (!_force && m_timedJob == j.id) return;
+
+    Json::Value jMsg;
+    Json::Value jPrm = Json::Value(Json::arrayValue);
+    string target = boundary().hex();
+
+    switch (m_flavour) {
+        case Flavour::Stratum:
+            jMsg["id"] = Json::Value::null;
+            jMsg["jsonrpc"] = "2.0";
+            jMsg["method"] = "mining.notify";
+            jPrm.append(j.id);
+            jPrm.append(j.header.hex(HexPrefix::Add));
+            jPrm.append(j.seed.hex(HexPrefix::Add));
+            jPrm.append("0x" + target);
+            jPrm.append(true);
+            jMsg["params"] = jPrm;
+            send(jMsg);
+            break;
+
+        case Flavour::EthProxy:
+            jMsg["id"] = 0;
+            jMsg["jsonrpc"] = "2.0";
+            jPrm.append(j.header.hex(HexPrefix::Add));
+            jPrm.append(j.seed.hex(HexPrefix::Add));
+            jPrm.append("0x" + target);
+            jPrm.append(toCompactHex(j.block, HexPrefix::Add));
+            jMsg["result"] = jPrm;
+            send(jMsg);
+            break;
+
+        case Flavour::EthereumStratum:
+            jMsg["id"] = Json::Value::null;
+            if (m_sentDifficulty != difficulty()) {
+                m_sentDifficulty = difficulty();
+                jMsg["method"] = "mining.set_difficulty";
+                jPrm.append(m_sentDifficulty);
+                jMsg["params"] = jPrm;
+                send(jMsg);
+                jPrm = Json::Value(Json::arrayValue);
+            }
+            jMsg["method"] = "mining.notify";
+            jPrm.append(j.id);
+            jPrm.append(j.seed.hex());
+            jPrm.append(j.header.hex());
+            jPrm.append(true);
+            jMsg["params"] = jPrm;
+            send(jMsg);
+            break;
+
+        case Flavour::EthereumStratum2:
+            if (m_sentDifficulty != difficulty() || m_sentEpoch != j.epoch) {
+                m_sentDifficulty = difficulty();
+                m_sentEpoch = j.epoch;
+                jMsg["method"] = "mining.set";
+                jMsg["params"]["epoch"] = toCompactHex(j.epoch, HexPrefix::DontAdd);
+                jMsg["params"]["target"] = target;
+                jMsg["params"]["algo"] = "ethash";
+                jMsg["params"]["extranonce"] = m_extraNonce;
+                send(jMsg);
+                jMsg = Json::Value();
+            }
+            jMsg["method"] = "mining.notify";
+            jPrm.append(j.id);
+            jPrm.append(toCompactHex(j.block, HexPrefix::DontAdd));
+            jPrm.append(j.header.hex());
+            jPrm.append("0");
+            jMsg["params"] = jPrm;
+            send(jMsg);
+            break;
+
+        default: return;
+    }
+
+    m_timedJob = j.id;
+    m_timedJobSent = chrono::steady_clock::now();
+}
+
+void MockSession::setExtraNonce(string const& _extraNonce) {
+    if (m_flavour != Flavour::EthereumStratum && m_flavour != Flavour::EthereumStratum2) return;
+    m_extraNonce = _extraNonce;
+
+    Json::Value jMsg;
+    if (m_flavour == Flavour::EthereumStratum) {
+        jMsg["id"] = Json::Value::null;
+        jMsg["method"] = "mining.set_extranonce";
+        jMsg["params"] = Json::Value(Json::arrayValue);
+        jMsg["params"].append(m_extraNonce);
+    } else {
+        jMsg["method"] = "mining.set";
+        jMsg["params"]["extranonce"] = m_extraNonce;
+    }
+    send(jMsg);
+
+    // Current job again so the miner restarts on its new nonce space
+    notify(true);
+}
+
+void MockSession::bye() {
+    if (m_flavour != Flavour::EthereumStratum2) {
+        close();
+        return;
+    }
+    Json::Value jMsg;
+    jMsg["method"] = "mining.bye";
+    jMsg["params"] = Json::Value(Json::arrayValue);
+    jMsg["params"].append("mockpool");
+    send(jMsg);
+}
+
+void MockSession::reply(Json::Value const& _id, Json::Value const& _result, string const& _error, int _code) {
+    Json::Value jRes;
+    jRes["id"] = _id;
+    if (m_flavour == Flavour::Stratum || m_flavour == Flavour::EthProxy) jRes["jsonrpc"] = "2.0";
+    jRes["result"] = _result;
+    if (_error.empty()) {
+        jRes["error"] = Json::Value::null;
+    } else if (m_flavour == Flavour::EthereumStratum) {
+        jRes["error"] = Json::Value(Json::arrayValue);
+        jRes["error"].append(_code);
+        jRes["error"].append(_error);
+        jRes["error"].append(Json::Value::null);
+    } else {
+        jRes["error"]["code"] = (m_flavour == Flavour::EthereumStratum2 ? Json::Value(to_string(_code)) : Json::Value(_code));
+        jRes["error"]["message"] = _error;
+    }
+    send(jRes);
+}
+
+void MockSession::send(Json::Value const& _jMsg) {
+    if (m_closed) return;
+
+    string line = m_txQueue.acquire();
+    line.append(Json::writeString(m_jSwBuilder, _jMsg));
+    line.push_back('\n');
+
+    if (m_pool.m_latency || !m_delayed.empty()) {
+        // Held back lines keep their order even if latency decreases
+        auto due = chrono::steady_clock::now() + chrono::milliseconds(m_pool.m_latency);
+        if (!m_delayed.empty()) due = max(due, m_delayed.back().first);
+        m_delayed.emplace_back(due, std::move(line));
+        if (m_delayed.size() == 1) holdBack();
+        return;
+    }
+
+    if (!m_txQueue.push(std::move(line), false)) {
+        cwarn << "Session " << m_id << " : miner does not read. Dropping it";
+        close();
+        return;
+    }
+    flush();
+}
+
+void MockSession::holdBack() {
+    auto wait = chrono::duration_cast<chrono::milliseconds>(m_delayed.front().first - chrono::steady_clock::now()).count();
+    m_delayTimer.expires_from_now(boost::posix_time::milliseconds(max<int64_t>(wait, 0)));
+    m_delayTimer.async_wait([self = shared_from_this()](boost::system::error_code const& ec) {
+        if (ec || self->m_closed) return;
+        auto now = chrono::steady_clock::now();
+        while (!self->m_delayed.empty() && self->m_delayed.front().first <= now) {
+            if (!self->m_txQueue.push(std::move(self->m_delayed.front().second), false)) {
+                cwarn << "Session " << self->m_id << " : miner does not read. Dropping it";
+                self->close();
+                return;
+            }
+            self->m_delayed.pop_front();
+        }
+        self->flush();
+        if (!self->m_delayed.empty()) self->holdBack();
+    });
+}
+
+void MockSession::flush() {
+    if (m_txPending || m_closed || m_txQueue.empty()) return;
+    m_txPending = true;
+
+    auto self = shared_from_this();
+    boost::asio::async_write(m_socket, m_txQueue.flight(), [self](boost::system::error_code const& ec, size_t) {
+        self->m_txQueue.landed();
+        self->m_txPending = false;
+        if (ec) {
+            self->close();
+            return;
+        }
+        self->flush();
+    });
+}
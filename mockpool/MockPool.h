@@ -0,0 +1,205 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <json/json.h>
+
+#include <libdev/FixedHash.h>
+#include <libpool/stratum/StratumParser.h>
+#include <libpool/stratum/StratumSender.h>
+
+namespace dev::eth {
+
+// Timed action of a mock pool script
+struct MockEvent {
+    enum class Type { Job, Epoch, Difficulty, ExtraNonce, Latency, Reject, Stale, Disconnect, Bye, Pause, Resume };
+
+    std::chrono::milliseconds at;   // Since script start
+    Type type;
+    double value = 0;   // Difficulty, milliseconds or count
+};
+
+struct MockPoolSettings {
+    std::string address = "127.0.0.1";   // Address to listen on
+    unsigned short port = 4444;          // Port to listen on
+    int flavour = -1;                    // Only stratum mode served (-1 serves whatever miner asks for)
+    unsigned jobInterval = 5000;         // Milliseconds between jobs (0 only sends jobs on script events)
+    unsigned jobJitter = 0;              // Random +/- milliseconds added to each interval
+    double difficulty = 1.0;             // Share difficulty
+    unsigned block = 0;                  // Block number of first job
+    unsigned latency = 0;                // Milliseconds every message to miners is held back
+    unsigned extraNonceSize = 2;         // Bytes of extranonce for EthereumStratum flavours
+    bool verify = false;                 // Whether shares are verified (costs a light cache per epoch)
+    std::vector<MockEvent> script;       // Scripted events, sorted by time
+    unsigned scriptLoop = 0;             // Milliseconds after which script restarts (0 runs once)
+};
+
+class MockPool;
+
+// One miner connected to the mock pool
+class MockSession : public std::enable_shared_from_this<MockSession> {
+public:
+    enum class Flavour { Unknown = -1, Stratum = 0, EthProxy = 1, EthereumStratum = 2, EthereumStratum2 = 3 };
+
+    MockSession(MockPool& _pool, unsigned _id);
+
+    void start();
+    void close();
+    void notify(bool _force = false);
+    void setExtraNonce(std::string const& _extraNonce);
+    void bye();
+
+    boost::asio::ip::tcp::socket& socket() { return m_socket; }
+    unsigned id() const { return m_id; }
+    bool authorized() const { return m_authorized; }
+    Flavour flavour() const { return m_flavour; }
+
+private:
+    void recv();
+    void processRequest(Json::Value& _jReq);
+    void submit(Json::Value const& _id, std::string const& _job, h256 const& _header, std::string _nonce);
+    void answer(Json::Value const& _id, bool _valid, bool _stale);
+    void reply(Json::Value const& _id, Json::Value const& _result, std::string const& _error = "", int _code = 20);
+    void send(Json::Value const& _jMsg);
+    void holdBack();
+    void flush();
+    double difficulty() const;
+    h256 boundary() const;
+
+    MockPool& m_pool;
+    unsigned m_id;
+    std::string m_address;
+    Flavour m_flavour = Flavour::Unknown;
+    bool m_authorized = false;
+    bool m_closed = false;
+    std::string m_extraNonce;
+    std::string m_sessionId;
+    double m_sentDifficulty = 0;
+    double m_suggested = 0;   // Difficulty asked by miner (0 takes pool difficulty)
+    unsigned m_sentEpoch = unsigned(-1);
+
+    boost::asio::ip::tcp::socket m_socket;
+    LineFramer m_framer;
+    std::unique_ptr<Json::CharReader> m_jsonReader;
+    Json::StreamWriterBuilder m_jSwBuilder;
+    StratumSendQueue m_txQueue;
+    bool m_txPending = false;
+
+    // Messages held back to simulate latency (due time, line)
+    boost::asio::deadline_timer m_delayTimer;
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> m_delayed;
+
+    // Job sent to this session awaiting its first share
+    std::string m_timedJob;
+    std::chrono::steady_clock::time_point m_timedJobSent;
+};
+
+// Standalone pool speaking Stratum, Eth-Proxy, EthereumStratum/1.0.0 and
+// EthereumStratum/2.0.0 to drive EthStratumClient and PoolManager in
+// network benchmarks. Jobs, difficulty, extranonce changes, rejections,
+// disconnections and latency follow the settings and script.
+// Everything runs on a single io_service thread but share verification.
+class MockPool {
+public:
+    static const unsigned s_maxJobs = 8;   // Jobs a share is still accepted (as stale) for
+
+    explicit MockPool(MockPoolSettings const& _settings);
+    ~MockPool();
+
+    bool start();
+    void stop();
+    void report();
+
+private:
+    friend class MockSession;
+
+    struct Job {
+        std::string id;
+        h256 header;
+        h256 seed;
+        unsigned block;
+        unsigned epoch;
+    };
+
+    void accept();
+    void scheduleJob();
+    void scheduleScript();
+    void runEvent(MockEvent const& _event);
+    void newJob(bool _newEpoch);
+    void release(unsigned _id);
+    void authorized();
+    Job const* findJob(std::string const& _id) const;
+    Job const* findHeader(h256 const& _header) const;
+    std::string newExtraNonce();
+    h256 boundary() const;
+    static char const* flavourName(MockSession::Flavour _flavour);
+
+    MockPoolSettings m_settings;
+    std::mt19937 m_random{std::random_device{}()};
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    boost::asio::deadline_timer m_jobTimer;
+    boost::asio::deadline_timer m_scriptTimer;
+    bool m_running = false;
+
+    std::map<unsigned, std::shared_ptr<MockSession>> m_sessions;
+    unsigned m_sessionSeq = 0;
+    std::map<std::string, std::string> m_resumable;   // EthereumStratum/2.0.0 session id to extranonce
+
+    std::deque<Job> m_jobs;   // Newest first
+    unsigned m_jobSeq = 0;
+    unsigned m_block;
+    double m_difficulty;
+    unsigned m_latency;
+    bool m_paused = false;
+    unsigned m_reject = 0;   // Next shares to reject
+    unsigned m_stale = 0;    // Next shares to answer as stale
+
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point m_scriptStart;
+    size_t m_scriptNext = 0;
+
+    // Results
+    struct Stats {
+        unsigned sessions = 0;
+        unsigned flavours[4] = {0, 0, 0, 0};
+        unsigned jobs = 0;
+        unsigned submitted = 0;
+        unsigned accepted = 0;
+        unsigned stale = 0;
+        unsigned rejected = 0;
+        unsigned invalid = 0;
+        unsigned duplicates = 0;
+        unsigned forced = 0;                 // Disconnections ordered by script
+        std::vector<uint32_t> reconnects;    // Milliseconds from forced disconnection to next authorized session
+        std::vector<uint32_t> firstShares;   // Milliseconds from job sent to first share on it
+    } m_stats;
+    std::chrono::steady_clock::time_point m_lastForced;
+    bool m_awaitingReconnect = false;
+    std::map<std::string, std::vector<uint64_t>> m_nonces;   // Nonces submitted per job, to spot duplicates
+
+    // Shares are verified on a thread of their own : building the light
+    // cache of a new epoch takes seconds sessions can't wait for
+    boost::asio::io_service m_verifyService;
+    std::unique_ptr<boost::asio::io_service::work> m_verifyWork;
+    std::thread m_verifier;
+};
+
+}   // namespace dev::eth
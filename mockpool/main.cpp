@@ -0,0 +1,160 @@
+/* Copyright (C) 1883 Thomas Edison - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the GPLv3 license, which unfortunately won't be
+ * written for another century.
+ *
+ * You should have received a copy of the LICENSE file with
+ * this file.
+ */
+
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <boost/program_options.hpp>
+
+#include <libdev/Log.h>
+
+#include "MockPool.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+using namespace boost::program_options;
+
+boost::asio::io_service g_io_service;   // The IO service itself
+
+// Script lines are "<seconds> <event> [value]", # starts a comment
+static vector<MockEvent> ParseScript(string const& _file) {
+    static const map<string, pair<MockEvent::Type, bool>> events = {{"job", {MockEvent::Type::Job, false}},
+        {"epoch", {MockEvent::Type::Epoch, false}}, {"difficulty", {MockEvent::Type::Difficulty, true}}, {"extranonce", {MockEvent::Type::ExtraNonce, false}},
+        {"latency", {MockEvent::Type::Latency, true}}, {"reject", {MockEvent::Type::Reject, true}}, {"stale", {MockEvent::Type::Stale, true}},
+        {"disconnect", {MockEvent::Type::Disconnect, false}}, {"bye", {MockEvent::Type::Bye, false}}, {"pause", {MockEvent::Type::Pause, false}},
+        {"resume", {MockEvent::Type::Resume, false}}};
+
+    ifstream in(_file);
+    if (!in) throw runtime_error("Could not open script " + _file);
+
+    vector<MockEvent> script;
+    string line;
+    for (unsigned n = 1; getline(in, line); n++) {
+        line = line.substr(0, line.find('#'));
+        istringstream ss(line);
+        double at;
+        string name;
+        if (!(ss >> at)) {
+            if (line.find_first_not_of(" \t\r") == string::npos) continue;
+            throw runtime_error("Script line " + to_string(n) + " : missing time");
+        }
+        if (!(ss >> name) || !events.count(name)) throw runtime_error("Script line " + to_string(n) + " : unknown event");
+
+        MockEvent e;
+        e.at = chrono::milliseconds(int64_t(at * 1000));
+        e.type = events.at(name).first;
+        if (events.at(name).second && (!(ss >> e.value) || e.value < 0)) throw runtime_error("Script line " + to_string(n) + " : " + name + " needs a value");
+        script.push_back(e);
+    }
+    stable_sort(script.begin(), script.end(), [](MockEvent const& a, MockEvent const& b) { return a.at < b.at; });
+    return script;
+}
+
+int main(int argc, char** argv) {
+    dev::setThreadName("main");
+
+    MockPoolSettings settings;
+    options_description options("Mock pool options");
+    // clang-format off
+    options.add_options()
+        ("help,h", "Show this help")
+
+        ("address", value<string>()->default_value(settings.address),
+            "Address to listen on.")
+
+        ("port,P", value<unsigned short>()->default_value(settings.port),
+            "Port to listen on.")
+
+        ("flavour", value<string>()->default_value("auto"),
+            "Stratum flavour served : stratum, ethproxy, es1, es2 or auto "
+            "(whatever the miner negotiates).")
+
+        ("job-interval", value<unsigned>()->default_value(settings.jobInterval),
+            "Milliseconds between jobs. 0 only sends jobs on script events.")
+
+        ("jitter", value<unsigned>()->default_value(settings.jobJitter),
+            "Random milliseconds added to or subtracted from each job interval.")
+
+        ("difficulty", value<double>()->default_value(settings.difficulty),
+            "Share difficulty.")
+
+        ("block", value<unsigned>()->default_value(settings.block),
+            "Block number of first job.")
+
+        ("latency", value<unsigned>()->default_value(settings.latency),
+            "Milliseconds every message to miners is held back.")
+
+        ("extranonce-size", value<unsigned>()->default_value(settings.extraNonceSize),
+            "Bytes of extranonce given to EthereumStratum miners.")
+
+        ("verify",
+            "Verify shares against the boundary.")
+
+        ("script", value<string>(),
+            "File of timed events, one \"<seconds> <event> [value]\" per line. "
+            "Events : job, epoch, difficulty <d>, extranonce, latency <ms>, "
+            "reject <n>, stale <n>, disconnect, bye, pause, resume.")
+
+        ("script-loop", value<double>()->default_value(0),
+            "Seconds after which the script starts over. 0 runs it once.");
+    // clang-format on
+
+    try {
+        variables_map vm;
+        store(parse_command_line(argc, argv, options), vm);
+        notify(vm);
+
+        if (vm.count("help")) {
+            cout << options << endl;
+            return 0;
+        }
+
+        static const map<string, int> flavours = {{"auto", -1}, {"stratum", 0}, {"ethproxy", 1}, {"es1", 2}, {"es2", 3}};
+        auto flavour = flavours.find(vm["flavour"].as<string>());
+        if (flavour == flavours.end()) throw error("The --flavour value must be one of stratum, ethproxy, es1, es2 or auto");
+        if (vm["difficulty"].as<double>() <= 0) throw error("The --difficulty value must be greater than 0");
+        if (vm["extranonce-size"].as<unsigned>() > 6) throw error("The --extranonce-size value must be at most 6");
+
+        settings.address = vm["address"].as<string>();
+        settings.port = vm["port"].as<unsigned short>();
+        settings.flavour = flavour->second;
+        settings.jobInterval = vm["job-interval"].as<unsigned>();
+        settings.jobJitter = min(vm["jitter"].as<unsigned>(), settings.jobInterval);
+        settings.difficulty = vm["difficulty"].as<double>();
+        settings.block = vm["block"].as<unsigned>();
+        settings.latency = vm["latency"].as<unsigned>();
+        settings.extraNonceSize = vm["extranonce-size"].as<unsigned>();
+        settings.verify = vm.count("verify");
+        if (vm.count("script")) settings.script = ParseScript(vm["script"].as<string>());
+        settings.scriptLoop = unsigned(vm["script-loop"].as<double>() * 1000);
+        if (settings.scriptLoop && !settings.script.empty() && chrono::milliseconds(settings.scriptLoop) <= settings.script.back().at)
+            throw error("The --script-loop value must be past the last script event");
+    } catch (exception const& _ex) {
+        cerr << "Error: " << _ex.what() << "\n\n" << options << endl;
+        return 1;
+    }
+
+    MockPool pool(settings);
+    if (!pool.start()) return 1;
+
+    boost::asio::signal_set signals(g_io_service, SIGINT, SIGTERM);
+    signals.async_wait([&pool](boost::system::error_code const& ec, int) {
+        if (ec) return;
+        pool.stop();
+        pool.report();
+        g_io_service.stop();
+    });
+
+    g_io_service.run();
+    return 0;
+}